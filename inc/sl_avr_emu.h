@@ -21,4 +21,19 @@ extern bool sl_avr_emu_verbose_logging_enabled;
 
 #define SL_AVR_EMU_VERBOSE_LOG(log_command) { if(sl_avr_emu_verbose_logging_enabled) {log_command;} }
 
+/**
+ * @brief Initializes an emulation to its reset state
+ * 
+ * @param emulation 
+ * @return sl_avr_emu_result_e 
+ */
+sl_avr_emu_result_e sl_avr_emu_init(sl_avr_emu_emulation_s *emulation);
+
+/**
+ * @brief Releases an emulation's data memory.  Guard pages must be stopped first.
+ * 
+ * @param emulation 
+ */
+void sl_avr_emu_deinit(sl_avr_emu_emulation_s *emulation);
+
 #endif  //_SL_AVR_EMU_HPP_
\ No newline at end of file
@@ -0,0 +1,107 @@
+/**
+ * @file sl_avr_emu_adc.h
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator ADC Peripheral Header
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#ifndef _SL_AVR_EMU_ADC_H_
+#define _SL_AVR_EMU_ADC_H_
+
+#include <stdio.h>
+
+#include "sl_avr_emu.h"
+#include "sl_avr_emu_samples.h"
+
+/* ADC data addresses */
+#define SL_AVR_EMU_ADC_ADCL   0x78
+#define SL_AVR_EMU_ADC_ADCH   0x79
+#define SL_AVR_EMU_ADC_ADCSRA 0x7A
+#define SL_AVR_EMU_ADC_ADCSRB 0x7B
+#define SL_AVR_EMU_ADC_ADMUX  0x7C
+
+/* ADCSRA bits */
+#define SL_AVR_EMU_ADC_ADEN      0x7
+#define SL_AVR_EMU_ADC_ADSC      0x6
+#define SL_AVR_EMU_ADC_ADATE     0x5
+#define SL_AVR_EMU_ADC_ADIF      0x4
+#define SL_AVR_EMU_ADC_ADIE      0x3
+#define SL_AVR_EMU_ADC_ADPS_MASK 0x07
+/* ADCSRB auto trigger source, 0 is free running */
+#define SL_AVR_EMU_ADC_ADTS_MASK 0x07
+/* ADMUX bits */
+#define SL_AVR_EMU_ADC_ADLAR     0x5
+#define SL_AVR_EMU_ADC_MUX_MASK  0x0F
+
+/* ADC clocks of a conversion, and of the first conversion after enabling */
+#define SL_AVR_EMU_ADC_CONVERSION_CLOCKS       13
+#define SL_AVR_EMU_ADC_FIRST_CONVERSION_CLOCKS 25
+/* Half ADC clocks from the start of a conversion to sample and hold, and for the first conversion */
+#define SL_AVR_EMU_ADC_HOLD_HALF_CLOCKS        3
+#define SL_AVR_EMU_ADC_FIRST_HOLD_HALF_CLOCKS  27
+
+/**
+ * @brief How input is taken between sample file records
+ * 
+ */
+typedef enum
+{
+  /* Last record at or before the sample and hold */
+  SL_AVR_EMU_ADC_INTERPOLATION_HOLD,
+  /* Record closest to the sample and hold */
+  SL_AVR_EMU_ADC_INTERPOLATION_NEAREST,
+  /* Straight line between the records either side of the sample and hold */
+  SL_AVR_EMU_ADC_INTERPOLATION_LINEAR,
+
+} sl_avr_emu_adc_interpolation_e;
+
+/**
+ * @brief ADC fed from a sample file.  Each record holds one little-endian 16-bit input per channel, ADC0 first,
+ *        full scale being the reference.  Conversions complete through the event scheduler.
+ * 
+ */
+typedef struct sl_avr_emu_adc_struct
+{
+  sl_avr_emu_samples_s            samples;
+  uint32_t                        channels;
+  sl_avr_emu_adc_interpolation_e  interpolation;
+
+  uint64_t                        conversions;
+  /* Results lost to the ADCL lock */
+  uint64_t                        lost;
+
+} sl_avr_emu_adc_s;
+
+/**
+ * @brief Attaches the ADC to emulation, fed from a sample file
+ * 
+ * @param emulation
+ * @param path
+ * @param channels      - 16-bit inputs per record, ADC0 upwards.  Other channels read 0.
+ * @param sample_hz     - Records per second of emulated time
+ * @param interpolation
+ * @return sl_avr_emu_result_e - SL_AVR_EMU_RESULT_INVALID_FILE_PATH if the file could not be mapped
+ */
+sl_avr_emu_result_e sl_avr_emu_adc_start(sl_avr_emu_emulation_s *emulation, const char *path, uint32_t channels, uint32_t sample_hz,
+                                         sl_avr_emu_adc_interpolation_e interpolation);
+
+/**
+ * @brief Prints conversion counters
+ * 
+ * @param output
+ * @param emulation
+ */
+void sl_avr_emu_adc_report(FILE *output, const sl_avr_emu_emulation_s *emulation);
+
+/**
+ * @brief Unmaps the sample file and detaches the ADC
+ * 
+ * @param emulation
+ */
+void sl_avr_emu_adc_stop(sl_avr_emu_emulation_s *emulation);
+
+#endif //_SL_AVR_EMU_ADC_H_
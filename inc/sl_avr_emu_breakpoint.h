@@ -0,0 +1,131 @@
+/**
+ * @file sl_avr_emu_breakpoint.h
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator Breakpoint Header
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#ifndef _SL_AVR_EMU_BREAKPOINT_H_
+#define _SL_AVR_EMU_BREAKPOINT_H_
+
+#include "sl_avr_emu.h"
+
+/* Breakpoints per emulation */
+#define SL_AVR_EMU_BREAKPOINT_MAX 64
+/* BREAK instruction patched over breakpoint addresses */
+#define SL_AVR_EMU_BREAKPOINT_OPCODE 0x9598
+
+/**
+ * @brief Breakpoint, flash holds SL_AVR_EMU_BREAKPOINT_OPCODE at its PC while set
+ * 
+ */
+typedef struct
+{
+  sl_avr_emu_extended_address_t pc;
+  /* Instruction word replaced in flash */
+  sl_avr_emu_word_t             original;
+
+} sl_avr_emu_breakpoint_s;
+
+/**
+ * @brief Breakpoints of an emulation
+ * 
+ */
+typedef struct sl_avr_emu_breakpoints_struct
+{
+  sl_avr_emu_breakpoint_s       breakpoints[SL_AVR_EMU_BREAKPOINT_MAX];
+  uint32_t                      count;
+
+  /* Set when stopped at a breakpoint, the next dispatch at resume_pc executes the original instruction */
+  bool                          resuming;
+  sl_avr_emu_extended_address_t resume_pc;
+
+} sl_avr_emu_breakpoints_s;
+
+/**
+ * @brief Sets a breakpoint.  Emulation stops with SL_AVR_EMU_RESULT_BREAKPOINT before executing pc.
+ * 
+ * @param emulation
+ * @param pc        - Word address of an instruction
+ * @return sl_avr_emu_result_e
+ */
+sl_avr_emu_result_e sl_avr_emu_breakpoint_set(sl_avr_emu_emulation_s *emulation, sl_avr_emu_extended_address_t pc);
+
+/**
+ * @brief Clears a breakpoint.  Detaches breakpoints after the last is cleared.
+ * 
+ * @param emulation
+ * @param pc
+ * @return sl_avr_emu_result_e - SL_AVR_EMU_RESULT_FAILURE if no breakpoint is set at pc
+ */
+sl_avr_emu_result_e sl_avr_emu_breakpoint_clear(sl_avr_emu_emulation_s *emulation, sl_avr_emu_extended_address_t pc);
+
+/**
+ * @brief Clears all breakpoints
+ * 
+ * @param emulation
+ */
+void sl_avr_emu_breakpoint_clear_all(sl_avr_emu_emulation_s *emulation);
+
+/**
+ * @brief Finds the breakpoint at pc
+ * 
+ * @param emulation
+ * @param pc
+ * @return sl_avr_emu_breakpoint_s* - NULL if no breakpoint is set at pc
+ */
+sl_avr_emu_breakpoint_s *sl_avr_emu_breakpoint_find(const sl_avr_emu_emulation_s *emulation, sl_avr_emu_extended_address_t pc);
+
+/**
+ * @brief Stops at a breakpoint at PC unless resuming from it.  Called at an instruction boundary before the instruction's hooks,
+ *        a stop gives the tick back so breakpoints cost no emulated time.
+ * 
+ * @param emulation
+ * @return true if stopped
+ */
+bool sl_avr_emu_breakpoint_stop(sl_avr_emu_emulation_s *emulation);
+
+/**
+ * @brief Returns the firmware's instruction word at pc, looking through breakpoints
+ * 
+ * @param emulation
+ * @param pc
+ * @return sl_avr_emu_word_t
+ */
+static inline sl_avr_emu_word_t sl_avr_emu_breakpoint_word(const sl_avr_emu_emulation_s *emulation, sl_avr_emu_extended_address_t pc)
+{
+  const sl_avr_emu_breakpoint_s *breakpoint;
+
+  if(NULL != emulation->hooks.breakpoints && SL_AVR_EMU_BREAKPOINT_OPCODE == emulation->memory.flash[pc] &&
+     NULL != (breakpoint = sl_avr_emu_breakpoint_find(emulation, pc)))
+  {
+    return breakpoint->original;
+  }
+  return emulation->memory.flash[pc];
+}
+
+/**
+ * @brief Runs until a breakpoint or pc is reached, an error occurs or tick_limit is reached
+ * 
+ * @param emulation
+ * @param pc         - Word address to stop at
+ * @param tick_limit - Tick count at which to stop, run-until-cycle is sl_avr_emu_run itself
+ * @return sl_avr_emu_result_e - SL_AVR_EMU_RESULT_BREAKPOINT when stopped at pc or another breakpoint
+ */
+sl_avr_emu_result_e sl_avr_emu_run_until_pc(sl_avr_emu_emulation_s *emulation, sl_avr_emu_extended_address_t pc, sl_avr_emu_tick_count_t tick_limit);
+
+/**
+ * @brief Runs until a breakpoint or the named function is reached, an error occurs or tick_limit is reached
+ * 
+ * @param emulation
+ * @param symbol     - Function name, looked up in emulation's symbols
+ * @param tick_limit - Tick count at which to stop
+ * @return sl_avr_emu_result_e - SL_AVR_EMU_RESULT_FAILURE if symbol is unknown
+ */
+sl_avr_emu_result_e sl_avr_emu_run_until_symbol(sl_avr_emu_emulation_s *emulation, const char *symbol, sl_avr_emu_tick_count_t tick_limit);
+
+#endif //_SL_AVR_EMU_BREAKPOINT_H_
@@ -0,0 +1,142 @@
+/**
+ * @file sl_avr_emu_callgraph.h
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator Call-Graph Profiler Header
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#ifndef _SL_AVR_EMU_CALLGRAPH_H_
+#define _SL_AVR_EMU_CALLGRAPH_H_
+
+#include <stdio.h>
+
+#include "sl_avr_emu.h"
+
+/* Deepest shadow call stack tracked, deeper calls are charged to the deepest frame */
+#define SL_AVR_EMU_CALLGRAPH_DEPTH_MAX 256
+
+/* Node index of the synthetic root of every call path */
+#define SL_AVR_EMU_CALLGRAPH_ROOT 0
+
+/**
+ * @brief Call path node, one per distinct stack of functions
+ * 
+ */
+typedef struct
+{
+  /* Entry PC of the function */
+  sl_avr_emu_extended_address_t function;
+  /* True if the function was entered by an interrupt */
+  bool                          isr;
+
+  /* Caller node, first callee node and next node with the same caller */
+  uint32_t                      parent;
+  uint32_t                      child;
+  uint32_t                      sibling;
+
+  /* Number of entries */
+  uint64_t                      calls;
+  /* Cycles spent in the function itself */
+  uint64_t                      exclusive;
+  /* Cycles spent in the function and its callees, excluding interrupts */
+  uint64_t                      inclusive;
+
+} sl_avr_emu_callgraph_node_s;
+
+/**
+ * @brief Shadow call stack frame
+ * 
+ */
+typedef struct
+{
+  /* Call path node of the frame */
+  uint32_t                node;
+  /* Stack-Pointer after the return address was pushed */
+  sl_avr_emu_address_t    sp;
+  /* Tick the frame was entered */
+  sl_avr_emu_tick_count_t entry_tick;
+  /* Ticks spent in interrupts while the frame was active */
+  sl_avr_emu_tick_count_t isr_ticks;
+
+} sl_avr_emu_callgraph_frame_s;
+
+/**
+ * @brief Call-graph profile
+ * 
+ */
+typedef struct sl_avr_emu_callgraph_struct
+{
+  /* Call path tree, SL_AVR_EMU_CALLGRAPH_ROOT first */
+  sl_avr_emu_callgraph_node_s  *nodes;
+  uint32_t                      node_count;
+  uint32_t                      node_capacity;
+
+  /* Shadow call stack */
+  sl_avr_emu_callgraph_frame_s  frames[SL_AVR_EMU_CALLGRAPH_DEPTH_MAX];
+  uint32_t                      depth;
+
+  /* Tick up to which cycles have been charged */
+  sl_avr_emu_tick_count_t       last_tick;
+
+} sl_avr_emu_callgraph_s;
+
+/**
+ * @brief Attaches a new call-graph profile to emulation.  The function at PC becomes the bottom frame.
+ * 
+ * @param emulation
+ * @return sl_avr_emu_result_e
+ */
+sl_avr_emu_result_e sl_avr_emu_callgraph_start(sl_avr_emu_emulation_s *emulation);
+
+/**
+ * @brief Enters the function at PC.  Called by CALL/RCALL after the return address is pushed.
+ * 
+ * @param emulation
+ */
+void sl_avr_emu_callgraph_call(sl_avr_emu_emulation_s *emulation);
+
+/**
+ * @brief Enters the interrupt handler for the vector at PC.  Called after the return address is pushed.
+ * 
+ * @param emulation
+ */
+void sl_avr_emu_callgraph_interrupt(sl_avr_emu_emulation_s *emulation);
+
+/**
+ * @brief Leaves the frame whose return address is on top of the stack.  Called by RET/RETI before popping it.
+ * 
+ * @param emulation
+ */
+void sl_avr_emu_callgraph_return(sl_avr_emu_emulation_s *emulation);
+
+/**
+ * @brief Prints the top_n functions by inclusive cycles.  Open frames are closed at the current tick.
+ * 
+ * @param output
+ * @param emulation
+ * @param top_n
+ */
+void sl_avr_emu_callgraph_report(FILE *output, sl_avr_emu_emulation_s *emulation, uint32_t top_n);
+
+/**
+ * @brief Writes exclusive cycles per call path in collapsed-stack format ("main;loop;f 1234"),
+ *        as read by flame graph tools.  Interrupt handlers are rooted separately from the interrupted code.
+ *        Open frames are closed at the current tick.
+ * 
+ * @param output
+ * @param emulation
+ */
+void sl_avr_emu_callgraph_write_collapsed(FILE *output, sl_avr_emu_emulation_s *emulation);
+
+/**
+ * @brief Detaches and frees emulation's call-graph profile
+ * 
+ * @param emulation
+ */
+void sl_avr_emu_callgraph_stop(sl_avr_emu_emulation_s *emulation);
+
+#endif //_SL_AVR_EMU_CALLGRAPH_H_
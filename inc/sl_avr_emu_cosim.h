@@ -0,0 +1,168 @@
+/**
+ * @file sl_avr_emu_cosim.h
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator Multi-Board Co-Simulation Header
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#ifndef _SL_AVR_EMU_COSIM_H_
+#define _SL_AVR_EMU_COSIM_H_
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+
+#include "sl_avr_emu.h"
+
+/* Boards per co-simulation */
+#define SL_AVR_EMU_COSIM_BOARDS_MAX 8
+/* Links per co-simulation */
+#define SL_AVR_EMU_COSIM_LINKS_MAX 32
+/* Messages in flight on one link, a power of 2 */
+#define SL_AVR_EMU_COSIM_QUEUE_SIZE (1 << 12)
+/* Quantum used when none is given, in ticks */
+#define SL_AVR_EMU_COSIM_QUANTUM_DEFAULT 1000
+/* Longest quantum.  At most three quanta of bytes are in flight, and the fastest USART frame is 80 ticks,
+   so links cannot fill. */
+#define SL_AVR_EMU_COSIM_QUANTUM_MAX ((SL_AVR_EMU_COSIM_QUEUE_SIZE / 3) * 80)
+
+/**
+ * @brief Byte in flight between boards
+ * 
+ */
+typedef struct
+{
+  /* Tick the byte arrives at the receiving board */
+  sl_avr_emu_tick_count_t tick;
+  sl_avr_emu_byte_t       byte;
+
+} sl_avr_emu_cosim_message_s;
+
+/**
+ * @brief One-way serial connection, from a transmitting port on one board to a receiving port on another.
+ *        Single-producer single-consumer, the sending board's thread pushes and the receiving board's thread pops.
+ * 
+ */
+typedef struct
+{
+  struct sl_avr_emu_cosim_struct *cosim;
+  uint32_t                        from;
+  sl_avr_emu_address_t            from_port;
+  uint32_t                        to;
+  sl_avr_emu_address_t            to_port;
+
+  /* Free running counts of messages pushed and popped, only advanced by the sending and receiving board respectively */
+  atomic_uint_fast32_t            head;
+  atomic_uint_fast32_t            tail;
+  sl_avr_emu_cosim_message_s      queue[SL_AVR_EMU_COSIM_QUEUE_SIZE];
+
+  /* Delivery event of the oldest message is scheduled on the receiving board */
+  bool                            scheduled;
+  uint64_t                        messages;
+  /* Messages that arrived after the receiving board stopped */
+  uint64_t                        discarded;
+
+} sl_avr_emu_cosim_link_s;
+
+/**
+ * @brief Board in a co-simulation
+ * 
+ */
+typedef struct
+{
+  sl_avr_emu_emulation_s         *emulation;
+  /* First unsuccessful result, the board stops running after it */
+  sl_avr_emu_result_e             result;
+  /* End of the quantum being run */
+  sl_avr_emu_tick_count_t         until;
+  /* Board is still running after the quantum, double buffered by quantum parity so a single barrier suffices */
+  bool                            running[2];
+  /* Links the board receives on, in link order */
+  uint32_t                        input_count;
+  sl_avr_emu_cosim_link_s        *inputs[SL_AVR_EMU_COSIM_LINKS_MAX];
+  struct sl_avr_emu_cosim_struct *cosim;
+
+} sl_avr_emu_cosim_board_s;
+
+/**
+ * @brief Boards run in parallel by conservative parallel discrete event simulation.
+ *        All boards run one quantum, then wait for each other.  Bytes arrive one quantum after they are sent,
+ *        so a board never receives a byte inside the quantum it is running and results do not depend on threads.
+ * 
+ */
+typedef struct sl_avr_emu_cosim_struct
+{
+  sl_avr_emu_cosim_board_s boards[SL_AVR_EMU_COSIM_BOARDS_MAX];
+  uint32_t                 board_count;
+  sl_avr_emu_cosim_link_s *links[SL_AVR_EMU_COSIM_LINKS_MAX];
+  uint32_t                 link_count;
+
+  /* Ticks between synchronizations, and the link latency */
+  sl_avr_emu_tick_count_t  quantum;
+  sl_avr_emu_tick_count_t  tick_limit;
+  uint32_t                 thread_count;
+  /* Held while threads start */
+  pthread_mutex_t          gate;
+  pthread_barrier_t        barrier;
+  /* Quanta run by the last sl_avr_emu_cosim_run */
+  uint64_t                 quanta;
+
+} sl_avr_emu_cosim_s;
+
+/**
+ * @brief Initializes an empty co-simulation
+ * 
+ * @param cosim
+ * @param quantum - Ticks between synchronizations, and latency of every link.  Limited to SL_AVR_EMU_COSIM_QUANTUM_MAX.
+ */
+void sl_avr_emu_cosim_init(sl_avr_emu_cosim_s *cosim, sl_avr_emu_tick_count_t quantum);
+
+/**
+ * @brief Adds an initialized emulation with firmware loaded as a board.  Boards start together, at tick 0.
+ * 
+ * @param cosim
+ * @param emulation
+ * @return sl_avr_emu_result_e - SL_AVR_EMU_RESULT_FAILURE if SL_AVR_EMU_COSIM_BOARDS_MAX boards were added already
+ */
+sl_avr_emu_result_e sl_avr_emu_cosim_add_board(sl_avr_emu_cosim_s *cosim, sl_avr_emu_emulation_s *emulation);
+
+/**
+ * @brief Connects USART0 transmit of one board to USART0 receive of another, attaching USART0 to either as needed
+ * 
+ * @param cosim
+ * @param from    - Board index
+ * @param to      - Board index
+ * @return sl_avr_emu_result_e
+ */
+sl_avr_emu_result_e sl_avr_emu_cosim_connect_uart(sl_avr_emu_cosim_s *cosim, uint32_t from, uint32_t to);
+
+/**
+ * @brief Runs all boards until tick_limit or until every board has stopped
+ * 
+ * @param cosim
+ * @param tick_limit
+ * @param thread_count - Threads to run boards on, boards are assigned round robin
+ * @return sl_avr_emu_result_e - First unsuccessful board result, SL_AVR_EMU_RESULT_SUCCESS if all boards reached tick_limit
+ */
+sl_avr_emu_result_e sl_avr_emu_cosim_run(sl_avr_emu_cosim_s *cosim, sl_avr_emu_tick_count_t tick_limit, uint32_t thread_count);
+
+/**
+ * @brief Prints the state of each board and the traffic on each link
+ * 
+ * @param output
+ * @param cosim
+ */
+void sl_avr_emu_cosim_report(FILE *output, const sl_avr_emu_cosim_s *cosim);
+
+/**
+ * @brief Frees links and detaches the co-simulation from its boards.  Boards remain owned by the caller.
+ * 
+ * @param cosim
+ */
+void sl_avr_emu_cosim_deinit(sl_avr_emu_cosim_s *cosim);
+
+#endif //_SL_AVR_EMU_COSIM_H_
@@ -0,0 +1,86 @@
+/**
+ * @file sl_avr_emu_coverage.h
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator Code Coverage Header
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#ifndef _SL_AVR_EMU_COVERAGE_H_
+#define _SL_AVR_EMU_COVERAGE_H_
+
+#include <stdio.h>
+
+#include "sl_avr_emu.h"
+
+/* Flash words covered by one bitmap word */
+#define SL_AVR_EMU_COVERAGE_WORD_BITS 64
+
+/**
+ * @brief Executed flash word bitmap
+ * 
+ */
+typedef struct sl_avr_emu_coverage_struct
+{
+  /* Bit n of word w is set once flash word w*64+n has executed */
+  uint64_t bits[(SL_AVR_EMU_FLASH_SIZE + SL_AVR_EMU_COVERAGE_WORD_BITS - 1)/SL_AVR_EMU_COVERAGE_WORD_BITS];
+
+} sl_avr_emu_coverage_s;
+
+/**
+ * @brief Attaches a new, empty coverage bitmap to emulation
+ * 
+ * @param emulation
+ * @return sl_avr_emu_result_e
+ */
+sl_avr_emu_result_e sl_avr_emu_coverage_start(sl_avr_emu_emulation_s *emulation);
+
+/**
+ * @brief Marks the instruction about to execute at PC.  Called on each instruction when coverage is attached.
+ *        Inline so the cost is a single OR.
+ * 
+ * @param emulation
+ */
+static inline void sl_avr_emu_coverage_trace(sl_avr_emu_emulation_s *emulation)
+{
+  emulation->hooks.coverage->bits[emulation->memory.pc / SL_AVR_EMU_COVERAGE_WORD_BITS] |= 1ULL << (emulation->memory.pc % SL_AVR_EMU_COVERAGE_WORD_BITS);
+}
+
+/**
+ * @brief Clears the coverage bitmap, e.g. between test cases
+ * 
+ * @param emulation
+ */
+void sl_avr_emu_coverage_reset(sl_avr_emu_emulation_s *emulation);
+
+/**
+ * @brief Checks if the flash word at pc has executed
+ * 
+ * @param coverage
+ * @param pc
+ * @return true
+ * @return false
+ */
+bool sl_avr_emu_coverage_hit(const sl_avr_emu_coverage_s *coverage, sl_avr_emu_extended_address_t pc);
+
+/**
+ * @brief Writes coverage as an lcov tracefile when the firmware's ELF has DWARF line info,
+ *        otherwise as executed flash address ranges
+ * 
+ * @param output
+ * @param emulation
+ * @return sl_avr_emu_result_e
+ */
+sl_avr_emu_result_e sl_avr_emu_coverage_write(FILE *output, const sl_avr_emu_emulation_s *emulation);
+
+/**
+ * @brief Detaches and frees emulation's coverage bitmap
+ * 
+ * @param emulation
+ */
+void sl_avr_emu_coverage_stop(sl_avr_emu_emulation_s *emulation);
+
+#endif //_SL_AVR_EMU_COVERAGE_H_
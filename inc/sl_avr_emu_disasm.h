@@ -0,0 +1,36 @@
+/**
+ * @file sl_avr_emu_disasm.h
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator Disassembler Header
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#ifndef _SL_AVR_EMU_DISASM_H_
+#define _SL_AVR_EMU_DISASM_H_
+
+#include <stddef.h>
+
+#include "sl_avr_emu_types.h"
+
+/**
+ * @brief Buffer size sufficient for any disassembled instruction
+ * 
+ */
+#define SL_AVR_EMU_DISASM_BUFFER_SIZE 48
+
+/**
+ * @brief Disassembles the instruction at pc
+ * 
+ * @param flash 
+ * @param pc 
+ * @param buffer - At least SL_AVR_EMU_DISASM_BUFFER_SIZE characters
+ * @param size 
+ * @return uint32_t - Instruction length in words
+ */
+uint32_t sl_avr_emu_disassemble(const sl_avr_emu_word_t *flash, sl_avr_emu_extended_address_t pc, char *buffer, size_t size);
+
+#endif //_SL_AVR_EMU_DISASM_H_
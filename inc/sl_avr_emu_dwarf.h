@@ -0,0 +1,65 @@
+/**
+ * @file sl_avr_emu_dwarf.h
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator DWARF Line Table Header
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#ifndef _SL_AVR_EMU_DWARF_H_
+#define _SL_AVR_EMU_DWARF_H_
+
+#include "sl_avr_emu_elf.h"
+
+/**
+ * @brief Line table row, the row's line covers addresses up to the next row's address
+ * 
+ */
+typedef struct
+{
+  /* Flash byte address */
+  uint32_t address;
+  /* Index into sl_avr_emu_lines_s files */
+  uint32_t file;
+  uint32_t line;
+  /* Row ends a sequence, its line is not used */
+  bool     end_sequence;
+
+} sl_avr_emu_line_s;
+
+/**
+ * @brief Source line table
+ * 
+ */
+typedef struct
+{
+  /* Rows in program order, grouped by sequence */
+  sl_avr_emu_line_s *lines;
+  uint32_t           count;
+
+  /* Unique source file paths */
+  char             **files;
+  uint32_t           file_count;
+
+} sl_avr_emu_lines_s;
+
+/**
+ * @brief Decodes the .debug_line section of the ELF file behind symbols
+ * 
+ * @param symbols - Symbol index loaded from an ELF file
+ * @param lines   - Filled with the line table, free with sl_avr_emu_lines_free
+ * @return sl_avr_emu_result_e - SL_AVR_EMU_RESULT_FAILURE if there is no usable line table
+ */
+sl_avr_emu_result_e sl_avr_emu_dwarf_load_lines(const sl_avr_emu_symbols_s *symbols, sl_avr_emu_lines_s *lines);
+
+/**
+ * @brief Frees a line table
+ * 
+ * @param lines
+ */
+void sl_avr_emu_lines_free(sl_avr_emu_lines_s *lines);
+
+#endif //_SL_AVR_EMU_DWARF_H_
@@ -0,0 +1,103 @@
+/**
+ * @file sl_avr_emu_elf.h
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator ELF Loading Header
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#ifndef _SL_AVR_EMU_ELF_H_
+#define _SL_AVR_EMU_ELF_H_
+
+#include <stddef.h>
+
+#include "sl_avr_emu.h"
+
+/**
+ * @brief avr-gcc places data space symbols at this offset to separate them from flash
+ * 
+ */
+#define SL_AVR_EMU_ELF_DATA_OFFSET 0x800000
+
+/**
+ * @brief Firmware symbol
+ * 
+ */
+typedef struct
+{
+  /* Flash byte address, or SL_AVR_EMU_ELF_DATA_OFFSET + data address */
+  uint32_t    address;
+  /* Size in bytes, 0 if unknown */
+  uint32_t    size;
+  /* Name, points into the mapped ELF file */
+  const char *name;
+  /* True for functions */
+  bool        function;
+
+} sl_avr_emu_symbol_s;
+
+/**
+ * @brief Address sorted symbol index
+ * 
+ */
+typedef struct sl_avr_emu_symbols_struct
+{
+  sl_avr_emu_symbol_s *symbols;
+  uint32_t             count;
+
+  /* ELF file mapping, symbol names point into it */
+  void                *map;
+  size_t               map_size;
+
+} sl_avr_emu_symbols_s;
+
+/**
+ * @brief Loads an AVR ELF file's loadable segments into emulation's flash and sets PC to its entry point
+ * 
+ * @param emulation 
+ * @param file_path 
+ * @param symbols   - Optional, filled with the file's symbol table and attached to emulation's hooks
+ * @return sl_avr_emu_result_e 
+ */
+sl_avr_emu_result_e sl_avr_emu_load_elf(sl_avr_emu_emulation_s *emulation, char * file_path, sl_avr_emu_symbols_s *symbols);
+
+/**
+ * @brief Finds the symbol containing address
+ * 
+ * @param symbols 
+ * @param address - Flash byte address, or SL_AVR_EMU_ELF_DATA_OFFSET + data address
+ * @param offset  - Optional, set to address' offset from the symbol
+ * @return const sl_avr_emu_symbol_s* - NULL if no symbol contains address
+ */
+const sl_avr_emu_symbol_s *sl_avr_emu_symbol_lookup(const sl_avr_emu_symbols_s *symbols, uint32_t address, uint32_t *offset);
+
+/**
+ * @brief Finds a symbol by name
+ * 
+ * @param symbols 
+ * @param name    
+ * @return const sl_avr_emu_symbol_s* - NULL if no symbol has name
+ */
+const sl_avr_emu_symbol_s *sl_avr_emu_symbol_find(const sl_avr_emu_symbols_s *symbols, const char *name);
+
+/**
+ * @brief Finds the function containing a PC
+ * 
+ * @param symbols 
+ * @param pc      - Word address
+ * @param offset  - Optional, set to the byte offset from the function
+ * @return const char* - Function name, NULL if unknown
+ */
+const char *sl_avr_emu_symbol_name_pc(const sl_avr_emu_symbols_s *symbols, sl_avr_emu_extended_address_t pc, uint32_t *offset);
+
+/**
+ * @brief Frees a symbol index and unmaps its ELF file
+ * 
+ * @param symbols 
+ */
+void sl_avr_emu_symbols_free(sl_avr_emu_symbols_s *symbols);
+
+#endif //_SL_AVR_EMU_ELF_H_
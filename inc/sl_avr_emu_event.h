@@ -0,0 +1,54 @@
+/**
+ * @file sl_avr_emu_event.h
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator Event Scheduler Header
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#ifndef _SL_AVR_EMU_EVENT_H_
+#define _SL_AVR_EMU_EVENT_H_
+
+#include "sl_avr_emu_types.h"
+
+/**
+ * @brief Initializes an empty event queue
+ * 
+ * @param emulation 
+ */
+void sl_avr_emu_event_init(sl_avr_emu_emulation_s *emulation);
+
+/**
+ * @brief Schedules callback to run at the start of the given tick.  
+ *        Events for the same tick run in scheduling order.
+ * 
+ * @param emulation 
+ * @param tick     - Tick at which to fire, ticks already passed fire on the next tick
+ * @param callback 
+ * @param context 
+ * @return sl_avr_emu_result_e 
+ */
+sl_avr_emu_result_e sl_avr_emu_event_schedule(sl_avr_emu_emulation_s *emulation, sl_avr_emu_tick_count_t tick, sl_avr_emu_event_callback_f callback, void *context);
+
+/**
+ * @brief Cancels all scheduled events matching callback and context
+ * 
+ * @param emulation 
+ * @param callback 
+ * @param context 
+ * @return uint32_t - Number of events cancelled
+ */
+uint32_t sl_avr_emu_event_cancel(sl_avr_emu_emulation_s *emulation, sl_avr_emu_event_callback_f callback, void *context);
+
+/**
+ * @brief Runs all events due at or before the current tick.  Called from sl_avr_emu_tick() when events.next_tick is reached
+ * 
+ * @param emulation 
+ * @return sl_avr_emu_result_e - First failing callback result
+ */
+sl_avr_emu_result_e sl_avr_emu_event_dispatch(sl_avr_emu_emulation_s *emulation);
+
+#endif //_SL_AVR_EMU_EVENT_H_
@@ -0,0 +1,125 @@
+/**
+ * @file sl_avr_emu_fuzz.h
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator In-Process Fuzzing Header
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#ifndef _SL_AVR_EMU_FUZZ_H_
+#define _SL_AVR_EMU_FUZZ_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "sl_avr_emu_snapshot.h"
+#include "sl_avr_emu_types.h"
+
+/**
+ * @brief Size of the edge coverage map in bytes (AFL-style, one hit counter per edge hash)
+ * 
+ */
+#define SL_AVR_EMU_FUZZ_EDGE_MAP_SIZE (1 << 16)
+
+/**
+ * @brief Stop PC value meaning "run each input for the full tick budget"
+ * 
+ */
+#define SL_AVR_EMU_FUZZ_NO_STOP_PC 0xFFFFFFFF
+
+/**
+ * @brief Fuzzing harness configuration
+ * 
+ */
+typedef struct
+{
+  /* PC (word address) at which the post-boot snapshot is taken */
+  sl_avr_emu_extended_address_t start_pc;
+  /* PC (word address) at which an input is considered handled */
+  sl_avr_emu_extended_address_t stop_pc;
+  /* Data address inputs are copied to */
+  sl_avr_emu_address_t          input_address;
+  /* Maximum input size, larger inputs are truncated */
+  sl_avr_emu_num_bytes          input_size_max;
+  /* Data address the 16-bit little-endian input length is written to (e.g. 0x18 for r24:r25) */
+  sl_avr_emu_address_t          input_length_address;
+  /* Tick budget to reach start_pc from reset */
+  sl_avr_emu_tick_count_t       boot_tick_budget;
+  /* Tick budget per input */
+  sl_avr_emu_tick_count_t       input_tick_budget;
+
+} sl_avr_emu_fuzz_config_s;
+
+/**
+ * @brief Fuzzing harness state
+ * 
+ */
+typedef struct
+{
+  sl_avr_emu_fuzz_config_s config;
+
+  /* Emulation under test */
+  sl_avr_emu_emulation_s  *emulation;
+  /* State at start_pc */
+  sl_avr_emu_snapshot_s    snapshot;
+
+  /* Edge coverage map of SL_AVR_EMU_FUZZ_EDGE_MAP_SIZE bytes */
+  sl_avr_emu_byte_t       *edge_map;
+  bool                     edge_map_allocated;
+
+  /* Number of inputs executed */
+  uint64_t                 executions;
+  /* Ticks used by the last input */
+  sl_avr_emu_tick_count_t  last_ticks;
+  /* Last input exhausted its tick budget before reaching stop_pc */
+  bool                     last_timed_out;
+
+} sl_avr_emu_fuzz_s;
+
+/**
+ * @brief Boots emulation to config->start_pc and snapshots it for repeated input execution
+ * 
+ * @param fuzz      - Harness to initialize
+ * @param emulation - Initialized emulation with firmware loaded
+ * @param config    - Harness configuration
+ * @param edge_map  - Coverage map of SL_AVR_EMU_FUZZ_EDGE_MAP_SIZE bytes, or NULL to allocate one
+ * @return sl_avr_emu_result_e 
+ */
+sl_avr_emu_result_e sl_avr_emu_fuzz_init(sl_avr_emu_fuzz_s *fuzz, sl_avr_emu_emulation_s *emulation, const sl_avr_emu_fuzz_config_s *config, sl_avr_emu_byte_t *edge_map);
+
+/**
+ * @brief Resets to the snapshot, injects an input and runs it within the tick budget
+ * 
+ * @param fuzz 
+ * @param data 
+ * @param size 
+ * @return sl_avr_emu_result_e - SL_AVR_EMU_RESULT_SUCCESS unless the firmware faulted
+ */
+sl_avr_emu_result_e sl_avr_emu_fuzz_run_input(sl_avr_emu_fuzz_s *fuzz, const uint8_t *data, size_t size);
+
+/**
+ * @brief Counts edges hit in the coverage map
+ * 
+ * @param fuzz 
+ * @return uint32_t 
+ */
+uint32_t sl_avr_emu_fuzz_edges_hit(const sl_avr_emu_fuzz_s *fuzz);
+
+/**
+ * @brief Releases harness resources and detaches it from the emulation
+ * 
+ * @param fuzz 
+ */
+void sl_avr_emu_fuzz_deinit(sl_avr_emu_fuzz_s *fuzz);
+
+/**
+ * @brief Records an edge from the previous PC to the current PC.  Called on each decoded instruction while fuzzing
+ * 
+ * @param emulation 
+ */
+void sl_avr_emu_fuzz_trace_pc(sl_avr_emu_emulation_s *emulation);
+
+#endif //_SL_AVR_EMU_FUZZ_H_
@@ -0,0 +1,42 @@
+/**
+ * @file sl_avr_emu_gdb.h
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator GDB Remote Serial Protocol Server Header
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#ifndef _SL_AVR_EMU_GDB_H_
+#define _SL_AVR_EMU_GDB_H_
+
+#include "sl_avr_emu.h"
+
+/* Largest packet payload accepted or sent */
+#define SL_AVR_EMU_GDB_PACKET_SIZE 4096
+/* Ticks run between checks for an interrupt from GDB while continuing */
+#define SL_AVR_EMU_GDB_POLL_TICKS (1 << 16)
+
+/* avr-gdb address spaces, flash bytes below SL_AVR_EMU_GDB_DATA_OFFSET */
+#define SL_AVR_EMU_GDB_DATA_OFFSET   0x800000
+#define SL_AVR_EMU_GDB_EEPROM_OFFSET 0x810000
+
+/* avr-gdb register file, r0-r31, SREG, SP and PC */
+#define SL_AVR_EMU_GDB_REGISTER_SREG  32
+#define SL_AVR_EMU_GDB_REGISTER_SP    33
+#define SL_AVR_EMU_GDB_REGISTER_PC    34
+#define SL_AVR_EMU_GDB_REGISTERS_SIZE 39
+
+/**
+ * @brief Serves one GDB connection, running emulation as GDB requests until it detaches or kills the target
+ * 
+ * @param emulation
+ * @param address    - TCP port on the loopback interface if numeric, else a Unix socket path
+ * @param tick_limit - Tick count at which the target is reported as exited
+ * @return sl_avr_emu_result_e - SL_AVR_EMU_RESULT_FAILURE if the socket could not be served
+ */
+sl_avr_emu_result_e sl_avr_emu_gdb_serve(sl_avr_emu_emulation_s *emulation, const char *address, sl_avr_emu_tick_count_t tick_limit);
+
+#endif //_SL_AVR_EMU_GDB_H_
@@ -0,0 +1,112 @@
+/**
+ * @file sl_avr_emu_guard.h
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator Guard Page Watch Header
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#ifndef _SL_AVR_EMU_GUARD_H_
+#define _SL_AVR_EMU_GUARD_H_
+
+#include <signal.h>
+
+#include "sl_avr_emu.h"
+#include "sl_avr_emu_watch.h"
+
+/* Guard ranges per emulation */
+#define SL_AVR_EMU_GUARD_MAX 8
+/* Smallest host page size supported, sizes the page tables */
+#define SL_AVR_EMU_GUARD_PAGE_SIZE_MIN 4096
+#define SL_AVR_EMU_GUARD_PAGES_MAX (SL_AVR_EMU_DATA_SIZE/SL_AVR_EMU_GUARD_PAGE_SIZE_MIN)
+/* Emulations with guard ranges at once, all share one SIGSEGV handler */
+#define SL_AVR_EMU_GUARD_EMULATIONS_MAX 8
+
+/**
+ * @brief Watch ranges enforced by protecting the host pages of data memory.
+ *        Accesses to unguarded pages run without any instrumentation.
+ * 
+ */
+typedef struct sl_avr_emu_guard_struct
+{
+  /* Guarded data memory, matched against fault addresses */
+  sl_avr_emu_byte_t            *data;
+  size_t                        page_size;
+  uint32_t                      page_count;
+  /* Protection of each page while armed, PROT_READ | PROT_WRITE for unguarded pages */
+  int                           protection[SL_AVR_EMU_GUARD_PAGES_MAX];
+  /* False while the host itself accesses data memory */
+  bool                          armed;
+
+  /* Pages opened by a fault, protected again after the faulting host instruction on x86,
+     else after the emulated instruction */
+  bool                          opened[SL_AVR_EMU_GUARD_PAGES_MAX];
+  /* Set while a hit or an opened page waits for sl_avr_emu_guard_check */
+  volatile sig_atomic_t         pending;
+
+  sl_avr_emu_watch_range_s      ranges[SL_AVR_EMU_GUARD_MAX];
+  uint32_t                      range_count;
+
+  /* Guard hits waiting for their instruction to complete */
+  bool                          triggered;
+  sl_avr_emu_address_t          trigger_address;
+  bool                          trigger_write;
+  uint32_t                      trigger_range;
+  /* Instruction that made the last hit */
+  sl_avr_emu_extended_address_t trigger_pc;
+  /* Set when the last hit stopped emulation */
+  bool                          stopped;
+
+} sl_avr_emu_guard_s;
+
+/**
+ * @brief Adds a guard range, protecting the host pages it covers.
+ *        Ranges sharing a page with the register file fault on every register access.
+ * 
+ * @param emulation
+ * @param start     - First data address watched
+ * @param size      - Bytes watched
+ * @param access    - Access kinds to trigger on
+ * @param callback  - NULL to stop emulation on a hit
+ * @param context   - Passed to callback
+ * @return sl_avr_emu_result_e - SL_AVR_EMU_RESULT_FAILURE if SL_AVR_EMU_GUARD_MAX ranges are already guarded
+ */
+sl_avr_emu_result_e sl_avr_emu_guard_add(sl_avr_emu_emulation_s *emulation, sl_avr_emu_extended_address_t start, uint32_t size,
+                                         sl_avr_emu_watch_access_e access, sl_avr_emu_watch_callback_f callback, void *context);
+
+/**
+ * @brief Arms or disarms page protection, so the host can access guarded data memory without hits
+ * 
+ * @param emulation
+ * @param protect
+ */
+void sl_avr_emu_guard_protect(const sl_avr_emu_emulation_s *emulation, bool protect);
+
+/**
+ * @brief Arms or disarms page protection if guard ranges are set
+ * 
+ */
+#define SL_AVR_EMU_GUARD_PROTECT(emulation, protect) \
+  do { if(NULL != (emulation)->hooks.guard) { sl_avr_emu_guard_protect((emulation), (protect)); } } while(0)
+
+/**
+ * @brief Protects pages opened by faults again and runs the callback of a hit made by the instruction that just completed.
+ *        Called after an instruction when a fault is pending.
+ * 
+ * @param emulation
+ * @param pc        - Instruction that just completed
+ * @return sl_avr_emu_result_e - SL_AVR_EMU_RESULT_WATCHPOINT for hits on ranges without a callback
+ */
+sl_avr_emu_result_e sl_avr_emu_guard_check(sl_avr_emu_emulation_s *emulation, sl_avr_emu_extended_address_t pc);
+
+/**
+ * @brief Removes all guard ranges, unprotects data memory and detaches the guard
+ * 
+ * @param emulation
+ */
+void sl_avr_emu_guard_stop(sl_avr_emu_emulation_s *emulation);
+
+#endif //_SL_AVR_EMU_GUARD_H_
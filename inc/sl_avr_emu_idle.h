@@ -0,0 +1,37 @@
+/**
+ * @file sl_avr_emu_idle.h
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator Register Poll Loop Detection Header
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#ifndef _SL_AVR_EMU_IDLE_H_
+#define _SL_AVR_EMU_IDLE_H_
+
+#include <stdbool.h>
+
+#include "sl_avr_emu.h"
+
+/**
+ * @brief Fast-forwards firmware spinning on a register that will not change before ready_tick.
+ *        Called by a peripheral's read hook, with the register already refreshed in data memory.
+ * 
+ * Recognizes the loops compilers emit to wait on a flag:
+ *   in/lds Rd, reg; sbrs/sbrc Rd, bit; rjmp back
+ *   sbis/sbic reg, bit; rjmp back
+ * Whole loop iterations are skipped, up to the first read at or after ready_tick, the next event or the run's tick limit,
+ * so the loop exits at the same tick and with the same instruction counts as if it had spun.
+ * Nothing is skipped while instrumentation that observes every instruction is attached.
+ * 
+ * @param emulation
+ * @param address    - Data address being read
+ * @param ready_tick - Earliest tick the register can change without firmware writing it
+ * @return true if iterations were skipped
+ */
+bool sl_avr_emu_idle_poll(sl_avr_emu_emulation_s *emulation, sl_avr_emu_address_t address, sl_avr_emu_tick_count_t ready_tick);
+
+#endif //_SL_AVR_EMU_IDLE_H_
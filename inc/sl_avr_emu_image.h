@@ -0,0 +1,60 @@
+/**
+ * @file sl_avr_emu_image.h
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator Precompiled Firmware Image Cache Header
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#ifndef _SL_AVR_EMU_IMAGE_H_
+#define _SL_AVR_EMU_IMAGE_H_
+
+#include <stddef.h>
+
+#include "sl_avr_emu.h"
+#include "sl_avr_emu_elf.h"
+
+/**
+ * @brief Loaded firmware image
+ * 
+ */
+typedef struct
+{
+  /* Cache file mapping */
+  void                    *map;
+  size_t                   map_size;
+
+  /* Content hash of the source .hex or .elf */
+  uint64_t                 source_hash;
+
+  /* Flash words stored, trailing erased words are not */
+  uint32_t                 flash_words;
+
+  /* Symbols, names point into map */
+  sl_avr_emu_symbols_s     symbols;
+
+} sl_avr_emu_image_s;
+
+/**
+ * @brief Loads firmware through the image cache.  
+ *        On a cache miss the .hex or .elf source is loaded normally and its cache entry is (re)generated.
+ * 
+ * @param emulation 
+ * @param image 
+ * @param source_path - .hex or .elf file
+ * @param cache_dir   - Directory holding cache entries
+ * @return sl_avr_emu_result_e 
+ */
+sl_avr_emu_result_e sl_avr_emu_image_load(sl_avr_emu_emulation_s *emulation, sl_avr_emu_image_s *image, char *source_path, const char *cache_dir);
+
+/**
+ * @brief Unmaps an image
+ * 
+ * @param image 
+ */
+void sl_avr_emu_image_free(sl_avr_emu_image_s *image);
+
+#endif //_SL_AVR_EMU_IMAGE_H_
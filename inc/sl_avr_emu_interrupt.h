@@ -12,8 +12,47 @@
 #ifndef _SL_AVR_EMU_INTERRUPT_H_
 #define _SL_AVR_EMU_INTERRUPT_H_
 
+#include <stdbool.h>
+
 #include "sl_avr_emu_types.h"
 
+/**
+ * @brief Interrupt source, a flag bit gated by an enable bit
+ * 
+ */
+typedef struct
+{
+  /* Vector PC, lower vectors have priority */
+  sl_avr_emu_extended_address_t vector;
+  /* Data address and bit of the interrupt flag */
+  sl_avr_emu_address_t          flag_address;
+  sl_avr_emu_byte_t             flag_bit;
+  /* Data address and bit of the interrupt enable */
+  sl_avr_emu_address_t          enable_address;
+  sl_avr_emu_byte_t             enable_bit;
+  /* Taking the vector clears the flag, else it stays set until firmware services the peripheral */
+  bool                          cleared_on_vector;
+  /* Datasheet vector name */
+  const char                   *name;
+
+} sl_avr_emu_interrupt_source_s;
+
+/**
+ * @brief Interrupt sources in priority order
+ * 
+ */
+extern const sl_avr_emu_interrupt_source_s sl_avr_emu_interrupt_sources[];
+extern const uint32_t                      sl_avr_emu_interrupt_source_count;
+
+/**
+ * @brief Pushes PC and vectors to interrupt_pc with interrupts disabled
+ * 
+ * @param emulation 
+ * @param interrupt_pc 
+ * @return sl_avr_emu_result_e 
+ */
+sl_avr_emu_result_e sl_avr_emu_interrupt(sl_avr_emu_emulation_s *emulation, sl_avr_emu_extended_address_t interrupt_pc);
+
 /**
  * @brief Handle any pending interrupts
  * 
@@ -22,4 +61,12 @@
  */
 sl_avr_emu_result_e sl_avr_emu_interrupt_handling(sl_avr_emu_emulation_s *emulation);
 
+/**
+ * @brief Returns whether an interrupt will be taken at the next instruction boundary
+ * 
+ * @param emulation 
+ * @return true if interrupts are enabled and an enabled source is flagged
+ */
+bool sl_avr_emu_interrupt_pending(const sl_avr_emu_emulation_s *emulation);
+
 #endif //_SL_AVR_EMU_INTERRUPT_H_
\ No newline at end of file
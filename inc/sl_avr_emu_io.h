@@ -0,0 +1,143 @@
+/**
+ * @file sl_avr_emu_io.h
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator Peripheral Register Hook Header
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#ifndef _SL_AVR_EMU_IO_H_
+#define _SL_AVR_EMU_IO_H_
+
+#include "sl_avr_emu.h"
+
+/* Data addresses that can be hooked, the IO and extended IO registers */
+#define SL_AVR_EMU_IO_HOOK_SIZE 0x100
+
+/**
+ * @brief Register read hook, called before the read so it can refresh the register in data memory
+ * 
+ * @param emulation
+ * @param address   - Data address read
+ * @param context
+ */
+typedef void (*sl_avr_emu_io_read_f)(sl_avr_emu_emulation_s *emulation, sl_avr_emu_address_t address, void *context);
+
+/**
+ * @brief Register write hook, called instead of storing value in data memory
+ * 
+ * @param emulation
+ * @param address   - Data address written
+ * @param value     - Value written by firmware
+ * @param context
+ */
+typedef void (*sl_avr_emu_io_write_f)(sl_avr_emu_emulation_s *emulation, sl_avr_emu_address_t address, sl_avr_emu_byte_t value, void *context);
+
+/**
+ * @brief Hooks of one register, either may be NULL
+ * 
+ */
+typedef struct
+{
+  sl_avr_emu_io_read_f  read;
+  sl_avr_emu_io_write_f write;
+  void                 *context;
+
+} sl_avr_emu_io_register_s;
+
+/**
+ * @brief Peripheral register hooks.  Only firmware accesses are hooked, peripherals and tooling access data memory directly.
+ * 
+ */
+typedef struct sl_avr_emu_io_struct
+{
+  sl_avr_emu_io_register_s registers[SL_AVR_EMU_IO_HOOK_SIZE];
+  /* Registers with a hook */
+  uint32_t                 count;
+
+} sl_avr_emu_io_s;
+
+/**
+ * @brief Hooks a register, replacing any hooks it already has
+ * 
+ * @param emulation
+ * @param address   - Data address of the register
+ * @param read      - NULL to read data memory as is
+ * @param write     - NULL to store writes in data memory as is
+ * @param context   - Passed to read and write
+ * @return sl_avr_emu_result_e - SL_AVR_EMU_RESULT_INVALID_DATA_ADDRESS if address is not an IO register
+ */
+sl_avr_emu_result_e sl_avr_emu_io_attach(sl_avr_emu_emulation_s *emulation, sl_avr_emu_address_t address,
+                                         sl_avr_emu_io_read_f read, sl_avr_emu_io_write_f write, void *context);
+
+/**
+ * @brief Removes the hooks of a register.  Detaches register hooks after the last is removed.
+ * 
+ * @param emulation
+ * @param address
+ */
+void sl_avr_emu_io_detach(sl_avr_emu_emulation_s *emulation, sl_avr_emu_address_t address);
+
+/**
+ * @brief Runs the read hook of a register.  Not called when no register is hooked.
+ * 
+ * @param emulation
+ * @param address   - Data address
+ */
+static inline void sl_avr_emu_io_read(sl_avr_emu_emulation_s *emulation, sl_avr_emu_extended_address_t address)
+{
+  const sl_avr_emu_io_register_s *hook;
+
+  if(address < SL_AVR_EMU_IO_HOOK_SIZE)
+  {
+    hook = &emulation->hooks.io->registers[address];
+    if(NULL != hook->read)
+    {
+      hook->read(emulation, address, hook->context);
+    }
+  }
+}
+
+/**
+ * @brief Runs the write hook of a register.  Not called when no register is hooked.
+ * 
+ * @param emulation
+ * @param address   - Data address
+ * @param value
+ * @return true if a hook took the write, else it is left to the caller to store
+ */
+static inline bool sl_avr_emu_io_write(sl_avr_emu_emulation_s *emulation, sl_avr_emu_extended_address_t address, sl_avr_emu_byte_t value)
+{
+  const sl_avr_emu_io_register_s *hook;
+
+  if(address < SL_AVR_EMU_IO_HOOK_SIZE)
+  {
+    hook = &emulation->hooks.io->registers[address];
+    if(NULL != hook->write)
+    {
+      hook->write(emulation, address, value, hook->context);
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/**
+ * @brief Runs the read hook of a register before firmware reads it, if registers are hooked
+ * 
+ */
+#define SL_AVR_EMU_IO_READ(emulation, address) \
+  do { if(NULL != (emulation)->hooks.io) { sl_avr_emu_io_read((emulation), (address)); } } while(0)
+
+/**
+ * @brief Stores a firmware write to data memory, through the register's write hook if it has one
+ * 
+ */
+#define SL_AVR_EMU_IO_WRITE(emulation, address, value) \
+  do { if(NULL == (emulation)->hooks.io || !sl_avr_emu_io_write((emulation), (address), (value))) { (emulation)->memory.data[(address)] = (value); } } while(0)
+
+#endif //_SL_AVR_EMU_IO_H_
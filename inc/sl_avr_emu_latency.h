@@ -0,0 +1,160 @@
+/**
+ * @file sl_avr_emu_latency.h
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator Interrupt Latency Instrumentation Header
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#ifndef _SL_AVR_EMU_LATENCY_H_
+#define _SL_AVR_EMU_LATENCY_H_
+
+#include <stdio.h>
+
+#include "sl_avr_emu.h"
+
+/* Interrupt sources tracked, at least sl_avr_emu_interrupt_source_count */
+#define SL_AVR_EMU_LATENCY_SOURCE_MAX 32
+/* Power of two histogram buckets, bucket n counts values in [2^(n-1), 2^n) */
+#define SL_AVR_EMU_LATENCY_BUCKETS 24
+/* Nested interrupts tracked */
+#define SL_AVR_EMU_LATENCY_NESTING_MAX 16
+/* Longest interrupts-disabled windows kept */
+#define SL_AVR_EMU_LATENCY_WINDOWS 8
+
+/**
+ * @brief Histogram of tick counts
+ * 
+ */
+typedef struct
+{
+  uint64_t count;
+  uint64_t sum;
+  uint64_t min;
+  uint64_t max;
+  uint64_t buckets[SL_AVR_EMU_LATENCY_BUCKETS];
+
+} sl_avr_emu_histogram_s;
+
+/**
+ * @brief Timing of one interrupt source
+ * 
+ */
+typedef struct
+{
+  /* Flag raised and not yet serviced, and the tick it was raised */
+  bool                    pending;
+  sl_avr_emu_tick_count_t flag_tick;
+  /* Flag seen set, flags not cleared on vector stay set while their handler runs */
+  bool                    raised;
+
+  /* Previous vector entry and the period before it, for jitter */
+  sl_avr_emu_tick_count_t last_entry_tick;
+  sl_avr_emu_tick_count_t last_period;
+
+  /* Flag raised to first handler instruction */
+  sl_avr_emu_histogram_s  latency;
+  /* Vector entry to RETI */
+  sl_avr_emu_histogram_s  duration;
+  /* Change in period between consecutive vector entries */
+  sl_avr_emu_histogram_s  jitter;
+
+} sl_avr_emu_latency_source_s;
+
+/**
+ * @brief Interval with the SREG I flag clear
+ * 
+ */
+typedef struct
+{
+  sl_avr_emu_tick_count_t       ticks;
+  sl_avr_emu_tick_count_t       start_tick;
+  /* Instructions that cleared and set the I flag */
+  sl_avr_emu_extended_address_t start_pc;
+  sl_avr_emu_extended_address_t end_pc;
+
+} sl_avr_emu_latency_window_s;
+
+/**
+ * @brief Interrupt latency instrumentation
+ * 
+ */
+typedef struct sl_avr_emu_latency_struct
+{
+  sl_avr_emu_latency_source_s   sources[SL_AVR_EMU_LATENCY_SOURCE_MAX];
+
+  /* Interrupts being serviced, innermost last */
+  struct
+  {
+    uint32_t                source;
+    sl_avr_emu_tick_count_t entry_tick;
+  }                             active[SL_AVR_EMU_LATENCY_NESTING_MAX];
+  uint32_t                      depth;
+
+  /* Set once firmware first enables interrupts, the reset state is not a window */
+  bool                          enabled_once;
+  bool                          disabled;
+  sl_avr_emu_tick_count_t       disabled_tick;
+  sl_avr_emu_extended_address_t disabled_pc;
+  sl_avr_emu_extended_address_t last_pc;
+
+  /* Longest interrupts-disabled windows, longest first */
+  sl_avr_emu_latency_window_s   windows[SL_AVR_EMU_LATENCY_WINDOWS];
+
+} sl_avr_emu_latency_s;
+
+/**
+ * @brief Attaches new latency instrumentation to emulation
+ * 
+ * @param emulation
+ * @return sl_avr_emu_result_e
+ */
+sl_avr_emu_result_e sl_avr_emu_latency_start(sl_avr_emu_emulation_s *emulation);
+
+/**
+ * @brief Timestamps newly raised interrupt flags.  Called each tick after scheduled events are dispatched.
+ * 
+ * @param emulation
+ */
+void sl_avr_emu_latency_io_tick(sl_avr_emu_emulation_s *emulation);
+
+/**
+ * @brief Follows the SREG I flag.  Called on each instruction boundary.
+ * 
+ * @param emulation
+ */
+void sl_avr_emu_latency_sample(sl_avr_emu_emulation_s *emulation);
+
+/**
+ * @brief Accounts the vector at PC being taken.  Called after the vector is entered.
+ * 
+ * @param emulation
+ */
+void sl_avr_emu_latency_interrupt(sl_avr_emu_emulation_s *emulation);
+
+/**
+ * @brief Accounts the innermost interrupt returning.  Called by RETI.
+ * 
+ * @param emulation
+ */
+void sl_avr_emu_latency_reti(sl_avr_emu_emulation_s *emulation);
+
+/**
+ * @brief Prints latency, duration and jitter per vector, and the longest interrupts-disabled windows
+ * 
+ * @param output
+ * @param emulation
+ */
+void sl_avr_emu_latency_report(FILE *output, sl_avr_emu_emulation_s *emulation);
+
+/**
+ * @brief Detaches and frees emulation's latency instrumentation
+ * 
+ * @param emulation
+ */
+void sl_avr_emu_latency_stop(sl_avr_emu_emulation_s *emulation);
+
+#endif //_SL_AVR_EMU_LATENCY_H_
@@ -0,0 +1,96 @@
+/**
+ * @file sl_avr_emu_opcode.h
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator Opcode Matching Header
+ * @version 0.1
+ * @date 2020-09-05
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#ifndef _SL_AVR_EMU_OPCODE_H_
+#define _SL_AVR_EMU_OPCODE_H_
+
+#include "sl_avr_emu_types.h"
+
+#define SL_AVR_EMU_IS_ADD(opcode)        (((opcode) & 0xEC00) == 0x0C00)
+#define SL_AVR_EMU_IS_ADIW(opcode)       (((opcode) & 0xFF00) == 0x9600)
+#define SL_AVR_EMU_IS_AND(opcode)        (((opcode) & 0xFC00) == 0x2000)
+#define SL_AVR_EMU_IS_BRBS_BRBC(opcode)  (((opcode) & 0xF800) == 0xF000)
+#define SL_AVR_EMU_IS_BREAK(opcode)      (((opcode) & 0xFFFF) == 0x9598)
+#define SL_AVR_EMU_IS_COM(opcode)        (((opcode) & 0xFE0C) == 0x9400)
+#define SL_AVR_EMU_IS_CP_CPC(opcode)     (((opcode) & 0xEC00) == 0x0400)
+#define SL_AVR_EMU_IS_CPI(opcode)        (((opcode) & 0xF000) == 0x3000)
+#define SL_AVR_EMU_IS_CPSE(opcode)       (((opcode) & 0xFC00) == 0x1000)
+#define SL_AVR_EMU_IS_DEC(opcode)        (((opcode) & 0xFE0F) == 0x940A)
+#define SL_AVR_EMU_IS_EOR(opcode)        (((opcode) & 0xFC00) == 0x2400)
+#define SL_AVR_EMU_IS_IJMP_ICALL(opcode) (((opcode) & 0xFEEF) == 0x9409)
+#define SL_AVR_EMU_IS_IN_OUT(opcode)     (((opcode) & 0xF000) == 0xB000)
+#define SL_AVR_EMU_IS_JMP_CALL(opcode)   (((opcode) & 0xFE0C) == 0x940C)
+#define SL_AVR_EMU_IS_PUSH_POP(opcode)   (((opcode) & 0xFC0F) == 0x900F)
+#define SL_AVR_EMU_IS_LD_ST(opcode)      ((((opcode) & 0xFC0C) == 0x900C) && !SL_AVR_EMU_IS_PUSH_POP(opcode))
+#define SL_AVR_EMU_IS_LDI(opcode)        (((opcode) & 0xF000) == 0xE000)
+#define SL_AVR_EMU_IS_LDS_STS(opcode)    (((opcode) & 0xFC0F) == 0x9000)
+#define SL_AVR_EMU_IS_LPM_ELPM(opcode)   (((opcode) & 0xFFEF) == 0x95C8)
+#define SL_AVR_EMU_IS_LPMZ_ELPMZ(opcode) (((opcode) & 0xFE0C) == 0x9004)
+#define SL_AVR_EMU_IS_MOV(opcode)        (((opcode) & 0xFC00) == 0x2C00)
+#define SL_AVR_EMU_IS_MOVW(opcode)       (((opcode) & 0xFF00) == 0x0100)
+#define SL_AVR_EMU_IS_OR(opcode)         (((opcode) & 0xFC00) == 0x2800)
+#define SL_AVR_EMU_IS_ORI(opcode)        (((opcode) & 0xF000) == 0x6000)
+#define SL_AVR_EMU_IS_RET(opcode)        (((opcode) & 0xFFFF) == 0x9508)
+#define SL_AVR_EMU_IS_RETI(opcode)       (((opcode) & 0xFFFF) == 0x9518)
+#define SL_AVR_EMU_IS_RJMP_RCALL(opcode) (((opcode) & 0xE000) == 0xC000)
+#define SL_AVR_EMU_IS_SBIC_SBIS(opcode)  (((opcode) & 0xFD00) == 0x9900)
+#define SL_AVR_EMU_IS_SBRC_SBRS(opcode)  (((opcode) & 0xFC08) == 0xFC00)
+#define SL_AVR_EMU_IS_SBIW(opcode)       (((opcode) & 0xFF00) == 0x9700)
+#define SL_AVR_EMU_IS_SEX_CLX(opcode)    (((opcode) & 0xFF0F) == 0x9408)
+#define SL_AVR_EMU_IS_SUB(opcode)        (((opcode) & 0xEC00) == 0x0800)
+#define SL_AVR_EMU_IS_SUBI_SBCI(opcode)  (((opcode) & 0xE000) == 0x4000)
+
+#define SL_AVR_EMU_IS_TWO_WORD_OPCODE(opcode) (SL_AVR_EMU_IS_JMP_CALL(opcode) || SL_AVR_EMU_IS_LDS_STS(opcode))
+
+/**
+ * @brief Instruction handlers, each executes the instruction at PC.  
+ *        Normally reached through sl_avr_emu_tick, exposed for benchmarking in isolation.
+ * 
+ */
+sl_avr_emu_result_e sl_avr_emu_opcode_unrecognized(sl_avr_emu_emulation_s * emulation);
+sl_avr_emu_result_e sl_avr_emu_opcode_unsupported(sl_avr_emu_emulation_s * emulation);
+sl_avr_emu_result_e sl_avr_emu_opcode_add(sl_avr_emu_emulation_s * emulation);
+sl_avr_emu_result_e sl_avr_emu_opcode_and(sl_avr_emu_emulation_s * emulation);
+sl_avr_emu_result_e sl_avr_emu_opcode_cp_cpc(sl_avr_emu_emulation_s * emulation);
+sl_avr_emu_result_e sl_avr_emu_opcode_cpi(sl_avr_emu_emulation_s * emulation);
+sl_avr_emu_result_e sl_avr_emu_opcode_cpse(sl_avr_emu_emulation_s * emulation);
+sl_avr_emu_result_e sl_avr_emu_opcode_eor(sl_avr_emu_emulation_s * emulation);
+sl_avr_emu_result_e sl_avr_emu_opcode_mov(sl_avr_emu_emulation_s * emulation);
+sl_avr_emu_result_e sl_avr_emu_opcode_movw(sl_avr_emu_emulation_s * emulation);
+sl_avr_emu_result_e sl_avr_emu_opcode_subi_sbci(sl_avr_emu_emulation_s * emulation);
+sl_avr_emu_result_e sl_avr_emu_opcode_or(sl_avr_emu_emulation_s * emulation);
+sl_avr_emu_result_e sl_avr_emu_opcode_sub(sl_avr_emu_emulation_s * emulation);
+sl_avr_emu_result_e sl_avr_emu_opcode_0(sl_avr_emu_emulation_s * emulation);
+sl_avr_emu_result_e sl_avr_emu_opcode_ori(sl_avr_emu_emulation_s * emulation);
+sl_avr_emu_result_e sl_avr_emu_opcode_1(sl_avr_emu_emulation_s * emulation);
+sl_avr_emu_result_e sl_avr_emu_opcode_adiw(sl_avr_emu_emulation_s * emulation);
+sl_avr_emu_result_e sl_avr_emu_opcode_dec(sl_avr_emu_emulation_s * emulation);
+sl_avr_emu_result_e sl_avr_emu_opcode_in_out(sl_avr_emu_emulation_s * emulation);
+sl_avr_emu_result_e sl_avr_emu_opcode_jmp_call(sl_avr_emu_emulation_s * emulation);
+sl_avr_emu_result_e sl_avr_emu_opcode_ld_st(sl_avr_emu_emulation_s * emulation);
+sl_avr_emu_result_e sl_avr_emu_opcode_lds_sts(sl_avr_emu_emulation_s * emulation);
+sl_avr_emu_result_e sl_avr_emu_opcode_lpm_elpm(sl_avr_emu_emulation_s * emulation);
+sl_avr_emu_result_e sl_avr_emu_opcode_com(sl_avr_emu_emulation_s * emulation);
+sl_avr_emu_result_e sl_avr_emu_opcode_push_pop(sl_avr_emu_emulation_s * emulation);
+sl_avr_emu_result_e sl_avr_emu_opcode_ret(sl_avr_emu_emulation_s * emulation);
+sl_avr_emu_result_e sl_avr_emu_opcode_reti(sl_avr_emu_emulation_s * emulation);
+sl_avr_emu_result_e sl_avr_emu_opcode_sbic_sbis(sl_avr_emu_emulation_s * emulation);
+sl_avr_emu_result_e sl_avr_emu_opcode_sbiw(sl_avr_emu_emulation_s * emulation);
+sl_avr_emu_result_e sl_avr_emu_opcode_sex_clx(sl_avr_emu_emulation_s * emulation);
+sl_avr_emu_result_e sl_avr_emu_opcode_break(sl_avr_emu_emulation_s * emulation);
+sl_avr_emu_result_e sl_avr_emu_opcode_2(sl_avr_emu_emulation_s * emulation);
+sl_avr_emu_result_e sl_avr_emu_opcode_ldi(sl_avr_emu_emulation_s * emulation);
+sl_avr_emu_result_e sl_avr_emu_opcode_brbs_brbc(sl_avr_emu_emulation_s * emulation);
+sl_avr_emu_result_e sl_avr_emu_opcode_rjmp_rcall(sl_avr_emu_emulation_s * emulation);
+sl_avr_emu_result_e sl_avr_emu_opcode_sbrc_sbrs(sl_avr_emu_emulation_s * emulation);
+sl_avr_emu_result_e sl_avr_emu_opcode_3(sl_avr_emu_emulation_s * emulation);
+
+#endif //_SL_AVR_EMU_OPCODE_H_
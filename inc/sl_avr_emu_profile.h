@@ -0,0 +1,77 @@
+/**
+ * @file sl_avr_emu_profile.h
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator Per-PC Profiler Header
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#ifndef _SL_AVR_EMU_PROFILE_H_
+#define _SL_AVR_EMU_PROFILE_H_
+
+#include <stdio.h>
+
+#include "sl_avr_emu.h"
+
+/**
+ * @brief Per flash word execution counters
+ * 
+ */
+typedef struct sl_avr_emu_profile_struct
+{
+  /* Times each flash word was executed as an instruction */
+  uint64_t                      instructions[SL_AVR_EMU_FLASH_SIZE];
+  /* Cycles consumed by the instruction at each flash word */
+  uint64_t                      cycles[SL_AVR_EMU_FLASH_SIZE];
+
+  /* Instruction in progress and the tick it started on */
+  sl_avr_emu_extended_address_t last_pc;
+  sl_avr_emu_tick_count_t       last_tick;
+
+} sl_avr_emu_profile_s;
+
+/**
+ * @brief Attaches a new profile to emulation
+ * 
+ * @param emulation 
+ * @return sl_avr_emu_result_e 
+ */
+sl_avr_emu_result_e sl_avr_emu_profile_start(sl_avr_emu_emulation_s *emulation);
+
+/**
+ * @brief Accounts the instruction about to execute at PC.  Called on each instruction when a profile is attached.
+ *        Inline to keep profiling overhead low.
+ * 
+ * @param emulation 
+ */
+static inline void sl_avr_emu_profile_trace(sl_avr_emu_emulation_s *emulation)
+{
+  sl_avr_emu_profile_s *profile = emulation->hooks.profile;
+
+  profile->cycles[profile->last_pc] += emulation->tick_count - profile->last_tick;
+  profile->last_pc   = emulation->memory.pc;
+  profile->last_tick = emulation->tick_count;
+  profile->instructions[emulation->memory.pc]++;
+}
+
+/**
+ * @brief Prints the top_n hottest functions (when symbols are available) and addresses, 
+ *        followed by annotated disassembly of the hottest code
+ * 
+ * @param output 
+ * @param emulation 
+ * @param top_n 
+ */
+void sl_avr_emu_profile_report(FILE *output, sl_avr_emu_emulation_s *emulation, uint32_t top_n);
+
+/**
+ * @brief Detaches and frees emulation's profile
+ * 
+ * @param emulation 
+ */
+void sl_avr_emu_profile_stop(sl_avr_emu_emulation_s *emulation);
+
+#endif //_SL_AVR_EMU_PROFILE_H_
@@ -0,0 +1,149 @@
+/**
+ * @file sl_avr_emu_replay.h
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator External Stimulus Record/Replay Header
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#ifndef _SL_AVR_EMU_REPLAY_H_
+#define _SL_AVR_EMU_REPLAY_H_
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "sl_avr_emu_types.h"
+
+/**
+ * @brief Types of non-deterministic input from outside the emulated device
+ * 
+ */
+typedef enum
+{
+  /* External pin levels, data[address] = value (e.g. PINx) */
+  SL_AVR_EMU_STIMULUS_IO_WRITE      = 0,
+  /* Set bits, data[address] |= value (e.g. raise an interrupt flag) */
+  SL_AVR_EMU_STIMULUS_IO_SET_BITS   = 1,
+  /* Clear bits, data[address] &= ~value */
+  SL_AVR_EMU_STIMULUS_IO_CLEAR_BITS = 2,
+  /* Byte received on serial port number address */
+  SL_AVR_EMU_STIMULUS_SERIAL_RX     = 3,
+  /* Input capture edge on timer 1 */
+  SL_AVR_EMU_STIMULUS_TIMER_CAPTURE = 4,
+
+  SL_AVR_EMU_STIMULUS_TYPE_COUNT,
+} sl_avr_emu_stimulus_type_e;
+
+/**
+ * @brief Live stimulus as injected
+ * 
+ */
+typedef struct
+{
+  /* Tick it is applied at */
+  sl_avr_emu_tick_count_t    tick;
+  sl_avr_emu_stimulus_type_e type;
+  sl_avr_emu_address_t       address;
+  sl_avr_emu_byte_t          value;
+
+} sl_avr_emu_stimulus_s;
+
+/**
+ * @brief Record/replay mode
+ * 
+ */
+typedef enum
+{
+  SL_AVR_EMU_REPLAY_MODE_RECORD,
+  SL_AVR_EMU_REPLAY_MODE_PLAYBACK,
+} sl_avr_emu_replay_mode_e;
+
+/**
+ * @brief Stimulus recorder/player state
+ * 
+ */
+typedef struct sl_avr_emu_replay_struct
+{
+  sl_avr_emu_replay_mode_e mode;
+
+  /* Log being recorded */
+  FILE                    *file;
+
+  /* Log being played back (memory mapped) */
+  const uint8_t           *log;
+  size_t                   log_size;
+  size_t                   log_offset;
+
+  /* Tick recording or playback started at */
+  sl_avr_emu_tick_count_t  start_tick;
+  /* Tick of the last record, log ticks are delta encoded against it */
+  sl_avr_emu_tick_count_t  last_tick;
+  /* Number of stimuli recorded or played back */
+  uint64_t                 stimulus_count;
+
+} sl_avr_emu_replay_s;
+
+/**
+ * @brief Injects an external stimulus.  It is applied at the start of the next tick and recorded if recording.
+ *        Live stimuli are dropped during playback, the log is the only input source, and while reverse execution re-executes.
+ * 
+ * @param emulation 
+ * @param type 
+ * @param address - Data address, or serial port number for SL_AVR_EMU_STIMULUS_SERIAL_RX
+ * @param value 
+ * @return sl_avr_emu_result_e 
+ */
+sl_avr_emu_result_e sl_avr_emu_stimulus_inject(sl_avr_emu_emulation_s *emulation, sl_avr_emu_stimulus_type_e type, sl_avr_emu_address_t address, sl_avr_emu_byte_t value);
+
+/**
+ * @brief Schedules live stimuli again after a snapshot restore, replacing copies the restored event queue already holds
+ * 
+ * @param emulation 
+ * @param stimuli   - Stimuli applied after the snapshot was taken
+ * @param count 
+ * @return sl_avr_emu_result_e 
+ */
+sl_avr_emu_result_e sl_avr_emu_stimulus_reinject(sl_avr_emu_emulation_s *emulation, const sl_avr_emu_stimulus_s *stimuli, uint32_t count);
+
+/**
+ * @brief Starts recording applied stimuli to a binary log
+ * 
+ * @param emulation 
+ * @param replay 
+ * @param file_path 
+ * @return sl_avr_emu_result_e 
+ */
+sl_avr_emu_result_e sl_avr_emu_replay_record_start(sl_avr_emu_emulation_s *emulation, sl_avr_emu_replay_s *replay, const char *file_path);
+
+/**
+ * @brief Starts playing back a binary stimulus log at the recorded ticks
+ * 
+ * @param emulation 
+ * @param replay 
+ * @param file_path 
+ * @return sl_avr_emu_result_e 
+ */
+sl_avr_emu_result_e sl_avr_emu_replay_playback_start(sl_avr_emu_emulation_s *emulation, sl_avr_emu_replay_s *replay, const char *file_path);
+
+/**
+ * @brief Rewinds playback to the start of the log, for a restored snapshot taken before playback started
+ * 
+ * @param emulation 
+ * @param replay 
+ * @return sl_avr_emu_result_e 
+ */
+sl_avr_emu_result_e sl_avr_emu_replay_rewind(sl_avr_emu_emulation_s *emulation, sl_avr_emu_replay_s *replay);
+
+/**
+ * @brief Stops recording or playback, flushing and closing the log
+ * 
+ * @param emulation 
+ * @param replay 
+ * @return sl_avr_emu_result_e 
+ */
+sl_avr_emu_result_e sl_avr_emu_replay_stop(sl_avr_emu_emulation_s *emulation, sl_avr_emu_replay_s *replay);
+
+#endif //_SL_AVR_EMU_REPLAY_H_
@@ -0,0 +1,129 @@
+/**
+ * @file sl_avr_emu_reverse.h
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator Reverse Execution Header
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#ifndef _SL_AVR_EMU_REVERSE_H_
+#define _SL_AVR_EMU_REVERSE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "sl_avr_emu_replay.h"
+#include "sl_avr_emu_snapshot.h"
+#include "sl_avr_emu_types.h"
+
+/**
+ * @brief Stop condition for reverse continue, evaluated at instruction boundaries
+ * 
+ */
+typedef bool (*sl_avr_emu_reverse_stop_f)(const sl_avr_emu_emulation_s *emulation, void *context);
+
+/**
+ * @brief Periodic in-memory checkpoint
+ * 
+ */
+typedef struct
+{
+  /* Tick the checkpoint was taken at */
+  sl_avr_emu_tick_count_t tick;
+  /* Machine state at tick */
+  sl_avr_emu_snapshot_s   snapshot;
+  /* Stimulus playback position at tick, if playing back */
+  bool                    replay_saved;
+  size_t                  replay_offset;
+  sl_avr_emu_tick_count_t replay_last_tick;
+  uint64_t                replay_stimulus_count;
+
+} sl_avr_emu_checkpoint_s;
+
+/**
+ * @brief Reverse execution state
+ * 
+ */
+typedef struct sl_avr_emu_reverse_struct
+{
+  sl_avr_emu_emulation_s  *emulation;
+
+  /* Ticks between checkpoints, doubles whenever the memory budget is exhausted */
+  sl_avr_emu_tick_count_t  interval;
+  /* Tick at which the next checkpoint is taken */
+  sl_avr_emu_tick_count_t  next_checkpoint_tick;
+
+  /* Checkpoints in tick order */
+  sl_avr_emu_checkpoint_s *checkpoints;
+  uint32_t                 checkpoint_count;
+  uint32_t                 checkpoint_capacity;
+
+  /* Live stimuli injected since the first checkpoint in tick order, applied again when re-executing past them */
+  sl_avr_emu_stimulus_s   *stimuli;
+  uint32_t                 stimulus_count;
+  uint32_t                 stimulus_capacity;
+  /* True while re-executing from a checkpoint, when live stimuli are dropped */
+  bool                     reexecuting;
+
+} sl_avr_emu_reverse_s;
+
+/**
+ * @brief Initializes reverse execution, taking the first checkpoint at the current tick, and attaches it to emulation
+ * 
+ * @param reverse 
+ * @param emulation 
+ * @param memory_budget - Bytes available for checkpoints
+ * @param interval      - Initial ticks between checkpoints
+ * @return sl_avr_emu_result_e 
+ */
+sl_avr_emu_result_e sl_avr_emu_reverse_init(sl_avr_emu_reverse_s *reverse, sl_avr_emu_emulation_s *emulation, size_t memory_budget, sl_avr_emu_tick_count_t interval);
+
+/**
+ * @brief Keeps a live stimulus so re-execution from earlier checkpoints applies it too.  Called when a stimulus is injected.
+ * 
+ * @param reverse 
+ * @param stimulus 
+ * @return sl_avr_emu_result_e 
+ */
+sl_avr_emu_result_e sl_avr_emu_reverse_stimulus(sl_avr_emu_reverse_s *reverse, const sl_avr_emu_stimulus_s *stimulus);
+
+/**
+ * @brief Runs forward until an error or tick_limit, taking periodic checkpoints
+ * 
+ * @param reverse 
+ * @param tick_limit 
+ * @return sl_avr_emu_result_e 
+ */
+sl_avr_emu_result_e sl_avr_emu_reverse_run(sl_avr_emu_reverse_s *reverse, sl_avr_emu_tick_count_t tick_limit);
+
+/**
+ * @brief Moves execution back to the start of the previous instruction
+ * 
+ * @param reverse 
+ * @return sl_avr_emu_result_e - SL_AVR_EMU_RESULT_FAILURE if there is no earlier instruction boundary
+ */
+sl_avr_emu_result_e sl_avr_emu_reverse_step(sl_avr_emu_reverse_s *reverse);
+
+/**
+ * @brief Moves execution back to the most recent instruction boundary where stop returns true.
+ *        Stops at the earliest checkpoint if stop never returns true.
+ * 
+ * @param reverse 
+ * @param stop 
+ * @param context - Passed to stop
+ * @param found   - Optional, set if stop returned true
+ * @return sl_avr_emu_result_e 
+ */
+sl_avr_emu_result_e sl_avr_emu_reverse_continue(sl_avr_emu_reverse_s *reverse, sl_avr_emu_reverse_stop_f stop, void *context, bool *found);
+
+/**
+ * @brief Detaches reverse execution and frees checkpoint and stimulus storage
+ * 
+ * @param reverse 
+ */
+void sl_avr_emu_reverse_deinit(sl_avr_emu_reverse_s *reverse);
+
+#endif //_SL_AVR_EMU_REVERSE_H_
@@ -0,0 +1,75 @@
+/**
+ * @file sl_avr_emu_samples.h
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator Memory-Mapped Sample Stream Header
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#ifndef _SL_AVR_EMU_SAMPLES_H_
+#define _SL_AVR_EMU_SAMPLES_H_
+
+#include <stddef.h>
+
+#include "sl_avr_emu.h"
+
+/**
+ * @brief Fixed-size records sampled at a fixed rate, mapped read-only from a file.
+ *        Records are indexed by emulated time, the page cache streams them in as they are reached.
+ * 
+ */
+typedef struct
+{
+  const sl_avr_emu_byte_t *map;
+  size_t                   map_size;
+  uint32_t                 record_size;
+  uint64_t                 record_count;
+  uint32_t                 sample_hz;
+
+  /* Lookups past the last record, which return the last record */
+  uint64_t                 overruns;
+
+} sl_avr_emu_samples_s;
+
+/**
+ * @brief Maps a sample file
+ * 
+ * @param samples
+ * @param path
+ * @param record_size - Bytes per record, trailing bytes of the file short of a record are ignored
+ * @param sample_hz   - Records per second of emulated time
+ * @return sl_avr_emu_result_e - SL_AVR_EMU_RESULT_INVALID_FILE_PATH if the file could not be mapped or holds no record
+ */
+sl_avr_emu_result_e sl_avr_emu_samples_open(sl_avr_emu_samples_s *samples, const char *path, uint32_t record_size, uint32_t sample_hz);
+
+/**
+ * @brief Index of the record current at a tick
+ * 
+ * @param samples
+ * @param tick
+ * @param clock_hz
+ * @param fraction - Set to the time since that record, in 1/65536ths of a sample period.  May be NULL.
+ * @return uint64_t - May be past the last record
+ */
+uint64_t sl_avr_emu_samples_index(const sl_avr_emu_samples_s *samples, sl_avr_emu_tick_count_t tick, uint32_t clock_hz, uint32_t *fraction);
+
+/**
+ * @brief Record at an index, the last record past the end
+ * 
+ * @param samples
+ * @param index
+ * @return const sl_avr_emu_byte_t*
+ */
+const sl_avr_emu_byte_t *sl_avr_emu_samples_record(sl_avr_emu_samples_s *samples, uint64_t index);
+
+/**
+ * @brief Unmaps a sample file
+ * 
+ * @param samples
+ */
+void sl_avr_emu_samples_close(sl_avr_emu_samples_s *samples);
+
+#endif //_SL_AVR_EMU_SAMPLES_H_
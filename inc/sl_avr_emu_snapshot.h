@@ -0,0 +1,65 @@
+/**
+ * @file sl_avr_emu_snapshot.h
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator Snapshot Header
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#ifndef _SL_AVR_EMU_SNAPSHOT_H_
+#define _SL_AVR_EMU_SNAPSHOT_H_
+
+#include <stddef.h>
+
+#include "sl_avr_emu_types.h"
+
+/**
+ * @brief Saved machine state of an emulation.
+ *        Flash is not saved (it is not written at runtime) and neither are host-side hooks.
+ *        Data memory is saved after the struct state since it is mapped separately.
+ *        A snapshot may only be restored into the emulation it was taken from.
+ * 
+ */
+typedef struct
+{
+  /* Saved state bytes, NULL until first taken */
+  sl_avr_emu_byte_t *state;
+
+} sl_avr_emu_snapshot_s;
+
+/**
+ * @brief Returns the number of bytes held by a snapshot
+ * 
+ * @return size_t 
+ */
+size_t sl_avr_emu_snapshot_size(void);
+
+/**
+ * @brief Saves emulation's machine state into snapshot, allocating storage on first use
+ * 
+ * @param emulation 
+ * @param snapshot 
+ * @return sl_avr_emu_result_e 
+ */
+sl_avr_emu_result_e sl_avr_emu_snapshot_take(const sl_avr_emu_emulation_s *emulation, sl_avr_emu_snapshot_s *snapshot);
+
+/**
+ * @brief Restores emulation's machine state from snapshot
+ * 
+ * @param emulation 
+ * @param snapshot 
+ * @return sl_avr_emu_result_e 
+ */
+sl_avr_emu_result_e sl_avr_emu_snapshot_restore(sl_avr_emu_emulation_s *emulation, const sl_avr_emu_snapshot_s *snapshot);
+
+/**
+ * @brief Frees storage held by snapshot
+ * 
+ * @param snapshot 
+ */
+void sl_avr_emu_snapshot_free(sl_avr_emu_snapshot_s *snapshot);
+
+#endif //_SL_AVR_EMU_SNAPSHOT_H_
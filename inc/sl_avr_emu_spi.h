@@ -0,0 +1,130 @@
+/**
+ * @file sl_avr_emu_spi.h
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator SPI Peripheral Header
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#ifndef _SL_AVR_EMU_SPI_H_
+#define _SL_AVR_EMU_SPI_H_
+
+#include <stdio.h>
+
+#include "sl_avr_emu.h"
+
+/* SPI data addresses */
+#define SL_AVR_EMU_SPI_SPCR 0x4C
+#define SL_AVR_EMU_SPI_SPSR 0x4D
+#define SL_AVR_EMU_SPI_SPDR 0x4E
+
+/* SPCR bits */
+#define SL_AVR_EMU_SPI_SPIE  0x7
+#define SL_AVR_EMU_SPI_SPE   0x6
+#define SL_AVR_EMU_SPI_DORD  0x5
+#define SL_AVR_EMU_SPI_MSTR  0x4
+#define SL_AVR_EMU_SPI_CPOL  0x3
+#define SL_AVR_EMU_SPI_CPHA  0x2
+#define SL_AVR_EMU_SPI_SPR1  0x1
+#define SL_AVR_EMU_SPI_SPR0  0x0
+/* SPSR bits */
+#define SL_AVR_EMU_SPI_SPIF  0x7
+#define SL_AVR_EMU_SPI_WCOL  0x6
+#define SL_AVR_EMU_SPI_SPI2X 0x0
+
+/* Data address and bit of the SS pin on the ATmega328P, PB2, the usual chip select of a single device */
+#define SL_AVR_EMU_SPI_SS_PORT 0x25
+#define SL_AVR_EMU_SPI_SS_BIT  0x2
+
+/* Devices attached at once */
+#define SL_AVR_EMU_SPI_DEVICES_MAX 4
+
+/**
+ * @brief Host-side device on the SPI bus.  Models embed it as their first member.
+ * 
+ */
+typedef struct sl_avr_emu_spi_device_struct
+{
+  const char        *name;
+  /* Chip select asserted (true) or released (false) */
+  void              (*select)(struct sl_avr_emu_spi_device_struct *device, bool selected);
+  /* Exchanges one byte, most significant bit first on the wire, while selected */
+  sl_avr_emu_byte_t (*transfer)(struct sl_avr_emu_spi_device_struct *device, sl_avr_emu_byte_t mosi);
+  /* Prints device counters, may be NULL */
+  void              (*report)(FILE *output, const struct sl_avr_emu_spi_device_struct *device);
+  /* Releases the device */
+  void              (*close)(struct sl_avr_emu_spi_device_struct *device);
+
+  /* Chip select, an active-low output pin, set by sl_avr_emu_spi_attach */
+  sl_avr_emu_address_t cs_port;
+  sl_avr_emu_byte_t    cs_bit;
+  bool                 selected;
+
+} sl_avr_emu_spi_device_s;
+
+/**
+ * @brief SPI model.  Transfers complete through the event scheduler, 8 SCK periods after they start.
+ * 
+ */
+typedef struct sl_avr_emu_spi_struct
+{
+  sl_avr_emu_spi_device_s *devices[SL_AVR_EMU_SPI_DEVICES_MAX];
+  uint32_t                 device_count;
+
+  uint64_t                 transfers;
+  /* SPDR writes during a transfer */
+  uint64_t                 collisions;
+
+} sl_avr_emu_spi_s;
+
+/**
+ * @brief Attaches SPI to emulation
+ * 
+ * @param emulation
+ * @return sl_avr_emu_result_e
+ */
+sl_avr_emu_result_e sl_avr_emu_spi_start(sl_avr_emu_emulation_s *emulation);
+
+/**
+ * @brief Attaches a device to the bus, selected while its chip select pin is an output driven low.
+ *        The SPI owns the device from then on and closes it on stop.
+ * 
+ * @param emulation
+ * @param device
+ * @param cs_port   - Data address of the chip select pin's PORTx register
+ * @param cs_bit
+ * @return sl_avr_emu_result_e - SL_AVR_EMU_RESULT_FAILURE if SPI is not attached or SL_AVR_EMU_SPI_DEVICES_MAX devices are
+ */
+sl_avr_emu_result_e sl_avr_emu_spi_attach(sl_avr_emu_emulation_s *emulation, sl_avr_emu_spi_device_s *device,
+                                          sl_avr_emu_address_t cs_port, sl_avr_emu_byte_t cs_bit);
+
+/**
+ * @brief Clocks one byte from an external master into SPI in slave mode, completing after 8 periods of bit_ticks.
+ *        The byte the firmware loaded into SPDR is left in the emulation's spi.slave_output.
+ * 
+ * @param emulation
+ * @param mosi
+ * @param bit_ticks - SCK period of the external master in ticks
+ * @return sl_avr_emu_result_e - SL_AVR_EMU_RESULT_FAILURE unless SPI is enabled as a slave and idle
+ */
+sl_avr_emu_result_e sl_avr_emu_spi_slave_transfer(sl_avr_emu_emulation_s *emulation, sl_avr_emu_byte_t mosi, uint32_t bit_ticks);
+
+/**
+ * @brief Prints SPI and device counters
+ * 
+ * @param output
+ * @param emulation
+ */
+void sl_avr_emu_spi_report(FILE *output, const sl_avr_emu_emulation_s *emulation);
+
+/**
+ * @brief Closes attached devices and detaches SPI
+ * 
+ * @param emulation
+ */
+void sl_avr_emu_spi_stop(sl_avr_emu_emulation_s *emulation);
+
+#endif //_SL_AVR_EMU_SPI_H_
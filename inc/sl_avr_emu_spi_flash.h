@@ -0,0 +1,60 @@
+/**
+ * @file sl_avr_emu_spi_flash.h
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator SPI NOR Flash Device Header
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#ifndef _SL_AVR_EMU_SPI_FLASH_H_
+#define _SL_AVR_EMU_SPI_FLASH_H_
+
+#include "sl_avr_emu_spi.h"
+
+/* Size of a new flash image when none is given, 1 MiB */
+#define SL_AVR_EMU_SPI_FLASH_SIZE_DEFAULT (1 << 20)
+/* Smallest and largest flash, addresses are 24 bits */
+#define SL_AVR_EMU_SPI_FLASH_SIZE_MIN     (1 << 16)
+#define SL_AVR_EMU_SPI_FLASH_SIZE_MAX     (1 << 24)
+#define SL_AVR_EMU_SPI_FLASH_PAGE_SIZE    256
+
+/* Commands */
+#define SL_AVR_EMU_SPI_FLASH_PAGE_PROGRAM  0x02
+#define SL_AVR_EMU_SPI_FLASH_READ          0x03
+#define SL_AVR_EMU_SPI_FLASH_WRITE_DISABLE 0x04
+#define SL_AVR_EMU_SPI_FLASH_READ_STATUS   0x05
+#define SL_AVR_EMU_SPI_FLASH_WRITE_ENABLE  0x06
+#define SL_AVR_EMU_SPI_FLASH_FAST_READ     0x0B
+#define SL_AVR_EMU_SPI_FLASH_ERASE_4K      0x20
+#define SL_AVR_EMU_SPI_FLASH_ERASE_32K     0x52
+#define SL_AVR_EMU_SPI_FLASH_ERASE_CHIP    0x60
+#define SL_AVR_EMU_SPI_FLASH_DEVICE_ID     0x90
+#define SL_AVR_EMU_SPI_FLASH_JEDEC_ID      0x9F
+#define SL_AVR_EMU_SPI_FLASH_RELEASE       0xAB
+#define SL_AVR_EMU_SPI_FLASH_POWER_DOWN    0xB9
+#define SL_AVR_EMU_SPI_FLASH_ERASE_CHIP_2  0xC7
+#define SL_AVR_EMU_SPI_FLASH_ERASE_64K     0xD8
+
+/* Status register bits */
+#define SL_AVR_EMU_SPI_FLASH_BUSY 0x0
+#define SL_AVR_EMU_SPI_FLASH_WEL  0x1
+
+/* JEDEC manufacturer and memory type reported, those of a Winbond W25Q */
+#define SL_AVR_EMU_SPI_FLASH_MANUFACTURER 0xEF
+#define SL_AVR_EMU_SPI_FLASH_MEMORY_TYPE  0x40
+
+/**
+ * @brief Opens a flash image as a SPI NOR flash device.  The image is mapped, so the host page cache holds the
+ *        contents and writes reach the file without system calls on the emulation thread.
+ * 
+ * @param path
+ * @param size - Flash size in bytes, a power of 2.  0 to use the size of an existing image, or SL_AVR_EMU_SPI_FLASH_SIZE_DEFAULT.
+ *               Smaller images are extended with erased bytes.
+ * @return sl_avr_emu_spi_device_s* - NULL if the image could not be opened or the size is invalid
+ */
+sl_avr_emu_spi_device_s *sl_avr_emu_spi_flash_open(const char *path, size_t size);
+
+#endif //_SL_AVR_EMU_SPI_FLASH_H_
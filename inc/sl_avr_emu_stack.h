@@ -0,0 +1,68 @@
+/**
+ * @file sl_avr_emu_stack.h
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator Stack Usage Tracking Header
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#ifndef _SL_AVR_EMU_STACK_H_
+#define _SL_AVR_EMU_STACK_H_
+
+#include <stdio.h>
+
+#include "sl_avr_emu.h"
+
+/**
+ * @brief Records a new low-water mark with the stack contents above it
+ * 
+ * @param emulation
+ * @param sp        - New lowest Stack-Pointer
+ * @param pc        - Instruction that moved the Stack-Pointer
+ */
+void sl_avr_emu_stack_low_water(sl_avr_emu_emulation_s *emulation, sl_avr_emu_extended_address_t sp, sl_avr_emu_extended_address_t pc);
+
+/**
+ * @brief Checks the Stack-Pointer against the low-water mark.  Called whenever the stack grows.
+ *        Inline so that tracking stays on at the cost of a compare.
+ * 
+ * @param emulation
+ * @param sp        - Stack-Pointer after growing
+ * @param pc        - Instruction that moved the Stack-Pointer
+ */
+static inline void sl_avr_emu_stack_track(sl_avr_emu_emulation_s *emulation, sl_avr_emu_extended_address_t sp, sl_avr_emu_extended_address_t pc)
+{
+  if(sp < emulation->hooks.stack_usage.low_water)
+  {
+    sl_avr_emu_stack_low_water(emulation, sp, pc);
+  }
+}
+
+/**
+ * @brief Accounts a Stack-Pointer write.  Called when SPL or SPH is written.
+ * 
+ * @param emulation
+ * @param address   - SL_AVR_EMU_SPL_ADDRESS or SL_AVR_EMU_SPH_ADDRESS
+ * @param pc        - Instruction that wrote the Stack-Pointer
+ */
+void sl_avr_emu_stack_sp_written(sl_avr_emu_emulation_s *emulation, sl_avr_emu_address_t address, sl_avr_emu_extended_address_t pc);
+
+/**
+ * @brief Clears the low-water mark
+ * 
+ * @param emulation
+ */
+void sl_avr_emu_stack_usage_reset(sl_avr_emu_emulation_s *emulation);
+
+/**
+ * @brief Prints the deepest stack reached and the call chain that reached it, with each frame's size
+ * 
+ * @param output
+ * @param emulation
+ */
+void sl_avr_emu_stack_report(FILE *output, const sl_avr_emu_emulation_s *emulation);
+
+#endif //_SL_AVR_EMU_STACK_H_
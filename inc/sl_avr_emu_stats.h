@@ -0,0 +1,67 @@
+/**
+ * @file sl_avr_emu_stats.h
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator Instruction-Mix Statistics Header
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#ifndef _SL_AVR_EMU_STATS_H_
+#define _SL_AVR_EMU_STATS_H_
+
+#include <stdio.h>
+
+#include "sl_avr_emu.h"
+
+/**
+ * @brief Counts one dispatch of class from opcode group.  Used by the dispatch branches in sl_avr_emu_tick.c
+ * 
+ */
+#define SL_AVR_EMU_STATS_COUNT(emulation, group, class) \
+  ((emulation)->hooks.stats.dispatch[group][class]++)
+
+/**
+ * @brief Returns a printable name for an opcode class
+ * 
+ * @param opcode_class
+ * @return const char*
+ */
+const char *sl_avr_emu_opcode_class_name(sl_avr_emu_opcode_class_e opcode_class);
+
+/**
+ * @brief Returns the number of instructions dispatched of opcode_class across all groups
+ * 
+ * @param emulation
+ * @param opcode_class
+ * @return uint64_t
+ */
+uint64_t sl_avr_emu_stats_class_count(const sl_avr_emu_emulation_s *emulation, sl_avr_emu_opcode_class_e opcode_class);
+
+/**
+ * @brief Returns the number of instructions dispatched through opcode group (0-3)
+ * 
+ * @param emulation
+ * @param group
+ * @return uint64_t
+ */
+uint64_t sl_avr_emu_stats_group_count(const sl_avr_emu_emulation_s *emulation, uint32_t group);
+
+/**
+ * @brief Clears all instruction-mix counters
+ * 
+ * @param emulation
+ */
+void sl_avr_emu_stats_reset(sl_avr_emu_emulation_s *emulation);
+
+/**
+ * @brief Prints the instruction mix, hottest class first, followed by the per-group breakdown
+ * 
+ * @param output
+ * @param emulation
+ */
+void sl_avr_emu_stats_print(FILE *output, const sl_avr_emu_emulation_s *emulation);
+
+#endif //_SL_AVR_EMU_STATS_H_
@@ -39,4 +39,13 @@ sl_avr_emu_result_e sl_avr_emu_tick(sl_avr_emu_emulation_s * emulation);
  */
 sl_avr_emu_result_e sl_avr_emu_io_tick(sl_avr_emu_emulation_s * emulation);
 
+/**
+ * @brief Runs IO and CPU ticks until an error occurs or tick_limit is reached
+ * 
+ * @param emulation  - Pointer to emulation to simulate
+ * @param tick_limit - Tick count at which to stop, SL_AVR_EMU_TICK_COUNT_MAX to run until error
+ * @return sl_avr_emu_result_e
+ */
+sl_avr_emu_result_e sl_avr_emu_run(sl_avr_emu_emulation_s * emulation, sl_avr_emu_tick_count_t tick_limit);
+
 #endif //_SL_AVR_EMU_TICK_HPP_
\ No newline at end of file
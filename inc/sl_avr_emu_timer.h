@@ -1,9 +1,9 @@
 /**
  * @file sl_avr_emu_timer.h
  * @author Ed Sandor (ed@ewsandor.com)
- * @brief Sandor Labs AVR Emulator Timer/Counter Header
+ * @brief Sandor Labs AVR Emulator Timer Header
  * @version 0.1
- * @date 2020-09-07
+ * @date 2020-09-05
  * 
  * @copyright Copyright (c) 2020
  * 
@@ -29,30 +29,73 @@
 #define SL_AVR_EMU_TIMER_0_OCF0A  0x1
 #define SL_AVR_EMU_TIMER_0_OCF0B  0x2
 
+#define SL_AVR_EMU_TIMER_1_TCCR1A 0x80
+#define SL_AVR_EMU_TIMER_1_TCCR1B 0x81
+#define SL_AVR_EMU_TIMER_1_TCCR1C 0x82
+#define SL_AVR_EMU_TIMER_1_TCNT1L 0x84
+#define SL_AVR_EMU_TIMER_1_TCNT1H 0x85
+#define SL_AVR_EMU_TIMER_1_ICR1L  0x86
+#define SL_AVR_EMU_TIMER_1_ICR1H  0x87
+#define SL_AVR_EMU_TIMER_1_OCR1AL 0x88
+#define SL_AVR_EMU_TIMER_1_OCR1AH 0x89
+#define SL_AVR_EMU_TIMER_1_OCR1BL 0x8A
+#define SL_AVR_EMU_TIMER_1_OCR1BH 0x8B
+#define SL_AVR_EMU_TIMER_1_TIMSK1 0x6F
+#define SL_AVR_EMU_TIMER_1_TIFR1  0x16
+
+#define SL_AVR_EMU_TIMER_1_TOIE1  0x0
+#define SL_AVR_EMU_TIMER_1_OCIE1A 0x1
+#define SL_AVR_EMU_TIMER_1_OCIE1B 0x2
+#define SL_AVR_EMU_TIMER_1_ICIE1  0x5
+#define SL_AVR_EMU_TIMER_1_TOV1   0x0
+#define SL_AVR_EMU_TIMER_1_OCF1A  0x1
+#define SL_AVR_EMU_TIMER_1_OCF1B  0x2
+#define SL_AVR_EMU_TIMER_1_ICF1   0x5
+
+#define SL_AVR_EMU_TIMER_2_TCCR2A 0xB0
+#define SL_AVR_EMU_TIMER_2_TCCR2B 0xB1
+#define SL_AVR_EMU_TIMER_2_TCNT2  0xB2
+#define SL_AVR_EMU_TIMER_2_OCR2A  0xB3
+#define SL_AVR_EMU_TIMER_2_OCR2B  0xB4
+#define SL_AVR_EMU_TIMER_2_ASSR   0xB6
+#define SL_AVR_EMU_TIMER_2_TIMSK2 0x70
+#define SL_AVR_EMU_TIMER_2_TIFR2  0x17
+
+#define SL_AVR_EMU_TIMER_2_AS2    0x5
+#define SL_AVR_EMU_TIMER_2_TOIE2  0x0
+#define SL_AVR_EMU_TIMER_2_OCIE2A 0x1
+#define SL_AVR_EMU_TIMER_2_OCIE2B 0x2
+#define SL_AVR_EMU_TIMER_2_TOV2   0x0
+#define SL_AVR_EMU_TIMER_2_OCF2A  0x1
+#define SL_AVR_EMU_TIMER_2_OCF2B  0x2
+
+/* Watch crystal clocking timer 2 when ASSR.AS2 is set */
+#define SL_AVR_EMU_TIMER_2_ASYNC_HZ 32768
+/* CPU clock used until one is configured */
+#define SL_AVR_EMU_CLOCK_HZ_DEFAULT 16000000
+
 /**
- * @brief Checks if 8-bit timer is properly configured
+ * @brief Resets timer counters 0, 1 and 2 and hooks their registers
  * 
- * @param timer - Timer to check
- * @return true 
- * @return false 
+ * @param emulation
+ * @return sl_avr_emu_result_e
  */
-bool sl_avr_emu_timer_8_configured(sl_avr_emu_timer_8_s *timer);
+sl_avr_emu_result_e sl_avr_emu_timer_init(sl_avr_emu_emulation_s *emulation);
 
 /**
- * @brief Configures timer counter 0 registers
+ * @brief Brings a timer's counter and flags up to the current tick
  * 
- * @param memory - memory containing timer 0's register
- * @param timer  - timer to configure
- * @return sl_avr_emu_result_e 
+ * @param emulation
+ * @param timer
  */
-sl_avr_emu_result_e sl_avr_emu_configure_timer0(sl_avr_emu_memory_s * memory, sl_avr_emu_timer_8_s *timer);
+void sl_avr_emu_timer_sync(sl_avr_emu_emulation_s *emulation, sl_avr_emu_timer_s *timer);
 
 /**
- * @brief Simulates tick of 8-bit timer/counter
+ * @brief Captures timer 1 into ICR1, as on an input capture edge.  Ignored while ICR1 sets TOP.
  * 
- * @param timer Timer to simulate
- * @return sl_avr_emu_result_e 
+ * @param emulation
+ * @return sl_avr_emu_result_e
  */
-sl_avr_emu_result_e sl_avr_emu_timer_8_tick(sl_avr_emu_timer_8_s *timer);
+sl_avr_emu_result_e sl_avr_emu_timer_capture(sl_avr_emu_emulation_s *emulation);
 
-#endif //_SL_AVR_EMU_TIMER_H_
\ No newline at end of file
+#endif //_SL_AVR_EMU_TIMER_H_
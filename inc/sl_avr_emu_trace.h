@@ -0,0 +1,152 @@
+/**
+ * @file sl_avr_emu_trace.h
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator Signal Trace Header
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#ifndef _SL_AVR_EMU_TRACE_H_
+#define _SL_AVR_EMU_TRACE_H_
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+
+#include "sl_avr_emu.h"
+
+/* Value changes buffered between emulation and the writer thread, a power of 2 */
+#define SL_AVR_EMU_TRACE_RING_SIZE (1 << 16)
+/* Longest the writer thread sleeps while no changes are buffered */
+#define SL_AVR_EMU_TRACE_FLUSH_MS 1
+
+/* GPIO port registers, PINB through PORTD */
+#define SL_AVR_EMU_TRACE_GPIO_FIRST 0x23
+#define SL_AVR_EMU_TRACE_GPIO_LAST  0x2B
+
+/**
+ * @brief Traced signals
+ * 
+ */
+typedef enum
+{
+  /* GPIO registers, in data address order from SL_AVR_EMU_TRACE_GPIO_FIRST */
+  SL_AVR_EMU_TRACE_PINB,
+  SL_AVR_EMU_TRACE_DDRB,
+  SL_AVR_EMU_TRACE_PORTB,
+  SL_AVR_EMU_TRACE_PINC,
+  SL_AVR_EMU_TRACE_DDRC,
+  SL_AVR_EMU_TRACE_PORTC,
+  SL_AVR_EMU_TRACE_PIND,
+  SL_AVR_EMU_TRACE_DDRD,
+  SL_AVR_EMU_TRACE_PORTD,
+  /* Timer compare outputs, OCnA then OCnB */
+  SL_AVR_EMU_TRACE_OC0A,
+  SL_AVR_EMU_TRACE_OC0B,
+  SL_AVR_EMU_TRACE_OC1A,
+  SL_AVR_EMU_TRACE_OC1B,
+  SL_AVR_EMU_TRACE_OC2A,
+  SL_AVR_EMU_TRACE_OC2B,
+
+  SL_AVR_EMU_TRACE_SIGNAL_COUNT,
+} sl_avr_emu_trace_signal_e;
+
+/**
+ * @brief Value change
+ * 
+ */
+typedef struct
+{
+  sl_avr_emu_tick_count_t tick;
+  uint8_t                 signal;
+  sl_avr_emu_byte_t       value;
+
+} sl_avr_emu_trace_change_s;
+
+/**
+ * @brief Value change trace, written to a VCD and/or compact binary file by a writer thread
+ * 
+ * Binary format: 8 byte header (SL_AVR_EMU_TRACE_MAGIC), varint clock Hz, varint signal count,
+ *   per signal a width byte, name length byte and name, then records of
+ *   varint tick delta, signal byte, value byte.  The first records are the values at the start.
+ */
+typedef struct sl_avr_emu_trace_struct
+{
+  /* Last value of each signal, only changes are recorded */
+  sl_avr_emu_byte_t         values[SL_AVR_EMU_TRACE_SIGNAL_COUNT];
+  uint64_t                  changes;
+  /* Times emulation waited for the writer thread */
+  uint64_t                  stalls;
+
+  /* Free running counts of changes written and read, only advanced by emulation and the writer thread respectively */
+  atomic_uint_fast32_t      head;
+  atomic_uint_fast32_t      tail;
+  sl_avr_emu_trace_change_s ring[SL_AVR_EMU_TRACE_RING_SIZE];
+
+  /* Outputs, NULL if unused */
+  FILE                     *binary;
+  FILE                     *vcd;
+  uint32_t                  clock_hz;
+  /* Last tick written by the writer thread */
+  sl_avr_emu_tick_count_t   last_tick;
+  pthread_t                 thread;
+  atomic_bool               running;
+
+} sl_avr_emu_trace_s;
+
+/**
+ * @brief Starts tracing GPIO registers and compare outputs.  Emulation pauses whenever the writer falls a full ring behind.
+ * 
+ * @param emulation
+ * @param binary_path - Compact binary trace, NULL for none
+ * @param vcd_path    - Value Change Dump, NULL for none
+ * @return sl_avr_emu_result_e - SL_AVR_EMU_RESULT_INVALID_FILE_PATH if an output could not be created
+ */
+sl_avr_emu_result_e sl_avr_emu_trace_start(sl_avr_emu_emulation_s *emulation, const char *binary_path, const char *vcd_path);
+
+/**
+ * @brief Records a signal value, if it changed
+ * 
+ * @param emulation
+ * @param tick
+ * @param signal
+ * @param value
+ */
+void sl_avr_emu_trace_signal(sl_avr_emu_emulation_s *emulation, sl_avr_emu_tick_count_t tick, sl_avr_emu_trace_signal_e signal, sl_avr_emu_byte_t value);
+
+/**
+ * @brief Records the value of a data address that was changed without a firmware write, if it is traced
+ * 
+ * @param emulation
+ * @param address
+ */
+void sl_avr_emu_trace_data(sl_avr_emu_emulation_s *emulation, sl_avr_emu_address_t address);
+
+/**
+ * @brief Converts a binary trace to a Value Change Dump
+ * 
+ * @param binary
+ * @param vcd
+ * @return sl_avr_emu_result_e - SL_AVR_EMU_RESULT_INVALID_FILE_FORMAT if binary is not a trace
+ */
+sl_avr_emu_result_e sl_avr_emu_trace_convert(FILE *binary, FILE *vcd);
+
+/**
+ * @brief Prints trace counters
+ * 
+ * @param output
+ * @param emulation
+ */
+void sl_avr_emu_trace_report(FILE *output, const sl_avr_emu_emulation_s *emulation);
+
+/**
+ * @brief Stops tracing, writing out buffered changes and closing the outputs
+ * 
+ * @param emulation
+ */
+void sl_avr_emu_trace_stop(sl_avr_emu_emulation_s *emulation);
+
+#endif //_SL_AVR_EMU_TRACE_H_
@@ -0,0 +1,130 @@
+/**
+ * @file sl_avr_emu_twi.h
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator TWI Peripheral and I2C Bus Header
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#ifndef _SL_AVR_EMU_TWI_H_
+#define _SL_AVR_EMU_TWI_H_
+
+#include <stdio.h>
+
+#include "sl_avr_emu.h"
+
+/* TWI data addresses */
+#define SL_AVR_EMU_TWI_TWBR 0xB8
+#define SL_AVR_EMU_TWI_TWSR 0xB9
+#define SL_AVR_EMU_TWI_TWAR 0xBA
+#define SL_AVR_EMU_TWI_TWDR 0xBB
+#define SL_AVR_EMU_TWI_TWCR 0xBC
+
+/* TWCR bits */
+#define SL_AVR_EMU_TWI_TWINT 0x7
+#define SL_AVR_EMU_TWI_TWEA  0x6
+#define SL_AVR_EMU_TWI_TWSTA 0x5
+#define SL_AVR_EMU_TWI_TWSTO 0x4
+#define SL_AVR_EMU_TWI_TWWC  0x3
+#define SL_AVR_EMU_TWI_TWEN  0x2
+#define SL_AVR_EMU_TWI_TWIE  0x0
+/* TWSR prescaler bits, the rest is the status code */
+#define SL_AVR_EMU_TWI_TWPS_MASK   0x03
+#define SL_AVR_EMU_TWI_STATUS_MASK 0xF8
+
+/* Master status codes */
+#define SL_AVR_EMU_TWI_START        0x08
+#define SL_AVR_EMU_TWI_REP_START    0x10
+#define SL_AVR_EMU_TWI_MT_SLA_ACK   0x18
+#define SL_AVR_EMU_TWI_MT_SLA_NACK  0x20
+#define SL_AVR_EMU_TWI_MT_DATA_ACK  0x28
+#define SL_AVR_EMU_TWI_MT_DATA_NACK 0x30
+#define SL_AVR_EMU_TWI_MR_SLA_ACK   0x40
+#define SL_AVR_EMU_TWI_MR_SLA_NACK  0x48
+#define SL_AVR_EMU_TWI_MR_DATA_ACK  0x50
+#define SL_AVR_EMU_TWI_MR_DATA_NACK 0x58
+#define SL_AVR_EMU_TWI_NO_INFO      0xF8
+
+/* Devices on the bus at once */
+#define SL_AVR_EMU_TWI_DEVICES_MAX 8
+
+/**
+ * @brief Host-side device on the I2C bus.  Models embed it as their first member.
+ * 
+ */
+typedef struct sl_avr_emu_twi_device_struct
+{
+  const char        *name;
+  /* 7-bit bus address */
+  sl_avr_emu_byte_t  address;
+  /* START or repeated START followed by the device's address, returns true to acknowledge */
+  bool              (*start)(struct sl_avr_emu_twi_device_struct *device, bool read);
+  /* Byte from the master, returns true to acknowledge */
+  bool              (*write)(struct sl_avr_emu_twi_device_struct *device, sl_avr_emu_byte_t byte);
+  /* Byte to the master */
+  sl_avr_emu_byte_t (*read)(struct sl_avr_emu_twi_device_struct *device);
+  /* STOP ending a transaction with the device */
+  void              (*stop)(struct sl_avr_emu_twi_device_struct *device);
+  /* Prints device counters, may be NULL */
+  void              (*report)(FILE *output, const struct sl_avr_emu_twi_device_struct *device);
+  /* Releases the device */
+  void              (*close)(struct sl_avr_emu_twi_device_struct *device);
+
+} sl_avr_emu_twi_device_s;
+
+/**
+ * @brief TWI in master mode and the devices on its bus.  Each condition and byte completes through the event scheduler
+ *        after its SCL periods, TWINT stays clear in between.
+ * 
+ */
+typedef struct sl_avr_emu_twi_struct
+{
+  sl_avr_emu_twi_device_s *devices[SL_AVR_EMU_TWI_DEVICES_MAX];
+  uint32_t                 device_count;
+
+  uint64_t                 starts;
+  uint64_t                 bytes;
+  /* Addresses and data bytes not acknowledged */
+  uint64_t                 nacks;
+  /* TWDR writes while TWINT was clear */
+  uint64_t                 collisions;
+
+} sl_avr_emu_twi_s;
+
+/**
+ * @brief Attaches TWI to emulation
+ * 
+ * @param emulation
+ * @return sl_avr_emu_result_e
+ */
+sl_avr_emu_result_e sl_avr_emu_twi_start(sl_avr_emu_emulation_s *emulation);
+
+/**
+ * @brief Attaches a device to the bus.  The TWI owns the device from then on and closes it on stop.
+ * 
+ * @param emulation
+ * @param device
+ * @return sl_avr_emu_result_e - SL_AVR_EMU_RESULT_FAILURE if TWI is not attached, SL_AVR_EMU_TWI_DEVICES_MAX devices are,
+ *                               or a device already has the address
+ */
+sl_avr_emu_result_e sl_avr_emu_twi_attach(sl_avr_emu_emulation_s *emulation, sl_avr_emu_twi_device_s *device);
+
+/**
+ * @brief Prints bus and device counters
+ * 
+ * @param output
+ * @param emulation
+ */
+void sl_avr_emu_twi_report(FILE *output, const sl_avr_emu_emulation_s *emulation);
+
+/**
+ * @brief Closes attached devices and detaches TWI
+ * 
+ * @param emulation
+ */
+void sl_avr_emu_twi_stop(sl_avr_emu_emulation_s *emulation);
+
+#endif //_SL_AVR_EMU_TWI_H_
@@ -0,0 +1,40 @@
+/**
+ * @file sl_avr_emu_twi_eeprom.h
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator I2C EEPROM Device Header
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#ifndef _SL_AVR_EMU_TWI_EEPROM_H_
+#define _SL_AVR_EMU_TWI_EEPROM_H_
+
+#include "sl_avr_emu_twi.h"
+
+/* Bus address of the first EEPROM, with its address pins low */
+#define SL_AVR_EMU_TWI_EEPROM_ADDRESS      0x50
+/* Size of a new EEPROM image when none is given, that of a 24C256 */
+#define SL_AVR_EMU_TWI_EEPROM_SIZE_DEFAULT (32 << 10)
+/* Smallest and largest EEPROM, a 24C02 and a 24C512 */
+#define SL_AVR_EMU_TWI_EEPROM_SIZE_MIN     256
+#define SL_AVR_EMU_TWI_EEPROM_SIZE_MAX     (64 << 10)
+/* Self-timed write cycle after a STOP ending a write, the EEPROM does not acknowledge its address meanwhile */
+#define SL_AVR_EMU_TWI_EEPROM_WRITE_US     5000
+
+/**
+ * @brief Opens an EEPROM image as a 24-series I2C EEPROM.  The image is mapped, so writes reach the file without
+ *        system calls on the emulation thread.  EEPROMs over 256 bytes take two address bytes.
+ * 
+ * @param emulation   - Emulation the EEPROM is timed by
+ * @param path
+ * @param size        - EEPROM size in bytes, a power of 2.  0 to use the size of an existing image, or SL_AVR_EMU_TWI_EEPROM_SIZE_DEFAULT.
+ *                      Smaller images are extended with erased bytes.
+ * @param bus_address - 7-bit bus address
+ * @return sl_avr_emu_twi_device_s* - NULL if the image could not be opened or the size is invalid
+ */
+sl_avr_emu_twi_device_s *sl_avr_emu_twi_eeprom_open(const sl_avr_emu_emulation_s *emulation, const char *path, size_t size, sl_avr_emu_byte_t bus_address);
+
+#endif //_SL_AVR_EMU_TWI_EEPROM_H_
@@ -0,0 +1,37 @@
+/**
+ * @file sl_avr_emu_twi_sensor.h
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator I2C Sensor Device Header
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#ifndef _SL_AVR_EMU_TWI_SENSOR_H_
+#define _SL_AVR_EMU_TWI_SENSOR_H_
+
+#include "sl_avr_emu_twi.h"
+
+/* Registers of a sensor, addressed by one byte */
+#define SL_AVR_EMU_TWI_SENSOR_REGISTERS 256
+
+/**
+ * @brief Opens a sample file as an I2C sensor with the usual register interface: a write sets the register pointer
+ *        and writes registers from it, a read reads registers from it, the pointer incrementing after each byte.
+ *        Output registers hold the sample record current at the START of each read, byte for byte as in the file.
+ *        Other registers read back what was written to them.
+ * 
+ * @param emulation     - Emulation whose time indexes samples
+ * @param path
+ * @param bus_address   - 7-bit bus address
+ * @param data_register - First output register
+ * @param record_size   - Bytes per sample record, the number of output registers
+ * @param sample_hz     - Records per second of emulated time
+ * @return sl_avr_emu_twi_device_s* - NULL if the file could not be mapped or the records do not fit in the registers
+ */
+sl_avr_emu_twi_device_s *sl_avr_emu_twi_sensor_open(const sl_avr_emu_emulation_s *emulation, const char *path, sl_avr_emu_byte_t bus_address,
+                                                    sl_avr_emu_byte_t data_register, uint32_t record_size, uint32_t sample_hz);
+
+#endif //_SL_AVR_EMU_TWI_SENSOR_H_
@@ -12,6 +12,7 @@
 #ifndef _SL_AVR_EMU_TYPES_H_
 #define _SL_AVR_EMU_TYPES_H_
 
+#include <stdbool.h>
 #include <stdint.h>
 
 /**
@@ -32,6 +33,8 @@ typedef enum
   SL_AVR_EMU_RESULT_INVALID_FILE_PATH     = 9,
   SL_AVR_EMU_RESULT_INVALID_FILE_FORMAT   = 10,
   SL_AVR_EMU_RESULT_INVALID_HARDWARE      = 11,
+  SL_AVR_EMU_RESULT_WATCHPOINT            = 12,
+  SL_AVR_EMU_RESULT_BREAKPOINT            = 13,
 
 } sl_avr_emu_result_e;
 
@@ -152,6 +155,13 @@ typedef enum
  * 
  */
 #define SL_AVR_EMU_SPL_ADDRESS 0x5D
+/**
+ * @brief Reads an emulation's Stack-Pointer
+ * 
+ */
+#define SL_AVR_EMU_GET_SP(emulation) \
+  ((emulation)->memory.data[SL_AVR_EMU_SPL_ADDRESS] | \
+   (SL_AVR_EMU_EXTENDED_DATA_ADDRESS?((emulation)->memory.data[SL_AVR_EMU_SPH_ADDRESS] << 8):0))
 /**
  * @brief Extended indirect jump/call address
  * 
@@ -228,8 +238,8 @@ typedef struct
   /* Program Counter */
   sl_avr_emu_extended_address_t pc;
 
-  /* Data Memory Space */
-  sl_avr_emu_byte_t data [SL_AVR_EMU_DATA_SIZE];
+  /* Data Memory Space, SL_AVR_EMU_DATA_SIZE bytes mapped on their own pages by sl_avr_emu_init */
+  sl_avr_emu_byte_t *data;
   /* Flash Memory Space */
   sl_avr_emu_word_t flash[SL_AVR_EMU_FLASH_SIZE];
 
@@ -268,33 +278,6 @@ typedef enum
   SL_AVR_EMU_TIMER_WGM_FAST_PWM_OCRA, 
 } sl_avr_emu_timer_wgm_e;
 
-typedef uint16_t sl_avr_emu_timer_prescaler_count_t;
-
-/**
- * @brief Data for an 8-bit Timer/Counter
- * 
- */
-typedef struct
-{
-  /* Timer counter control register A */
-  sl_avr_emu_byte_t *tccra;
-  /* Timer counter control register B */
-  sl_avr_emu_byte_t *tccrb;
-  /* Timer counter register */
-  sl_avr_emu_byte_t *tcnt;
-  /* Output compare register A */
-  sl_avr_emu_byte_t *ocra;
-  /* Output compare register B */
-  sl_avr_emu_byte_t *ocrb;
-  /* Timer counter interrupt mask register */
-  sl_avr_emu_byte_t *timsk;
-  /* Timer counter interrupt flag register */
-  sl_avr_emu_byte_t *tifr;
-
-  sl_avr_emu_timer_prescaler_count_t prescaler_count;
-
-} sl_avr_emu_timer_8_s;
-
 /**
  * @brief Number of cycles related to an operation
  * 
@@ -318,15 +301,336 @@ typedef enum
  * 
  */
 typedef uint64_t sl_avr_emu_tick_count_t;
+/**
+ * @brief Largest representable tick count, used as "no limit"
+ * 
+ */
+#define SL_AVR_EMU_TICK_COUNT_MAX UINT64_MAX
 
 /**
- * @brief Main structure for an emulation
+ * @brief Timer/Counter, counted analytically between the events it schedules
  * 
  */
 typedef struct
+{
+  /* Timer number, selects the register layout */
+  uint8_t                 number;
+
+  /* Counter after the last timer clock edge accounted for, and its direction in dual-slope modes */
+  sl_avr_emu_word_t       count;
+  bool                    down;
+  /* Timer clock edge n falls on tick clock_origin + ceil(n*clock_ticks/clock_edges) */
+  sl_avr_emu_tick_count_t clock_origin;
+  uint64_t                clock_ticks;
+  uint64_t                clock_edges;
+  /* Edges since clock_origin accounted for in count */
+  uint64_t                edges;
+
+  /* Compare values in use, OCRnx writes are buffered until TOP or BOTTOM in PWM modes */
+  sl_avr_emu_word_t       ocr[2];
+  /* High byte latch of 16-bit register accesses */
+  sl_avr_emu_byte_t       temp;
+  /* Compare output levels, OCnA in bit 0 and OCnB in bit 1 */
+  sl_avr_emu_byte_t       oc;
+
+  /* Tick of the scheduled event, SL_AVR_EMU_TICK_COUNT_MAX if none */
+  sl_avr_emu_tick_count_t event_tick;
+
+} sl_avr_emu_timer_s;
+
+/**
+ * @brief USART machine state, restored with snapshots.  Host side state is in sl_avr_emu_usart_s.
+ * 
+ */
+typedef struct
+{
+  /* Received byte returned by reads of UDR0 */
+  sl_avr_emu_byte_t rx_data;
+  /* Byte written to UDR0 waiting for the shift register */
+  sl_avr_emu_byte_t tx_buffer;
+  bool              tx_buffered;
+  /* Byte being shifted out */
+  sl_avr_emu_byte_t tx_shift;
+  bool              tx_shifting;
+
+} sl_avr_emu_usart_state_s;
+
+/**
+ * @brief SPI machine state, restored with snapshots.  Attached devices are in sl_avr_emu_spi_s.
+ * 
+ */
+typedef struct
+{
+  /* Received byte returned by reads of SPDR */
+  sl_avr_emu_byte_t       rx_data;
+  /* Byte written to SPDR, shifted out by the next transfer */
+  sl_avr_emu_byte_t       shift;
+  bool                    busy;
+  bool                    master;
+  sl_avr_emu_tick_count_t done_tick;
+  /* SPSR was read with SPIF set, the next SPDR access clears SPIF and WCOL */
+  bool                    status_read;
+
+  /* In slave mode, byte from the external master and the byte shifted back to it */
+  sl_avr_emu_byte_t       slave_input;
+  sl_avr_emu_byte_t       slave_output;
+
+} sl_avr_emu_spi_state_s;
+
+/**
+ * @brief Bus condition or byte in progress
+ * 
+ */
+typedef enum
+{
+  SL_AVR_EMU_TWI_IDLE,
+  SL_AVR_EMU_TWI_SENDING_START,
+  SL_AVR_EMU_TWI_SENDING_STOP,
+  SL_AVR_EMU_TWI_SENDING_ADDRESS,
+  SL_AVR_EMU_TWI_SENDING_DATA,
+  SL_AVR_EMU_TWI_RECEIVING_DATA,
+
+} sl_avr_emu_twi_operation_e;
+
+/**
+ * @brief TWI machine state, restored with snapshots.  Devices on the bus are in sl_avr_emu_twi_s.
+ * 
+ */
+typedef struct
+{
+  sl_avr_emu_twi_operation_e operation;
+  sl_avr_emu_tick_count_t    done_tick;
+  /* Master holds the bus, between START and STOP */
+  bool                       bus_owner;
+  /* Bus address of the device that acknowledged its address, valid while addressed */
+  bool                       addressed;
+  sl_avr_emu_byte_t          target;
+
+} sl_avr_emu_twi_state_s;
+
+/**
+ * @brief ADC machine state, restored with snapshots.  The sample file is in sl_avr_emu_adc_s.
+ * 
+ */
+typedef struct
+{
+  bool                    converting;
+  /* Next conversion is the first since ADC was enabled */
+  bool                    first;
+  /* Channel latched at the start of the conversion in progress */
+  sl_avr_emu_byte_t       channel;
+  sl_avr_emu_tick_count_t hold_tick;
+  sl_avr_emu_tick_count_t done_tick;
+  /* ADCL was read and ADCH not yet, results are not written meanwhile */
+  bool                    locked;
+
+} sl_avr_emu_adc_state_s;
+
+/**
+ * @brief Forward declaration of main emulation structure
+ * 
+ */
+struct sl_avr_emu_emulation_struct;
+
+/**
+ * @brief Scheduled event callback
+ * 
+ */
+typedef sl_avr_emu_result_e (*sl_avr_emu_event_callback_f)(struct sl_avr_emu_emulation_struct *emulation, void *context);
+
+/**
+ * @brief Maximum number of simultaneously scheduled events
+ * 
+ */
+#define SL_AVR_EMU_EVENT_QUEUE_SIZE 64
+
+/**
+ * @brief Event scheduled for a given tick
+ * 
+ */
+typedef struct
+{
+  /* Tick at which the event fires */
+  sl_avr_emu_tick_count_t     tick;
+  /* Scheduling order, breaks ties between events of the same tick */
+  uint32_t                    sequence;
+  /* Callback and its context */
+  sl_avr_emu_event_callback_f callback;
+  void                       *context;
+
+} sl_avr_emu_event_s;
+
+/**
+ * @brief Tick-ordered event queue (binary min-heap)
+ * 
+ */
+typedef struct
+{
+  /* Tick of earliest event, SL_AVR_EMU_TICK_COUNT_MAX if empty */
+  sl_avr_emu_tick_count_t next_tick;
+  /* Number of scheduled events */
+  uint32_t                count;
+  /* Next sequence number */
+  uint32_t                sequence;
+  /* Heap of scheduled events */
+  sl_avr_emu_event_s      heap[SL_AVR_EMU_EVENT_QUEUE_SIZE];
+
+} sl_avr_emu_event_queue_s;
+
+/**
+ * @brief Decoded opcode classes, one per dispatch branch in sl_avr_emu_tick.c
+ * 
+ */
+typedef enum
+{
+  SL_AVR_EMU_OPCODE_CLASS_UNRECOGNIZED,
+  SL_AVR_EMU_OPCODE_CLASS_NOP,
+  SL_AVR_EMU_OPCODE_CLASS_ADD,
+  SL_AVR_EMU_OPCODE_CLASS_ADIW,
+  SL_AVR_EMU_OPCODE_CLASS_AND,
+  SL_AVR_EMU_OPCODE_CLASS_BRBS_BRBC,
+  SL_AVR_EMU_OPCODE_CLASS_BREAK,
+  SL_AVR_EMU_OPCODE_CLASS_COM,
+  SL_AVR_EMU_OPCODE_CLASS_CP_CPC,
+  SL_AVR_EMU_OPCODE_CLASS_CPI,
+  SL_AVR_EMU_OPCODE_CLASS_CPSE,
+  SL_AVR_EMU_OPCODE_CLASS_DEC,
+  SL_AVR_EMU_OPCODE_CLASS_EOR,
+  SL_AVR_EMU_OPCODE_CLASS_IN_OUT,
+  SL_AVR_EMU_OPCODE_CLASS_JMP_CALL,
+  SL_AVR_EMU_OPCODE_CLASS_LD_ST,
+  SL_AVR_EMU_OPCODE_CLASS_LDI,
+  SL_AVR_EMU_OPCODE_CLASS_LDS_STS,
+  SL_AVR_EMU_OPCODE_CLASS_LPM_ELPM,
+  SL_AVR_EMU_OPCODE_CLASS_MOV,
+  SL_AVR_EMU_OPCODE_CLASS_MOVW,
+  SL_AVR_EMU_OPCODE_CLASS_OR,
+  SL_AVR_EMU_OPCODE_CLASS_ORI,
+  SL_AVR_EMU_OPCODE_CLASS_PUSH_POP,
+  SL_AVR_EMU_OPCODE_CLASS_RET,
+  SL_AVR_EMU_OPCODE_CLASS_RETI,
+  SL_AVR_EMU_OPCODE_CLASS_RJMP_RCALL,
+  SL_AVR_EMU_OPCODE_CLASS_SBIC_SBIS,
+  SL_AVR_EMU_OPCODE_CLASS_SBIW,
+  SL_AVR_EMU_OPCODE_CLASS_SBRC_SBRS,
+  SL_AVR_EMU_OPCODE_CLASS_SEX_CLX,
+  SL_AVR_EMU_OPCODE_CLASS_SUB,
+  SL_AVR_EMU_OPCODE_CLASS_SUBI_SBCI,
+  SL_AVR_EMU_OPCODE_CLASS_COUNT,
+} sl_avr_emu_opcode_class_e;
+
+/* Number of top-level opcode groups (sl_avr_emu_opcode_0..3) */
+#define SL_AVR_EMU_OPCODE_GROUP_COUNT 4
+
+/**
+ * @brief Instruction-mix counters
+ * 
+ */
+typedef struct
+{
+  /* Instructions dispatched per opcode group and class */
+  uint64_t dispatch[SL_AVR_EMU_OPCODE_GROUP_COUNT][SL_AVR_EMU_OPCODE_CLASS_COUNT];
+  /* Register poll loops fast-forwarded and the ticks skipped, their instructions are still counted in dispatch */
+  uint64_t idle_skips;
+  uint64_t idle_ticks;
+
+} sl_avr_emu_stats_s;
+
+/* Bytes below the stack top kept from the deepest stack, for unwinding it later */
+#define SL_AVR_EMU_STACK_TRACE_SIZE 2048
+
+/**
+ * @brief Stack usage high-water mark
+ * 
+ */
+typedef struct
+{
+  /* Highest Stack-Pointer set by firmware */
+  sl_avr_emu_extended_address_t top;
+  /* Lowest Stack-Pointer reached, SL_AVR_EMU_DATA_SIZE until the stack is used */
+  sl_avr_emu_extended_address_t low_water;
+  /* Instruction and tick that reached the low-water mark */
+  sl_avr_emu_extended_address_t low_water_pc;
+  sl_avr_emu_tick_count_t       low_water_tick;
+
+  /* Stack contents above the low-water mark when it was reached */
+  uint32_t                      trace_size;
+  sl_avr_emu_byte_t             trace[SL_AVR_EMU_STACK_TRACE_SIZE];
+
+} sl_avr_emu_stack_usage_s;
+
+/**
+ * @brief Host-side attachments to an emulation (tooling, instrumentation).
+ *        Not part of the emulated machine state, so snapshots neither save nor restore them.
+ * 
+ */
+typedef struct
+{
+  /* Fuzzing edge coverage map, NULL when not fuzzing */
+  sl_avr_emu_byte_t            *fuzz_edge_map;
+  /* Previous PC for fuzzing edge coverage */
+  sl_avr_emu_extended_address_t fuzz_prev_pc;
+
+  /* Stimulus recorder/player, NULL if neither recording nor replaying */
+  struct sl_avr_emu_replay_struct *replay;
+  /* Reverse execution checkpoints and stimulus history, NULL when not reverse executing */
+  struct sl_avr_emu_reverse_struct *reverse;
+  /* Consumer of serial receive stimuli */
+  sl_avr_emu_result_e (*serial_rx_handler)(struct sl_avr_emu_emulation_struct *emulation, sl_avr_emu_address_t port, sl_avr_emu_byte_t byte, void *context);
+  void                            *serial_rx_context;
+  /* Consumer of transmitted serial bytes in place of the host connection, NULL if none */
+  sl_avr_emu_result_e (*serial_tx_handler)(struct sl_avr_emu_emulation_struct *emulation, sl_avr_emu_address_t port, sl_avr_emu_byte_t byte, void *context);
+  void                            *serial_tx_context;
+
+  /* Per-PC profile, NULL when not profiling */
+  struct sl_avr_emu_profile_struct *profile;
+  /* Call-graph profile, NULL when not profiling calls */
+  struct sl_avr_emu_callgraph_struct *callgraph;
+  /* Interrupt latency instrumentation, NULL when not measuring */
+  struct sl_avr_emu_latency_struct *latency;
+  /* Executed code bitmap, NULL when not measuring coverage */
+  struct sl_avr_emu_coverage_struct *coverage;
+  /* Data access counters and watch ranges, NULL when neither is in use */
+  struct sl_avr_emu_watch_struct *watch;
+  /* Breakpoints patched into flash, NULL when none are set */
+  struct sl_avr_emu_breakpoints_struct *breakpoints;
+  /* Watch ranges enforced by host page protection, NULL when none are set */
+  struct sl_avr_emu_guard_struct *guard;
+  /* Peripheral register access hooks, NULL when no register is hooked */
+  struct sl_avr_emu_io_struct *io;
+  /* USART0 and its host connection, NULL when not attached */
+  struct sl_avr_emu_usart_struct *usart0;
+  /* SPI and its attached devices, NULL when not attached */
+  struct sl_avr_emu_spi_struct *spi;
+  /* TWI and the devices on its bus, NULL when not attached */
+  struct sl_avr_emu_twi_struct *twi;
+  /* ADC fed from a sample file, NULL when not attached */
+  struct sl_avr_emu_adc_struct *adc;
+  /* Compare output edge recorder, NULL when not recording */
+  struct sl_avr_emu_waveform_struct *waveform;
+  /* GPIO and compare output value change trace, NULL when not tracing */
+  struct sl_avr_emu_trace_struct *trace;
+
+  /* Firmware symbol index for reporting, NULL if the firmware has no symbols */
+  const struct sl_avr_emu_symbols_struct *symbols;
+
+  /* Instruction-mix counters, always maintained */
+  sl_avr_emu_stats_s stats;
+  /* Stack high-water mark, always maintained */
+  sl_avr_emu_stack_usage_s stack_usage;
+
+} sl_avr_emu_hooks_s;
+
+/**
+ * @brief Main structure for an emulation
+ * 
+ */
+typedef struct sl_avr_emu_emulation_struct
 {
   /* AVR Instruction Set Version */
   sl_avr_emu_version_e  version;
+  /* CPU clock in Hz, relates ticks to time for clocks not derived from it */
+  uint32_t              clock_hz;
   
   /* Emulation Memory */
   sl_avr_emu_memory_s   memory;
@@ -339,9 +643,28 @@ typedef struct
   sl_avr_emu_tick_count_t tick_count;
   /* Number of IO ticks emulated */
   sl_avr_emu_tick_count_t io_tick_count;
-
-  /* Timer Counter 0 */
-  sl_avr_emu_timer_8_s timer0;
+  /* Tick limit of the sl_avr_emu_run in progress, 0 outside of it.  Idle skipping stops short of it. */
+  sl_avr_emu_tick_count_t tick_limit;
+
+  /* Scheduled events */
+  sl_avr_emu_event_queue_s events;
+
+  /* Timer Counters */
+  sl_avr_emu_timer_s timer0;
+  sl_avr_emu_timer_s timer1;
+  sl_avr_emu_timer_s timer2;
+
+  /* USART0, idle unless sl_avr_emu_usart_start attached it */
+  sl_avr_emu_usart_state_s usart0;
+  /* SPI, idle unless sl_avr_emu_spi_start attached it */
+  sl_avr_emu_spi_state_s   spi;
+  /* TWI, idle unless sl_avr_emu_twi_start attached it */
+  sl_avr_emu_twi_state_s   twi;
+  /* ADC, idle unless sl_avr_emu_adc_start attached it */
+  sl_avr_emu_adc_state_s   adc;
+
+  /* Host-side attachments.  Must remain the last member, see sl_avr_emu_snapshot.c */
+  sl_avr_emu_hooks_s hooks;
 
 } sl_avr_emu_emulation_s;
 
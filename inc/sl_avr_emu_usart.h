@@ -0,0 +1,154 @@
+/**
+ * @file sl_avr_emu_usart.h
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator USART Header
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#ifndef _SL_AVR_EMU_USART_H_
+#define _SL_AVR_EMU_USART_H_
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+
+#include "sl_avr_emu.h"
+
+/* USART0 data addresses */
+#define SL_AVR_EMU_USART_0_UCSR0A 0xC0
+#define SL_AVR_EMU_USART_0_UCSR0B 0xC1
+#define SL_AVR_EMU_USART_0_UCSR0C 0xC2
+#define SL_AVR_EMU_USART_0_UBRR0L 0xC4
+#define SL_AVR_EMU_USART_0_UBRR0H 0xC5
+#define SL_AVR_EMU_USART_0_UDR0   0xC6
+
+/* UCSR0A bits */
+#define SL_AVR_EMU_USART_0_RXC0   0x7
+#define SL_AVR_EMU_USART_0_TXC0   0x6
+#define SL_AVR_EMU_USART_0_UDRE0  0x5
+#define SL_AVR_EMU_USART_0_FE0    0x4
+#define SL_AVR_EMU_USART_0_DOR0   0x3
+#define SL_AVR_EMU_USART_0_UPE0   0x2
+#define SL_AVR_EMU_USART_0_U2X0   0x1
+#define SL_AVR_EMU_USART_0_MPCM0  0x0
+/* UCSR0B bits */
+#define SL_AVR_EMU_USART_0_RXCIE0 0x7
+#define SL_AVR_EMU_USART_0_TXCIE0 0x6
+#define SL_AVR_EMU_USART_0_UDRIE0 0x5
+#define SL_AVR_EMU_USART_0_RXEN0  0x4
+#define SL_AVR_EMU_USART_0_TXEN0  0x3
+#define SL_AVR_EMU_USART_0_UCSZ02 0x2
+/* UCSR0C bits */
+#define SL_AVR_EMU_USART_0_UPM01  0x5
+#define SL_AVR_EMU_USART_0_USBS0  0x3
+#define SL_AVR_EMU_USART_0_UCSZ01 0x2
+#define SL_AVR_EMU_USART_0_UCSZ00 0x1
+
+/* Serial port number of USART0 in SL_AVR_EMU_STIMULUS_SERIAL_RX stimuli */
+#define SL_AVR_EMU_USART_0_PORT 0
+
+/* Bytes buffered in each direction between emulation and host, a power of 2 */
+#define SL_AVR_EMU_USART_RING_SIZE (1 << 16)
+/* Longest the host thread waits before moving transmitted bytes to the host */
+#define SL_AVR_EMU_USART_FLUSH_MS 1
+
+/**
+ * @brief Single-producer single-consumer byte ring between the emulation and the host thread
+ * 
+ */
+typedef struct
+{
+  /* Free running counts of bytes written and read, only advanced by the producer and consumer respectively */
+  atomic_uint_fast32_t head;
+  atomic_uint_fast32_t tail;
+  sl_avr_emu_byte_t    buffer[SL_AVR_EMU_USART_RING_SIZE];
+
+} sl_avr_emu_usart_ring_s;
+
+/**
+ * @brief USART model connected to host file descriptors
+ * 
+ */
+typedef struct sl_avr_emu_usart_struct
+{
+  /* Host file descriptors, -1 if unused */
+  int                     input_fd;
+  int                     output_fd;
+  /* Descriptors opened by sl_avr_emu_usart_open, closed on stop */
+  int                     owned_fds[2];
+  /* False for regular files, which epoll does not support and which never block */
+  bool                    input_pollable;
+  /* Input stopped being read, at end of file or while the receive ring is full */
+  bool                    input_eof;
+  bool                    input_paused;
+  int                     epoll_fd;
+  pthread_t               thread;
+  atomic_bool             running;
+
+  /* Host to firmware, filled by the host thread */
+  sl_avr_emu_usart_ring_s rx;
+  /* Firmware to host, drained by the host thread */
+  sl_avr_emu_usart_ring_s tx;
+
+  uint64_t                rx_bytes;
+  uint64_t                tx_bytes;
+  /* Bytes received while RXC0 was still set */
+  uint64_t                rx_overruns;
+  /* Bytes transmitted while the transmit ring was full */
+  uint64_t                tx_dropped;
+
+} sl_avr_emu_usart_s;
+
+/**
+ * @brief Attaches USART0 to emulation, bridging it to host file descriptors through a host thread.
+ *        Firmware never waits on the host, bytes the host is too slow to take are dropped.
+ *        Without descriptors no thread is started, bytes only move through the serial handlers.
+ * 
+ * @param emulation
+ * @param input_fd  - Descriptor received bytes are read from, -1 for none
+ * @param output_fd - Descriptor transmitted bytes are written to, -1 for none
+ * @return sl_avr_emu_result_e
+ */
+sl_avr_emu_result_e sl_avr_emu_usart_start(sl_avr_emu_emulation_s *emulation, int input_fd, int output_fd);
+
+/**
+ * @brief Attaches USART0 to emulation, bridging it to a host endpoint
+ * 
+ * @param emulation
+ * @param endpoint  - "-" for stdin and stdout, "pty" for a new pseudo-terminal, else a path to a FIFO, tty or file
+ * @return sl_avr_emu_result_e - SL_AVR_EMU_RESULT_INVALID_FILE_PATH if endpoint could not be opened
+ */
+sl_avr_emu_result_e sl_avr_emu_usart_open(sl_avr_emu_emulation_s *emulation, const char *endpoint);
+
+/**
+ * @brief Receives a byte on USART0, as if its frame just completed.
+ *        Serial receive stimuli for SL_AVR_EMU_USART_0_PORT arrive here.
+ * 
+ * @param emulation
+ * @param port      - Serial port number, bytes for other ports are ignored
+ * @param byte
+ * @param context   - USART state
+ * @return sl_avr_emu_result_e
+ */
+sl_avr_emu_result_e sl_avr_emu_usart_receive(sl_avr_emu_emulation_s *emulation, sl_avr_emu_address_t port, sl_avr_emu_byte_t byte, void *context);
+
+/**
+ * @brief Prints USART0 byte counts
+ * 
+ * @param output
+ * @param emulation
+ */
+void sl_avr_emu_usart_report(FILE *output, const sl_avr_emu_emulation_s *emulation);
+
+/**
+ * @brief Flushes transmitted bytes to the host, stops the host thread and detaches USART0
+ * 
+ * @param emulation
+ */
+void sl_avr_emu_usart_stop(sl_avr_emu_emulation_s *emulation);
+
+#endif //_SL_AVR_EMU_USART_H_
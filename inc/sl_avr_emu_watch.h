@@ -0,0 +1,215 @@
+/**
+ * @file sl_avr_emu_watch.h
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator Data Access Heatmap and Watch Header
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#ifndef _SL_AVR_EMU_WATCH_H_
+#define _SL_AVR_EMU_WATCH_H_
+
+#include <stdio.h>
+
+#include "sl_avr_emu.h"
+
+/* Watch ranges per emulation */
+#define SL_AVR_EMU_WATCH_MAX 8
+/* Bytes per heatmap region for addresses without a data symbol */
+#define SL_AVR_EMU_WATCH_REGION_SIZE 16
+
+/**
+ * @brief Access kinds a watch triggers on
+ * 
+ */
+typedef enum
+{
+  SL_AVR_EMU_WATCH_READ       = 0x1,
+  SL_AVR_EMU_WATCH_WRITE      = 0x2,
+  SL_AVR_EMU_WATCH_READ_WRITE = 0x3,
+
+} sl_avr_emu_watch_access_e;
+
+/**
+ * @brief Watch callback, called after the access' instruction completes
+ * 
+ * @param emulation
+ * @param address   - Data address accessed
+ * @param write     - True for writes
+ * @param context
+ * @return sl_avr_emu_result_e - Anything but SL_AVR_EMU_RESULT_SUCCESS stops emulation with that result
+ */
+typedef sl_avr_emu_result_e (*sl_avr_emu_watch_callback_f)(sl_avr_emu_emulation_s *emulation, sl_avr_emu_address_t address, bool write, void *context);
+
+/**
+ * @brief Watched data address range
+ * 
+ */
+typedef struct
+{
+  /* [start, end) data addresses */
+  sl_avr_emu_extended_address_t start;
+  sl_avr_emu_extended_address_t end;
+  sl_avr_emu_watch_access_e     access;
+  /* NULL to stop emulation with SL_AVR_EMU_RESULT_WATCHPOINT */
+  sl_avr_emu_watch_callback_f   callback;
+  void                         *context;
+
+} sl_avr_emu_watch_range_s;
+
+/**
+ * @brief Data access counters and watch ranges
+ * 
+ */
+typedef struct sl_avr_emu_watch_struct
+{
+  /* Accesses to each data address */
+  uint64_t                      reads[SL_AVR_EMU_DATA_SIZE];
+  uint64_t                      writes[SL_AVR_EMU_DATA_SIZE];
+
+  sl_avr_emu_watch_range_s      ranges[SL_AVR_EMU_WATCH_MAX];
+  uint32_t                      range_count;
+  /* Union of all ranges, so accesses outside every range are rejected with two compares */
+  sl_avr_emu_extended_address_t range_start;
+  sl_avr_emu_extended_address_t range_end;
+
+  /* Watch hits waiting for their instruction to complete */
+  bool                          triggered;
+  sl_avr_emu_address_t          trigger_address;
+  bool                          trigger_write;
+  uint32_t                      trigger_range;
+  /* Instruction that made the last hit */
+  sl_avr_emu_extended_address_t trigger_pc;
+
+} sl_avr_emu_watch_s;
+
+/**
+ * @brief Attaches new access counters, without watch ranges, to emulation
+ * 
+ * @param emulation
+ * @return sl_avr_emu_result_e
+ */
+sl_avr_emu_result_e sl_avr_emu_watch_start(sl_avr_emu_emulation_s *emulation);
+
+/**
+ * @brief Adds a watch range.  Attaches access counters first if needed.
+ * 
+ * @param emulation
+ * @param start     - First data address watched
+ * @param size      - Bytes watched
+ * @param access    - Access kinds to trigger on
+ * @param callback  - NULL to stop emulation on a hit
+ * @param context   - Passed to callback
+ * @return sl_avr_emu_result_e - SL_AVR_EMU_RESULT_FAILURE if SL_AVR_EMU_WATCH_MAX ranges are already watched
+ */
+sl_avr_emu_result_e sl_avr_emu_watch_add(sl_avr_emu_emulation_s *emulation, sl_avr_emu_extended_address_t start, uint32_t size,
+                                         sl_avr_emu_watch_access_e access, sl_avr_emu_watch_callback_f callback, void *context);
+
+/**
+ * @brief Removes the watch range added with the same start, size and access
+ * 
+ * @param emulation
+ * @param start
+ * @param size
+ * @param access
+ * @return sl_avr_emu_result_e - SL_AVR_EMU_RESULT_FAILURE if no such range is watched
+ */
+sl_avr_emu_result_e sl_avr_emu_watch_remove(sl_avr_emu_emulation_s *emulation, sl_avr_emu_extended_address_t start, uint32_t size,
+                                            sl_avr_emu_watch_access_e access);
+
+/**
+ * @brief Removes all watch ranges, leaving the access counters attached
+ * 
+ * @param emulation
+ */
+void sl_avr_emu_watch_clear(sl_avr_emu_emulation_s *emulation);
+
+/**
+ * @brief Accounts a data access and checks it against watch ranges
+ * 
+ * @param emulation
+ * @param address   - Data address
+ * @param write     - True for writes
+ */
+static inline void sl_avr_emu_watch_access(sl_avr_emu_emulation_s *emulation, sl_avr_emu_extended_address_t address, bool write)
+{
+  sl_avr_emu_watch_s *watch = emulation->hooks.watch;
+  uint32_t            i;
+
+  if(!SL_AVR_EMU_DATA_ADDRESS_VALID(address))
+  {
+    return;
+  }
+  if(write)
+  {
+    watch->writes[address]++;
+  }
+  else
+  {
+    watch->reads[address]++;
+  }
+
+  if(address >= watch->range_start && address < watch->range_end)
+  {
+    for(i = 0; i < watch->range_count; i++)
+    {
+      if(address >= watch->ranges[i].start && address < watch->ranges[i].end &&
+         0 != (watch->ranges[i].access & (write?SL_AVR_EMU_WATCH_WRITE:SL_AVR_EMU_WATCH_READ)))
+      {
+        watch->triggered       = true;
+        watch->trigger_address = address;
+        watch->trigger_write   = write;
+        watch->trigger_range   = i;
+        break;
+      }
+    }
+  }
+}
+
+/**
+ * @brief Accounts the stack accesses of pushing or popping bytes at the current stack pointer
+ * 
+ * @param emulation
+ * @param bytes     - Bytes pushed or popped
+ * @param push      - True for pushes, which write, else pops, which read
+ */
+void sl_avr_emu_watch_stack(sl_avr_emu_emulation_s *emulation, uint32_t bytes, bool push);
+
+/**
+ * @brief Accounts the data accesses the instruction at PC is about to make.  Called before each instruction when
+ *        access counters are attached, so the instruction handlers themselves never test for counters.
+ * 
+ * @param emulation
+ */
+void sl_avr_emu_watch_instruction(sl_avr_emu_emulation_s *emulation);
+
+/**
+ * @brief Runs the callback of a watch hit made by the instruction that just completed.
+ *        Called after each instruction when access counters are attached.
+ * 
+ * @param emulation
+ * @param pc        - Instruction that just completed
+ * @return sl_avr_emu_result_e - SL_AVR_EMU_RESULT_WATCHPOINT for hits on ranges without a callback
+ */
+sl_avr_emu_result_e sl_avr_emu_watch_check(sl_avr_emu_emulation_s *emulation, sl_avr_emu_extended_address_t pc);
+
+/**
+ * @brief Prints reads and writes of the top_n most accessed data symbols, or fixed size regions without symbols
+ * 
+ * @param output
+ * @param emulation
+ * @param top_n
+ */
+void sl_avr_emu_watch_report(FILE *output, const sl_avr_emu_emulation_s *emulation, uint32_t top_n);
+
+/**
+ * @brief Detaches and frees emulation's access counters and watch ranges
+ * 
+ * @param emulation
+ */
+void sl_avr_emu_watch_stop(sl_avr_emu_emulation_s *emulation);
+
+#endif //_SL_AVR_EMU_WATCH_H_
@@ -0,0 +1,133 @@
+/**
+ * @file sl_avr_emu_waveform.h
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator Compare Output Waveform Header
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#ifndef _SL_AVR_EMU_WAVEFORM_H_
+#define _SL_AVR_EMU_WAVEFORM_H_
+
+#include <stdio.h>
+
+#include "sl_avr_emu.h"
+
+/* Compare outputs, OCnA is pin n*2 and OCnB pin n*2 + 1 */
+#define SL_AVR_EMU_WAVEFORM_PIN_COUNT 6
+
+/**
+ * @brief Compare output level change
+ * 
+ */
+typedef struct
+{
+  sl_avr_emu_tick_count_t tick;
+  uint8_t                 pin;
+  bool                    level;
+
+} sl_avr_emu_waveform_edge_s;
+
+/**
+ * @brief Compare output levels recorded as they change, in tick order
+ * 
+ */
+typedef struct sl_avr_emu_waveform_struct
+{
+  sl_avr_emu_waveform_edge_s *edges;
+  uint64_t                    edge_count;
+  uint64_t                    edge_capacity;
+  /* Edges lost to allocation failures */
+  uint64_t                    dropped;
+
+  /* Levels when recording started */
+  sl_avr_emu_tick_count_t     start_tick;
+  bool                        initial[SL_AVR_EMU_WAVEFORM_PIN_COUNT];
+
+} sl_avr_emu_waveform_s;
+
+/**
+ * @brief Period, duty cycle and jitter of one compare output.
+ *        Periods run from rising edge to rising edge, times are in ticks.
+ * 
+ */
+typedef struct
+{
+  uint64_t edges;
+  uint64_t periods;
+
+  double   period_mean;
+  uint64_t period_min;
+  uint64_t period_max;
+  /* Standard deviation of the period */
+  double   period_stddev;
+  double   frequency_hz;
+
+  /* High time over period */
+  double   duty_mean;
+  double   duty_min;
+  double   duty_max;
+
+} sl_avr_emu_waveform_analysis_s;
+
+/**
+ * @brief Compare output names, indexed by pin
+ * 
+ */
+extern const char *const sl_avr_emu_waveform_pin_names[SL_AVR_EMU_WAVEFORM_PIN_COUNT];
+
+/**
+ * @brief Attaches a new waveform recorder to emulation, starting from the current compare output levels
+ * 
+ * @param emulation
+ * @return sl_avr_emu_result_e
+ */
+sl_avr_emu_result_e sl_avr_emu_waveform_start(sl_avr_emu_emulation_s *emulation);
+
+/**
+ * @brief Records a compare output level change.  Called by the timers.
+ * 
+ * @param emulation
+ * @param tick      - Tick of the timer clock edge that changed the output
+ * @param pin
+ * @param level
+ */
+void sl_avr_emu_waveform_edge(sl_avr_emu_emulation_s *emulation, sl_avr_emu_tick_count_t tick, uint8_t pin, bool level);
+
+/**
+ * @brief Computes period, duty cycle and jitter of a compare output from its recorded edges
+ * 
+ * @param emulation
+ * @param pin
+ * @param analysis
+ */
+void sl_avr_emu_waveform_analyze(const sl_avr_emu_emulation_s *emulation, uint8_t pin, sl_avr_emu_waveform_analysis_s *analysis);
+
+/**
+ * @brief Prints the analysis of each compare output that changed
+ * 
+ * @param output
+ * @param emulation
+ */
+void sl_avr_emu_waveform_report(FILE *output, const sl_avr_emu_emulation_s *emulation);
+
+/**
+ * @brief Writes the recorded edges as a Value Change Dump, in picoseconds at the emulation clock
+ * 
+ * @param output
+ * @param emulation
+ * @return sl_avr_emu_result_e
+ */
+sl_avr_emu_result_e sl_avr_emu_waveform_write_vcd(FILE *output, const sl_avr_emu_emulation_s *emulation);
+
+/**
+ * @brief Detaches and frees emulation's waveform recorder
+ * 
+ * @param emulation
+ */
+void sl_avr_emu_waveform_stop(sl_avr_emu_emulation_s *emulation);
+
+#endif //_SL_AVR_EMU_WAVEFORM_H_
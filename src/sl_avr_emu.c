@@ -10,15 +10,24 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 
 #include "sl_avr_emu.h"
+#include "sl_avr_emu_event.h"
+#include "sl_avr_emu_stack.h"
 #include "sl_avr_emu_timer.h"
-#include "sl_avr_emu_hex.h"
 
 /* Global flag to enable/disable verbose logging */
 bool sl_avr_emu_verbose_logging_enabled = false;
 
+/**
+ * @brief Initializes an emulation to its reset state
+ * 
+ * @param emulation 
+ * @return sl_avr_emu_result_e 
+ */
 sl_avr_emu_result_e sl_avr_emu_init(sl_avr_emu_emulation_s *emulation)
 {
   printf("Initializing AVR Emulation\n");
@@ -27,58 +36,37 @@ sl_avr_emu_result_e sl_avr_emu_init(sl_avr_emu_emulation_s *emulation)
 
   memset(emulation, 0, sizeof(sl_avr_emu_emulation_s));
 
-  printf("Initializing Timer 0\n");
-  result = sl_avr_emu_configure_timer0(&emulation->memory, &emulation->timer0);
-
-  return result;
-}
+  /* Data memory gets pages of its own so they can be protected for guard watches */
+  emulation->memory.data = mmap(NULL, SL_AVR_EMU_DATA_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if(MAP_FAILED == emulation->memory.data)
+  {
+    emulation->memory.data = NULL;
+    return SL_AVR_EMU_RESULT_FAILURE;
+  }
 
-int main(int argc, char *argv[])
-{
-  uint32_t i;
-  sl_avr_emu_result_e    result = SL_AVR_EMU_RESULT_SUCCESS;
-  sl_avr_emu_emulation_s emulation;
+  sl_avr_emu_event_init(emulation);
+  sl_avr_emu_stack_usage_reset(emulation);
 
-  sl_avr_emu_init(&emulation);
+  emulation->clock_hz = SL_AVR_EMU_CLOCK_HZ_DEFAULT;
 
-  for(i = 1; i < argc; i++)
-  {
-    if(strcmp(argv[i],"-v") == 0)
-    {
-      printf("Verbose logging enabled.\n");
-      sl_avr_emu_verbose_logging_enabled = true;
-    }
-    else if(strcmp(argv[i],"-h") == 0)
-    {
-      if((i+1) < argc)
-      {
-        result = sl_avr_emu_load_hex(&emulation, argv[i+1]);
+  printf("Initializing Timers\n");
+  result = sl_avr_emu_timer_init(emulation);
 
-        if(result != SL_AVR_EMU_RESULT_SUCCESS)
-        {
-          fprintf(stderr, "Error! Failed to load hex %u at %s\n", result, argv[2]);
-          return result;
-        }
-      }
-    }
-  }
+  return result;
+}
 
-  while(SL_AVR_EMU_RESULT_SUCCESS == result)
+/**
+ * @brief Releases an emulation's data memory and register hooks.  Guard pages must be stopped first.
+ * 
+ * @param emulation 
+ */
+void sl_avr_emu_deinit(sl_avr_emu_emulation_s *emulation)
+{
+  if(emulation->memory.data != NULL)
   {
-    result = sl_avr_emu_io_tick(&emulation);
-    if(result != SL_AVR_EMU_RESULT_SUCCESS)
-    {
-      fprintf(stderr, "Error! IO Tick result %u\n", result);
-    }
-    else
-    {
-      result = sl_avr_emu_tick(&emulation);
-      if(result != SL_AVR_EMU_RESULT_SUCCESS)
-      {
-        fprintf(stderr, "Error! Tick result %u\n", result);
-      }
-    }
+    munmap(emulation->memory.data, SL_AVR_EMU_DATA_SIZE);
+    emulation->memory.data = NULL;
   }
-
-  return result;
-}
\ No newline at end of file
+  free(emulation->hooks.io);
+  emulation->hooks.io = NULL;
+}
@@ -0,0 +1,322 @@
+/**
+ * @file sl_avr_emu_adc.c
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator ADC Peripheral Logic
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ * A conversion is one scheduled event at its end.  The input is looked up in the mapped sample file at the
+ * tick of sample and hold, so results depend only on emulated time.  Free running mode schedules the next
+ * conversion from the completion of the last, with no work between them.  Conversion state lives in the
+ * emulation structure, so snapshots restore it with the event.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sl_avr_emu_adc.h"
+#include "sl_avr_emu_bitops.h"
+#include "sl_avr_emu_event.h"
+#include "sl_avr_emu_idle.h"
+#include "sl_avr_emu_io.h"
+
+/**
+ * @brief Input of a channel in one record
+ * 
+ * @param channel
+ * @param record
+ * @return uint32_t - 16-bit full scale
+ */
+static uint32_t sl_avr_emu_adc_input(sl_avr_emu_byte_t channel, const sl_avr_emu_byte_t *record)
+{
+  return record[2 * channel] | (record[2 * channel + 1] << 8);
+}
+
+/**
+ * @brief Input of the latched channel at the sample and hold tick
+ * 
+ * @param emulation
+ * @param adc
+ * @return uint32_t - 16-bit full scale
+ */
+static uint32_t sl_avr_emu_adc_sample(const sl_avr_emu_emulation_s *emulation, sl_avr_emu_adc_s *adc)
+{
+  uint64_t index;
+  uint32_t fraction;
+  uint32_t before;
+  uint32_t after;
+
+  if(emulation->adc.channel >= adc->channels)
+  {
+    return 0;
+  }
+
+  index  = sl_avr_emu_samples_index(&adc->samples, emulation->adc.hold_tick, emulation->clock_hz, &fraction);
+  before = sl_avr_emu_adc_input(emulation->adc.channel, sl_avr_emu_samples_record(&adc->samples, index));
+  if(SL_AVR_EMU_ADC_INTERPOLATION_HOLD == adc->interpolation || index + 1 >= adc->samples.record_count)
+  {
+    return before;
+  }
+
+  after = sl_avr_emu_adc_input(emulation->adc.channel, sl_avr_emu_samples_record(&adc->samples, index + 1));
+  if(SL_AVR_EMU_ADC_INTERPOLATION_NEAREST == adc->interpolation)
+  {
+    return (fraction < (1 << 15))?before:after;
+  }
+
+  return (uint32_t) ((int32_t) before + (((int32_t) after - (int32_t) before) * (int64_t) fraction) / (1 << 16));
+}
+
+static sl_avr_emu_result_e sl_avr_emu_adc_done_event(sl_avr_emu_emulation_s *emulation, void *context);
+
+/**
+ * @brief Starts a conversion on the channel selected in ADMUX
+ * 
+ * @param emulation
+ * @param adc
+ */
+static void sl_avr_emu_adc_convert(sl_avr_emu_emulation_s *emulation, sl_avr_emu_adc_s *adc)
+{
+  const sl_avr_emu_byte_t *data      = emulation->memory.data;
+  const sl_avr_emu_byte_t  adps      = data[SL_AVR_EMU_ADC_ADCSRA] & SL_AVR_EMU_ADC_ADPS_MASK;
+  /* ADPS 0 divides by 2 as ADPS 1 does */
+  const uint32_t           prescaler = 1 << ((0 == adps)?1:adps);
+
+  emulation->adc.converting = true;
+  emulation->adc.channel    = data[SL_AVR_EMU_ADC_ADMUX] & SL_AVR_EMU_ADC_MUX_MASK;
+  emulation->adc.hold_tick  = emulation->tick_count + prescaler * (emulation->adc.first?SL_AVR_EMU_ADC_FIRST_HOLD_HALF_CLOCKS:SL_AVR_EMU_ADC_HOLD_HALF_CLOCKS) / 2;
+  emulation->adc.done_tick  = emulation->tick_count + prescaler * (emulation->adc.first?SL_AVR_EMU_ADC_FIRST_CONVERSION_CLOCKS:SL_AVR_EMU_ADC_CONVERSION_CLOCKS);
+  emulation->adc.first      = false;
+  sl_avr_emu_event_schedule(emulation, emulation->adc.done_tick, sl_avr_emu_adc_done_event, adc);
+}
+
+/**
+ * @brief Conversion complete event.  Writes the result unless ADCL is locked, sets ADIF, and starts the next conversion when free running.
+ * 
+ * @param emulation
+ * @param context   - ADC state
+ * @return sl_avr_emu_result_e
+ */
+static sl_avr_emu_result_e sl_avr_emu_adc_done_event(sl_avr_emu_emulation_s *emulation, void *context)
+{
+  sl_avr_emu_adc_s  *adc  = context;
+  sl_avr_emu_byte_t *data = emulation->memory.data;
+  const uint32_t     code = sl_avr_emu_adc_sample(emulation, adc) >> 6;
+
+  if(emulation->adc.locked)
+  {
+    adc->lost++;
+  }
+  else if(SL_AVR_EMU_CHECK_BIT(data[SL_AVR_EMU_ADC_ADMUX], SL_AVR_EMU_ADC_ADLAR))
+  {
+    data[SL_AVR_EMU_ADC_ADCH] = code >> 2;
+    data[SL_AVR_EMU_ADC_ADCL] = (code & 0x3) << 6;
+  }
+  else
+  {
+    data[SL_AVR_EMU_ADC_ADCH] = code >> 8;
+    data[SL_AVR_EMU_ADC_ADCL] = code & 0xFF;
+  }
+  SL_AVR_EMU_SET_BIT(data[SL_AVR_EMU_ADC_ADCSRA], SL_AVR_EMU_ADC_ADIF);
+  adc->conversions++;
+
+  if(SL_AVR_EMU_CHECK_BIT(data[SL_AVR_EMU_ADC_ADCSRA], SL_AVR_EMU_ADC_ADATE) && 0 == (data[SL_AVR_EMU_ADC_ADCSRB] & SL_AVR_EMU_ADC_ADTS_MASK))
+  {
+    /* Free running, ADSC stays set */
+    sl_avr_emu_adc_convert(emulation, adc);
+  }
+  else
+  {
+    emulation->adc.converting = false;
+    SL_AVR_EMU_CLEAR_BIT(data[SL_AVR_EMU_ADC_ADCSRA], SL_AVR_EMU_ADC_ADSC);
+  }
+
+  return SL_AVR_EMU_RESULT_SUCCESS;
+}
+
+/**
+ * @brief ADCSRA read hook, fast-forwards firmware polling for the conversion to complete
+ * 
+ * @param emulation
+ * @param address
+ * @param context   - Unused
+ */
+static void sl_avr_emu_adc_adcsra_read(sl_avr_emu_emulation_s *emulation, sl_avr_emu_address_t address, void *context)
+{
+  if(emulation->adc.converting)
+  {
+    sl_avr_emu_idle_poll(emulation, address, emulation->adc.done_tick);
+  }
+}
+
+/**
+ * @brief ADCSRA write hook.  ADIF is cleared by writing one, ADSC starts a conversion and only clears when it completes.
+ *        Disabling the ADC abandons the conversion in progress.
+ * 
+ * @param emulation
+ * @param address
+ * @param value
+ * @param context   - ADC state
+ */
+static void sl_avr_emu_adc_adcsra_write(sl_avr_emu_emulation_s *emulation, sl_avr_emu_address_t address, sl_avr_emu_byte_t value, void *context)
+{
+  sl_avr_emu_adc_s  *adc      = context;
+  sl_avr_emu_byte_t *adcsra   = &emulation->memory.data[address];
+  const bool         flagged  = SL_AVR_EMU_CHECK_BIT(*adcsra, SL_AVR_EMU_ADC_ADIF) && !SL_AVR_EMU_CHECK_BIT(value, SL_AVR_EMU_ADC_ADIF);
+
+  *adcsra = value;
+  SL_AVR_EMU_CLEAR_BIT(*adcsra, SL_AVR_EMU_ADC_ADIF);
+  SL_AVR_EMU_CLEAR_BIT(*adcsra, SL_AVR_EMU_ADC_ADSC);
+  if(flagged)
+  {
+    SL_AVR_EMU_SET_BIT(*adcsra, SL_AVR_EMU_ADC_ADIF);
+  }
+
+  if(!SL_AVR_EMU_CHECK_BIT(value, SL_AVR_EMU_ADC_ADEN))
+  {
+    sl_avr_emu_event_cancel(emulation, sl_avr_emu_adc_done_event, adc);
+    emulation->adc.converting = false;
+    emulation->adc.first      = true;
+    return;
+  }
+
+  if(SL_AVR_EMU_CHECK_BIT(value, SL_AVR_EMU_ADC_ADSC) && !emulation->adc.converting)
+  {
+    sl_avr_emu_adc_convert(emulation, adc);
+  }
+  if(emulation->adc.converting)
+  {
+    SL_AVR_EMU_SET_BIT(*adcsra, SL_AVR_EMU_ADC_ADSC);
+  }
+}
+
+/**
+ * @brief ADCL read hook, locks the result registers until ADCH is read
+ * 
+ * @param emulation
+ * @param address
+ * @param context   - Unused
+ */
+static void sl_avr_emu_adc_adcl_read(sl_avr_emu_emulation_s *emulation, sl_avr_emu_address_t address, void *context)
+{
+  emulation->adc.locked = true;
+}
+
+/**
+ * @brief ADCH read hook, unlocks the result registers
+ * 
+ * @param emulation
+ * @param address
+ * @param context   - Unused
+ */
+static void sl_avr_emu_adc_adch_read(sl_avr_emu_emulation_s *emulation, sl_avr_emu_address_t address, void *context)
+{
+  emulation->adc.locked = false;
+}
+
+/**
+ * @brief Result registers write hook, they are read only
+ * 
+ * @param emulation
+ * @param address
+ * @param value
+ * @param context   - ADC state
+ */
+static void sl_avr_emu_adc_result_write(sl_avr_emu_emulation_s *emulation, sl_avr_emu_address_t address, sl_avr_emu_byte_t value, void *context)
+{
+}
+
+/**
+ * @brief Attaches the ADC to emulation, fed from a sample file
+ * 
+ * @param emulation
+ * @param path
+ * @param channels      - 16-bit inputs per record, ADC0 upwards.  Other channels read 0.
+ * @param sample_hz     - Records per second of emulated time
+ * @param interpolation
+ * @return sl_avr_emu_result_e - SL_AVR_EMU_RESULT_INVALID_FILE_PATH if the file could not be mapped
+ */
+sl_avr_emu_result_e sl_avr_emu_adc_start(sl_avr_emu_emulation_s *emulation, const char *path, uint32_t channels, uint32_t sample_hz,
+                                         sl_avr_emu_adc_interpolation_e interpolation)
+{
+  sl_avr_emu_result_e  result;
+  sl_avr_emu_adc_s    *adc;
+
+  if(NULL != emulation->hooks.adc || 0 == channels || channels > SL_AVR_EMU_ADC_MUX_MASK + 1)
+  {
+    return SL_AVR_EMU_RESULT_FAILURE;
+  }
+
+  adc = calloc(1, sizeof(sl_avr_emu_adc_s));
+  if(NULL == adc)
+  {
+    return SL_AVR_EMU_RESULT_FAILURE;
+  }
+  result = sl_avr_emu_samples_open(&adc->samples, path, 2 * channels, sample_hz);
+  if(SL_AVR_EMU_RESULT_SUCCESS != result)
+  {
+    free(adc);
+    return result;
+  }
+  adc->channels      = channels;
+  adc->interpolation = interpolation;
+  emulation->hooks.adc = adc;
+  memset(&emulation->adc, 0, sizeof(emulation->adc));
+  emulation->adc.first = true;
+
+  result = sl_avr_emu_io_attach(emulation, SL_AVR_EMU_ADC_ADCSRA, sl_avr_emu_adc_adcsra_read, sl_avr_emu_adc_adcsra_write, adc);
+  if(SL_AVR_EMU_RESULT_SUCCESS == result)
+  {
+    result = sl_avr_emu_io_attach(emulation, SL_AVR_EMU_ADC_ADCL, sl_avr_emu_adc_adcl_read, sl_avr_emu_adc_result_write, adc);
+  }
+  if(SL_AVR_EMU_RESULT_SUCCESS == result)
+  {
+    result = sl_avr_emu_io_attach(emulation, SL_AVR_EMU_ADC_ADCH, sl_avr_emu_adc_adch_read, sl_avr_emu_adc_result_write, adc);
+  }
+
+  if(SL_AVR_EMU_RESULT_SUCCESS != result)
+  {
+    sl_avr_emu_adc_stop(emulation);
+  }
+
+  return result;
+}
+
+/**
+ * @brief Prints conversion counters
+ * 
+ * @param output
+ * @param emulation
+ */
+void sl_avr_emu_adc_report(FILE *output, const sl_avr_emu_emulation_s *emulation)
+{
+  const sl_avr_emu_adc_s *adc = emulation->hooks.adc;
+
+  fprintf(output, "ADC: %lu conversions, %lu results lost to the ADCL lock, %lu samples of %u channels, %lu past the end\n",
+          adc->conversions, adc->lost, adc->samples.record_count, adc->channels, adc->samples.overruns);
+}
+
+/**
+ * @brief Unmaps the sample file and detaches the ADC
+ * 
+ * @param emulation
+ */
+void sl_avr_emu_adc_stop(sl_avr_emu_emulation_s *emulation)
+{
+  sl_avr_emu_adc_s *adc = emulation->hooks.adc;
+
+  if(NULL == adc)
+  {
+    return;
+  }
+
+  sl_avr_emu_event_cancel(emulation, sl_avr_emu_adc_done_event, adc);
+  sl_avr_emu_io_detach(emulation, SL_AVR_EMU_ADC_ADCSRA);
+  sl_avr_emu_io_detach(emulation, SL_AVR_EMU_ADC_ADCL);
+  sl_avr_emu_io_detach(emulation, SL_AVR_EMU_ADC_ADCH);
+  sl_avr_emu_samples_close(&adc->samples);
+  free(adc);
+  emulation->hooks.adc = NULL;
+}
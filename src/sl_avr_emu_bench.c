@@ -0,0 +1,400 @@
+/**
+ * @file sl_avr_emu_bench.c
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator Benchmark Suite
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ * Runs bundled workloads and isolated instruction handlers, reporting results as JSON.
+ * Usage: sl_avr_emu_bench [-t <ticks per workload>] [-n <calls per opcode>] [-o <output file>]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define SL_AVR_EMU_BENCH_HOST_CYCLES() __rdtsc()
+#endif
+
+#include "sl_avr_emu.h"
+#include "sl_avr_emu_opcode.h"
+#include "sl_avr_emu_tick.h"
+
+#define SL_AVR_EMU_BENCH_DEFAULT_TICKS 20000000
+#define SL_AVR_EMU_BENCH_DEFAULT_CALLS 2000000
+
+/**
+ * @brief Bundled workloads, loaded at flash address 0
+ * 
+ */
+static const sl_avr_emu_word_t sl_avr_emu_bench_arithmetic[] =
+{
+  0xEF0F,          /* 0000: ldi  r16, 0xFF */
+  0xBF0D,          /* 0001: out  SPL, r16 */
+  0xE008,          /* 0002: ldi  r16, 0x08 */
+  0xBF0E,          /* 0003: out  SPH, r16 */
+  0xEF0F,          /* 0004: ldi  r16, 0xFF */
+  0x0C01,          /* 0005: add  r0, r1 */
+  0x1C23,          /* 0006: adc  r2, r3 */
+  0x1845,          /* 0007: sub  r4, r5 */
+  0x2467,          /* 0008: eor  r6, r7 */
+  0x5011,          /* 0009: subi r17, 0x01 */
+  0x4020,          /* 000a: sbci r18, 0x00 */
+  0x2E11,          /* 000b: mov  r1, r17 */
+  0x950A,          /* 000c: dec  r16 */
+  0xF7B9,          /* 000d: brne inner */
+  0xCFF5,          /* 000e: rjmp outer */
+};
+
+static const sl_avr_emu_word_t sl_avr_emu_bench_recursion[] =
+{
+  0xEF0F,          /* 0000: ldi  r16, 0xFF */
+  0xBF0D,          /* 0001: out  SPL, r16 */
+  0xE008,          /* 0002: ldi  r16, 0x08 */
+  0xBF0E,          /* 0003: out  SPH, r16 */
+  0xE104,          /* 0004: ldi  r16, 20 */
+  0xD001,          /* 0005: rcall recurse */
+  0xCFFD,          /* 0006: rjmp main */
+  0x950A,          /* 0007: dec  r16 */
+  0xF019,          /* 0008: breq done */
+  0x930F,          /* 0009: push r16 */
+  0xDFFC,          /* 000a: rcall recurse */
+  0x910F,          /* 000b: pop  r16 */
+  0x9508,          /* 000c: ret */
+};
+
+static const sl_avr_emu_word_t sl_avr_emu_bench_timer_isr[] =
+{
+  0x940C, 0x0022,  /* 0000: jmp  main */
+  [0x20] = 0xC00E,  /* 0020: rjmp isr (TIMER0 OVF) */
+  0x0000,          /* 0021: nop */
+  0xEF0F,          /* 0022: ldi  r16, 0xFF */
+  0xBF0D,          /* 0023: out  SPL, r16 */
+  0xE008,          /* 0024: ldi  r16, 0x08 */
+  0xBF0E,          /* 0025: out  SPH, r16 */
+  0xE001,          /* 0026: ldi  r16, 1<<TOIE0 */
+  0x9300, 0x006E,  /* 0027: sts  TIMSK0, r16 */
+  0xE001,          /* 0029: ldi  r16, CS0=clk */
+  0xBD05,          /* 002a: out  TCCR0B, r16 */
+  0x9478,          /* 002b: sei */
+  0x0C01,          /* 002c: add  r0, r1 */
+  0x1C23,          /* 002d: adc  r2, r3 */
+  0xCFFD,          /* 002e: rjmp loop */
+  0x930F,          /* 002f: push r16 */
+  0x9100, 0x0200,  /* 0030: lds  r16, 0x0200 */
+  0x5F0F,          /* 0032: subi r16, 0xFF */
+  0x9300, 0x0200,  /* 0033: sts  0x0200, r16 */
+  0x910F,          /* 0035: pop  r16 */
+  0x9518,          /* 0036: reti */
+};
+
+static const sl_avr_emu_word_t sl_avr_emu_bench_memory_copy[] =
+{
+  0xEF0F,          /* 0000: ldi  r16, 0xFF */
+  0xBF0D,          /* 0001: out  SPL, r16 */
+  0xE008,          /* 0002: ldi  r16, 0x08 */
+  0xBF0E,          /* 0003: out  SPH, r16 */
+  0xE080,          /* 0004: ldi  r24, lo8(0x0100) */
+  0xE091,          /* 0005: ldi  r25, hi8(0x0100) */
+  0xE060,          /* 0006: ldi  r22, lo8(0x0500) */
+  0xE075,          /* 0007: ldi  r23, hi8(0x0500) */
+  0xE0E0,          /* 0008: ldi  r30, lo8(1024) */
+  0xE0F4,          /* 0009: ldi  r31, hi8(1024) */
+  0x01DC,          /* 000a: movw r26, r24 */
+  0x900D,          /* 000b: ld   r0, X+ */
+  0x01CD,          /* 000c: movw r24, r26 */
+  0x01DB,          /* 000d: movw r26, r22 */
+  0x920D,          /* 000e: st   X+, r0 */
+  0x01BD,          /* 000f: movw r22, r26 */
+  0x9731,          /* 0010: sbiw r30, 1 */
+  0xF7C1,          /* 0011: brne copy */
+  0xCFF1,          /* 0012: rjmp outer */
+};
+
+static const sl_avr_emu_word_t sl_avr_emu_bench_idle_scheduler[] =
+{
+  0x940C, 0x0022,  /* 0000: jmp  main */
+  [0x20] = 0xC016,  /* 0020: rjmp isr (TIMER0 OVF) */
+  0x0000,          /* 0021: nop */
+  0xEF0F,          /* 0022: ldi  r16, 0xFF */
+  0xBF0D,          /* 0023: out  SPL, r16 */
+  0xE008,          /* 0024: ldi  r16, 0x08 */
+  0xBF0E,          /* 0025: out  SPH, r16 */
+  0xE001,          /* 0026: ldi  r16, 1<<TOIE0 */
+  0x9300, 0x006E,  /* 0027: sts  TIMSK0, r16 */
+  0xE003,          /* 0029: ldi  r16, CS0=clk/64 */
+  0xBD05,          /* 002a: out  TCCR0B, r16 */
+  0x9478,          /* 002b: sei */
+  0x9100, 0x0200,  /* 002c: lds  r16, 0x0200 */
+  0x3000,          /* 002e: cpi  r16, 0 */
+  0xF3E1,          /* 002f: breq idle */
+  0xE000,          /* 0030: ldi  r16, 0 */
+  0x9300, 0x0200,  /* 0031: sts  0x0200, r16 */
+  0xE312,          /* 0033: ldi  r17, 50 */
+  0x951A,          /* 0034: dec  r17 */
+  0xF7F1,          /* 0035: brne task */
+  0xCFF5,          /* 0036: rjmp idle */
+  0x930F,          /* 0037: push r16 */
+  0xE001,          /* 0038: ldi  r16, 1 */
+  0x9300, 0x0200,  /* 0039: sts  0x0200, r16 */
+  0x910F,          /* 003b: pop  r16 */
+  0x9518,          /* 003c: reti */
+};
+
+typedef struct
+{
+  const char              *name;
+  const sl_avr_emu_word_t *code;
+  size_t                   words;
+
+} sl_avr_emu_bench_workload_s;
+
+#define SL_AVR_EMU_BENCH_WORKLOAD(name) { #name, sl_avr_emu_bench_##name, sizeof(sl_avr_emu_bench_##name)/sizeof(sl_avr_emu_word_t) }
+
+static const sl_avr_emu_bench_workload_s sl_avr_emu_bench_workloads[] =
+{
+  SL_AVR_EMU_BENCH_WORKLOAD(arithmetic),
+  SL_AVR_EMU_BENCH_WORKLOAD(recursion),
+  SL_AVR_EMU_BENCH_WORKLOAD(timer_isr),
+  SL_AVR_EMU_BENCH_WORKLOAD(memory_copy),
+  SL_AVR_EMU_BENCH_WORKLOAD(idle_scheduler),
+};
+
+/**
+ * @brief Isolated handler microbenchmark.  
+ *        Instruction A is at word 0 and B, if it has a handler, at word 2; calls alternate between them.
+ * 
+ */
+typedef struct
+{
+  const char          *name;
+  sl_avr_emu_result_e (*handler_a)(sl_avr_emu_emulation_s * emulation);
+  sl_avr_emu_result_e (*handler_b)(sl_avr_emu_emulation_s * emulation);
+  sl_avr_emu_word_t    code[4];
+
+} sl_avr_emu_bench_opcode_s;
+
+static const sl_avr_emu_bench_opcode_s sl_avr_emu_bench_opcodes[] =
+{
+  { "add",       sl_avr_emu_opcode_add,         NULL,                   { 0x0F01 } },         /* add  r16, r17 */
+  { "adiw",      sl_avr_emu_opcode_adiw,        NULL,                   { 0x9601 } },         /* adiw r24, 1 */
+  { "and",       sl_avr_emu_opcode_and,         NULL,                   { 0x2301 } },         /* and  r16, r17 */
+  { "brbs_brbc", sl_avr_emu_opcode_brbs_brbc,   NULL,                   { 0xF401 } },         /* brne .+0 */
+  { "com",       sl_avr_emu_opcode_com,         NULL,                   { 0x9500 } },         /* com  r16 */
+  { "cp_cpc",    sl_avr_emu_opcode_cp_cpc,      NULL,                   { 0x1701 } },         /* cp   r16, r17 */
+  { "cpi",       sl_avr_emu_opcode_cpi,         NULL,                   { 0x3100 } },         /* cpi  r16, 0x10 */
+  { "cpse",      sl_avr_emu_opcode_cpse,        NULL,                   { 0x1301 } },         /* cpse r16, r17 */
+  { "dec",       sl_avr_emu_opcode_dec,         NULL,                   { 0x950A } },         /* dec  r16 */
+  { "eor",       sl_avr_emu_opcode_eor,         NULL,                   { 0x2701 } },         /* eor  r16, r17 */
+  { "in_out",    sl_avr_emu_opcode_in_out,      NULL,                   { 0xB70F } },         /* in   r16, SREG */
+  { "jmp_call",  sl_avr_emu_opcode_jmp_call,    NULL,                   { 0x940C, 0x0000 } }, /* jmp  0 */
+  { "ld_st",     sl_avr_emu_opcode_ld_st,       NULL,                   { 0x910C } },         /* ld   r16, X */
+  { "lds_sts",   sl_avr_emu_opcode_lds_sts,     NULL,                   { 0x9100, 0x0200 } }, /* lds  r16, 0x0200 */
+  { "ldi",       sl_avr_emu_opcode_ldi,         NULL,                   { 0xE505 } },         /* ldi  r16, 0x55 */
+  { "lpm_elpm",  sl_avr_emu_opcode_lpm_elpm,    NULL,                   { 0x95C8 } },         /* lpm */
+  { "mov",       sl_avr_emu_opcode_mov,         NULL,                   { 0x2F01 } },         /* mov  r16, r17 */
+  { "movw",      sl_avr_emu_opcode_movw,        NULL,                   { 0x01CD } },         /* movw r24, r26 */
+  { "or",        sl_avr_emu_opcode_or,          NULL,                   { 0x2B01 } },         /* or   r16, r17 */
+  { "ori",       sl_avr_emu_opcode_ori,         NULL,                   { 0x6001 } },         /* ori  r16, 0x01 */
+  { "push_pop",  sl_avr_emu_opcode_push_pop,    sl_avr_emu_opcode_push_pop, { 0x930F, 0, 0x910F } }, /* push r16; pop r16 */
+  { "rcall_ret", sl_avr_emu_opcode_rjmp_rcall,  sl_avr_emu_opcode_ret,  { 0xD000, 0, 0x9508 } }, /* rcall .+0; ret */
+  { "rcall_reti",sl_avr_emu_opcode_rjmp_rcall,  sl_avr_emu_opcode_reti, { 0xD000, 0, 0x9518 } }, /* rcall .+0; reti */
+  { "rjmp",      sl_avr_emu_opcode_rjmp_rcall,  NULL,                   { 0xC000 } },         /* rjmp .+0 */
+  { "sbic_sbis", sl_avr_emu_opcode_sbic_sbis,   NULL,                   { 0x99F8 } },         /* sbic 0x1F, 0 */
+  { "sbiw",      sl_avr_emu_opcode_sbiw,        NULL,                   { 0x9701 } },         /* sbiw r24, 1 */
+  { "sbrc_sbrs", sl_avr_emu_opcode_sbrc_sbrs,   NULL,                   { 0xFD07 } },         /* sbrc r16, 7 */
+  { "sex_clx",   sl_avr_emu_opcode_sex_clx,     NULL,                   { 0x9408 } },         /* sec */
+  { "sub",       sl_avr_emu_opcode_sub,         NULL,                   { 0x1B01 } },         /* sub  r16, r17 */
+  { "subi_sbci", sl_avr_emu_opcode_subi_sbci,   NULL,                   { 0x5001 } },         /* subi r16, 0x01 */
+};
+
+/**
+ * @brief Monotonic host time in nanoseconds
+ * 
+ * @return uint64_t 
+ */
+static uint64_t sl_avr_emu_bench_ns(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/**
+ * @brief Host CPU cycle counter, 0 where unavailable
+ * 
+ * @return uint64_t 
+ */
+static uint64_t sl_avr_emu_bench_host_cycles(void)
+{
+#ifdef SL_AVR_EMU_BENCH_HOST_CYCLES
+  return SL_AVR_EMU_BENCH_HOST_CYCLES();
+#else
+  return 0;
+#endif
+}
+
+/**
+ * @brief Resets an emulation and loads code at flash address 0
+ * 
+ * @param emulation 
+ * @param code 
+ * @param words 
+ */
+static void sl_avr_emu_bench_load(sl_avr_emu_emulation_s *emulation, const sl_avr_emu_word_t *code, size_t words)
+{
+  sl_avr_emu_deinit(emulation);
+  sl_avr_emu_init(emulation);
+  memcpy(emulation->memory.flash, code, words*sizeof(sl_avr_emu_word_t));
+}
+
+/**
+ * @brief Runs a workload for ticks and prints its JSON result
+ * 
+ * @param output 
+ * @param emulation 
+ * @param workload 
+ * @param ticks 
+ * @return sl_avr_emu_result_e 
+ */
+static sl_avr_emu_result_e sl_avr_emu_bench_workload(FILE *output, sl_avr_emu_emulation_s *emulation, const sl_avr_emu_bench_workload_s *workload, sl_avr_emu_tick_count_t ticks)
+{
+  sl_avr_emu_result_e result = SL_AVR_EMU_RESULT_SUCCESS;
+  uint64_t            instructions = 0;
+  uint64_t            start_ns, end_ns;
+  uint64_t            start_cycles, end_cycles;
+  double              seconds;
+
+  /* Untimed pass counting instructions, i.e. ticks that start at an instruction boundary */
+  sl_avr_emu_bench_load(emulation, workload->code, workload->words);
+  while(SL_AVR_EMU_RESULT_SUCCESS == result && emulation->tick_count < ticks)
+  {
+    instructions += (0 == emulation->op_cycles_remaining);
+    result = sl_avr_emu_run(emulation, emulation->tick_count + 1);
+  }
+
+  /* Timed pass */
+  sl_avr_emu_bench_load(emulation, workload->code, workload->words);
+  start_ns     = sl_avr_emu_bench_ns();
+  start_cycles = sl_avr_emu_bench_host_cycles();
+  if(SL_AVR_EMU_RESULT_SUCCESS == result)
+  {
+    result = sl_avr_emu_run(emulation, ticks);
+  }
+  end_cycles   = sl_avr_emu_bench_host_cycles();
+  end_ns       = sl_avr_emu_bench_ns();
+  seconds      = (end_ns - start_ns) / 1e9;
+
+  fprintf(output, "    { \"benchmark\": \"workload_%s\", \"result\": %u, \"ticks\": %lu, \"instructions\": %lu, \"seconds\": %.6f, "
+                  "\"emulated_mhz\": %.3f, \"ns_per_instruction\": %.3f, \"host_cycles_per_cycle\": %.3f }",
+          workload->name, result, emulation->tick_count, instructions, seconds,
+          (seconds > 0)?emulation->tick_count / seconds / 1e6:0.0,
+          (instructions > 0)?(end_ns - start_ns) / (double) instructions:0.0,
+          (emulation->tick_count > 0)?(end_cycles - start_cycles) / (double) emulation->tick_count:0.0);
+
+  return result;
+}
+
+/**
+ * @brief Calls an instruction handler in isolation and prints its JSON result
+ * 
+ * @param output 
+ * @param emulation 
+ * @param opcode 
+ * @param calls 
+ * @return sl_avr_emu_result_e 
+ */
+static sl_avr_emu_result_e sl_avr_emu_bench_opcode(FILE *output, sl_avr_emu_emulation_s *emulation, const sl_avr_emu_bench_opcode_s *opcode, uint64_t calls)
+{
+  sl_avr_emu_result_e result = SL_AVR_EMU_RESULT_SUCCESS;
+  uint64_t            i;
+  uint64_t            start_ns, end_ns;
+  uint64_t            start_cycles, end_cycles;
+
+  sl_avr_emu_bench_load(emulation, opcode->code, sizeof(opcode->code)/sizeof(sl_avr_emu_word_t));
+  /* Stack at top of SRAM, X at SRAM start */
+  emulation->memory.data[SL_AVR_EMU_SPL_ADDRESS] = 0xFF;
+  emulation->memory.data[SL_AVR_EMU_SPH_ADDRESS] = 0x08;
+  emulation->memory.data[SL_AVR_EMU_XH_ADDRESS]  = 0x01;
+
+  start_ns     = sl_avr_emu_bench_ns();
+  start_cycles = sl_avr_emu_bench_host_cycles();
+  for(i = 0; i < calls && SL_AVR_EMU_RESULT_SUCCESS == result; i++)
+  {
+    if(NULL == opcode->handler_b || 0 == (i % 2))
+    {
+      emulation->memory.pc = 0;
+      result = opcode->handler_a(emulation);
+    }
+    else
+    {
+      emulation->memory.pc = 2;
+      result = opcode->handler_b(emulation);
+    }
+  }
+  end_cycles   = sl_avr_emu_bench_host_cycles();
+  end_ns       = sl_avr_emu_bench_ns();
+
+  fprintf(output, "    { \"benchmark\": \"opcode_%s\", \"result\": %u, \"calls\": %lu, \"ns_per_call\": %.3f, \"host_cycles_per_call\": %.3f }",
+          opcode->name, result, i, (i > 0)?(end_ns - start_ns) / (double) i:0.0, (i > 0)?(end_cycles - start_cycles) / (double) i:0.0);
+
+  return result;
+}
+
+int main(int argc, char *argv[])
+{
+  sl_avr_emu_result_e     result = SL_AVR_EMU_RESULT_SUCCESS;
+  sl_avr_emu_tick_count_t ticks  = SL_AVR_EMU_BENCH_DEFAULT_TICKS;
+  uint64_t                calls  = SL_AVR_EMU_BENCH_DEFAULT_CALLS;
+  FILE                   *output = stdout;
+  uint32_t                i;
+  /* Large, keep off the stack */
+  static sl_avr_emu_emulation_s emulation;
+
+  for(i = 1; i < argc; i++)
+  {
+    if(strcmp(argv[i],"-t") == 0 && (i+1) < argc)
+    {
+      ticks = strtoull(argv[++i], NULL, 0);
+    }
+    else if(strcmp(argv[i],"-n") == 0 && (i+1) < argc)
+    {
+      calls = strtoull(argv[++i], NULL, 0);
+    }
+    else if(strcmp(argv[i],"-o") == 0 && (i+1) < argc)
+    {
+      output = fopen(argv[++i], "w");
+      if(NULL == output)
+      {
+        fprintf(stderr, "Error! Unable to open %s\n", argv[i]);
+        return SL_AVR_EMU_RESULT_INVALID_FILE_PATH;
+      }
+    }
+  }
+
+  fprintf(output, "{\n  \"results\": [\n");
+  for(i = 0; i < sizeof(sl_avr_emu_bench_workloads)/sizeof(sl_avr_emu_bench_workload_s); i++)
+  {
+    result |= sl_avr_emu_bench_workload(output, &emulation, &sl_avr_emu_bench_workloads[i], ticks);
+    fprintf(output, ",\n");
+  }
+  for(i = 0; i < sizeof(sl_avr_emu_bench_opcodes)/sizeof(sl_avr_emu_bench_opcode_s); i++)
+  {
+    result |= sl_avr_emu_bench_opcode(output, &emulation, &sl_avr_emu_bench_opcodes[i], calls);
+    fprintf(output, (i+1 < sizeof(sl_avr_emu_bench_opcodes)/sizeof(sl_avr_emu_bench_opcode_s))?",\n":"\n");
+  }
+  fprintf(output, "  ]\n}\n");
+
+  if(output != stdout)
+  {
+    fclose(output);
+  }
+
+  return (SL_AVR_EMU_RESULT_SUCCESS == result)?0:1;
+}
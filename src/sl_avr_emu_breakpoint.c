@@ -0,0 +1,215 @@
+/**
+ * @file sl_avr_emu_breakpoint.c
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator Breakpoint Logic
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ * Breakpoints are BREAK instructions patched into flash, so the dispatch loop never compares PC.
+ * Only executing a patched word reaches this code.  Flash is not part of snapshots, so restoring
+ * a snapshot neither loses nor reinstates breakpoints.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sl_avr_emu_breakpoint.h"
+#include "sl_avr_emu_elf.h"
+#include "sl_avr_emu_tick.h"
+
+/**
+ * @brief Sets a breakpoint.  Emulation stops with SL_AVR_EMU_RESULT_BREAKPOINT before executing pc.
+ * 
+ * @param emulation
+ * @param pc        - Word address of an instruction
+ * @return sl_avr_emu_result_e
+ */
+sl_avr_emu_result_e sl_avr_emu_breakpoint_set(sl_avr_emu_emulation_s *emulation, sl_avr_emu_extended_address_t pc)
+{
+  sl_avr_emu_result_e       result = SL_AVR_EMU_RESULT_SUCCESS;
+  sl_avr_emu_breakpoints_s *breakpoints;
+
+  if(!SL_AVR_EMU_PC_ADDRESS_VALID(pc))
+  {
+    return SL_AVR_EMU_RESULT_INVALID_PC;
+  }
+  if(NULL != sl_avr_emu_breakpoint_find(emulation, pc))
+  {
+    return SL_AVR_EMU_RESULT_SUCCESS;
+  }
+
+  if(NULL == emulation->hooks.breakpoints)
+  {
+    emulation->hooks.breakpoints = calloc(1, sizeof(sl_avr_emu_breakpoints_s));
+  }
+  breakpoints = emulation->hooks.breakpoints;
+
+  if(breakpoints != NULL && breakpoints->count < SL_AVR_EMU_BREAKPOINT_MAX)
+  {
+    breakpoints->breakpoints[breakpoints->count].pc       = pc;
+    breakpoints->breakpoints[breakpoints->count].original = emulation->memory.flash[pc];
+    breakpoints->count++;
+    emulation->memory.flash[pc] = SL_AVR_EMU_BREAKPOINT_OPCODE;
+  }
+  else
+  {
+    result = SL_AVR_EMU_RESULT_FAILURE;
+  }
+
+  return result;
+}
+
+/**
+ * @brief Clears a breakpoint.  Detaches breakpoints after the last is cleared.
+ * 
+ * @param emulation
+ * @param pc
+ * @return sl_avr_emu_result_e - SL_AVR_EMU_RESULT_FAILURE if no breakpoint is set at pc
+ */
+sl_avr_emu_result_e sl_avr_emu_breakpoint_clear(sl_avr_emu_emulation_s *emulation, sl_avr_emu_extended_address_t pc)
+{
+  sl_avr_emu_breakpoints_s *breakpoints = emulation->hooks.breakpoints;
+  sl_avr_emu_breakpoint_s  *breakpoint  = sl_avr_emu_breakpoint_find(emulation, pc);
+
+  if(NULL == breakpoint)
+  {
+    return SL_AVR_EMU_RESULT_FAILURE;
+  }
+
+  emulation->memory.flash[pc] = breakpoint->original;
+  *breakpoint = breakpoints->breakpoints[--breakpoints->count];
+  if(breakpoints->resuming && pc == breakpoints->resume_pc)
+  {
+    breakpoints->resuming = false;
+  }
+
+  if(0 == breakpoints->count)
+  {
+    free(breakpoints);
+    emulation->hooks.breakpoints = NULL;
+  }
+
+  return SL_AVR_EMU_RESULT_SUCCESS;
+}
+
+/**
+ * @brief Clears all breakpoints
+ * 
+ * @param emulation
+ */
+void sl_avr_emu_breakpoint_clear_all(sl_avr_emu_emulation_s *emulation)
+{
+  while(NULL != emulation->hooks.breakpoints)
+  {
+    sl_avr_emu_breakpoint_clear(emulation, emulation->hooks.breakpoints->breakpoints[0].pc);
+  }
+}
+
+/**
+ * @brief Finds the breakpoint at pc
+ * 
+ * @param emulation
+ * @param pc
+ * @return sl_avr_emu_breakpoint_s* - NULL if no breakpoint is set at pc
+ */
+sl_avr_emu_breakpoint_s *sl_avr_emu_breakpoint_find(const sl_avr_emu_emulation_s *emulation, sl_avr_emu_extended_address_t pc)
+{
+  sl_avr_emu_breakpoints_s *breakpoints = emulation->hooks.breakpoints;
+  uint32_t                  i;
+
+  for(i = 0; breakpoints != NULL && i < breakpoints->count; i++)
+  {
+    if(pc == breakpoints->breakpoints[i].pc)
+    {
+      return &breakpoints->breakpoints[i];
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * @brief Stops at a breakpoint at PC unless resuming from it.  Called at an instruction boundary before the instruction's hooks,
+ *        a stop gives the tick back so breakpoints cost no emulated time.
+ * 
+ * @param emulation
+ * @return true if stopped
+ */
+bool sl_avr_emu_breakpoint_stop(sl_avr_emu_emulation_s *emulation)
+{
+  sl_avr_emu_breakpoints_s      *breakpoints = emulation->hooks.breakpoints;
+  sl_avr_emu_extended_address_t  pc          = emulation->memory.pc;
+
+  if(SL_AVR_EMU_BREAKPOINT_OPCODE != emulation->memory.flash[pc] || NULL == sl_avr_emu_breakpoint_find(emulation, pc) ||
+     (breakpoints->resuming && pc == breakpoints->resume_pc))
+  {
+    return false;
+  }
+
+  /* Events due this tick have run and are not due again when it is repeated on resume */
+  emulation->tick_count--;
+  emulation->io_tick_count--;
+  breakpoints->resuming  = true;
+  breakpoints->resume_pc = pc;
+  SL_AVR_EMU_VERBOSE_LOG(printf("Breakpoint. PC 0x%06x.\n", pc));
+
+  return true;
+}
+
+/**
+ * @brief Runs until a breakpoint or pc is reached, an error occurs or tick_limit is reached
+ * 
+ * @param emulation
+ * @param pc         - Word address to stop at
+ * @param tick_limit - Tick count at which to stop, run-until-cycle is sl_avr_emu_run itself
+ * @return sl_avr_emu_result_e - SL_AVR_EMU_RESULT_BREAKPOINT when stopped at pc or another breakpoint
+ */
+sl_avr_emu_result_e sl_avr_emu_run_until_pc(sl_avr_emu_emulation_s *emulation, sl_avr_emu_extended_address_t pc, sl_avr_emu_tick_count_t tick_limit)
+{
+  sl_avr_emu_result_e result;
+  bool                temporary;
+
+  temporary = (NULL == sl_avr_emu_breakpoint_find(emulation, pc));
+  result    = sl_avr_emu_breakpoint_set(emulation, pc);
+
+  if(SL_AVR_EMU_RESULT_SUCCESS == result)
+  {
+    if(temporary && pc == emulation->memory.pc)
+    {
+      /* Already at pc, run until it is reached again */
+      emulation->hooks.breakpoints->resuming  = true;
+      emulation->hooks.breakpoints->resume_pc = pc;
+    }
+    result = sl_avr_emu_run(emulation, tick_limit);
+    if(temporary)
+    {
+      /* Stopped at pc, nothing is left to step over once the breakpoint is gone */
+      sl_avr_emu_breakpoint_clear(emulation, pc);
+    }
+  }
+
+  return result;
+}
+
+/**
+ * @brief Runs until a breakpoint or the named function is reached, an error occurs or tick_limit is reached
+ * 
+ * @param emulation
+ * @param symbol     - Function name, looked up in emulation's symbols
+ * @param tick_limit - Tick count at which to stop
+ * @return sl_avr_emu_result_e - SL_AVR_EMU_RESULT_FAILURE if symbol is unknown
+ */
+sl_avr_emu_result_e sl_avr_emu_run_until_symbol(sl_avr_emu_emulation_s *emulation, const char *symbol, sl_avr_emu_tick_count_t tick_limit)
+{
+  const sl_avr_emu_symbol_s *found = sl_avr_emu_symbol_find(emulation->hooks.symbols, symbol);
+
+  if(NULL == found || !found->function)
+  {
+    return SL_AVR_EMU_RESULT_FAILURE;
+  }
+
+  return sl_avr_emu_run_until_pc(emulation, found->address/2, tick_limit);
+}
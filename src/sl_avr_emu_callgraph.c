@@ -0,0 +1,487 @@
+/**
+ * @file sl_avr_emu_callgraph.c
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator Call-Graph Profiler Logic
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ * A shadow call stack follows CALL/RCALL, interrupts and RET/RETI.  Frames are matched to
+ * returns by Stack-Pointer, so returns that do not pop a tracked return address are ignored and
+ * frames abandoned by stack unwinding are closed when a return passes them.  Cycles are charged
+ * at each call and return, with the call/return instruction split between caller and callee.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sl_avr_emu_bitops.h"
+#include "sl_avr_emu_callgraph.h"
+#include "sl_avr_emu_elf.h"
+#include "sl_avr_emu_opcode.h"
+
+/* Longest printable function name, including an offset or address */
+#define SL_AVR_EMU_CALLGRAPH_NAME_SIZE 64
+
+/**
+ * @brief Report entry, one per function
+ * 
+ */
+typedef struct
+{
+  sl_avr_emu_extended_address_t function;
+  bool                          isr;
+  uint64_t                      calls;
+  uint64_t                      exclusive;
+  uint64_t                      inclusive;
+
+} sl_avr_emu_callgraph_entry_s;
+
+/* Nodes referenced by the indices being sorted, qsort has no context argument */
+static const sl_avr_emu_callgraph_node_s *sl_avr_emu_callgraph_sort_nodes;
+
+/**
+ * @brief Orders node indices by function, interrupt handlers last
+ * 
+ * @param a
+ * @param b
+ * @return int
+ */
+static int sl_avr_emu_callgraph_compare_function(const void *a, const void *b)
+{
+  const sl_avr_emu_callgraph_node_s *node_a = &sl_avr_emu_callgraph_sort_nodes[*(const uint32_t *) a];
+  const sl_avr_emu_callgraph_node_s *node_b = &sl_avr_emu_callgraph_sort_nodes[*(const uint32_t *) b];
+
+  if(node_a->isr != node_b->isr)
+  {
+    return node_a->isr - node_b->isr;
+  }
+  return (node_a->function > node_b->function) - (node_a->function < node_b->function);
+}
+
+/**
+ * @brief Orders entries by inclusive cycles, descending
+ * 
+ * @param a
+ * @param b
+ * @return int
+ */
+static int sl_avr_emu_callgraph_compare_inclusive(const void *a, const void *b)
+{
+  const sl_avr_emu_callgraph_entry_s *entry_a = a;
+  const sl_avr_emu_callgraph_entry_s *entry_b = b;
+
+  return (entry_a->inclusive < entry_b->inclusive)?1:(entry_a->inclusive > entry_b->inclusive)?-1:
+         (entry_a->function > entry_b->function);
+}
+
+/**
+ * @brief Finds the node for function called from parent, adding it if new
+ * 
+ * @param callgraph
+ * @param parent
+ * @param function
+ * @param isr
+ * @param node         - Index of the node
+ * @return sl_avr_emu_result_e
+ */
+static sl_avr_emu_result_e sl_avr_emu_callgraph_node(sl_avr_emu_callgraph_s *callgraph, uint32_t parent, sl_avr_emu_extended_address_t function, bool isr, uint32_t *node)
+{
+  sl_avr_emu_result_e          result = SL_AVR_EMU_RESULT_SUCCESS;
+  sl_avr_emu_callgraph_node_s *nodes;
+  uint32_t                     i;
+
+  for(i = callgraph->nodes[parent].child; i != SL_AVR_EMU_CALLGRAPH_ROOT; i = callgraph->nodes[i].sibling)
+  {
+    if(callgraph->nodes[i].function == function && callgraph->nodes[i].isr == isr)
+    {
+      *node = i;
+      return result;
+    }
+  }
+
+  if(callgraph->node_count == callgraph->node_capacity)
+  {
+    nodes = realloc(callgraph->nodes, 2 * callgraph->node_capacity * sizeof(sl_avr_emu_callgraph_node_s));
+    if(NULL == nodes)
+    {
+      return SL_AVR_EMU_RESULT_FAILURE;
+    }
+    callgraph->nodes          = nodes;
+    callgraph->node_capacity *= 2;
+  }
+
+  i = callgraph->node_count++;
+  memset(&callgraph->nodes[i], 0, sizeof(sl_avr_emu_callgraph_node_s));
+  callgraph->nodes[i].function = function;
+  callgraph->nodes[i].isr      = isr;
+  callgraph->nodes[i].parent   = parent;
+  callgraph->nodes[i].sibling  = callgraph->nodes[parent].child;
+  callgraph->nodes[parent].child = i;
+  *node = i;
+
+  return result;
+}
+
+/**
+ * @brief Charges the ticks since the last call or return to the innermost frame
+ * 
+ * @param callgraph
+ * @param tick
+ */
+static void sl_avr_emu_callgraph_charge(sl_avr_emu_callgraph_s *callgraph, sl_avr_emu_tick_count_t tick)
+{
+  if(callgraph->depth > 0)
+  {
+    callgraph->nodes[callgraph->frames[callgraph->depth-1].node].exclusive += tick - callgraph->last_tick;
+  }
+  callgraph->last_tick = tick;
+}
+
+/**
+ * @brief Pushes a frame for function
+ * 
+ * @param emulation
+ * @param function
+ * @param isr
+ * @param sp
+ */
+static void sl_avr_emu_callgraph_push(sl_avr_emu_emulation_s *emulation, sl_avr_emu_extended_address_t function, bool isr, sl_avr_emu_address_t sp)
+{
+  sl_avr_emu_callgraph_s       *callgraph = emulation->hooks.callgraph;
+  sl_avr_emu_callgraph_frame_s *frame;
+  uint32_t                      parent;
+  uint32_t                      node;
+
+  sl_avr_emu_callgraph_charge(callgraph, emulation->tick_count);
+
+  /* Interrupt handlers are rooted on their own, apart from the code they interrupted */
+  parent = (isr || 0 == callgraph->depth)?SL_AVR_EMU_CALLGRAPH_ROOT:callgraph->frames[callgraph->depth-1].node;
+
+  if(callgraph->depth < SL_AVR_EMU_CALLGRAPH_DEPTH_MAX &&
+     SL_AVR_EMU_RESULT_SUCCESS == sl_avr_emu_callgraph_node(callgraph, parent, function, isr, &node))
+  {
+    callgraph->nodes[node].calls++;
+    frame = &callgraph->frames[callgraph->depth++];
+    frame->node       = node;
+    frame->sp         = sp;
+    frame->entry_tick = emulation->tick_count;
+    frame->isr_ticks  = 0;
+  }
+}
+
+/**
+ * @brief Pops the innermost frame, accounting its inclusive cycles
+ * 
+ * @param callgraph
+ * @param tick
+ */
+static void sl_avr_emu_callgraph_pop(sl_avr_emu_callgraph_s *callgraph, sl_avr_emu_tick_count_t tick)
+{
+  sl_avr_emu_callgraph_frame_s *frame = &callgraph->frames[--callgraph->depth];
+  sl_avr_emu_callgraph_node_s  *node  = &callgraph->nodes[frame->node];
+  sl_avr_emu_tick_count_t       duration = tick - frame->entry_tick;
+
+  node->inclusive += duration - frame->isr_ticks;
+
+  /* Interrupt time is excluded from every frame the interrupt was nested in */
+  if(callgraph->depth > 0)
+  {
+    callgraph->frames[callgraph->depth-1].isr_ticks += (node->isr)?duration:frame->isr_ticks;
+  }
+}
+
+/**
+ * @brief Pops every open frame at the current tick
+ * 
+ * @param emulation
+ */
+static void sl_avr_emu_callgraph_close(sl_avr_emu_emulation_s *emulation)
+{
+  sl_avr_emu_callgraph_s *callgraph = emulation->hooks.callgraph;
+
+  sl_avr_emu_callgraph_charge(callgraph, emulation->tick_count);
+  while(callgraph->depth > 0)
+  {
+    sl_avr_emu_callgraph_pop(callgraph, emulation->tick_count);
+  }
+}
+
+/**
+ * @brief Formats a function's name, its symbol when known or else its byte address
+ * 
+ * @param emulation
+ * @param function
+ * @param buffer
+ * @param size
+ * @return const char*
+ */
+static const char *sl_avr_emu_callgraph_name(const sl_avr_emu_emulation_s *emulation, sl_avr_emu_extended_address_t function, char *buffer, size_t size)
+{
+  const char *name;
+  uint32_t    offset;
+
+  name = sl_avr_emu_symbol_name_pc(emulation->hooks.symbols, function, &offset);
+  if(NULL == name)
+  {
+    snprintf(buffer, size, "0x%x", function*2);
+  }
+  else if(offset > 0)
+  {
+    snprintf(buffer, size, "%s+0x%x", name, offset);
+  }
+  else
+  {
+    snprintf(buffer, size, "%s", name);
+  }
+
+  return buffer;
+}
+
+/**
+ * @brief Attaches a new call-graph profile to emulation.  The function at PC becomes the bottom frame.
+ * 
+ * @param emulation
+ * @return sl_avr_emu_result_e
+ */
+sl_avr_emu_result_e sl_avr_emu_callgraph_start(sl_avr_emu_emulation_s *emulation)
+{
+  sl_avr_emu_result_e     result = SL_AVR_EMU_RESULT_SUCCESS;
+  sl_avr_emu_callgraph_s *callgraph;
+
+  callgraph = calloc(1, sizeof(sl_avr_emu_callgraph_s));
+  if(callgraph != NULL)
+  {
+    callgraph->node_capacity = 256;
+    callgraph->node_count    = 1;
+    callgraph->nodes         = calloc(callgraph->node_capacity, sizeof(sl_avr_emu_callgraph_node_s));
+  }
+  if(NULL == callgraph || NULL == callgraph->nodes)
+  {
+    free(callgraph);
+    return SL_AVR_EMU_RESULT_FAILURE;
+  }
+
+  callgraph->last_tick     = emulation->tick_count;
+  emulation->hooks.callgraph = callgraph;
+
+  /* The bottom frame never matches a return */
+  sl_avr_emu_callgraph_push(emulation, emulation->memory.pc, false, UINT16_MAX);
+
+  return result;
+}
+
+/**
+ * @brief Enters the function at PC.  Called by CALL/RCALL after the return address is pushed.
+ * 
+ * @param emulation
+ */
+void sl_avr_emu_callgraph_call(sl_avr_emu_emulation_s *emulation)
+{
+  sl_avr_emu_callgraph_push(emulation, emulation->memory.pc, false, SL_AVR_EMU_GET_SP(emulation));
+}
+
+/**
+ * @brief Enters the interrupt handler for the vector at PC.  Called after the return address is pushed.
+ * 
+ * @param emulation
+ */
+void sl_avr_emu_callgraph_interrupt(sl_avr_emu_emulation_s *emulation)
+{
+  sl_avr_emu_extended_address_t function = emulation->memory.pc;
+  sl_avr_emu_word_t             opcode   = emulation->memory.flash[function];
+  sl_avr_emu_extended_address_t offset;
+
+  /* Name the handler the vector jumps to rather than the vector */
+  if(SL_AVR_EMU_IS_JMP_CALL(opcode) && 0 == (opcode & 0x2) && SL_AVR_EMU_FLASH_ADDRESS_VALID(function + 1))
+  {
+    function = emulation->memory.flash[function + 1] | ((opcode & 0x1) << 16) | ((opcode & 0x1F0) << 13);
+  }
+  else if(SL_AVR_EMU_IS_RJMP_RCALL(opcode) && !SL_AVR_EMU_CHECK_BIT(opcode, 12))
+  {
+    offset   = opcode & 0x0FFF;
+    function = (SL_AVR_EMU_CHECK_BIT(offset, 11))?function + 1 - (0x1000 - offset):function + 1 + offset;
+  }
+
+  sl_avr_emu_callgraph_push(emulation, function, true, SL_AVR_EMU_GET_SP(emulation));
+}
+
+/**
+ * @brief Leaves the frame whose return address is on top of the stack.  Called by RET/RETI before popping it.
+ * 
+ * @param emulation
+ */
+void sl_avr_emu_callgraph_return(sl_avr_emu_emulation_s *emulation)
+{
+  sl_avr_emu_callgraph_s *callgraph = emulation->hooks.callgraph;
+  sl_avr_emu_address_t    sp        = SL_AVR_EMU_GET_SP(emulation);
+
+  sl_avr_emu_callgraph_charge(callgraph, emulation->tick_count);
+
+  /* Frames deeper than the return address were abandoned (e.g. longjmp) */
+  while(callgraph->depth > 0 && callgraph->frames[callgraph->depth-1].sp < sp)
+  {
+    sl_avr_emu_callgraph_pop(callgraph, emulation->tick_count);
+  }
+  if(callgraph->depth > 0 && callgraph->frames[callgraph->depth-1].sp == sp)
+  {
+    sl_avr_emu_callgraph_pop(callgraph, emulation->tick_count);
+  }
+}
+
+/**
+ * @brief Prints the top_n functions by inclusive cycles.  Open frames are closed at the current tick.
+ * 
+ * @param output
+ * @param emulation
+ * @param top_n
+ */
+void sl_avr_emu_callgraph_report(FILE *output, sl_avr_emu_emulation_s *emulation, uint32_t top_n)
+{
+  sl_avr_emu_callgraph_s       *callgraph = emulation->hooks.callgraph;
+  const sl_avr_emu_callgraph_node_s *node;
+  sl_avr_emu_callgraph_entry_s *entries;
+  uint32_t                     *order;
+  uint32_t                      entry_count = 0;
+  uint64_t                      total = 0;
+  uint64_t                      isr_total = 0;
+  uint32_t                      i, ancestor;
+  bool                          recursive;
+  char                          name[SL_AVR_EMU_CALLGRAPH_NAME_SIZE];
+
+  if(NULL == callgraph)
+  {
+    return;
+  }
+  sl_avr_emu_callgraph_close(emulation);
+
+  order   = malloc(callgraph->node_count * sizeof(uint32_t));
+  entries = calloc(callgraph->node_count, sizeof(sl_avr_emu_callgraph_entry_s));
+  if(NULL == order || NULL == entries)
+  {
+    free(order);
+    free(entries);
+    return;
+  }
+
+  for(i = 1; i < callgraph->node_count; i++)
+  {
+    order[i-1] = i;
+  }
+  sl_avr_emu_callgraph_sort_nodes = callgraph->nodes;
+  qsort(order, callgraph->node_count - 1, sizeof(uint32_t), sl_avr_emu_callgraph_compare_function);
+
+  for(i = 0; i < callgraph->node_count - 1; i++)
+  {
+    node = &callgraph->nodes[order[i]];
+    if(0 == entry_count || entries[entry_count-1].function != node->function || entries[entry_count-1].isr != node->isr)
+    {
+      entries[entry_count].function = node->function;
+      entries[entry_count].isr      = node->isr;
+      entry_count++;
+    }
+    entries[entry_count-1].calls     += node->calls;
+    entries[entry_count-1].exclusive += node->exclusive;
+    total += node->exclusive;
+
+    /* Recursive activations are already inside the outermost one's inclusive cycles */
+    recursive = false;
+    for(ancestor = order[i]; !callgraph->nodes[ancestor].isr && callgraph->nodes[ancestor].parent != SL_AVR_EMU_CALLGRAPH_ROOT; )
+    {
+      ancestor = callgraph->nodes[ancestor].parent;
+      if(callgraph->nodes[ancestor].function == node->function && callgraph->nodes[ancestor].isr == node->isr)
+      {
+        recursive = true;
+        break;
+      }
+    }
+    if(!recursive)
+    {
+      entries[entry_count-1].inclusive += node->inclusive;
+    }
+    if(node->isr && SL_AVR_EMU_CALLGRAPH_ROOT == node->parent)
+    {
+      isr_total += node->inclusive;
+    }
+  }
+  qsort(entries, entry_count, sizeof(sl_avr_emu_callgraph_entry_s), sl_avr_emu_callgraph_compare_inclusive);
+
+  fprintf(output, "\nCall graph: %lu cycles, %lu (%.2f%%) in interrupts\n", total, isr_total, (total > 0)?100.0*isr_total/total:0.0);
+  fprintf(output, "  %12s %7s %12s %7s %10s  %s\n", "inclusive", "%", "exclusive", "%", "calls", "function");
+  for(i = 0; i < top_n && i < entry_count; i++)
+  {
+    fprintf(output, "  %12lu %6.2f%% %12lu %6.2f%% %10lu  %s%s\n",
+            entries[i].inclusive, (total > 0)?100.0*entries[i].inclusive/total:0.0,
+            entries[i].exclusive, (total > 0)?100.0*entries[i].exclusive/total:0.0,
+            entries[i].calls, sl_avr_emu_callgraph_name(emulation, entries[i].function, name, sizeof(name)),
+            (entries[i].isr)?" [interrupt]":"");
+  }
+
+  free(order);
+  free(entries);
+}
+
+/**
+ * @brief Writes exclusive cycles per call path in collapsed-stack format ("main;loop;f 1234"),
+ *        as read by flame graph tools.  Interrupt handlers are rooted separately from the interrupted code.
+ *        Open frames are closed at the current tick.
+ * 
+ * @param output
+ * @param emulation
+ */
+void sl_avr_emu_callgraph_write_collapsed(FILE *output, sl_avr_emu_emulation_s *emulation)
+{
+  sl_avr_emu_callgraph_s *callgraph = emulation->hooks.callgraph;
+  uint32_t                path[SL_AVR_EMU_CALLGRAPH_DEPTH_MAX];
+  uint32_t                path_length;
+  uint32_t                i, node;
+  char                    name[SL_AVR_EMU_CALLGRAPH_NAME_SIZE];
+
+  if(NULL == callgraph)
+  {
+    return;
+  }
+  sl_avr_emu_callgraph_close(emulation);
+
+  for(i = 1; i < callgraph->node_count; i++)
+  {
+    if(0 == callgraph->nodes[i].exclusive)
+    {
+      continue;
+    }
+
+    path_length = 0;
+    for(node = i; node != SL_AVR_EMU_CALLGRAPH_ROOT && path_length < SL_AVR_EMU_CALLGRAPH_DEPTH_MAX; node = callgraph->nodes[node].parent)
+    {
+      path[path_length++] = node;
+    }
+
+    if(callgraph->nodes[path[path_length-1]].isr)
+    {
+      fprintf(output, "[interrupt];");
+    }
+    while(path_length > 0)
+    {
+      path_length--;
+      fprintf(output, "%s%s", sl_avr_emu_callgraph_name(emulation, callgraph->nodes[path[path_length]].function, name, sizeof(name)),
+              (path_length > 0)?";":"");
+    }
+    fprintf(output, " %lu\n", callgraph->nodes[i].exclusive);
+  }
+}
+
+/**
+ * @brief Detaches and frees emulation's call-graph profile
+ * 
+ * @param emulation
+ */
+void sl_avr_emu_callgraph_stop(sl_avr_emu_emulation_s *emulation)
+{
+  if(emulation->hooks.callgraph != NULL)
+  {
+    free(emulation->hooks.callgraph->nodes);
+    free(emulation->hooks.callgraph);
+    emulation->hooks.callgraph = NULL;
+  }
+}
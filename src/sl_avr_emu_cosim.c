@@ -0,0 +1,485 @@
+/**
+ * @file sl_avr_emu_cosim.c
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator Multi-Board Co-Simulation Logic
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ * Every byte sent between boards is stamped to arrive one quantum after it was sent.  A byte sent in
+ * one quantum therefore always arrives in a later one, so boards of a quantum run without seeing each
+ * other and only meet at the barrier between quanta.  Each board touches only its own emulation, the
+ * tail of the links it receives on and the head of the links it sends on, so any assignment of boards
+ * to threads runs the same instructions at the same ticks.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sl_avr_emu_cosim.h"
+#include "sl_avr_emu_event.h"
+#include "sl_avr_emu_replay.h"
+#include "sl_avr_emu_tick.h"
+#include "sl_avr_emu_usart.h"
+
+#define SL_AVR_EMU_COSIM_QUEUE_MASK (SL_AVR_EMU_COSIM_QUEUE_SIZE - 1)
+
+/**
+ * @brief Thread running a share of the boards
+ * 
+ */
+typedef struct
+{
+  sl_avr_emu_cosim_s *cosim;
+  uint32_t            index;
+  pthread_t           thread;
+
+} sl_avr_emu_cosim_worker_s;
+
+/**
+ * @brief Initializes an empty co-simulation
+ * 
+ * @param cosim
+ * @param quantum - Ticks between synchronizations, and latency of every link.  Limited to SL_AVR_EMU_COSIM_QUANTUM_MAX.
+ */
+void sl_avr_emu_cosim_init(sl_avr_emu_cosim_s *cosim, sl_avr_emu_tick_count_t quantum)
+{
+  memset(cosim, 0, sizeof(sl_avr_emu_cosim_s));
+  cosim->quantum = (0 == quantum)?SL_AVR_EMU_COSIM_QUANTUM_DEFAULT:(quantum > SL_AVR_EMU_COSIM_QUANTUM_MAX)?SL_AVR_EMU_COSIM_QUANTUM_MAX:quantum;
+}
+
+/**
+ * @brief Adds an initialized emulation with firmware loaded as a board.  Boards start together, at tick 0.
+ * 
+ * @param cosim
+ * @param emulation
+ * @return sl_avr_emu_result_e - SL_AVR_EMU_RESULT_FAILURE if SL_AVR_EMU_COSIM_BOARDS_MAX boards were added already
+ */
+sl_avr_emu_result_e sl_avr_emu_cosim_add_board(sl_avr_emu_cosim_s *cosim, sl_avr_emu_emulation_s *emulation)
+{
+  sl_avr_emu_cosim_board_s *board;
+
+  if(cosim->board_count >= SL_AVR_EMU_COSIM_BOARDS_MAX)
+  {
+    return SL_AVR_EMU_RESULT_FAILURE;
+  }
+
+  board = &cosim->boards[cosim->board_count];
+  memset(board, 0, sizeof(sl_avr_emu_cosim_board_s));
+  board->emulation = emulation;
+  board->result    = SL_AVR_EMU_RESULT_SUCCESS;
+  board->cosim     = cosim;
+  cosim->board_count++;
+
+  return SL_AVR_EMU_RESULT_SUCCESS;
+}
+
+/**
+ * @brief Returns the oldest undelivered message on a link, if it is due before tick.  Called by the receiving board.
+ * 
+ * @param link
+ * @param tick
+ * @return const sl_avr_emu_cosim_message_s* - NULL if the link is empty or its oldest message is not yet due
+ */
+static const sl_avr_emu_cosim_message_s *sl_avr_emu_cosim_due(const sl_avr_emu_cosim_link_s *link, sl_avr_emu_tick_count_t tick)
+{
+  const sl_avr_emu_cosim_message_s *message;
+  uint_fast32_t                     tail;
+
+  tail = atomic_load_explicit(&link->tail, memory_order_relaxed);
+  if(tail == atomic_load_explicit(&link->head, memory_order_acquire))
+  {
+    return NULL;
+  }
+  message = &link->queue[tail & SL_AVR_EMU_COSIM_QUEUE_MASK];
+
+  return (message->tick < tick)?message:NULL;
+}
+
+/**
+ * @brief Delivery event of a link's oldest message.  Receives the byte, then schedules the next message due this quantum.
+ * 
+ * @param emulation - Receiving board
+ * @param context   - Link
+ * @return sl_avr_emu_result_e
+ */
+static sl_avr_emu_result_e sl_avr_emu_cosim_deliver_event(sl_avr_emu_emulation_s *emulation, void *context)
+{
+  sl_avr_emu_result_e               result = SL_AVR_EMU_RESULT_SUCCESS;
+  sl_avr_emu_cosim_link_s          *link   = context;
+  const sl_avr_emu_cosim_message_s *message;
+  sl_avr_emu_byte_t                 byte;
+  uint_fast32_t                     tail;
+
+  tail = atomic_load_explicit(&link->tail, memory_order_relaxed);
+  byte = link->queue[tail & SL_AVR_EMU_COSIM_QUEUE_MASK].byte;
+  atomic_store_explicit(&link->tail, tail + 1, memory_order_release);
+  link->scheduled = false;
+
+  /* Through the stimulus path when recording, replaying or reverse executing, so the byte is logged */
+  if(NULL != emulation->hooks.replay || NULL != emulation->hooks.reverse)
+  {
+    result = sl_avr_emu_stimulus_inject(emulation, SL_AVR_EMU_STIMULUS_SERIAL_RX, link->to_port, byte);
+  }
+  else if(NULL != emulation->hooks.serial_rx_handler)
+  {
+    result = emulation->hooks.serial_rx_handler(emulation, link->to_port, byte, emulation->hooks.serial_rx_context);
+  }
+
+  message = sl_avr_emu_cosim_due(link, link->cosim->boards[link->to].until);
+  if(SL_AVR_EMU_RESULT_SUCCESS == result && NULL != message)
+  {
+    result = sl_avr_emu_event_schedule(emulation, (message->tick > emulation->tick_count)?message->tick:emulation->tick_count,
+                                       sl_avr_emu_cosim_deliver_event, link);
+    link->scheduled = (SL_AVR_EMU_RESULT_SUCCESS == result);
+  }
+
+  return result;
+}
+
+/**
+ * @brief Serial transmit handler of every board.  Sends the byte on each link from the transmitting port.
+ * 
+ * @param emulation - Transmitting board
+ * @param port
+ * @param byte
+ * @param context   - Board
+ * @return sl_avr_emu_result_e - SL_AVR_EMU_RESULT_FAILURE if a link is full
+ */
+static sl_avr_emu_result_e sl_avr_emu_cosim_transmit(sl_avr_emu_emulation_s *emulation, sl_avr_emu_address_t port, sl_avr_emu_byte_t byte, void *context)
+{
+  sl_avr_emu_cosim_board_s *board = context;
+  sl_avr_emu_cosim_s       *cosim = board->cosim;
+  sl_avr_emu_cosim_link_s  *link;
+  uint32_t                  from  = board - cosim->boards;
+  uint_fast32_t             head;
+  uint32_t                  i;
+
+  for(i = 0; i < cosim->link_count; i++)
+  {
+    link = cosim->links[i];
+    if(link->from != from || link->from_port != port)
+    {
+      continue;
+    }
+
+    head = atomic_load_explicit(&link->head, memory_order_relaxed);
+    if((head - atomic_load_explicit(&link->tail, memory_order_acquire)) >= SL_AVR_EMU_COSIM_QUEUE_SIZE)
+    {
+      /* Not reached within SL_AVR_EMU_COSIM_QUANTUM_MAX.  Waiting for the receiver would depend on thread timing. */
+      SL_AVR_EMU_VERBOSE_LOG(printf("Co-simulation link %u full\n", i));
+      return SL_AVR_EMU_RESULT_FAILURE;
+    }
+    link->queue[head & SL_AVR_EMU_COSIM_QUEUE_MASK].tick = emulation->tick_count + cosim->quantum;
+    link->queue[head & SL_AVR_EMU_COSIM_QUEUE_MASK].byte = byte;
+    atomic_store_explicit(&link->head, head + 1, memory_order_release);
+    link->messages++;
+  }
+
+  return SL_AVR_EMU_RESULT_SUCCESS;
+}
+
+/**
+ * @brief Connects USART0 transmit of one board to USART0 receive of another, attaching USART0 to either as needed
+ * 
+ * @param cosim
+ * @param from    - Board index
+ * @param to      - Board index
+ * @return sl_avr_emu_result_e
+ */
+sl_avr_emu_result_e sl_avr_emu_cosim_connect_uart(sl_avr_emu_cosim_s *cosim, uint32_t from, uint32_t to)
+{
+  sl_avr_emu_result_e       result = SL_AVR_EMU_RESULT_SUCCESS;
+  sl_avr_emu_cosim_board_s *sender;
+  sl_avr_emu_cosim_board_s *receiver;
+  sl_avr_emu_cosim_link_s  *link;
+
+  if(from >= cosim->board_count || to >= cosim->board_count ||
+     cosim->link_count >= SL_AVR_EMU_COSIM_LINKS_MAX)
+  {
+    return SL_AVR_EMU_RESULT_FAILURE;
+  }
+  sender   = &cosim->boards[from];
+  receiver = &cosim->boards[to];
+
+  if(NULL == sender->emulation->hooks.usart0)
+  {
+    result = sl_avr_emu_usart_start(sender->emulation, -1, -1);
+  }
+  if(SL_AVR_EMU_RESULT_SUCCESS == result && NULL == receiver->emulation->hooks.usart0)
+  {
+    result = sl_avr_emu_usart_start(receiver->emulation, -1, -1);
+  }
+  if(SL_AVR_EMU_RESULT_SUCCESS != result)
+  {
+    return result;
+  }
+
+  link = calloc(1, sizeof(sl_avr_emu_cosim_link_s));
+  if(NULL == link)
+  {
+    return SL_AVR_EMU_RESULT_FAILURE;
+  }
+  link->from      = from;
+  link->from_port = SL_AVR_EMU_USART_0_PORT;
+  link->to        = to;
+  link->to_port   = SL_AVR_EMU_USART_0_PORT;
+  link->cosim     = cosim;
+  cosim->links[cosim->link_count++] = link;
+  receiver->inputs[receiver->input_count++] = link;
+
+  sender->emulation->hooks.serial_tx_handler = sl_avr_emu_cosim_transmit;
+  sender->emulation->hooks.serial_tx_context = sender;
+
+  return SL_AVR_EMU_RESULT_SUCCESS;
+}
+
+/**
+ * @brief Runs one board to the end of the quantum, first scheduling delivery of the messages due in it
+ * 
+ * @param cosim
+ * @param board
+ * @param until - End of the quantum
+ */
+static void sl_avr_emu_cosim_board_run(sl_avr_emu_cosim_s *cosim, sl_avr_emu_cosim_board_s *board, sl_avr_emu_tick_count_t until)
+{
+  sl_avr_emu_emulation_s           *emulation = board->emulation;
+  sl_avr_emu_cosim_link_s          *link;
+  const sl_avr_emu_cosim_message_s *message;
+  uint32_t                          i;
+
+  board->until = until;
+  for(i = 0; i < board->input_count; i++)
+  {
+    link = board->inputs[i];
+    if(SL_AVR_EMU_RESULT_SUCCESS != board->result)
+    {
+      /* Stopped boards still consume their links, so senders never find them full */
+      while(NULL != sl_avr_emu_cosim_due(link, until))
+      {
+        atomic_fetch_add_explicit(&link->tail, 1, memory_order_release);
+        link->discarded++;
+      }
+      continue;
+    }
+
+    message = link->scheduled?NULL:sl_avr_emu_cosim_due(link, until);
+    if(NULL != message)
+    {
+      board->result   = sl_avr_emu_event_schedule(emulation, (message->tick > emulation->tick_count)?message->tick:emulation->tick_count,
+                                                  sl_avr_emu_cosim_deliver_event, link);
+      link->scheduled = (SL_AVR_EMU_RESULT_SUCCESS == board->result);
+    }
+  }
+
+  if(SL_AVR_EMU_RESULT_SUCCESS == board->result)
+  {
+    board->result = sl_avr_emu_run(emulation, until);
+  }
+}
+
+/**
+ * @brief Runs the boards assigned to one thread, quantum by quantum, until no board is running
+ * 
+ * @param context - Worker
+ * @return void*
+ */
+static void *sl_avr_emu_cosim_thread(void *context)
+{
+  sl_avr_emu_cosim_worker_s *worker = context;
+  sl_avr_emu_cosim_s        *cosim  = worker->cosim;
+  sl_avr_emu_cosim_board_s  *board;
+  sl_avr_emu_tick_count_t    start  = 0;
+  sl_avr_emu_tick_count_t    until;
+  uint64_t                   quantum;
+  bool                       running = true;
+  uint32_t                   i;
+
+  pthread_mutex_lock(&cosim->gate);
+  pthread_mutex_unlock(&cosim->gate);
+  if(worker->index >= cosim->thread_count)
+  {
+    return NULL;
+  }
+
+  for(quantum = 0; running; quantum++)
+  {
+    until = (cosim->tick_limit - start > cosim->quantum)?(start + cosim->quantum):cosim->tick_limit;
+
+    for(i = worker->index; i < cosim->board_count; i += cosim->thread_count)
+    {
+      board = &cosim->boards[i];
+      sl_avr_emu_cosim_board_run(cosim, board, until);
+      board->running[quantum & 0x1] = (SL_AVR_EMU_RESULT_SUCCESS == board->result && board->emulation->tick_count < cosim->tick_limit);
+    }
+
+    pthread_barrier_wait(&cosim->barrier);
+
+    /* Each thread decides alike from flags no board writes again until the next barrier has passed */
+    running = false;
+    for(i = 0; i < cosim->board_count; i++)
+    {
+      running = running || cosim->boards[i].running[quantum & 0x1];
+    }
+    start = until;
+  }
+
+  if(0 == worker->index)
+  {
+    cosim->quanta = quantum;
+  }
+
+  return NULL;
+}
+
+/**
+ * @brief Runs all boards until tick_limit or until every board has stopped
+ * 
+ * @param cosim
+ * @param tick_limit
+ * @param thread_count - Threads to run boards on, boards are assigned round robin
+ * @return sl_avr_emu_result_e - First unsuccessful board result, SL_AVR_EMU_RESULT_SUCCESS if all boards reached tick_limit
+ */
+sl_avr_emu_result_e sl_avr_emu_cosim_run(sl_avr_emu_cosim_s *cosim, sl_avr_emu_tick_count_t tick_limit, uint32_t thread_count)
+{
+  sl_avr_emu_result_e        result = SL_AVR_EMU_RESULT_SUCCESS;
+  sl_avr_emu_cosim_worker_s  workers[SL_AVR_EMU_COSIM_BOARDS_MAX];
+  uint32_t                   started;
+  uint32_t                   i;
+
+  if(0 == cosim->board_count)
+  {
+    return SL_AVR_EMU_RESULT_FAILURE;
+  }
+
+  cosim->tick_limit   = tick_limit;
+  cosim->thread_count = (0 == thread_count)?1:(thread_count > cosim->board_count)?cosim->board_count:thread_count;
+  if(0 != pthread_mutex_init(&cosim->gate, NULL))
+  {
+    return SL_AVR_EMU_RESULT_FAILURE;
+  }
+
+  /* Workers wait at the gate until the number of threads, and so the barrier and board assignment, is settled */
+  pthread_mutex_lock(&cosim->gate);
+  for(i = 0; i < cosim->thread_count; i++)
+  {
+    workers[i].cosim = cosim;
+    workers[i].index = i;
+  }
+  for(started = 1; started < cosim->thread_count; started++)
+  {
+    if(0 != pthread_create(&workers[started].thread, NULL, sl_avr_emu_cosim_thread, &workers[started]))
+    {
+      SL_AVR_EMU_VERBOSE_LOG(printf("Co-simulation running on %u threads, not %u\n", started, cosim->thread_count));
+      break;
+    }
+  }
+  cosim->thread_count = started;
+  if(0 != pthread_barrier_init(&cosim->barrier, NULL, cosim->thread_count))
+  {
+    /* Boards are only run past the gate, so started workers simply find nothing to do */
+    cosim->thread_count = 0;
+  }
+  pthread_mutex_unlock(&cosim->gate);
+
+  if(0 == cosim->thread_count)
+  {
+    for(i = 1; i < started; i++)
+    {
+      pthread_join(workers[i].thread, NULL);
+    }
+    pthread_mutex_destroy(&cosim->gate);
+    return SL_AVR_EMU_RESULT_FAILURE;
+  }
+
+  sl_avr_emu_cosim_thread(&workers[0]);
+  for(i = 1; i < cosim->thread_count; i++)
+  {
+    pthread_join(workers[i].thread, NULL);
+  }
+  pthread_barrier_destroy(&cosim->barrier);
+  pthread_mutex_destroy(&cosim->gate);
+
+  for(i = 0; i < cosim->board_count && SL_AVR_EMU_RESULT_SUCCESS == result; i++)
+  {
+    result = cosim->boards[i].result;
+  }
+
+  return result;
+}
+
+/**
+ * @brief Prints the state of each board and the traffic on each link
+ * 
+ * @param output
+ * @param cosim
+ */
+void sl_avr_emu_cosim_report(FILE *output, const sl_avr_emu_cosim_s *cosim)
+{
+  const sl_avr_emu_cosim_board_s *board;
+  const sl_avr_emu_cosim_link_s  *link;
+  const sl_avr_emu_usart_s       *usart;
+  /* FNV-1a of data memory, equal across runs exactly when the boards ended in the same state */
+  uint64_t                        hash;
+  uint32_t                        address;
+  uint32_t                        i;
+
+  fprintf(output, "\nCo-simulation: %u boards, %u links, %lu quanta of %lu ticks on %u threads\n",
+          cosim->board_count, cosim->link_count, cosim->quanta, cosim->quantum, cosim->thread_count);
+  for(i = 0; i < cosim->board_count; i++)
+  {
+    board = &cosim->boards[i];
+    hash  = 0xcbf29ce484222325ULL;
+    for(address = 0; address < SL_AVR_EMU_DATA_SIZE; address++)
+    {
+      hash = (hash ^ board->emulation->memory.data[address]) * 0x100000001b3ULL;
+    }
+    fprintf(output, "  board %u: result %u at tick %lu, PC 0x%x, data hash %016lx", i, board->result,
+            board->emulation->tick_count, board->emulation->memory.pc*2, hash);
+    usart = board->emulation->hooks.usart0;
+    if(NULL != usart)
+    {
+      fprintf(output, ", USART0 %lu sent, %lu received", usart->tx_bytes, usart->rx_bytes);
+    }
+    fprintf(output, "\n");
+  }
+  for(i = 0; i < cosim->link_count; i++)
+  {
+    link = cosim->links[i];
+    fprintf(output, "  link %u: board %u port %u -> board %u port %u, %lu bytes", i, link->from, link->from_port,
+            link->to, link->to_port, link->messages);
+    if(link->discarded > 0)
+    {
+      fprintf(output, ", %lu discarded", link->discarded);
+    }
+    fprintf(output, "\n");
+  }
+}
+
+/**
+ * @brief Frees links and detaches the co-simulation from its boards.  Boards remain owned by the caller.
+ * 
+ * @param cosim
+ */
+void sl_avr_emu_cosim_deinit(sl_avr_emu_cosim_s *cosim)
+{
+  sl_avr_emu_emulation_s *emulation;
+  uint32_t                i;
+
+  for(i = 0; i < cosim->link_count; i++)
+  {
+    sl_avr_emu_event_cancel(cosim->boards[cosim->links[i]->to].emulation, sl_avr_emu_cosim_deliver_event, cosim->links[i]);
+    free(cosim->links[i]);
+  }
+  for(i = 0; i < cosim->board_count; i++)
+  {
+    emulation = cosim->boards[i].emulation;
+    if(sl_avr_emu_cosim_transmit == emulation->hooks.serial_tx_handler)
+    {
+      emulation->hooks.serial_tx_handler = NULL;
+      emulation->hooks.serial_tx_context = NULL;
+    }
+  }
+  memset(cosim, 0, sizeof(sl_avr_emu_cosim_s));
+}
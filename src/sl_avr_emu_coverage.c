@@ -0,0 +1,346 @@
+/**
+ * @file sl_avr_emu_coverage.c
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator Code Coverage Logic
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ * Only the bitmap is maintained while running.  Source lines are resolved when coverage is written:
+ * a line is hit if any flash word in the address ranges the line table gives it has executed.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sl_avr_emu_coverage.h"
+#include "sl_avr_emu_dwarf.h"
+#include "sl_avr_emu_elf.h"
+
+/**
+ * @brief Source line or function coverage
+ * 
+ */
+typedef struct
+{
+  uint32_t    file;
+  uint32_t    line;
+  /* Function name, NULL for lines */
+  const char *function;
+  bool        hit;
+
+} sl_avr_emu_coverage_record_s;
+
+/**
+ * @brief Orders records by file, then line
+ * 
+ * @param a
+ * @param b
+ * @return int
+ */
+static int sl_avr_emu_coverage_record_compare(const void *a, const void *b)
+{
+  const sl_avr_emu_coverage_record_s *record_a = a;
+  const sl_avr_emu_coverage_record_s *record_b = b;
+
+  if(record_a->file != record_b->file)
+  {
+    return (record_a->file < record_b->file)?-1:1;
+  }
+  if(record_a->line != record_b->line)
+  {
+    return (record_a->line < record_b->line)?-1:1;
+  }
+  return 0;
+}
+
+/**
+ * @brief Checks if any flash word in [start, end) byte addresses has executed
+ * 
+ * @param coverage
+ * @param start
+ * @param end
+ * @return true
+ * @return false
+ */
+static bool sl_avr_emu_coverage_range_hit(const sl_avr_emu_coverage_s *coverage, uint32_t start, uint32_t end)
+{
+  uint32_t pc;
+
+  for(pc = start/2; pc < (end+1)/2; pc++)
+  {
+    if(sl_avr_emu_coverage_hit(coverage, pc))
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief Finds the line table row covering a flash byte address
+ * 
+ * @param lines
+ * @param address
+ * @return const sl_avr_emu_line_s* - NULL if no row covers address
+ */
+static const sl_avr_emu_line_s *sl_avr_emu_coverage_find_line(const sl_avr_emu_lines_s *lines, uint32_t address)
+{
+  uint32_t i;
+
+  for(i = 0; (i + 1) < lines->count; i++)
+  {
+    if(!lines->lines[i].end_sequence && lines->lines[i].address <= address && address < lines->lines[i+1].address)
+    {
+      return &lines->lines[i];
+    }
+  }
+  return NULL;
+}
+
+/**
+ * @brief Writes an lcov tracefile
+ * 
+ * @param output
+ * @param emulation
+ * @param lines
+ * @return sl_avr_emu_result_e
+ */
+static sl_avr_emu_result_e sl_avr_emu_coverage_write_lcov(FILE *output, const sl_avr_emu_emulation_s *emulation, const sl_avr_emu_lines_s *lines)
+{
+  const sl_avr_emu_coverage_s        *coverage = emulation->hooks.coverage;
+  const sl_avr_emu_symbols_s         *symbols  = emulation->hooks.symbols;
+  const sl_avr_emu_line_s            *line;
+  sl_avr_emu_coverage_record_s       *records;
+  sl_avr_emu_coverage_record_s       *pending;
+  uint32_t                            record_count = 0;
+  uint32_t                            functions_found, functions_hit, lines_found, lines_hit;
+  uint32_t                            i, j;
+
+  records = malloc((lines->count + symbols->count) * sizeof(sl_avr_emu_coverage_record_s));
+  if(NULL == records)
+  {
+    return SL_AVR_EMU_RESULT_FAILURE;
+  }
+
+  for(i = 0; (i + 1) < lines->count; i++)
+  {
+    if(!lines->lines[i].end_sequence && lines->lines[i].line > 0)
+    {
+      records[record_count].file     = lines->lines[i].file;
+      records[record_count].line     = lines->lines[i].line;
+      records[record_count].function = NULL;
+      records[record_count].hit      = sl_avr_emu_coverage_range_hit(coverage, lines->lines[i].address, lines->lines[i+1].address);
+      record_count++;
+    }
+  }
+  for(i = 0; i < symbols->count; i++)
+  {
+    if(symbols->symbols[i].function && NULL != (line = sl_avr_emu_coverage_find_line(lines, symbols->symbols[i].address)))
+    {
+      records[record_count].file     = line->file;
+      records[record_count].line     = line->line;
+      records[record_count].function = symbols->symbols[i].name;
+      records[record_count].hit      = sl_avr_emu_coverage_hit(coverage, symbols->symbols[i].address/2);
+      record_count++;
+    }
+  }
+  qsort(records, record_count, sizeof(sl_avr_emu_coverage_record_s), sl_avr_emu_coverage_record_compare);
+
+  fprintf(output, "TN:\n");
+  for(i = 0; i < record_count; i = j)
+  {
+    fprintf(output, "SF:%s\n", lines->files[records[i].file]);
+
+    functions_found = functions_hit = 0;
+    for(j = i; j < record_count && records[j].file == records[i].file; j++)
+    {
+      if(records[j].function != NULL)
+      {
+        fprintf(output, "FN:%u,%s\n", records[j].line, records[j].function);
+      }
+    }
+    for(j = i; j < record_count && records[j].file == records[i].file; j++)
+    {
+      if(records[j].function != NULL)
+      {
+        fprintf(output, "FNDA:%u,%s\n", records[j].hit?1:0, records[j].function);
+        functions_found++;
+        functions_hit += records[j].hit?1:0;
+      }
+    }
+    fprintf(output, "FNF:%u\nFNH:%u\n", functions_found, functions_hit);
+
+    /* A line split across several address ranges is hit if any of them is */
+    lines_found = lines_hit = 0;
+    pending     = NULL;
+    for(j = i; j <= record_count; j++)
+    {
+      if(j < record_count && records[j].file == records[i].file && records[j].function != NULL)
+      {
+        continue;
+      }
+      if(pending != NULL && j < record_count && records[j].file == records[i].file && records[j].line == pending->line)
+      {
+        pending->hit |= records[j].hit;
+        continue;
+      }
+      if(pending != NULL)
+      {
+        fprintf(output, "DA:%u,%u\n", pending->line, pending->hit?1:0);
+        lines_found++;
+        lines_hit += pending->hit?1:0;
+      }
+      if(j == record_count || records[j].file != records[i].file)
+      {
+        break;
+      }
+      pending = &records[j];
+    }
+    fprintf(output, "LF:%u\nLH:%u\nend_of_record\n", lines_found, lines_hit);
+  }
+
+  free(records);
+
+  return SL_AVR_EMU_RESULT_SUCCESS;
+}
+
+/**
+ * @brief Writes executed flash address ranges, and executed words per function when symbols are available
+ * 
+ * @param output
+ * @param emulation
+ */
+static void sl_avr_emu_coverage_write_ranges(FILE *output, const sl_avr_emu_emulation_s *emulation)
+{
+  const sl_avr_emu_coverage_s *coverage = emulation->hooks.coverage;
+  const sl_avr_emu_symbols_s  *symbols  = emulation->hooks.symbols;
+  const sl_avr_emu_symbol_s   *symbol;
+  uint64_t                     executed = 0;
+  uint32_t                     function_words, function_executed;
+  uint32_t                     pc, start;
+
+  fprintf(output, "# Executed flash byte address ranges\n");
+  for(pc = 0; pc < SL_AVR_EMU_FLASH_SIZE; pc++)
+  {
+    if(!sl_avr_emu_coverage_hit(coverage, pc))
+    {
+      continue;
+    }
+    for(start = pc; pc < SL_AVR_EMU_FLASH_SIZE && sl_avr_emu_coverage_hit(coverage, pc); pc++);
+    fprintf(output, "0x%06x-0x%06x\n", start*2, pc*2 - 1);
+    executed += pc - start;
+  }
+  fprintf(output, "# %lu flash words executed\n", executed);
+
+  if(NULL == symbols)
+  {
+    return;
+  }
+  fprintf(output, "# Executed words per function\n");
+  for(symbol = symbols->symbols; symbol < &symbols->symbols[symbols->count]; symbol++)
+  {
+    if(!symbol->function || 0 == symbol->size)
+    {
+      continue;
+    }
+    function_words    = (symbol->size + 1)/2;
+    function_executed = 0;
+    for(pc = symbol->address/2; pc < (symbol->address/2 + function_words); pc++)
+    {
+      function_executed += sl_avr_emu_coverage_hit(coverage, pc)?1:0;
+    }
+    fprintf(output, "%-32s %6u/%-6u %6.2f%%\n", symbol->name, function_executed, function_words, 100.0 * function_executed / function_words);
+  }
+}
+
+/**
+ * @brief Attaches a new, empty coverage bitmap to emulation
+ * 
+ * @param emulation
+ * @return sl_avr_emu_result_e
+ */
+sl_avr_emu_result_e sl_avr_emu_coverage_start(sl_avr_emu_emulation_s *emulation)
+{
+  sl_avr_emu_result_e    result = SL_AVR_EMU_RESULT_SUCCESS;
+  sl_avr_emu_coverage_s *coverage;
+
+  coverage = calloc(1, sizeof(sl_avr_emu_coverage_s));
+  if(coverage != NULL)
+  {
+    emulation->hooks.coverage = coverage;
+  }
+  else
+  {
+    result = SL_AVR_EMU_RESULT_FAILURE;
+  }
+
+  return result;
+}
+
+/**
+ * @brief Clears the coverage bitmap, e.g. between test cases
+ * 
+ * @param emulation
+ */
+void sl_avr_emu_coverage_reset(sl_avr_emu_emulation_s *emulation)
+{
+  memset(emulation->hooks.coverage->bits, 0, sizeof(emulation->hooks.coverage->bits));
+}
+
+/**
+ * @brief Checks if the flash word at pc has executed
+ * 
+ * @param coverage
+ * @param pc
+ * @return true
+ * @return false
+ */
+bool sl_avr_emu_coverage_hit(const sl_avr_emu_coverage_s *coverage, sl_avr_emu_extended_address_t pc)
+{
+  return SL_AVR_EMU_FLASH_ADDRESS_VALID(pc) &&
+         0 != (coverage->bits[pc / SL_AVR_EMU_COVERAGE_WORD_BITS] & (1ULL << (pc % SL_AVR_EMU_COVERAGE_WORD_BITS)));
+}
+
+/**
+ * @brief Writes coverage as an lcov tracefile when the firmware's ELF has DWARF line info,
+ *        otherwise as executed flash address ranges
+ * 
+ * @param output
+ * @param emulation
+ * @return sl_avr_emu_result_e
+ */
+sl_avr_emu_result_e sl_avr_emu_coverage_write(FILE *output, const sl_avr_emu_emulation_s *emulation)
+{
+  sl_avr_emu_result_e result = SL_AVR_EMU_RESULT_SUCCESS;
+  sl_avr_emu_lines_s  lines;
+
+  if(NULL == emulation->hooks.coverage)
+  {
+    return SL_AVR_EMU_RESULT_FAILURE;
+  }
+
+  if(SL_AVR_EMU_RESULT_SUCCESS == sl_avr_emu_dwarf_load_lines(emulation->hooks.symbols, &lines))
+  {
+    result = sl_avr_emu_coverage_write_lcov(output, emulation, &lines);
+    sl_avr_emu_lines_free(&lines);
+  }
+  else
+  {
+    sl_avr_emu_coverage_write_ranges(output, emulation);
+  }
+
+  return result;
+}
+
+/**
+ * @brief Detaches and frees emulation's coverage bitmap
+ * 
+ * @param emulation
+ */
+void sl_avr_emu_coverage_stop(sl_avr_emu_emulation_s *emulation)
+{
+  free(emulation->hooks.coverage);
+  emulation->hooks.coverage = NULL;
+}
@@ -0,0 +1,178 @@
+/**
+ * @file sl_avr_emu_disasm.c
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator Disassembler
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ * Covers the instructions the emulator decodes, anything else is shown as .word
+ */
+
+#include <stdio.h>
+
+#include "sl_avr_emu_disasm.h"
+#include "sl_avr_emu_opcode.h"
+
+/* Common operand fields */
+#define SL_AVR_EMU_DISASM_RD(opcode)    (((opcode) >> 4) & 0x1F)
+#define SL_AVR_EMU_DISASM_RR(opcode)    (((opcode) & 0xF) | (((opcode) >> 5) & 0x10))
+#define SL_AVR_EMU_DISASM_RD_HI(opcode) (16 + (((opcode) >> 4) & 0xF))
+#define SL_AVR_EMU_DISASM_K8(opcode)    ((((opcode) >> 4) & 0xF0) | ((opcode) & 0xF))
+
+static const char *sl_avr_emu_disasm_brbs[8] = { "brcs", "breq", "brmi", "brvs", "brlt", "brhs", "brts", "brie" };
+static const char *sl_avr_emu_disasm_brbc[8] = { "brcc", "brne", "brpl", "brvc", "brge", "brhc", "brtc", "brid" };
+static const char  sl_avr_emu_disasm_sreg[8] = { 'c', 'z', 'n', 'v', 's', 'h', 't', 'i' };
+
+/**
+ * @brief Disassembles the instruction at pc
+ * 
+ * @param flash 
+ * @param pc 
+ * @param buffer - At least SL_AVR_EMU_DISASM_BUFFER_SIZE characters
+ * @param size 
+ * @return uint32_t - Instruction length in words
+ */
+uint32_t sl_avr_emu_disassemble(const sl_avr_emu_word_t *flash, sl_avr_emu_extended_address_t pc, char *buffer, size_t size)
+{
+  sl_avr_emu_word_t opcode = flash[pc];
+  sl_avr_emu_word_t next   = SL_AVR_EMU_FLASH_ADDRESS_VALID(pc+1)?flash[pc+1]:0;
+  uint32_t          words  = SL_AVR_EMU_IS_TWO_WORD_OPCODE(opcode)?2:1;
+  int32_t           offset;
+
+  if(0x0000 == opcode)
+  {
+    snprintf(buffer, size, "nop");
+  }
+  else if(0x9598 == opcode)
+  {
+    snprintf(buffer, size, "break");
+  }
+  else if(SL_AVR_EMU_IS_ADD(opcode))
+  {
+    snprintf(buffer, size, "%s r%u, r%u", (opcode & 0x1000)?"adc":"add", SL_AVR_EMU_DISASM_RD(opcode), SL_AVR_EMU_DISASM_RR(opcode));
+  }
+  else if(SL_AVR_EMU_IS_SUB(opcode))
+  {
+    snprintf(buffer, size, "%s r%u, r%u", (opcode & 0x1000)?"sub":"sbc", SL_AVR_EMU_DISASM_RD(opcode), SL_AVR_EMU_DISASM_RR(opcode));
+  }
+  else if(SL_AVR_EMU_IS_CP_CPC(opcode))
+  {
+    snprintf(buffer, size, "%s r%u, r%u", (opcode & 0x1000)?"cp":"cpc", SL_AVR_EMU_DISASM_RD(opcode), SL_AVR_EMU_DISASM_RR(opcode));
+  }
+  else if(SL_AVR_EMU_IS_CPSE(opcode) || SL_AVR_EMU_IS_AND(opcode) || SL_AVR_EMU_IS_EOR(opcode) ||
+          SL_AVR_EMU_IS_OR(opcode)   || SL_AVR_EMU_IS_MOV(opcode))
+  {
+    snprintf(buffer, size, "%s r%u, r%u", 
+             SL_AVR_EMU_IS_CPSE(opcode)?"cpse":SL_AVR_EMU_IS_AND(opcode)?"and":SL_AVR_EMU_IS_EOR(opcode)?"eor":SL_AVR_EMU_IS_OR(opcode)?"or":"mov",
+             SL_AVR_EMU_DISASM_RD(opcode), SL_AVR_EMU_DISASM_RR(opcode));
+  }
+  else if(SL_AVR_EMU_IS_MOVW(opcode))
+  {
+    snprintf(buffer, size, "movw r%u, r%u", ((opcode >> 4) & 0xF)*2, (opcode & 0xF)*2);
+  }
+  else if(SL_AVR_EMU_IS_CPI(opcode) || SL_AVR_EMU_IS_SUBI_SBCI(opcode) || SL_AVR_EMU_IS_ORI(opcode) || SL_AVR_EMU_IS_LDI(opcode))
+  {
+    snprintf(buffer, size, "%s r%u, 0x%02x", 
+             SL_AVR_EMU_IS_CPI(opcode)?"cpi":SL_AVR_EMU_IS_ORI(opcode)?"ori":SL_AVR_EMU_IS_LDI(opcode)?"ldi":(opcode & 0x1000)?"subi":"sbci",
+             SL_AVR_EMU_DISASM_RD_HI(opcode), SL_AVR_EMU_DISASM_K8(opcode));
+  }
+  else if(SL_AVR_EMU_IS_ADIW(opcode) || SL_AVR_EMU_IS_SBIW(opcode))
+  {
+    snprintf(buffer, size, "%s r%u, %u", SL_AVR_EMU_IS_ADIW(opcode)?"adiw":"sbiw",
+             24 + ((opcode >> 4) & 0x3)*2, (opcode & 0xF) | ((opcode >> 2) & 0x30));
+  }
+  else if(SL_AVR_EMU_IS_DEC(opcode))
+  {
+    snprintf(buffer, size, "dec r%u", SL_AVR_EMU_DISASM_RD(opcode));
+  }
+  else if(SL_AVR_EMU_IS_COM(opcode))
+  {
+    snprintf(buffer, size, "com r%u", SL_AVR_EMU_DISASM_RD(opcode));
+  }
+  else if(SL_AVR_EMU_IS_IN_OUT(opcode))
+  {
+    if(opcode & 0x0800)
+    {
+      snprintf(buffer, size, "out 0x%02x, r%u", (opcode & 0xF) | ((opcode >> 5) & 0x30), SL_AVR_EMU_DISASM_RD(opcode));
+    }
+    else
+    {
+      snprintf(buffer, size, "in r%u, 0x%02x", SL_AVR_EMU_DISASM_RD(opcode), (opcode & 0xF) | ((opcode >> 5) & 0x30));
+    }
+  }
+  else if(SL_AVR_EMU_IS_JMP_CALL(opcode))
+  {
+    snprintf(buffer, size, "%s 0x%x", (opcode & 0x2)?"call":"jmp", 
+             ((((((uint32_t) opcode >> 3) & 0x3E) | (opcode & 0x1)) << 16) | next)*2);
+  }
+  else if(SL_AVR_EMU_IS_RJMP_RCALL(opcode))
+  {
+    offset = ((int32_t)((opcode & 0xFFF) << 20)) >> 20;
+    snprintf(buffer, size, "%s .%+d ; 0x%x", (opcode & 0x1000)?"rcall":"rjmp", offset*2, (pc + 1 + offset)*2);
+  }
+  else if(SL_AVR_EMU_IS_BRBS_BRBC(opcode))
+  {
+    offset = ((int32_t)(((opcode >> 3) & 0x7F) << 25)) >> 25;
+    snprintf(buffer, size, "%s .%+d ; 0x%x", (opcode & 0x0400)?sl_avr_emu_disasm_brbc[opcode & 0x7]:sl_avr_emu_disasm_brbs[opcode & 0x7],
+             offset*2, (pc + 1 + offset)*2);
+  }
+  else if(SL_AVR_EMU_IS_PUSH_POP(opcode))
+  {
+    snprintf(buffer, size, "%s r%u", (opcode & 0x0200)?"push":"pop", SL_AVR_EMU_DISASM_RD(opcode));
+  }
+  else if(SL_AVR_EMU_IS_LD_ST(opcode))
+  {
+    if(opcode & 0x0200)
+    {
+      snprintf(buffer, size, "st %sX%s, r%u", (opcode & 0x2)?"-":"", (opcode & 0x1)?"+":"", SL_AVR_EMU_DISASM_RD(opcode));
+    }
+    else
+    {
+      snprintf(buffer, size, "ld r%u, %sX%s", SL_AVR_EMU_DISASM_RD(opcode), (opcode & 0x2)?"-":"", (opcode & 0x1)?"+":"");
+    }
+  }
+  else if(SL_AVR_EMU_IS_LDS_STS(opcode))
+  {
+    if(opcode & 0x0200)
+    {
+      snprintf(buffer, size, "sts 0x%04x, r%u", next, SL_AVR_EMU_DISASM_RD(opcode));
+    }
+    else
+    {
+      snprintf(buffer, size, "lds r%u, 0x%04x", SL_AVR_EMU_DISASM_RD(opcode), next);
+    }
+  }
+  else if(SL_AVR_EMU_IS_LPM_ELPM(opcode))
+  {
+    snprintf(buffer, size, "%s", (opcode & 0x0010)?"elpm":"lpm");
+  }
+  else if(SL_AVR_EMU_IS_LPMZ_ELPMZ(opcode))
+  {
+    snprintf(buffer, size, "%s r%u, Z%s", (opcode & 0x2)?"elpm":"lpm", SL_AVR_EMU_DISASM_RD(opcode), (opcode & 0x1)?"+":"");
+  }
+  else if(SL_AVR_EMU_IS_RET(opcode))
+  {
+    snprintf(buffer, size, "ret");
+  }
+  else if(SL_AVR_EMU_IS_RETI(opcode))
+  {
+    snprintf(buffer, size, "reti");
+  }
+  else if(SL_AVR_EMU_IS_SBIC_SBIS(opcode))
+  {
+    snprintf(buffer, size, "%s 0x%02x, %u", (opcode & 0x0200)?"sbis":"sbic", (opcode >> 3) & 0x1F, opcode & 0x7);
+  }
+  else if(SL_AVR_EMU_IS_SEX_CLX(opcode))
+  {
+    snprintf(buffer, size, "%s%c", (opcode & 0x0080)?"cl":"se", sl_avr_emu_disasm_sreg[(opcode >> 4) & 0x7]);
+  }
+  else
+  {
+    snprintf(buffer, size, ".word 0x%04x", opcode);
+    words = 1;
+  }
+
+  return words;
+}
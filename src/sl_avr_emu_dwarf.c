@@ -0,0 +1,667 @@
+/**
+ * @file sl_avr_emu_dwarf.c
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator DWARF Line Table Logic
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ * Runs the .debug_line programs of DWARF versions 2 through 5.  Only the row address, file and line
+ * are kept.  Files are deduplicated across units by path so headers included by several units
+ * share one entry.
+ */
+
+#include <elf.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sl_avr_emu_dwarf.h"
+
+/* Line number program opcodes */
+#define SL_AVR_EMU_DW_LNS_COPY             0x01
+#define SL_AVR_EMU_DW_LNS_ADVANCE_PC       0x02
+#define SL_AVR_EMU_DW_LNS_ADVANCE_LINE     0x03
+#define SL_AVR_EMU_DW_LNS_SET_FILE         0x04
+#define SL_AVR_EMU_DW_LNS_CONST_ADD_PC     0x08
+#define SL_AVR_EMU_DW_LNS_FIXED_ADVANCE_PC 0x09
+#define SL_AVR_EMU_DW_LNE_END_SEQUENCE     0x01
+#define SL_AVR_EMU_DW_LNE_SET_ADDRESS      0x02
+
+/* DWARF 5 entry formats */
+#define SL_AVR_EMU_DW_LNCT_PATH            0x1
+#define SL_AVR_EMU_DW_LNCT_DIRECTORY_INDEX 0x2
+#define SL_AVR_EMU_DW_FORM_BLOCK           0x09
+#define SL_AVR_EMU_DW_FORM_DATA1           0x0b
+#define SL_AVR_EMU_DW_FORM_DATA2           0x05
+#define SL_AVR_EMU_DW_FORM_DATA4           0x06
+#define SL_AVR_EMU_DW_FORM_DATA8           0x07
+#define SL_AVR_EMU_DW_FORM_DATA16          0x1e
+#define SL_AVR_EMU_DW_FORM_STRING          0x08
+#define SL_AVR_EMU_DW_FORM_STRP            0x0e
+#define SL_AVR_EMU_DW_FORM_UDATA           0x0f
+#define SL_AVR_EMU_DW_FORM_LINE_STRP       0x1f
+
+/* Directories or files per unit */
+#define SL_AVR_EMU_DWARF_ENTRIES_MAX 256
+
+/**
+ * @brief Bounds checked reader over a section
+ * 
+ */
+typedef struct
+{
+  const sl_avr_emu_byte_t *position;
+  const sl_avr_emu_byte_t *end;
+  bool                     error;
+
+} sl_avr_emu_dwarf_reader_s;
+
+/**
+ * @brief ELF section contents
+ * 
+ */
+typedef struct
+{
+  const sl_avr_emu_byte_t *data;
+  size_t                   size;
+
+} sl_avr_emu_dwarf_section_s;
+
+/**
+ * @brief Reads a little endian unsigned value of size bytes
+ * 
+ * @param reader
+ * @param size
+ * @return uint64_t
+ */
+static uint64_t sl_avr_emu_dwarf_read(sl_avr_emu_dwarf_reader_s *reader, uint32_t size)
+{
+  uint64_t result = 0;
+  uint32_t i;
+
+  if(reader->error || (size_t)(reader->end - reader->position) < size)
+  {
+    reader->error = true;
+    return 0;
+  }
+  for(i = 0; i < size; i++)
+  {
+    result |= ((uint64_t) reader->position[i]) << (8*i);
+  }
+  reader->position += size;
+
+  return result;
+}
+
+/**
+ * @brief Reads an unsigned LEB128 value
+ * 
+ * @param reader
+ * @return uint64_t
+ */
+static uint64_t sl_avr_emu_dwarf_read_uleb(sl_avr_emu_dwarf_reader_s *reader)
+{
+  uint64_t          result = 0;
+  uint32_t          shift  = 0;
+  sl_avr_emu_byte_t byte   = 0x80;
+
+  while(!reader->error && (byte & 0x80))
+  {
+    byte = sl_avr_emu_dwarf_read(reader, 1);
+    if(shift < 64)
+    {
+      result |= ((uint64_t)(byte & 0x7F)) << shift;
+    }
+    shift += 7;
+  }
+
+  return result;
+}
+
+/**
+ * @brief Reads a signed LEB128 value
+ * 
+ * @param reader
+ * @return int64_t
+ */
+static int64_t sl_avr_emu_dwarf_read_sleb(sl_avr_emu_dwarf_reader_s *reader)
+{
+  int64_t           result = 0;
+  uint32_t          shift  = 0;
+  sl_avr_emu_byte_t byte   = 0x80;
+
+  while(!reader->error && (byte & 0x80))
+  {
+    byte = sl_avr_emu_dwarf_read(reader, 1);
+    if(shift < 64)
+    {
+      result |= ((int64_t)(byte & 0x7F)) << shift;
+    }
+    shift += 7;
+  }
+  if(shift < 64 && (byte & 0x40))
+  {
+    result |= -(((int64_t) 1) << shift);
+  }
+
+  return result;
+}
+
+/**
+ * @brief Reads a NUL terminated string in place
+ * 
+ * @param reader
+ * @return const char* - NULL on error
+ */
+static const char *sl_avr_emu_dwarf_read_string(sl_avr_emu_dwarf_reader_s *reader)
+{
+  const char *result = (const char *) reader->position;
+  const sl_avr_emu_byte_t *terminator;
+
+  if(reader->error || NULL == (terminator = memchr(reader->position, 0, reader->end - reader->position)))
+  {
+    reader->error = true;
+    return NULL;
+  }
+  reader->position = terminator + 1;
+
+  return result;
+}
+
+/**
+ * @brief Returns the string at offset in a string section
+ * 
+ * @param section
+ * @param offset
+ * @return const char* - NULL if offset is outside the section
+ */
+static const char *sl_avr_emu_dwarf_section_string(const sl_avr_emu_dwarf_section_s *section, uint64_t offset)
+{
+  if(NULL == section->data || offset >= section->size || NULL == memchr(&section->data[offset], 0, section->size - offset))
+  {
+    return NULL;
+  }
+  return (const char *) &section->data[offset];
+}
+
+/**
+ * @brief Finds a section by name
+ * 
+ * @param map
+ * @param map_size
+ * @param name
+ * @param section  - Set to the section's contents, NULL data if not found
+ */
+static void sl_avr_emu_dwarf_find_section(const sl_avr_emu_byte_t *map, size_t map_size, const char *name, sl_avr_emu_dwarf_section_s *section)
+{
+  Elf32_Ehdr header;
+  Elf32_Shdr section_header, names_header;
+  uint32_t   i;
+
+  section->data = NULL;
+  section->size = 0;
+
+  if(map_size < sizeof(Elf32_Ehdr))
+  {
+    return;
+  }
+  memcpy(&header, map, sizeof(Elf32_Ehdr));
+  if(sizeof(Elf32_Shdr) != header.e_shentsize || header.e_shstrndx >= header.e_shnum ||
+     header.e_shoff > map_size || ((size_t) header.e_shnum * sizeof(Elf32_Shdr)) > (map_size - header.e_shoff))
+  {
+    return;
+  }
+  memcpy(&names_header, &map[header.e_shoff + header.e_shstrndx*sizeof(Elf32_Shdr)], sizeof(Elf32_Shdr));
+  if(names_header.sh_offset > map_size || names_header.sh_size > (map_size - names_header.sh_offset))
+  {
+    return;
+  }
+
+  for(i = 0; i < header.e_shnum; i++)
+  {
+    memcpy(&section_header, &map[header.e_shoff + i*sizeof(Elf32_Shdr)], sizeof(Elf32_Shdr));
+    if(section_header.sh_name < names_header.sh_size &&
+       0 == strncmp((const char *) &map[names_header.sh_offset + section_header.sh_name], name, names_header.sh_size - section_header.sh_name) &&
+       SHT_NOBITS != section_header.sh_type &&
+       section_header.sh_offset <= map_size && section_header.sh_size <= (map_size - section_header.sh_offset))
+    {
+      section->data = &map[section_header.sh_offset];
+      section->size = section_header.sh_size;
+      return;
+    }
+  }
+}
+
+/**
+ * @brief Returns the index of path in lines' files, adding it if new
+ * 
+ * @param lines
+ * @param directory - Optional, joined to relative file names
+ * @param file
+ * @param index
+ * @return sl_avr_emu_result_e
+ */
+static sl_avr_emu_result_e sl_avr_emu_dwarf_add_file(sl_avr_emu_lines_s *lines, const char *directory, const char *file, uint32_t *index)
+{
+  char    *path;
+  char   **files;
+  size_t   size;
+  uint32_t i;
+
+  size = strlen(file) + 1 + ((directory != NULL && '/' != file[0])?strlen(directory) + 1:0);
+  path = malloc(size);
+  if(NULL == path)
+  {
+    return SL_AVR_EMU_RESULT_FAILURE;
+  }
+  if(directory != NULL && '/' != file[0])
+  {
+    snprintf(path, size, "%s/%s", directory, file);
+  }
+  else
+  {
+    snprintf(path, size, "%s", file);
+  }
+
+  for(i = 0; i < lines->file_count; i++)
+  {
+    if(0 == strcmp(lines->files[i], path))
+    {
+      free(path);
+      *index = i;
+      return SL_AVR_EMU_RESULT_SUCCESS;
+    }
+  }
+
+  files = realloc(lines->files, (lines->file_count + 1) * sizeof(char *));
+  if(NULL == files)
+  {
+    free(path);
+    return SL_AVR_EMU_RESULT_FAILURE;
+  }
+  lines->files = files;
+  lines->files[lines->file_count] = path;
+  *index = lines->file_count++;
+
+  return SL_AVR_EMU_RESULT_SUCCESS;
+}
+
+/**
+ * @brief Appends a row
+ * 
+ * @param lines
+ * @param capacity
+ * @param row
+ * @return sl_avr_emu_result_e
+ */
+static sl_avr_emu_result_e sl_avr_emu_dwarf_add_row(sl_avr_emu_lines_s *lines, uint32_t *capacity, const sl_avr_emu_line_s *row)
+{
+  sl_avr_emu_line_s *rows;
+
+  if(lines->count == *capacity)
+  {
+    rows = realloc(lines->lines, ((*capacity > 0)?2 * *capacity:1024) * sizeof(sl_avr_emu_line_s));
+    if(NULL == rows)
+    {
+      return SL_AVR_EMU_RESULT_FAILURE;
+    }
+    lines->lines = rows;
+    *capacity    = (*capacity > 0)?2 * *capacity:1024;
+  }
+  lines->lines[lines->count++] = *row;
+
+  return SL_AVR_EMU_RESULT_SUCCESS;
+}
+
+/**
+ * @brief Reads a DWARF 5 directory or file name table
+ * 
+ * @param reader
+ * @param offset_size - 4 or 8 for 32 or 64-bit DWARF
+ * @param strings     - .debug_str
+ * @param line_strings - .debug_line_str
+ * @param names       - Set to each entry's path
+ * @param directories - Optional, set to each entry's directory index
+ * @return uint32_t - Number of entries
+ */
+static uint32_t sl_avr_emu_dwarf_read_entries(sl_avr_emu_dwarf_reader_s *reader, uint32_t offset_size,
+                                              const sl_avr_emu_dwarf_section_s *strings, const sl_avr_emu_dwarf_section_s *line_strings,
+                                              const char **names, uint64_t *directories)
+{
+  uint64_t    formats[16][2];
+  uint32_t    format_count;
+  uint64_t    entry_count;
+  uint64_t    value;
+  const char *string;
+  uint32_t    i, j;
+
+  format_count = sl_avr_emu_dwarf_read(reader, 1);
+  if(format_count > 16)
+  {
+    reader->error = true;
+    return 0;
+  }
+  for(i = 0; i < format_count; i++)
+  {
+    formats[i][0] = sl_avr_emu_dwarf_read_uleb(reader);
+    formats[i][1] = sl_avr_emu_dwarf_read_uleb(reader);
+  }
+
+  entry_count = sl_avr_emu_dwarf_read_uleb(reader);
+  for(i = 0; i < entry_count && !reader->error; i++)
+  {
+    for(j = 0; j < format_count; j++)
+    {
+      string = NULL;
+      value  = 0;
+      switch(formats[j][1])
+      {
+        case SL_AVR_EMU_DW_FORM_STRING:    string = sl_avr_emu_dwarf_read_string(reader); break;
+        case SL_AVR_EMU_DW_FORM_LINE_STRP: string = sl_avr_emu_dwarf_section_string(line_strings, sl_avr_emu_dwarf_read(reader, offset_size)); break;
+        case SL_AVR_EMU_DW_FORM_STRP:      string = sl_avr_emu_dwarf_section_string(strings, sl_avr_emu_dwarf_read(reader, offset_size)); break;
+        case SL_AVR_EMU_DW_FORM_UDATA:     value  = sl_avr_emu_dwarf_read_uleb(reader); break;
+        case SL_AVR_EMU_DW_FORM_DATA1:     value  = sl_avr_emu_dwarf_read(reader, 1); break;
+        case SL_AVR_EMU_DW_FORM_DATA2:     value  = sl_avr_emu_dwarf_read(reader, 2); break;
+        case SL_AVR_EMU_DW_FORM_DATA4:     value  = sl_avr_emu_dwarf_read(reader, 4); break;
+        case SL_AVR_EMU_DW_FORM_DATA8:     value  = sl_avr_emu_dwarf_read(reader, 8); break;
+        case SL_AVR_EMU_DW_FORM_DATA16:    sl_avr_emu_dwarf_read(reader, 8); sl_avr_emu_dwarf_read(reader, 8); break;
+        case SL_AVR_EMU_DW_FORM_BLOCK:
+        {
+          value = sl_avr_emu_dwarf_read_uleb(reader);
+          if(value > (uint64_t)(reader->end - reader->position))
+          {
+            reader->error = true;
+          }
+          else
+          {
+            reader->position += value;
+          }
+          break;
+        }
+        default:
+        {
+          reader->error = true;
+          break;
+        }
+      }
+
+      if(i < SL_AVR_EMU_DWARF_ENTRIES_MAX)
+      {
+        if(SL_AVR_EMU_DW_LNCT_PATH == formats[j][0])
+        {
+          names[i] = string;
+        }
+        else if(SL_AVR_EMU_DW_LNCT_DIRECTORY_INDEX == formats[j][0] && directories != NULL)
+        {
+          directories[i] = value;
+        }
+      }
+    }
+  }
+
+  return (entry_count < SL_AVR_EMU_DWARF_ENTRIES_MAX)?entry_count:SL_AVR_EMU_DWARF_ENTRIES_MAX;
+}
+
+/**
+ * @brief Runs one unit's line number program
+ * 
+ * @param reader       - Positioned at the unit header, left at the next unit
+ * @param strings      - .debug_str
+ * @param line_strings - .debug_line_str
+ * @param lines
+ * @param capacity
+ * @return sl_avr_emu_result_e
+ */
+static sl_avr_emu_result_e sl_avr_emu_dwarf_unit(sl_avr_emu_dwarf_reader_s *reader, const sl_avr_emu_dwarf_section_s *strings,
+                                                 const sl_avr_emu_dwarf_section_s *line_strings, sl_avr_emu_lines_s *lines, uint32_t *capacity)
+{
+  sl_avr_emu_result_e       result = SL_AVR_EMU_RESULT_SUCCESS;
+  sl_avr_emu_dwarf_reader_s unit, program;
+  uint64_t                  length;
+  uint32_t                  offset_size = 4;
+  uint32_t                  version;
+  uint64_t                  header_length;
+  uint32_t                  minimum_instruction_length;
+  int32_t                   line_base;
+  uint32_t                  line_range;
+  uint32_t                  opcode_base;
+  sl_avr_emu_byte_t         opcode_lengths[256];
+  const char               *directories[SL_AVR_EMU_DWARF_ENTRIES_MAX];
+  const char               *names[SL_AVR_EMU_DWARF_ENTRIES_MAX];
+  uint64_t                  name_directories[SL_AVR_EMU_DWARF_ENTRIES_MAX];
+  uint32_t                  files[SL_AVR_EMU_DWARF_ENTRIES_MAX];
+  uint32_t                  directory_count = 0;
+  uint32_t                  file_count = 0;
+  uint32_t                  file_base;
+  sl_avr_emu_line_s         row;
+  uint64_t                  file;
+  uint32_t                  opcode, adjusted;
+  uint64_t                  extended_length;
+  const sl_avr_emu_byte_t  *extended_end;
+  uint32_t                  i;
+
+  length = sl_avr_emu_dwarf_read(reader, 4);
+  if(0xFFFFFFFF == length)
+  {
+    offset_size = 8;
+    length      = sl_avr_emu_dwarf_read(reader, 8);
+  }
+  if(reader->error || length > (uint64_t)(reader->end - reader->position))
+  {
+    return SL_AVR_EMU_RESULT_FAILURE;
+  }
+  unit.position = reader->position;
+  unit.end      = reader->position + length;
+  unit.error    = false;
+  reader->position = unit.end;
+
+  version = sl_avr_emu_dwarf_read(&unit, 2);
+  if(version < 2 || version > 5)
+  {
+    /* Unsupported unit, skip it */
+    return result;
+  }
+  if(version >= 5)
+  {
+    /* Address and segment selector sizes */
+    sl_avr_emu_dwarf_read(&unit, 2);
+  }
+  header_length = sl_avr_emu_dwarf_read(&unit, offset_size);
+  if(unit.error || header_length > (uint64_t)(unit.end - unit.position))
+  {
+    return SL_AVR_EMU_RESULT_FAILURE;
+  }
+  program.position = unit.position + header_length;
+  program.end      = unit.end;
+  program.error    = false;
+
+  minimum_instruction_length = sl_avr_emu_dwarf_read(&unit, 1);
+  if(version >= 4)
+  {
+    /* Maximum operations per instruction, always 1 outside VLIW targets */
+    sl_avr_emu_dwarf_read(&unit, 1);
+  }
+  sl_avr_emu_dwarf_read(&unit, 1);
+  line_base   = (int8_t) sl_avr_emu_dwarf_read(&unit, 1);
+  line_range  = sl_avr_emu_dwarf_read(&unit, 1);
+  opcode_base = sl_avr_emu_dwarf_read(&unit, 1);
+  if(0 == line_range || 0 == opcode_base)
+  {
+    return SL_AVR_EMU_RESULT_FAILURE;
+  }
+  for(i = 1; i < opcode_base; i++)
+  {
+    opcode_lengths[i] = sl_avr_emu_dwarf_read(&unit, 1);
+  }
+
+  if(version >= 5)
+  {
+    directory_count = sl_avr_emu_dwarf_read_entries(&unit, offset_size, strings, line_strings, directories, NULL);
+    file_count      = sl_avr_emu_dwarf_read_entries(&unit, offset_size, strings, line_strings, names, name_directories);
+    file_base       = 0;
+  }
+  else
+  {
+    /* Directory 0 is the compilation directory, which these versions leave implicit */
+    directories[directory_count++] = NULL;
+    while(!unit.error && unit.position < unit.end && 0 != *unit.position)
+    {
+      directories[(directory_count < SL_AVR_EMU_DWARF_ENTRIES_MAX)?directory_count++:directory_count-1] = sl_avr_emu_dwarf_read_string(&unit);
+    }
+    sl_avr_emu_dwarf_read(&unit, 1);
+    while(!unit.error && unit.position < unit.end && 0 != *unit.position)
+    {
+      i = (file_count < SL_AVR_EMU_DWARF_ENTRIES_MAX)?file_count++:file_count-1;
+      names[i]            = sl_avr_emu_dwarf_read_string(&unit);
+      name_directories[i] = sl_avr_emu_dwarf_read_uleb(&unit);
+      sl_avr_emu_dwarf_read_uleb(&unit);
+      sl_avr_emu_dwarf_read_uleb(&unit);
+    }
+    file_base = 1;
+  }
+  if(unit.error)
+  {
+    return SL_AVR_EMU_RESULT_FAILURE;
+  }
+
+  for(i = 0; i < file_count && SL_AVR_EMU_RESULT_SUCCESS == result; i++)
+  {
+    if(NULL == names[i])
+    {
+      names[i] = "??";
+    }
+    result = sl_avr_emu_dwarf_add_file(lines, (name_directories[i] < directory_count)?directories[name_directories[i]]:NULL, names[i], &files[i]);
+  }
+
+  memset(&row, 0, sizeof(row));
+  row.line = 1;
+  file     = file_base;
+  while(SL_AVR_EMU_RESULT_SUCCESS == result && !program.error && program.position < program.end)
+  {
+    opcode = sl_avr_emu_dwarf_read(&program, 1);
+    if(opcode >= opcode_base)
+    {
+      adjusted     = opcode - opcode_base;
+      row.address += (adjusted / line_range) * minimum_instruction_length;
+      row.line    += line_base + (int32_t)(adjusted % line_range);
+      row.file     = (file - file_base < file_count)?files[file - file_base]:0;
+      result = sl_avr_emu_dwarf_add_row(lines, capacity, &row);
+    }
+    else if(0 == opcode)
+    {
+      extended_length = sl_avr_emu_dwarf_read_uleb(&program);
+      if(0 == extended_length || extended_length > (uint64_t)(program.end - program.position))
+      {
+        break;
+      }
+      extended_end = program.position + extended_length;
+      opcode       = sl_avr_emu_dwarf_read(&program, 1);
+      if(SL_AVR_EMU_DW_LNE_END_SEQUENCE == opcode)
+      {
+        row.end_sequence = true;
+        result = sl_avr_emu_dwarf_add_row(lines, capacity, &row);
+        memset(&row, 0, sizeof(row));
+        row.line = 1;
+        file     = file_base;
+      }
+      else if(SL_AVR_EMU_DW_LNE_SET_ADDRESS == opcode && extended_length <= 9)
+      {
+        row.address = sl_avr_emu_dwarf_read(&program, extended_length - 1);
+      }
+      program.position = extended_end;
+    }
+    else
+    {
+      switch(opcode)
+      {
+        case SL_AVR_EMU_DW_LNS_COPY:
+        {
+          row.file = (file - file_base < file_count)?files[file - file_base]:0;
+          result = sl_avr_emu_dwarf_add_row(lines, capacity, &row);
+          break;
+        }
+        case SL_AVR_EMU_DW_LNS_ADVANCE_PC:     row.address += sl_avr_emu_dwarf_read_uleb(&program) * minimum_instruction_length; break;
+        case SL_AVR_EMU_DW_LNS_ADVANCE_LINE:   row.line    += sl_avr_emu_dwarf_read_sleb(&program); break;
+        case SL_AVR_EMU_DW_LNS_SET_FILE:       file         = sl_avr_emu_dwarf_read_uleb(&program); break;
+        case SL_AVR_EMU_DW_LNS_CONST_ADD_PC:   row.address += ((255 - opcode_base) / line_range) * minimum_instruction_length; break;
+        case SL_AVR_EMU_DW_LNS_FIXED_ADVANCE_PC: row.address += sl_avr_emu_dwarf_read(&program, 2); break;
+        default:
+        {
+          /* Operands of opcodes that do not affect address, file or line */
+          for(i = 0; i < opcode_lengths[opcode]; i++)
+          {
+            sl_avr_emu_dwarf_read_uleb(&program);
+          }
+          break;
+        }
+      }
+    }
+  }
+
+  return result;
+}
+
+/**
+ * @brief Decodes the .debug_line section of the ELF file behind symbols
+ * 
+ * @param symbols - Symbol index loaded from an ELF file
+ * @param lines   - Filled with the line table, free with sl_avr_emu_lines_free
+ * @return sl_avr_emu_result_e - SL_AVR_EMU_RESULT_FAILURE if there is no usable line table
+ */
+sl_avr_emu_result_e sl_avr_emu_dwarf_load_lines(const sl_avr_emu_symbols_s *symbols, sl_avr_emu_lines_s *lines)
+{
+  sl_avr_emu_result_e        result = SL_AVR_EMU_RESULT_SUCCESS;
+  sl_avr_emu_dwarf_section_s debug_line, strings, line_strings;
+  sl_avr_emu_dwarf_reader_s  reader;
+  uint32_t                   capacity = 0;
+
+  memset(lines, 0, sizeof(sl_avr_emu_lines_s));
+  if(NULL == symbols || NULL == symbols->map)
+  {
+    return SL_AVR_EMU_RESULT_FAILURE;
+  }
+
+  sl_avr_emu_dwarf_find_section(symbols->map, symbols->map_size, ".debug_line",     &debug_line);
+  sl_avr_emu_dwarf_find_section(symbols->map, symbols->map_size, ".debug_str",      &strings);
+  sl_avr_emu_dwarf_find_section(symbols->map, symbols->map_size, ".debug_line_str", &line_strings);
+  if(NULL == debug_line.data)
+  {
+    return SL_AVR_EMU_RESULT_FAILURE;
+  }
+
+  reader.position = debug_line.data;
+  reader.end      = debug_line.data + debug_line.size;
+  reader.error    = false;
+  while(SL_AVR_EMU_RESULT_SUCCESS == result && reader.position < reader.end)
+  {
+    result = sl_avr_emu_dwarf_unit(&reader, &strings, &line_strings, lines, &capacity);
+  }
+
+  if(SL_AVR_EMU_RESULT_SUCCESS != result || 0 == lines->count)
+  {
+    sl_avr_emu_lines_free(lines);
+    result = SL_AVR_EMU_RESULT_FAILURE;
+  }
+
+  return result;
+}
+
+/**
+ * @brief Frees a line table
+ * 
+ * @param lines
+ */
+void sl_avr_emu_lines_free(sl_avr_emu_lines_s *lines)
+{
+  uint32_t i;
+
+  for(i = 0; i < lines->file_count; i++)
+  {
+    free(lines->files[i]);
+  }
+  free(lines->files);
+  free(lines->lines);
+  memset(lines, 0, sizeof(sl_avr_emu_lines_s));
+}
@@ -0,0 +1,381 @@
+/**
+ * @file sl_avr_emu_elf.c
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator ELF Loading Logic
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ * Loadable segments are copied to flash by their load (physical) address, 
+ * which places .data's initializers after .text exactly as avr-objcopy does.
+ * The file stays mapped while a symbol index references it so names are not copied.
+ * ELF headers are read in host byte order, so a little endian host is assumed.
+ */
+
+#include <elf.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "sl_avr_emu_elf.h"
+
+#ifndef EM_AVR
+#define EM_AVR 83
+#endif
+
+/**
+ * @brief Checks that [offset, offset+size) lies within a mapping of map_size bytes
+ * 
+ */
+#define SL_AVR_EMU_ELF_RANGE_VALID(offset, size, map_size) \
+  ((offset) <= (map_size) && (size) <= ((map_size) - (offset)))
+
+/**
+ * @brief Orders symbols by address, functions after other symbols at the same address so lookups prefer them
+ * 
+ * @param a 
+ * @param b 
+ * @return int 
+ */
+static int sl_avr_emu_symbol_compare(const void *a, const void *b)
+{
+  const sl_avr_emu_symbol_s *symbol_a = a;
+  const sl_avr_emu_symbol_s *symbol_b = b;
+  int                        result;
+
+  if(symbol_a->address != symbol_b->address)
+  {
+    result = (symbol_a->address < symbol_b->address)?-1:1;
+  }
+  else if(symbol_a->function != symbol_b->function)
+  {
+    result = (symbol_a->function)?1:-1;
+  }
+  else
+  {
+    result = (symbol_a->size < symbol_b->size)?-1:(symbol_a->size > symbol_b->size);
+  }
+
+  return result;
+}
+
+/**
+ * @brief Builds the symbol index from the file's .symtab
+ * 
+ * @param symbols 
+ * @param map 
+ * @param map_size 
+ * @param header 
+ * @return sl_avr_emu_result_e 
+ */
+static sl_avr_emu_result_e sl_avr_emu_elf_load_symbols(sl_avr_emu_symbols_s *symbols, const sl_avr_emu_byte_t *map, size_t map_size, const Elf32_Ehdr *header)
+{
+  sl_avr_emu_result_e result = SL_AVR_EMU_RESULT_SUCCESS;
+  Elf32_Shdr          section, string_section;
+  Elf32_Sym           symbol;
+  const char         *strings;
+  uint32_t            symbol_count;
+  uint32_t            i;
+  uint32_t            type;
+
+  symbols->symbols = NULL;
+  symbols->count   = 0;
+
+  if(0 == header->e_shnum || sizeof(Elf32_Shdr) != header->e_shentsize ||
+     !SL_AVR_EMU_ELF_RANGE_VALID(header->e_shoff, (size_t)header->e_shnum * sizeof(Elf32_Shdr), map_size))
+  {
+    SL_AVR_EMU_VERBOSE_LOG(printf("ELF has no section headers, no symbols loaded\n"));
+    return result;
+  }
+
+  for(i = 0; i < header->e_shnum; i++)
+  {
+    memcpy(&section, &map[header->e_shoff + i*sizeof(Elf32_Shdr)], sizeof(Elf32_Shdr));
+    if(SHT_SYMTAB == section.sh_type)
+    {
+      break;
+    }
+  }
+  if(i == header->e_shnum)
+  {
+    SL_AVR_EMU_VERBOSE_LOG(printf("ELF has no .symtab, no symbols loaded\n"));
+    return result;
+  }
+
+  if(section.sh_link >= header->e_shnum)
+  {
+    return SL_AVR_EMU_RESULT_INVALID_FILE_FORMAT;
+  }
+  memcpy(&string_section, &map[header->e_shoff + section.sh_link*sizeof(Elf32_Shdr)], sizeof(Elf32_Shdr));
+  if( !SL_AVR_EMU_ELF_RANGE_VALID(section.sh_offset, section.sh_size, map_size) ||
+      !SL_AVR_EMU_ELF_RANGE_VALID(string_section.sh_offset, string_section.sh_size, map_size) ||
+      0 == string_section.sh_size || 0 != map[string_section.sh_offset + string_section.sh_size - 1] )
+  {
+    return SL_AVR_EMU_RESULT_INVALID_FILE_FORMAT;
+  }
+  strings      = (const char *) &map[string_section.sh_offset];
+  symbol_count = section.sh_size / sizeof(Elf32_Sym);
+
+  symbols->symbols = calloc(symbol_count + 1, sizeof(sl_avr_emu_symbol_s));
+  if(NULL == symbols->symbols)
+  {
+    return SL_AVR_EMU_RESULT_FAILURE;
+  }
+
+  for(i = 0; i < symbol_count; i++)
+  {
+    memcpy(&symbol, &map[section.sh_offset + i*sizeof(Elf32_Sym)], sizeof(Elf32_Sym));
+    type = ELF32_ST_TYPE(symbol.st_info);
+
+    /* Only defined, named code and data symbols are useful for reporting */
+    if( SHN_UNDEF == symbol.st_shndx || symbol.st_shndx >= SHN_LORESERVE ||
+        0 == symbol.st_name || symbol.st_name >= string_section.sh_size ||
+        (STT_FUNC != type && STT_OBJECT != type && STT_NOTYPE != type) )
+    {
+      continue;
+    }
+
+    symbols->symbols[symbols->count].address  = symbol.st_value;
+    symbols->symbols[symbols->count].size     = symbol.st_size;
+    symbols->symbols[symbols->count].name     = &strings[symbol.st_name];
+    symbols->symbols[symbols->count].function = (STT_FUNC == type);
+    symbols->count++;
+  }
+
+  qsort(symbols->symbols, symbols->count, sizeof(sl_avr_emu_symbol_s), sl_avr_emu_symbol_compare);
+  SL_AVR_EMU_VERBOSE_LOG(printf("Loaded %u symbols\n", symbols->count));
+
+  return result;
+}
+
+/**
+ * @brief Loads an AVR ELF file's loadable segments into emulation's flash and sets PC to its entry point
+ * 
+ * @param emulation 
+ * @param file_path 
+ * @param symbols   - Optional, filled with the file's symbol table and attached to emulation's hooks
+ * @return sl_avr_emu_result_e 
+ */
+sl_avr_emu_result_e sl_avr_emu_load_elf(sl_avr_emu_emulation_s *emulation, char * file_path, sl_avr_emu_symbols_s *symbols)
+{
+  sl_avr_emu_result_e      result = SL_AVR_EMU_RESULT_SUCCESS;
+  int                      fd;
+  struct stat              file_stat;
+  const sl_avr_emu_byte_t *map = MAP_FAILED;
+  size_t                   map_size = 0;
+  Elf32_Ehdr               header;
+  Elf32_Phdr               segment;
+  uint32_t                 i;
+
+  if(NULL == emulation || NULL == file_path)
+  {
+    return SL_AVR_EMU_RESULT_INVALID_FILE_PATH;
+  }
+
+  printf("Loading flash from .elf file: %s\n", file_path);
+  fd = open(file_path, O_RDONLY);
+  if(fd >= 0 && 0 == fstat(fd, &file_stat) && file_stat.st_size >= sizeof(Elf32_Ehdr))
+  {
+    map_size = file_stat.st_size;
+    map      = mmap(NULL, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  if(fd >= 0)
+  {
+    close(fd);
+  }
+  if(MAP_FAILED == map)
+  {
+    return SL_AVR_EMU_RESULT_INVALID_FILE_PATH;
+  }
+
+  memcpy(&header, map, sizeof(Elf32_Ehdr));
+  if( 0 != memcmp(header.e_ident, ELFMAG, SELFMAG) ||
+      ELFCLASS32  != header.e_ident[EI_CLASS] ||
+      ELFDATA2LSB != header.e_ident[EI_DATA] ||
+      EM_AVR      != header.e_machine ||
+      0 == header.e_phnum || sizeof(Elf32_Phdr) != header.e_phentsize ||
+      !SL_AVR_EMU_ELF_RANGE_VALID(header.e_phoff, (size_t)header.e_phnum * sizeof(Elf32_Phdr), map_size) )
+  {
+    fprintf(stderr, "Not an AVR ELF executable: %s\n", file_path);
+    result = SL_AVR_EMU_RESULT_INVALID_FILE_FORMAT;
+  }
+
+  for(i = 0; i < header.e_phnum && SL_AVR_EMU_RESULT_SUCCESS == result; i++)
+  {
+    memcpy(&segment, &map[header.e_phoff + i*sizeof(Elf32_Phdr)], sizeof(Elf32_Phdr));
+    if(PT_LOAD != segment.p_type || 0 == segment.p_filesz)
+    {
+      continue;
+    }
+    if(segment.p_paddr >= SL_AVR_EMU_ELF_DATA_OFFSET)
+    {
+      /* EEPROM, fuses, etc. are not flash */
+      SL_AVR_EMU_VERBOSE_LOG(printf("Skipping segment at 0x%x\n", segment.p_paddr));
+      continue;
+    }
+
+    SL_AVR_EMU_VERBOSE_LOG(printf("Loading %u bytes at flash byte address 0x%x\n", segment.p_filesz, segment.p_paddr));
+    if(!SL_AVR_EMU_ELF_RANGE_VALID(segment.p_offset, segment.p_filesz, map_size))
+    {
+      result = SL_AVR_EMU_RESULT_INVALID_FILE_FORMAT;
+    }
+    else if(!SL_AVR_EMU_ELF_RANGE_VALID(segment.p_paddr, segment.p_filesz, sizeof(emulation->memory.flash)))
+    {
+      result = SL_AVR_EMU_RESULT_INVALID_FLASH_ADDRESS;
+    }
+    else
+    {
+      /* Flash words are little endian in both the file and on the host */
+      memcpy(&((sl_avr_emu_byte_t *) emulation->memory.flash)[segment.p_paddr], &map[segment.p_offset], segment.p_filesz);
+    }
+  }
+
+  if(SL_AVR_EMU_RESULT_SUCCESS == result)
+  {
+    /* Entry point is a byte address, PC is in words */
+    if(SL_AVR_EMU_PC_ADDRESS_VALID(header.e_entry/2))
+    {
+      emulation->memory.pc = header.e_entry/2;
+    }
+    else
+    {
+      result = SL_AVR_EMU_RESULT_INVALID_PC;
+    }
+  }
+
+  if(SL_AVR_EMU_RESULT_SUCCESS == result && symbols != NULL)
+  {
+    result = sl_avr_emu_elf_load_symbols(symbols, map, map_size, &header);
+    if(SL_AVR_EMU_RESULT_SUCCESS == result)
+    {
+      symbols->map             = (void *) map;
+      symbols->map_size        = map_size;
+      emulation->hooks.symbols = symbols;
+      map = MAP_FAILED;
+    }
+    else
+    {
+      free(symbols->symbols);
+      symbols->symbols = NULL;
+      symbols->count   = 0;
+    }
+  }
+
+  if(map != MAP_FAILED)
+  {
+    munmap((void *) map, map_size);
+  }
+
+  return result;
+}
+
+/**
+ * @brief Finds the symbol containing address
+ * 
+ * @param symbols 
+ * @param address - Flash byte address, or SL_AVR_EMU_ELF_DATA_OFFSET + data address
+ * @param offset  - Optional, set to address' offset from the symbol
+ * @return const sl_avr_emu_symbol_s* - NULL if no symbol contains address
+ */
+const sl_avr_emu_symbol_s *sl_avr_emu_symbol_lookup(const sl_avr_emu_symbols_s *symbols, uint32_t address, uint32_t *offset)
+{
+  const sl_avr_emu_symbol_s *symbol = NULL;
+  uint32_t                   low    = 0;
+  uint32_t                   high;
+  uint32_t                   middle;
+
+  if(symbols != NULL && symbols->count > 0)
+  {
+    /* Last symbol starting at or before address */
+    high = symbols->count;
+    while(low < high)
+    {
+      middle = low + (high - low)/2;
+      if(symbols->symbols[middle].address <= address)
+      {
+        low = middle + 1;
+      }
+      else
+      {
+        high = middle;
+      }
+    }
+
+    if(low > 0)
+    {
+      symbol = &symbols->symbols[low - 1];
+      /* Symbols without a size are taken to extend to the next symbol */
+      if( (symbol->size > 0 && (address - symbol->address) >= symbol->size) ||
+          ((symbol->address >= SL_AVR_EMU_ELF_DATA_OFFSET) != (address >= SL_AVR_EMU_ELF_DATA_OFFSET)) )
+      {
+        symbol = NULL;
+      }
+      else if(offset != NULL)
+      {
+        *offset = address - symbol->address;
+      }
+    }
+  }
+
+  return symbol;
+}
+
+/**
+ * @brief Finds a symbol by name
+ * 
+ * @param symbols 
+ * @param name    
+ * @return const sl_avr_emu_symbol_s* - NULL if no symbol has name
+ */
+const sl_avr_emu_symbol_s *sl_avr_emu_symbol_find(const sl_avr_emu_symbols_s *symbols, const char *name)
+{
+  uint32_t i;
+
+  for(i = 0; symbols != NULL && i < symbols->count; i++)
+  {
+    if(0 == strcmp(symbols->symbols[i].name, name))
+    {
+      return &symbols->symbols[i];
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * @brief Finds the function containing a PC
+ * 
+ * @param symbols 
+ * @param pc      - Word address
+ * @param offset  - Optional, set to the byte offset from the function
+ * @return const char* - Function name, NULL if unknown
+ */
+const char *sl_avr_emu_symbol_name_pc(const sl_avr_emu_symbols_s *symbols, sl_avr_emu_extended_address_t pc, uint32_t *offset)
+{
+  const sl_avr_emu_symbol_s *symbol = sl_avr_emu_symbol_lookup(symbols, pc*2, offset);
+
+  return (symbol != NULL)?symbol->name:NULL;
+}
+
+/**
+ * @brief Frees a symbol index and unmaps its ELF file
+ * 
+ * @param symbols 
+ */
+void sl_avr_emu_symbols_free(sl_avr_emu_symbols_s *symbols)
+{
+  if(symbols != NULL)
+  {
+    free(symbols->symbols);
+    if(symbols->map != NULL)
+    {
+      munmap(symbols->map, symbols->map_size);
+    }
+    memset(symbols, 0, sizeof(sl_avr_emu_symbols_s));
+  }
+}
@@ -0,0 +1,170 @@
+/**
+ * @file sl_avr_emu_event.c
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator Event Scheduler Logic
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "sl_avr_emu.h"
+#include "sl_avr_emu_event.h"
+
+/**
+ * @brief True if event a must run before event b
+ * 
+ */
+#define SL_AVR_EMU_EVENT_BEFORE(a, b) \
+  (((a).tick < (b).tick) || ((a).tick == (b).tick && (int32_t)((a).sequence - (b).sequence) < 0))
+
+static void sl_avr_emu_event_sift_up(sl_avr_emu_event_queue_s *queue, uint32_t i)
+{
+  sl_avr_emu_event_s event = queue->heap[i];
+
+  while(i > 0 && SL_AVR_EMU_EVENT_BEFORE(event, queue->heap[(i-1)/2]))
+  {
+    queue->heap[i] = queue->heap[(i-1)/2];
+    i = (i-1)/2;
+  }
+  queue->heap[i] = event;
+}
+
+static void sl_avr_emu_event_sift_down(sl_avr_emu_event_queue_s *queue, uint32_t i)
+{
+  uint32_t           child;
+  sl_avr_emu_event_s event = queue->heap[i];
+
+  while((child = 2*i + 1) < queue->count)
+  {
+    if((child + 1) < queue->count && SL_AVR_EMU_EVENT_BEFORE(queue->heap[child+1], queue->heap[child]))
+    {
+      child++;
+    }
+    if(!SL_AVR_EMU_EVENT_BEFORE(queue->heap[child], event))
+    {
+      break;
+    }
+    queue->heap[i] = queue->heap[child];
+    i = child;
+  }
+  queue->heap[i] = event;
+}
+
+static void sl_avr_emu_event_remove(sl_avr_emu_event_queue_s *queue, uint32_t i)
+{
+  queue->count--;
+  if(i < queue->count)
+  {
+    queue->heap[i] = queue->heap[queue->count];
+    sl_avr_emu_event_sift_down(queue, i);
+    sl_avr_emu_event_sift_up(queue, i);
+  }
+  queue->next_tick = (queue->count > 0)?queue->heap[0].tick:SL_AVR_EMU_TICK_COUNT_MAX;
+}
+
+/**
+ * @brief Initializes an empty event queue
+ * 
+ * @param emulation 
+ */
+void sl_avr_emu_event_init(sl_avr_emu_emulation_s *emulation)
+{
+  emulation->events.count     = 0;
+  emulation->events.sequence  = 0;
+  emulation->events.next_tick = SL_AVR_EMU_TICK_COUNT_MAX;
+}
+
+/**
+ * @brief Schedules callback to run at the start of the given tick.  
+ *        Events for the same tick run in scheduling order.
+ * 
+ * @param emulation 
+ * @param tick     - Tick at which to fire, ticks already passed fire on the next tick
+ * @param callback 
+ * @param context 
+ * @return sl_avr_emu_result_e 
+ */
+sl_avr_emu_result_e sl_avr_emu_event_schedule(sl_avr_emu_emulation_s *emulation, sl_avr_emu_tick_count_t tick, sl_avr_emu_event_callback_f callback, void *context)
+{
+  sl_avr_emu_result_e       result = SL_AVR_EMU_RESULT_SUCCESS;
+  sl_avr_emu_event_queue_s *queue  = &emulation->events;
+
+  if(callback != NULL && queue->count < SL_AVR_EMU_EVENT_QUEUE_SIZE)
+  {
+    queue->heap[queue->count].tick     = tick;
+    queue->heap[queue->count].sequence = queue->sequence++;
+    queue->heap[queue->count].callback = callback;
+    queue->heap[queue->count].context  = context;
+    queue->count++;
+    sl_avr_emu_event_sift_up(queue, queue->count-1);
+    queue->next_tick = queue->heap[0].tick;
+  }
+  else
+  {
+    fprintf(stderr, "Event queue full, %u events scheduled\n", queue->count);
+    result = SL_AVR_EMU_RESULT_FAILURE;
+  }
+
+  return result;
+}
+
+/**
+ * @brief Cancels all scheduled events matching callback and context
+ * 
+ * @param emulation 
+ * @param callback 
+ * @param context 
+ * @return uint32_t - Number of events cancelled
+ */
+uint32_t sl_avr_emu_event_cancel(sl_avr_emu_emulation_s *emulation, sl_avr_emu_event_callback_f callback, void *context)
+{
+  uint32_t                  i         = 0;
+  uint32_t                  cancelled = 0;
+  sl_avr_emu_event_queue_s *queue     = &emulation->events;
+
+  while(i < queue->count)
+  {
+    if(queue->heap[i].callback == callback && queue->heap[i].context == context)
+    {
+      sl_avr_emu_event_remove(queue, i);
+      cancelled++;
+      /* Removal may move an unchecked event below i, restart scan */
+      i = 0;
+    }
+    else
+    {
+      i++;
+    }
+  }
+
+  return cancelled;
+}
+
+/**
+ * @brief Runs all events due at or before the current tick.  Called from sl_avr_emu_tick() when events.next_tick is reached
+ * 
+ * @param emulation 
+ * @return sl_avr_emu_result_e - First failing callback result
+ */
+sl_avr_emu_result_e sl_avr_emu_event_dispatch(sl_avr_emu_emulation_s *emulation)
+{
+  sl_avr_emu_result_e       result = SL_AVR_EMU_RESULT_SUCCESS;
+  sl_avr_emu_event_queue_s *queue  = &emulation->events;
+  sl_avr_emu_event_s        event;
+
+  while(SL_AVR_EMU_RESULT_SUCCESS == result && queue->count > 0 && queue->heap[0].tick <= emulation->tick_count)
+  {
+    event = queue->heap[0];
+    sl_avr_emu_event_remove(queue, 0);
+    SL_AVR_EMU_VERBOSE_LOG(printf("tick %lu: event scheduled for tick %lu\n", emulation->tick_count, event.tick));
+    result = event.callback(emulation, event.context);
+  }
+
+  return result;
+}
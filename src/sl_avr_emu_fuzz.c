@@ -0,0 +1,228 @@
+/**
+ * @file sl_avr_emu_fuzz.c
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator In-Process Fuzzing Logic
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sl_avr_emu.h"
+#include "sl_avr_emu_fuzz.h"
+#include "sl_avr_emu_tick.h"
+
+/**
+ * @brief Hashes a PC into the edge map index space
+ * 
+ */
+#define SL_AVR_EMU_FUZZ_PC_HASH(pc) ((((pc) * 2654435761u) >> 16) & (SL_AVR_EMU_FUZZ_EDGE_MAP_SIZE-1))
+
+/**
+ * @brief Runs emulation until an instruction boundary at stop_pc, an error or tick_limit
+ * 
+ * @param emulation 
+ * @param stop_pc 
+ * @param tick_limit 
+ * @param reached   - Set if stop_pc was reached
+ * @return sl_avr_emu_result_e 
+ */
+static sl_avr_emu_result_e sl_avr_emu_fuzz_run_to_pc(sl_avr_emu_emulation_s *emulation, sl_avr_emu_extended_address_t stop_pc, sl_avr_emu_tick_count_t tick_limit, bool *reached)
+{
+  sl_avr_emu_result_e result = SL_AVR_EMU_RESULT_SUCCESS;
+
+  *reached = false;
+  while(SL_AVR_EMU_RESULT_SUCCESS == result && emulation->tick_count < tick_limit)
+  {
+    if(0 == emulation->op_cycles_remaining && stop_pc == emulation->memory.pc)
+    {
+      *reached = true;
+      break;
+    }
+    result = sl_avr_emu_io_tick(emulation);
+    if(SL_AVR_EMU_RESULT_SUCCESS == result)
+    {
+      result = sl_avr_emu_tick(emulation);
+    }
+  }
+
+  return result;
+}
+
+/**
+ * @brief Boots emulation to config->start_pc and snapshots it for repeated input execution
+ * 
+ * @param fuzz      - Harness to initialize
+ * @param emulation - Initialized emulation with firmware loaded
+ * @param config    - Harness configuration
+ * @param edge_map  - Coverage map of SL_AVR_EMU_FUZZ_EDGE_MAP_SIZE bytes, or NULL to allocate one
+ * @return sl_avr_emu_result_e 
+ */
+sl_avr_emu_result_e sl_avr_emu_fuzz_init(sl_avr_emu_fuzz_s *fuzz, sl_avr_emu_emulation_s *emulation, const sl_avr_emu_fuzz_config_s *config, sl_avr_emu_byte_t *edge_map)
+{
+  sl_avr_emu_result_e result = SL_AVR_EMU_RESULT_SUCCESS;
+  bool                reached;
+
+  if(fuzz != NULL && emulation != NULL && config != NULL &&
+     SL_AVR_EMU_DATA_ADDRESS_VALID((uint32_t) config->input_address + config->input_size_max) &&
+     SL_AVR_EMU_DATA_ADDRESS_VALID((uint32_t) config->input_length_address + 1))
+  {
+    memset(fuzz, 0, sizeof(sl_avr_emu_fuzz_s));
+    fuzz->config    = *config;
+    fuzz->emulation = emulation;
+
+    if(edge_map != NULL)
+    {
+      fuzz->edge_map = edge_map;
+    }
+    else
+    {
+      fuzz->edge_map = calloc(SL_AVR_EMU_FUZZ_EDGE_MAP_SIZE, sizeof(sl_avr_emu_byte_t));
+      fuzz->edge_map_allocated = true;
+    }
+
+    if(fuzz->edge_map != NULL)
+    {
+      result = sl_avr_emu_fuzz_run_to_pc(emulation, config->start_pc, config->boot_tick_budget, &reached);
+      if(SL_AVR_EMU_RESULT_SUCCESS == result && !reached)
+      {
+        fprintf(stderr, "Fuzz boot did not reach start PC 0x%06x within %lu ticks\n", config->start_pc, config->boot_tick_budget);
+        result = SL_AVR_EMU_RESULT_INVALID_PC;
+      }
+      if(SL_AVR_EMU_RESULT_SUCCESS == result)
+      {
+        result = sl_avr_emu_snapshot_take(emulation, &fuzz->snapshot);
+      }
+      if(SL_AVR_EMU_RESULT_SUCCESS == result)
+      {
+        emulation->hooks.fuzz_edge_map = fuzz->edge_map;
+        emulation->hooks.fuzz_prev_pc  = 0;
+      }
+    }
+    else
+    {
+      result = SL_AVR_EMU_RESULT_FAILURE;
+    }
+  }
+  else
+  {
+    result = SL_AVR_EMU_RESULT_FAILURE;
+  }
+
+  return result;
+}
+
+/**
+ * @brief Resets to the snapshot, injects an input and runs it within the tick budget
+ * 
+ * @param fuzz 
+ * @param data 
+ * @param size 
+ * @return sl_avr_emu_result_e - SL_AVR_EMU_RESULT_SUCCESS unless the firmware faulted
+ */
+sl_avr_emu_result_e sl_avr_emu_fuzz_run_input(sl_avr_emu_fuzz_s *fuzz, const uint8_t *data, size_t size)
+{
+  sl_avr_emu_result_e     result = SL_AVR_EMU_RESULT_SUCCESS;
+  sl_avr_emu_emulation_s *emulation;
+  sl_avr_emu_tick_count_t start_tick;
+  bool                    reached;
+
+  if(fuzz != NULL && fuzz->emulation != NULL && (data != NULL || 0 == size))
+  {
+    emulation = fuzz->emulation;
+    result = sl_avr_emu_snapshot_restore(emulation, &fuzz->snapshot);
+
+    if(SL_AVR_EMU_RESULT_SUCCESS == result)
+    {
+      if(size > fuzz->config.input_size_max)
+      {
+        size = fuzz->config.input_size_max;
+      }
+      if(size > 0)
+      {
+        memcpy(&emulation->memory.data[fuzz->config.input_address], data, size);
+      }
+      emulation->memory.data[fuzz->config.input_length_address]   = (size & 0xFF);
+      emulation->memory.data[fuzz->config.input_length_address+1] = ((size >> 8) & 0xFF);
+      emulation->hooks.fuzz_prev_pc = 0;
+
+      start_tick = emulation->tick_count;
+      result = sl_avr_emu_fuzz_run_to_pc(emulation, fuzz->config.stop_pc, start_tick + fuzz->config.input_tick_budget, &reached);
+
+      fuzz->executions++;
+      fuzz->last_ticks     = emulation->tick_count - start_tick;
+      fuzz->last_timed_out = (SL_AVR_EMU_RESULT_SUCCESS == result && !reached && SL_AVR_EMU_FUZZ_NO_STOP_PC != fuzz->config.stop_pc);
+    }
+  }
+  else
+  {
+    result = SL_AVR_EMU_RESULT_FAILURE;
+  }
+
+  return result;
+}
+
+/**
+ * @brief Counts edges hit in the coverage map
+ * 
+ * @param fuzz 
+ * @return uint32_t 
+ */
+uint32_t sl_avr_emu_fuzz_edges_hit(const sl_avr_emu_fuzz_s *fuzz)
+{
+  uint32_t i;
+  uint32_t edges = 0;
+
+  if(fuzz != NULL && fuzz->edge_map != NULL)
+  {
+    for(i = 0; i < SL_AVR_EMU_FUZZ_EDGE_MAP_SIZE; i++)
+    {
+      if(fuzz->edge_map[i] != 0)
+      {
+        edges++;
+      }
+    }
+  }
+
+  return edges;
+}
+
+/**
+ * @brief Releases harness resources and detaches it from the emulation
+ * 
+ * @param fuzz 
+ */
+void sl_avr_emu_fuzz_deinit(sl_avr_emu_fuzz_s *fuzz)
+{
+  if(fuzz != NULL)
+  {
+    if(fuzz->emulation != NULL)
+    {
+      fuzz->emulation->hooks.fuzz_edge_map = NULL;
+    }
+    if(fuzz->edge_map_allocated)
+    {
+      free(fuzz->edge_map);
+    }
+    sl_avr_emu_snapshot_free(&fuzz->snapshot);
+    memset(fuzz, 0, sizeof(sl_avr_emu_fuzz_s));
+  }
+}
+
+/**
+ * @brief Records an edge from the previous PC to the current PC.  Called on each decoded instruction while fuzzing
+ * 
+ * @param emulation 
+ */
+void sl_avr_emu_fuzz_trace_pc(sl_avr_emu_emulation_s *emulation)
+{
+  sl_avr_emu_extended_address_t current = SL_AVR_EMU_FUZZ_PC_HASH(emulation->memory.pc);
+
+  emulation->hooks.fuzz_edge_map[current ^ emulation->hooks.fuzz_prev_pc]++;
+  emulation->hooks.fuzz_prev_pc = current >> 1;
+}
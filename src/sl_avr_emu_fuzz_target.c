@@ -0,0 +1,256 @@
+/**
+ * @file sl_avr_emu_fuzz_target.c
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator Fuzzing Entry Points (libFuzzer, AFL persistent mode and standalone)
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ * Configured through the environment:
+ *   SL_AVR_EMU_FUZZ_HEX                  - Firmware .hex file (required)
+ *   SL_AVR_EMU_FUZZ_START_PC             - Word address to snapshot at (required)
+ *   SL_AVR_EMU_FUZZ_STOP_PC              - Word address at which an input is done (default: run full budget)
+ *   SL_AVR_EMU_FUZZ_INPUT_ADDRESS        - Data address inputs are written to (required)
+ *   SL_AVR_EMU_FUZZ_INPUT_SIZE           - Maximum input size (default 256)
+ *   SL_AVR_EMU_FUZZ_INPUT_LENGTH_ADDRESS - Data address of the 16-bit input length (default 0x18, r24:r25)
+ *   SL_AVR_EMU_FUZZ_BOOT_TICKS           - Tick budget to reach the start PC (default 10000000)
+ *   SL_AVR_EMU_FUZZ_TICKS                - Tick budget per input (default 100000)
+ * 
+ * Built with -DSL_AVR_EMU_LIBFUZZER the edge map is exported to libFuzzer as extra counters.
+ * Otherwise a standalone main runs each file argument (or, under afl-clang-fast, stdin in persistent mode).
+ * In persistent mode the firmware edges are added into AFL's map after each input, alongside the emulator's
+ * own instrumentation.  AFL++ maps smaller than SL_AVR_EMU_FUZZ_EDGE_MAP_SIZE fold firmware edges together,
+ * so set AFL_MAP_SIZE to at least 65536 (classic AFL's fixed map is that size).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sl_avr_emu.h"
+#include "sl_avr_emu_fuzz.h"
+#include "sl_avr_emu_hex.h"
+
+#ifdef SL_AVR_EMU_LIBFUZZER
+__attribute__((used, section("__libfuzzer_extra_counters")))
+static sl_avr_emu_byte_t sl_avr_emu_fuzz_target_edge_map[SL_AVR_EMU_FUZZ_EDGE_MAP_SIZE];
+#define SL_AVR_EMU_FUZZ_TARGET_EDGE_MAP sl_avr_emu_fuzz_target_edge_map
+#elif defined(__AFL_HAVE_MANUAL_CONTROL)
+static sl_avr_emu_byte_t sl_avr_emu_fuzz_target_edge_map[SL_AVR_EMU_FUZZ_EDGE_MAP_SIZE];
+#define SL_AVR_EMU_FUZZ_TARGET_EDGE_MAP sl_avr_emu_fuzz_target_edge_map
+/* AFL's shared coverage map, and its size where AFL++ exports it */
+extern unsigned char *__afl_area_ptr;
+extern unsigned int   __afl_map_size __attribute__((weak));
+#else
+#define SL_AVR_EMU_FUZZ_TARGET_EDGE_MAP NULL
+#endif
+
+static sl_avr_emu_emulation_s sl_avr_emu_fuzz_target_emulation;
+static sl_avr_emu_fuzz_s      sl_avr_emu_fuzz_target_fuzz;
+
+/**
+ * @brief Reads a numeric environment variable
+ * 
+ * @param name 
+ * @param default_value 
+ * @param required 
+ * @param value 
+ * @return true if a value is available
+ */
+static bool sl_avr_emu_fuzz_target_env(const char *name, uint64_t default_value, bool required, uint64_t *value)
+{
+  const char *str = getenv(name);
+
+  if(str != NULL)
+  {
+    *value = strtoull(str, NULL, 0);
+  }
+  else if(required)
+  {
+    fprintf(stderr, "Error! %s must be set\n", name);
+  }
+  else
+  {
+    *value = default_value;
+  }
+
+  return (str != NULL || !required);
+}
+
+/**
+ * @brief Loads firmware and boots the harness from the environment configuration
+ * 
+ * @return sl_avr_emu_result_e 
+ */
+static sl_avr_emu_result_e sl_avr_emu_fuzz_target_setup(void)
+{
+  sl_avr_emu_result_e      result = SL_AVR_EMU_RESULT_SUCCESS;
+  sl_avr_emu_fuzz_config_s config;
+  uint64_t                 value[8];
+  char                    *hex_path = getenv("SL_AVR_EMU_FUZZ_HEX");
+  bool                     valid;
+
+  valid = (hex_path != NULL);
+  valid = sl_avr_emu_fuzz_target_env("SL_AVR_EMU_FUZZ_START_PC",             0,                          true,  &value[0]) && valid;
+  valid = sl_avr_emu_fuzz_target_env("SL_AVR_EMU_FUZZ_STOP_PC",              SL_AVR_EMU_FUZZ_NO_STOP_PC, false, &value[1]) && valid;
+  valid = sl_avr_emu_fuzz_target_env("SL_AVR_EMU_FUZZ_INPUT_ADDRESS",        0,                          true,  &value[2]) && valid;
+  valid = sl_avr_emu_fuzz_target_env("SL_AVR_EMU_FUZZ_INPUT_SIZE",           256,                        false, &value[3]) && valid;
+  valid = sl_avr_emu_fuzz_target_env("SL_AVR_EMU_FUZZ_INPUT_LENGTH_ADDRESS", 0x18,                       false, &value[4]) && valid;
+  valid = sl_avr_emu_fuzz_target_env("SL_AVR_EMU_FUZZ_BOOT_TICKS",           10000000,                   false, &value[5]) && valid;
+  valid = sl_avr_emu_fuzz_target_env("SL_AVR_EMU_FUZZ_TICKS",                100000,                     false, &value[6]) && valid;
+
+  if(valid)
+  {
+    config.start_pc             = value[0];
+    config.stop_pc              = value[1];
+    config.input_address        = value[2];
+    config.input_size_max       = value[3];
+    config.input_length_address = value[4];
+    config.boot_tick_budget     = value[5];
+    config.input_tick_budget    = value[6];
+
+    result = sl_avr_emu_init(&sl_avr_emu_fuzz_target_emulation);
+    if(SL_AVR_EMU_RESULT_SUCCESS == result)
+    {
+      result = sl_avr_emu_load_hex(&sl_avr_emu_fuzz_target_emulation, hex_path);
+    }
+    if(SL_AVR_EMU_RESULT_SUCCESS == result)
+    {
+      result = sl_avr_emu_fuzz_init(&sl_avr_emu_fuzz_target_fuzz, &sl_avr_emu_fuzz_target_emulation, &config, SL_AVR_EMU_FUZZ_TARGET_EDGE_MAP);
+    }
+  }
+  else
+  {
+    if(NULL == hex_path)
+    {
+      fprintf(stderr, "Error! SL_AVR_EMU_FUZZ_HEX must be set\n");
+    }
+    result = SL_AVR_EMU_RESULT_FAILURE;
+  }
+
+  return result;
+}
+
+/**
+ * @brief Runs one input, aborting on firmware faults so the fuzzer records a crash
+ * 
+ * @param data 
+ * @param size 
+ */
+static void sl_avr_emu_fuzz_target_run(const uint8_t *data, size_t size)
+{
+  sl_avr_emu_result_e result;
+
+  result = sl_avr_emu_fuzz_run_input(&sl_avr_emu_fuzz_target_fuzz, data, size);
+  if(result != SL_AVR_EMU_RESULT_SUCCESS)
+  {
+    fprintf(stderr, "Firmware fault %u at PC 0x%06x, tick %lu\n", result, 
+            sl_avr_emu_fuzz_target_emulation.memory.pc, sl_avr_emu_fuzz_target_emulation.tick_count);
+    abort();
+  }
+}
+
+#if !defined(SL_AVR_EMU_LIBFUZZER) && defined(__AFL_HAVE_MANUAL_CONTROL)
+/**
+ * @brief Adds the firmware edges of the last input into AFL's map and clears them for the next
+ * 
+ */
+static void sl_avr_emu_fuzz_target_afl_edges(void)
+{
+  const uint32_t map_size = (NULL != &__afl_map_size && __afl_map_size > 0)?__afl_map_size:SL_AVR_EMU_FUZZ_EDGE_MAP_SIZE;
+  uint64_t       word;
+  uint32_t       i, j;
+
+  for(i = 0; i < SL_AVR_EMU_FUZZ_EDGE_MAP_SIZE; i += sizeof(word))
+  {
+    /* Most of the map is untouched by an input, skip it a word at a time */
+    memcpy(&word, &sl_avr_emu_fuzz_target_edge_map[i], sizeof(word));
+    if(0 == word)
+    {
+      continue;
+    }
+    for(j = i; j < i + sizeof(word); j++)
+    {
+      __afl_area_ptr[j % map_size] += sl_avr_emu_fuzz_target_edge_map[j];
+    }
+    memset(&sl_avr_emu_fuzz_target_edge_map[i], 0, sizeof(word));
+  }
+}
+#endif
+
+#ifdef SL_AVR_EMU_LIBFUZZER
+
+int LLVMFuzzerInitialize(int *argc, char ***argv)
+{
+  if(sl_avr_emu_fuzz_target_setup() != SL_AVR_EMU_RESULT_SUCCESS)
+  {
+    exit(1);
+  }
+  return 0;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+  sl_avr_emu_fuzz_target_run(data, size);
+  return 0;
+}
+
+#else
+
+int main(int argc, char *argv[])
+{
+  int                 i;
+  FILE               *fp;
+  size_t              size;
+  static uint8_t      input[1 << 16];
+  struct timespec     start, end;
+  double              seconds;
+
+  if(sl_avr_emu_fuzz_target_setup() != SL_AVR_EMU_RESULT_SUCCESS)
+  {
+    return 1;
+  }
+
+#ifdef __AFL_HAVE_MANUAL_CONTROL
+  if(argc < 2)
+  {
+    while(__AFL_LOOP(100000))
+    {
+      size = fread(input, 1, sizeof(input), stdin);
+      sl_avr_emu_fuzz_target_run(input, size);
+      sl_avr_emu_fuzz_target_afl_edges();
+    }
+    return 0;
+  }
+#endif
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for(i = 1; i < argc; i++)
+  {
+    fp = fopen(argv[i], "rb");
+    if(fp != NULL)
+    {
+      size = fread(input, 1, sizeof(input), fp);
+      fclose(fp);
+      sl_avr_emu_fuzz_target_run(input, size);
+      printf("%s: %lu ticks%s\n", argv[i], sl_avr_emu_fuzz_target_fuzz.last_ticks, 
+             (sl_avr_emu_fuzz_target_fuzz.last_timed_out)?" (timeout)":"");
+    }
+    else
+    {
+      fprintf(stderr, "Error! Cannot open %s\n", argv[i]);
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  printf("%lu executions, %u edges, %.0f executions/s\n", sl_avr_emu_fuzz_target_fuzz.executions, 
+         sl_avr_emu_fuzz_edges_hit(&sl_avr_emu_fuzz_target_fuzz), 
+         (seconds > 0)?(sl_avr_emu_fuzz_target_fuzz.executions / seconds):0.0);
+
+  return 0;
+}
+
+#endif
@@ -0,0 +1,882 @@
+/**
+ * @file sl_avr_emu_gdb.c
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator GDB Remote Serial Protocol Server
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ * Continue runs sl_avr_emu_run in SL_AVR_EMU_GDB_POLL_TICKS chunks, stopping on the flash
+ * patched breakpoints and watch ranges of the emulation itself.  The socket is only polled for
+ * an interrupt between chunks, so the target runs at full speed between stops.
+ */
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "sl_avr_emu_breakpoint.h"
+#include "sl_avr_emu_gdb.h"
+#include "sl_avr_emu_guard.h"
+#include "sl_avr_emu_tick.h"
+#include "sl_avr_emu_watch.h"
+
+/* Interrupt request sent by GDB outside of packets */
+#define SL_AVR_EMU_GDB_INTERRUPT 0x03
+
+/**
+ * @brief GDB connection state
+ * 
+ */
+typedef struct
+{
+  sl_avr_emu_emulation_s *emulation;
+  sl_avr_emu_tick_count_t tick_limit;
+  int                     socket;
+  /* Acknowledgments disabled with QStartNoAckMode */
+  bool                    no_ack;
+
+  /* Received bytes not yet consumed */
+  uint8_t                 input[SL_AVR_EMU_GDB_PACKET_SIZE];
+  size_t                  input_length;
+  size_t                  input_position;
+
+  char                    packet[SL_AVR_EMU_GDB_PACKET_SIZE + 1];
+  char                    reply[SL_AVR_EMU_GDB_PACKET_SIZE + 1];
+
+} sl_avr_emu_gdb_s;
+
+static const char sl_avr_emu_gdb_hex_digits[] = "0123456789abcdef";
+
+/**
+ * @brief Value of a hex digit
+ * 
+ * @param digit
+ * @return int - -1 if not a hex digit
+ */
+static int sl_avr_emu_gdb_hex_value(char digit)
+{
+  if(digit >= '0' && digit <= '9')
+  {
+    return digit - '0';
+  }
+  if(digit >= 'a' && digit <= 'f')
+  {
+    return digit - 'a' + 10;
+  }
+  if(digit >= 'A' && digit <= 'F')
+  {
+    return digit - 'A' + 10;
+  }
+  return -1;
+}
+
+/**
+ * @brief Decodes hex pairs into bytes
+ * 
+ * @param hex
+ * @param bytes
+ * @param size  - Bytes to decode
+ * @return bool - False if hex is short or not hex
+ */
+static bool sl_avr_emu_gdb_hex_decode(const char *hex, uint8_t *bytes, size_t size)
+{
+  size_t i;
+  int    high, low;
+
+  for(i = 0; i < size; i++)
+  {
+    high = sl_avr_emu_gdb_hex_value(hex[2*i]);
+    low  = (high >= 0)?sl_avr_emu_gdb_hex_value(hex[2*i + 1]):-1;
+    if(low < 0)
+    {
+      return false;
+    }
+    bytes[i] = (high << 4) | low;
+  }
+  return true;
+}
+
+/**
+ * @brief Encodes bytes as hex pairs, null terminated
+ * 
+ * @param bytes
+ * @param size
+ * @param hex   - 2*size + 1 characters
+ */
+static void sl_avr_emu_gdb_hex_encode(const uint8_t *bytes, size_t size, char *hex)
+{
+  size_t i;
+
+  for(i = 0; i < size; i++)
+  {
+    hex[2*i]     = sl_avr_emu_gdb_hex_digits[bytes[i] >> 4];
+    hex[2*i + 1] = sl_avr_emu_gdb_hex_digits[bytes[i] & 0xF];
+  }
+  hex[2*size] = '\0';
+}
+
+/**
+ * @brief Reads a byte from GDB, blocking
+ * 
+ * @param gdb
+ * @return int - -1 once the connection is closed
+ */
+static int sl_avr_emu_gdb_getc(sl_avr_emu_gdb_s *gdb)
+{
+  ssize_t length;
+
+  if(gdb->input_position == gdb->input_length)
+  {
+    length = recv(gdb->socket, gdb->input, sizeof(gdb->input), 0);
+    if(length <= 0)
+    {
+      return -1;
+    }
+    gdb->input_length   = length;
+    gdb->input_position = 0;
+  }
+  return gdb->input[gdb->input_position++];
+}
+
+/**
+ * @brief Checks for bytes from GDB without blocking
+ * 
+ * @param gdb
+ * @return bool
+ */
+static bool sl_avr_emu_gdb_input_pending(sl_avr_emu_gdb_s *gdb)
+{
+  struct pollfd poll_fd = { .fd = gdb->socket, .events = POLLIN };
+
+  return (gdb->input_position < gdb->input_length) || (poll(&poll_fd, 1, 0) > 0);
+}
+
+/**
+ * @brief Sends a packet and waits for its acknowledgment
+ * 
+ * @param gdb
+ * @param payload
+ * @return sl_avr_emu_result_e
+ */
+static sl_avr_emu_result_e sl_avr_emu_gdb_send(sl_avr_emu_gdb_s *gdb, const char *payload)
+{
+  char     frame[SL_AVR_EMU_GDB_PACKET_SIZE + 5];
+  size_t   length   = strlen(payload);
+  uint8_t  checksum = 0;
+  size_t   i;
+  int      ack;
+
+  for(i = 0; i < length; i++)
+  {
+    checksum += (uint8_t) payload[i];
+  }
+  frame[0] = '$';
+  memcpy(&frame[1], payload, length);
+  frame[length + 1] = '#';
+  frame[length + 2] = sl_avr_emu_gdb_hex_digits[checksum >> 4];
+  frame[length + 3] = sl_avr_emu_gdb_hex_digits[checksum & 0xF];
+
+  do
+  {
+    if((ssize_t) (length + 4) != send(gdb->socket, frame, length + 4, MSG_NOSIGNAL))
+    {
+      return SL_AVR_EMU_RESULT_FAILURE;
+    }
+    if(gdb->no_ack)
+    {
+      break;
+    }
+    do
+    {
+      ack = sl_avr_emu_gdb_getc(gdb);
+    } while(ack >= 0 && ack != '+' && ack != '-');
+  } while(ack == '-');
+
+  return (ack >= 0 || gdb->no_ack)?SL_AVR_EMU_RESULT_SUCCESS:SL_AVR_EMU_RESULT_FAILURE;
+}
+
+/**
+ * @brief Receives the next packet into gdb->packet, acknowledging it
+ * 
+ * @param gdb
+ * @return sl_avr_emu_result_e - SL_AVR_EMU_RESULT_FAILURE once the connection is closed
+ */
+static sl_avr_emu_result_e sl_avr_emu_gdb_receive(sl_avr_emu_gdb_s *gdb)
+{
+  int     c = 0;
+  size_t  length;
+  uint8_t checksum;
+  int     high, low;
+
+  while(c >= 0)
+  {
+    /* Acknowledgments and interrupts while stopped are dropped */
+    while((c = sl_avr_emu_gdb_getc(gdb)) >= 0 && c != '$');
+
+    length   = 0;
+    checksum = 0;
+    while(c >= 0 && (c = sl_avr_emu_gdb_getc(gdb)) >= 0 && c != '#')
+    {
+      if(length < SL_AVR_EMU_GDB_PACKET_SIZE)
+      {
+        gdb->packet[length++] = c;
+      }
+      checksum += c;
+    }
+    gdb->packet[length] = '\0';
+    high = (c >= 0)?sl_avr_emu_gdb_hex_value(sl_avr_emu_gdb_getc(gdb)):-1;
+    low  = (c >= 0)?sl_avr_emu_gdb_hex_value(sl_avr_emu_gdb_getc(gdb)):-1;
+
+    if(c < 0)
+    {
+      break;
+    }
+    if(gdb->no_ack)
+    {
+      return SL_AVR_EMU_RESULT_SUCCESS;
+    }
+    if(high >= 0 && low >= 0 && checksum == ((high << 4) | low))
+    {
+      return (1 == send(gdb->socket, "+", 1, MSG_NOSIGNAL))?SL_AVR_EMU_RESULT_SUCCESS:SL_AVR_EMU_RESULT_FAILURE;
+    }
+    if(1 != send(gdb->socket, "-", 1, MSG_NOSIGNAL))
+    {
+      break;
+    }
+  }
+
+  return SL_AVR_EMU_RESULT_FAILURE;
+}
+
+/**
+ * @brief Size of a register in avr-gdb numbering
+ * 
+ * @param number
+ * @return size_t - 0 for unknown registers
+ */
+static size_t sl_avr_emu_gdb_register_size(uint32_t number)
+{
+  return (number <= SL_AVR_EMU_GDB_REGISTER_SREG)?1:
+         (SL_AVR_EMU_GDB_REGISTER_SP == number)?2:
+         (SL_AVR_EMU_GDB_REGISTER_PC == number)?4:0;
+}
+
+/**
+ * @brief Reads a register in avr-gdb numbering
+ * 
+ * @param emulation
+ * @param number
+ * @param value     - Little-endian register bytes
+ * @return size_t   - Register size in bytes, 0 for unknown registers
+ */
+static size_t sl_avr_emu_gdb_register_read(const sl_avr_emu_emulation_s *emulation, uint32_t number, uint8_t *value)
+{
+  sl_avr_emu_extended_address_t pc = emulation->memory.pc*2;
+
+  if(number < SL_AVR_EMU_GDB_REGISTER_SREG)
+  {
+    value[0] = emulation->memory.data[number];
+    return 1;
+  }
+  if(SL_AVR_EMU_GDB_REGISTER_SREG == number)
+  {
+    value[0] = emulation->memory.data[SL_AVR_EMU_SREG_ADDRESS];
+    return 1;
+  }
+  if(SL_AVR_EMU_GDB_REGISTER_SP == number)
+  {
+    value[0] = emulation->memory.data[SL_AVR_EMU_SPL_ADDRESS];
+    value[1] = emulation->memory.data[SL_AVR_EMU_SPH_ADDRESS];
+    return 2;
+  }
+  if(SL_AVR_EMU_GDB_REGISTER_PC == number)
+  {
+    value[0] = pc;
+    value[1] = pc >> 8;
+    value[2] = pc >> 16;
+    value[3] = pc >> 24;
+    return 4;
+  }
+  return 0;
+}
+
+/**
+ * @brief Writes a register in avr-gdb numbering
+ * 
+ * @param emulation
+ * @param number
+ * @param value     - Little-endian register bytes, as many as sl_avr_emu_gdb_register_read returns
+ */
+static void sl_avr_emu_gdb_register_write(sl_avr_emu_emulation_s *emulation, uint32_t number, const uint8_t *value)
+{
+  if(number < SL_AVR_EMU_GDB_REGISTER_SREG)
+  {
+    emulation->memory.data[number] = value[0];
+  }
+  else if(SL_AVR_EMU_GDB_REGISTER_SREG == number)
+  {
+    emulation->memory.data[SL_AVR_EMU_SREG_ADDRESS] = value[0];
+  }
+  else if(SL_AVR_EMU_GDB_REGISTER_SP == number)
+  {
+    emulation->memory.data[SL_AVR_EMU_SPL_ADDRESS] = value[0];
+    emulation->memory.data[SL_AVR_EMU_SPH_ADDRESS] = value[1];
+  }
+  else if(SL_AVR_EMU_GDB_REGISTER_PC == number)
+  {
+    emulation->memory.pc = (value[0] | (value[1] << 8) | (value[2] << 16) | ((uint32_t) value[3] << 24))/2;
+  }
+}
+
+/**
+ * @brief Reads target memory, flash bytes looking through breakpoints
+ * 
+ * @param emulation
+ * @param address   - avr-gdb address
+ * @param value
+ * @return bool     - False outside flash and data
+ */
+static bool sl_avr_emu_gdb_memory_read(const sl_avr_emu_emulation_s *emulation, uint32_t address, uint8_t *value)
+{
+  sl_avr_emu_word_t word;
+
+  if(address >= SL_AVR_EMU_GDB_DATA_OFFSET)
+  {
+    if(address >= SL_AVR_EMU_GDB_EEPROM_OFFSET || !SL_AVR_EMU_DATA_ADDRESS_VALID(address - SL_AVR_EMU_GDB_DATA_OFFSET))
+    {
+      return false;
+    }
+    *value = emulation->memory.data[address - SL_AVR_EMU_GDB_DATA_OFFSET];
+    return true;
+  }
+  if(!SL_AVR_EMU_FLASH_ADDRESS_VALID(address/2))
+  {
+    return false;
+  }
+  word   = sl_avr_emu_breakpoint_word(emulation, address/2);
+  *value = (address & 1)?(word >> 8):word;
+  return true;
+}
+
+/**
+ * @brief Writes target memory, flash bytes under breakpoints go to the saved instruction
+ * 
+ * @param emulation
+ * @param address   - avr-gdb address
+ * @param value
+ * @return bool     - False outside flash and data
+ */
+static bool sl_avr_emu_gdb_memory_write(sl_avr_emu_emulation_s *emulation, uint32_t address, uint8_t value)
+{
+  sl_avr_emu_breakpoint_s *breakpoint;
+  sl_avr_emu_word_t       *word;
+
+  if(address >= SL_AVR_EMU_GDB_DATA_OFFSET)
+  {
+    if(address >= SL_AVR_EMU_GDB_EEPROM_OFFSET || !SL_AVR_EMU_DATA_ADDRESS_VALID(address - SL_AVR_EMU_GDB_DATA_OFFSET))
+    {
+      return false;
+    }
+    emulation->memory.data[address - SL_AVR_EMU_GDB_DATA_OFFSET] = value;
+    return true;
+  }
+  if(!SL_AVR_EMU_FLASH_ADDRESS_VALID(address/2))
+  {
+    return false;
+  }
+  breakpoint = sl_avr_emu_breakpoint_find(emulation, address/2);
+  word       = (breakpoint != NULL)?&breakpoint->original:&emulation->memory.flash[address/2];
+  *word      = (address & 1)?((*word & 0x00FF) | (value << 8)):((*word & 0xFF00) | value);
+  return true;
+}
+
+/**
+ * @brief Lets the instruction at PC execute if GDB resumes from a breakpoint placed on it
+ * 
+ * @param emulation
+ */
+static void sl_avr_emu_gdb_resume(sl_avr_emu_emulation_s *emulation)
+{
+  if(NULL != sl_avr_emu_breakpoint_find(emulation, emulation->memory.pc))
+  {
+    emulation->hooks.breakpoints->resuming  = true;
+    emulation->hooks.breakpoints->resume_pc = emulation->memory.pc;
+  }
+}
+
+/**
+ * @brief Executes one instruction, finishing the cycles of an interrupted one first
+ * 
+ * @param gdb
+ * @return sl_avr_emu_result_e
+ */
+static sl_avr_emu_result_e sl_avr_emu_gdb_step(sl_avr_emu_gdb_s *gdb)
+{
+  sl_avr_emu_emulation_s *emulation = gdb->emulation;
+  sl_avr_emu_result_e     result    = SL_AVR_EMU_RESULT_SUCCESS;
+  bool                    dispatched = false;
+
+  sl_avr_emu_gdb_resume(emulation);
+  while(SL_AVR_EMU_RESULT_SUCCESS == result && emulation->tick_count < gdb->tick_limit &&
+        (!dispatched || emulation->op_cycles_remaining > 0))
+  {
+    dispatched = dispatched || (0 == emulation->op_cycles_remaining);
+    result = sl_avr_emu_io_tick(emulation);
+    if(SL_AVR_EMU_RESULT_SUCCESS == result)
+    {
+      result = sl_avr_emu_tick(emulation);
+    }
+  }
+
+  return result;
+}
+
+/**
+ * @brief Runs until a breakpoint, watch hit, error, tick_limit or interrupt from GDB
+ * 
+ * @param gdb
+ * @param interrupted - Set if GDB interrupted the target
+ * @return sl_avr_emu_result_e
+ */
+static sl_avr_emu_result_e sl_avr_emu_gdb_continue(sl_avr_emu_gdb_s *gdb, bool *interrupted)
+{
+  sl_avr_emu_emulation_s *emulation = gdb->emulation;
+  sl_avr_emu_result_e     result    = SL_AVR_EMU_RESULT_SUCCESS;
+  sl_avr_emu_tick_count_t chunk_limit;
+  int                     c;
+
+  *interrupted = false;
+  sl_avr_emu_gdb_resume(emulation);
+  while(SL_AVR_EMU_RESULT_SUCCESS == result && !*interrupted && emulation->tick_count < gdb->tick_limit)
+  {
+    chunk_limit = ((gdb->tick_limit - emulation->tick_count) > SL_AVR_EMU_GDB_POLL_TICKS)?
+                  (emulation->tick_count + SL_AVR_EMU_GDB_POLL_TICKS):gdb->tick_limit;
+    result = sl_avr_emu_run(emulation, chunk_limit);
+
+    while(SL_AVR_EMU_RESULT_SUCCESS == result && !*interrupted && sl_avr_emu_gdb_input_pending(gdb))
+    {
+      c = sl_avr_emu_gdb_getc(gdb);
+      if(c < 0)
+      {
+        result = SL_AVR_EMU_RESULT_FAILURE;
+      }
+      *interrupted = (SL_AVR_EMU_GDB_INTERRUPT == c);
+    }
+  }
+
+  return result;
+}
+
+/**
+ * @brief Formats the stop reply for how the target stopped
+ * 
+ * @param gdb
+ * @param result      - Result of the step or continue
+ * @param interrupted - True if GDB interrupted the target
+ */
+static void sl_avr_emu_gdb_stop_reply(sl_avr_emu_gdb_s *gdb, sl_avr_emu_result_e result, bool interrupted)
+{
+  const sl_avr_emu_watch_s *watch = gdb->emulation->hooks.watch;
+  const char               *kind;
+
+  if(interrupted)
+  {
+    /* SIGINT */
+    snprintf(gdb->reply, sizeof(gdb->reply), "S02");
+  }
+  else if(SL_AVR_EMU_RESULT_WATCHPOINT == result && watch != NULL)
+  {
+    kind = (SL_AVR_EMU_WATCH_READ_WRITE == watch->ranges[watch->trigger_range].access)?"awatch":
+           (SL_AVR_EMU_WATCH_READ == watch->ranges[watch->trigger_range].access)?"rwatch":"watch";
+    snprintf(gdb->reply, sizeof(gdb->reply), "T05%s:%x;", kind, SL_AVR_EMU_GDB_DATA_OFFSET + watch->trigger_address);
+  }
+  else if(SL_AVR_EMU_RESULT_SUCCESS == result && gdb->emulation->tick_count >= gdb->tick_limit)
+  {
+    /* Out of ticks, reported as an exit */
+    snprintf(gdb->reply, sizeof(gdb->reply), "W00");
+  }
+  else if(SL_AVR_EMU_RESULT_INVALID_OPCODE == result || SL_AVR_EMU_RESULT_UNSUPPORTED_OPCODE == result)
+  {
+    /* SIGILL */
+    snprintf(gdb->reply, sizeof(gdb->reply), "S04");
+  }
+  else if(SL_AVR_EMU_RESULT_SUCCESS == result || SL_AVR_EMU_RESULT_BREAKPOINT == result ||
+          SL_AVR_EMU_RESULT_WATCHPOINT == result)
+  {
+    /* SIGTRAP */
+    snprintf(gdb->reply, sizeof(gdb->reply), "S05");
+  }
+  else
+  {
+    /* SIGSEGV for address, PC and stack errors */
+    snprintf(gdb->reply, sizeof(gdb->reply), "S0b");
+  }
+}
+
+/**
+ * @brief Handles Z and z packets
+ * 
+ * @param gdb
+ * @param insert - True for Z
+ */
+static void sl_avr_emu_gdb_breakpoint(sl_avr_emu_gdb_s *gdb, bool insert)
+{
+  static const sl_avr_emu_watch_access_e access[] = { SL_AVR_EMU_WATCH_WRITE, SL_AVR_EMU_WATCH_READ, SL_AVR_EMU_WATCH_READ_WRITE };
+  sl_avr_emu_result_e result = SL_AVR_EMU_RESULT_FAILURE;
+  char               *end;
+  uint32_t            type, address, length;
+
+  type    = strtoul(&gdb->packet[1], &end, 16);
+  address = (',' == *end)?strtoul(end + 1, &end, 16):0;
+  length  = (',' == *end)?strtoul(end + 1, &end, 16):0;
+
+  if(type <= 1 && address < SL_AVR_EMU_GDB_DATA_OFFSET)
+  {
+    /* Software and hardware breakpoints are both flash patches */
+    result = insert?sl_avr_emu_breakpoint_set(gdb->emulation, address/2):sl_avr_emu_breakpoint_clear(gdb->emulation, address/2);
+  }
+  else if(type <= 4 && address >= SL_AVR_EMU_GDB_DATA_OFFSET && address < SL_AVR_EMU_GDB_EEPROM_OFFSET)
+  {
+    address -= SL_AVR_EMU_GDB_DATA_OFFSET;
+    result = insert?sl_avr_emu_watch_add(gdb->emulation, address, length, access[type - 2], NULL, NULL):
+                    sl_avr_emu_watch_remove(gdb->emulation, address, length, access[type - 2]);
+  }
+  else if(type > 4)
+  {
+    /* Unsupported type */
+    gdb->reply[0] = '\0';
+    return;
+  }
+
+  snprintf(gdb->reply, sizeof(gdb->reply), (SL_AVR_EMU_RESULT_SUCCESS == result)?"OK":"E01");
+}
+
+/**
+ * @brief Handles m and M packets
+ * 
+ * @param gdb
+ * @param write - True for M
+ */
+static void sl_avr_emu_gdb_memory(sl_avr_emu_gdb_s *gdb, bool write)
+{
+  char     *end;
+  uint32_t  address, length, i;
+  uint8_t   value;
+  uint8_t   bytes[SL_AVR_EMU_GDB_PACKET_SIZE/2];
+
+  address = strtoul(&gdb->packet[1], &end, 16);
+  length  = (',' == *end)?strtoul(end + 1, &end, 16):0;
+
+  if(write)
+  {
+    if(':' != *end || length > sizeof(bytes) || !sl_avr_emu_gdb_hex_decode(end + 1, bytes, length))
+    {
+      snprintf(gdb->reply, sizeof(gdb->reply), "E01");
+      return;
+    }
+    for(i = 0; i < length && sl_avr_emu_gdb_memory_write(gdb->emulation, address + i, bytes[i]); i++);
+    snprintf(gdb->reply, sizeof(gdb->reply), (i == length)?"OK":"E01");
+  }
+  else
+  {
+    /* Reads stop at the end of the address space, an empty read is an error */
+    for(i = 0; i < length && i < sizeof(bytes) && sl_avr_emu_gdb_memory_read(gdb->emulation, address + i, &value); i++)
+    {
+      bytes[i] = value;
+    }
+    if(0 == i && length > 0)
+    {
+      snprintf(gdb->reply, sizeof(gdb->reply), "E01");
+    }
+    else
+    {
+      sl_avr_emu_gdb_hex_encode(bytes, i, gdb->reply);
+    }
+  }
+}
+
+/**
+ * @brief Handles g, G, p and P packets
+ * 
+ * @param gdb
+ */
+static void sl_avr_emu_gdb_registers(sl_avr_emu_gdb_s *gdb)
+{
+  uint8_t   registers[SL_AVR_EMU_GDB_REGISTERS_SIZE];
+  uint8_t  *value = registers;
+  uint32_t  number;
+  size_t    size;
+  char     *end;
+
+  if('g' == gdb->packet[0])
+  {
+    for(number = 0; number <= SL_AVR_EMU_GDB_REGISTER_PC; number++)
+    {
+      value += sl_avr_emu_gdb_register_read(gdb->emulation, number, value);
+    }
+    sl_avr_emu_gdb_hex_encode(registers, sizeof(registers), gdb->reply);
+  }
+  else if('G' == gdb->packet[0])
+  {
+    if(!sl_avr_emu_gdb_hex_decode(&gdb->packet[1], registers, sizeof(registers)))
+    {
+      snprintf(gdb->reply, sizeof(gdb->reply), "E01");
+      return;
+    }
+    for(number = 0; number <= SL_AVR_EMU_GDB_REGISTER_PC; number++)
+    {
+      sl_avr_emu_gdb_register_write(gdb->emulation, number, value);
+      value += sl_avr_emu_gdb_register_size(number);
+    }
+    snprintf(gdb->reply, sizeof(gdb->reply), "OK");
+  }
+  else
+  {
+    number = strtoul(&gdb->packet[1], &end, 16);
+    size   = sl_avr_emu_gdb_register_read(gdb->emulation, number, registers);
+    if(0 == size)
+    {
+      snprintf(gdb->reply, sizeof(gdb->reply), "E01");
+    }
+    else if('p' == gdb->packet[0])
+    {
+      sl_avr_emu_gdb_hex_encode(registers, size, gdb->reply);
+    }
+    else if('=' == *end && sl_avr_emu_gdb_hex_decode(end + 1, registers, size))
+    {
+      sl_avr_emu_gdb_register_write(gdb->emulation, number, registers);
+      snprintf(gdb->reply, sizeof(gdb->reply), "OK");
+    }
+    else
+    {
+      snprintf(gdb->reply, sizeof(gdb->reply), "E01");
+    }
+  }
+}
+
+/**
+ * @brief Opens a listening socket
+ * 
+ * @param address - TCP port on the loopback interface if numeric, else a Unix socket path
+ * @return int    - -1 on failure
+ */
+static int sl_avr_emu_gdb_listen(const char *address)
+{
+  struct sockaddr_in tcp_address  = {0};
+  struct sockaddr_un unix_address = {0};
+  struct stat        status;
+  char              *end;
+  unsigned long      port;
+  int                listen_socket;
+  int                enable = 1;
+
+  port = strtoul(address, &end, 10);
+  if('\0' == *end && port > 0 && port <= 0xFFFF)
+  {
+    listen_socket = socket(AF_INET, SOCK_STREAM, 0);
+    tcp_address.sin_family      = AF_INET;
+    tcp_address.sin_port        = htons(port);
+    tcp_address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if(listen_socket < 0 ||
+       0 != setsockopt(listen_socket, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable)) ||
+       0 != bind(listen_socket, (struct sockaddr *) &tcp_address, sizeof(tcp_address)))
+    {
+      goto error;
+    }
+  }
+  else
+  {
+    if(strlen(address) >= sizeof(unix_address.sun_path))
+    {
+      return -1;
+    }
+    /* Replace a socket left by an earlier run, but nothing else */
+    if(0 == stat(address, &status) && S_ISSOCK(status.st_mode))
+    {
+      unlink(address);
+    }
+    listen_socket = socket(AF_UNIX, SOCK_STREAM, 0);
+    unix_address.sun_family = AF_UNIX;
+    strcpy(unix_address.sun_path, address);
+    if(listen_socket < 0 || 0 != bind(listen_socket, (struct sockaddr *) &unix_address, sizeof(unix_address)))
+    {
+      goto error;
+    }
+  }
+
+  if(0 == listen(listen_socket, 1))
+  {
+    return listen_socket;
+  }
+
+error:
+  if(listen_socket >= 0)
+  {
+    close(listen_socket);
+  }
+  return -1;
+}
+
+/**
+ * @brief Serves one GDB connection, running emulation as GDB requests until it detaches or kills the target
+ * 
+ * @param emulation
+ * @param address    - TCP port on the loopback interface if numeric, else a Unix socket path
+ * @param tick_limit - Tick count at which the target is reported as exited
+ * @return sl_avr_emu_result_e - SL_AVR_EMU_RESULT_FAILURE if the socket could not be served
+ */
+sl_avr_emu_result_e sl_avr_emu_gdb_serve(sl_avr_emu_emulation_s *emulation, const char *address, sl_avr_emu_tick_count_t tick_limit)
+{
+  sl_avr_emu_result_e result = SL_AVR_EMU_RESULT_SUCCESS;
+  sl_avr_emu_result_e stop_result;
+  sl_avr_emu_gdb_s   *gdb;
+  int                 listen_socket;
+  int                 enable = 1;
+  bool                interrupted;
+  bool                done = false;
+  char               *end;
+
+  listen_socket = sl_avr_emu_gdb_listen(address);
+  if(listen_socket < 0)
+  {
+    return SL_AVR_EMU_RESULT_FAILURE;
+  }
+  gdb = calloc(1, sizeof(sl_avr_emu_gdb_s));
+  if(NULL == gdb)
+  {
+    close(listen_socket);
+    return SL_AVR_EMU_RESULT_FAILURE;
+  }
+  gdb->emulation  = emulation;
+  gdb->tick_limit = tick_limit;
+
+  printf("Waiting for GDB on %s\n", address);
+  fflush(stdout);
+  gdb->socket = accept(listen_socket, NULL, NULL);
+  close(listen_socket);
+  if(gdb->socket < 0)
+  {
+    free(gdb);
+    return SL_AVR_EMU_RESULT_FAILURE;
+  }
+  setsockopt(gdb->socket, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+  while(!done && SL_AVR_EMU_RESULT_SUCCESS == result)
+  {
+    result = sl_avr_emu_gdb_receive(gdb);
+    if(SL_AVR_EMU_RESULT_SUCCESS != result)
+    {
+      break;
+    }
+
+    /* Unsupported packets get an empty reply */
+    gdb->reply[0] = '\0';
+    switch(gdb->packet[0])
+    {
+      case '?':
+      {
+        snprintf(gdb->reply, sizeof(gdb->reply), "S05");
+        break;
+      }
+      case 'g':
+      case 'G':
+      case 'p':
+      case 'P':
+      {
+        /* Host accesses to guarded data memory are not watch hits */
+        SL_AVR_EMU_GUARD_PROTECT(emulation, false);
+        sl_avr_emu_gdb_registers(gdb);
+        SL_AVR_EMU_GUARD_PROTECT(emulation, true);
+        break;
+      }
+      case 'm':
+      case 'M':
+      {
+        SL_AVR_EMU_GUARD_PROTECT(emulation, false);
+        sl_avr_emu_gdb_memory(gdb, ('M' == gdb->packet[0]));
+        SL_AVR_EMU_GUARD_PROTECT(emulation, true);
+        break;
+      }
+      case 'Z':
+      case 'z':
+      {
+        sl_avr_emu_gdb_breakpoint(gdb, ('Z' == gdb->packet[0]));
+        break;
+      }
+      case 'c':
+      case 's':
+      {
+        /* Optional resume address */
+        if('\0' != gdb->packet[1])
+        {
+          emulation->memory.pc = strtoul(&gdb->packet[1], &end, 16)/2;
+        }
+        interrupted = false;
+        stop_result = ('s' == gdb->packet[0])?sl_avr_emu_gdb_step(gdb):sl_avr_emu_gdb_continue(gdb, &interrupted);
+        sl_avr_emu_gdb_stop_reply(gdb, stop_result, interrupted);
+        break;
+      }
+      case 'H':
+      {
+        snprintf(gdb->reply, sizeof(gdb->reply), "OK");
+        break;
+      }
+      case 'q':
+      {
+        if(0 == strncmp(gdb->packet, "qSupported", strlen("qSupported")))
+        {
+          snprintf(gdb->reply, sizeof(gdb->reply), "PacketSize=%x;QStartNoAckMode+", SL_AVR_EMU_GDB_PACKET_SIZE);
+        }
+        else if(0 == strcmp(gdb->packet, "qAttached"))
+        {
+          snprintf(gdb->reply, sizeof(gdb->reply), "1");
+        }
+        break;
+      }
+      case 'Q':
+      {
+        if(0 == strcmp(gdb->packet, "QStartNoAckMode"))
+        {
+          snprintf(gdb->reply, sizeof(gdb->reply), "OK");
+          result = sl_avr_emu_gdb_send(gdb, gdb->reply);
+          gdb->no_ack = true;
+          continue;
+        }
+        break;
+      }
+      case 'D':
+      {
+        snprintf(gdb->reply, sizeof(gdb->reply), "OK");
+        done = true;
+        break;
+      }
+      case 'k':
+      {
+        /* Kill has no reply */
+        done = true;
+        continue;
+      }
+      default:
+      {
+        break;
+      }
+    }
+
+    result = sl_avr_emu_gdb_send(gdb, gdb->reply);
+  }
+
+  close(gdb->socket);
+  free(gdb);
+
+  /* GDB closing the connection ends the session like a detach */
+  return SL_AVR_EMU_RESULT_SUCCESS;
+}
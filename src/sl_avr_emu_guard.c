@@ -0,0 +1,410 @@
+/**
+ * @file sl_avr_emu_guard.c
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator Guard Page Watch Logic
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ * Pages holding a read watch are PROT_NONE and pages holding only write watches PROT_READ.
+ * An emulated access to such a page faults; the SIGSEGV handler latches a hit if the address
+ * is in a range, opens the page and lets the access retry.  On x86 the retried host instruction
+ * is single-stepped and the SIGTRAP handler protects the page again, so every access is seen.
+ * Elsewhere the page is protected again once the emulated instruction completes, and further
+ * accesses to the page by that instruction go unseen.  Either way the hit is acted on after
+ * the instruction, like a sl_avr_emu_watch hit.
+ * 
+ * Faults are delivered to the thread making the access, so emulations on parallel threads each
+ * handle their own.  The handlers take no lock: a guard is only followed for a fault in the data
+ * memory it protects, which happens on the thread running its emulation.
+ */
+
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#include "sl_avr_emu_guard.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SL_AVR_EMU_GUARD_SINGLE_STEP
+#endif
+/* x86 page fault error code bit set for writes */
+#define SL_AVR_EMU_GUARD_FAULT_WRITE 0x2
+/* x86 EFLAGS trap flag */
+#define SL_AVR_EMU_GUARD_TRAP_FLAG 0x100
+
+/**
+ * @brief Registered guard.  data is published after guard, and cleared before the guard is freed.
+ * 
+ */
+typedef struct
+{
+  _Atomic(uintptr_t)  data;
+  sl_avr_emu_guard_s *guard;
+
+} sl_avr_emu_guard_slot_s;
+
+/* Guards matched against fault addresses, 0 data for free slots */
+static sl_avr_emu_guard_slot_s sl_avr_emu_guards[SL_AVR_EMU_GUARD_EMULATIONS_MAX];
+/* Serializes registration and handler installation between threads, never taken by the handlers */
+static pthread_mutex_t  sl_avr_emu_guard_lock = PTHREAD_MUTEX_INITIALIZER;
+/* SIGSEGV and SIGTRAP actions replaced by the guard handlers */
+static struct sigaction sl_avr_emu_guard_previous_action;
+static struct sigaction sl_avr_emu_guard_previous_trap_action;
+static bool             sl_avr_emu_guard_handler_installed = false;
+/* Guard with pages opened for the host instruction this thread is single-stepping */
+static _Thread_local sl_avr_emu_guard_s *volatile sl_avr_emu_guard_stepping;
+
+/**
+ * @brief Protects pages opened by faults again
+ * 
+ * @param guard
+ */
+static void sl_avr_emu_guard_close(sl_avr_emu_guard_s *guard)
+{
+  uint32_t page;
+
+  for(page = 0; page < guard->page_count; page++)
+  {
+    if(guard->opened[page])
+    {
+      guard->opened[page] = false;
+      mprotect(&guard->data[page*guard->page_size], guard->page_size, guard->protection[page]);
+    }
+  }
+}
+
+/**
+ * @brief SIGSEGV handler, opens guarded pages for emulated accesses and latches hits
+ * 
+ * @param signal
+ * @param info
+ * @param context
+ */
+static void sl_avr_emu_guard_signal(int signal, siginfo_t *info, void *context)
+{
+  sl_avr_emu_guard_s *guard;
+  uintptr_t           fault = (uintptr_t) info->si_addr;
+  uintptr_t           data;
+  uint32_t            address, page, i, j;
+  bool                write;
+
+  for(i = 0; i < SL_AVR_EMU_GUARD_EMULATIONS_MAX; i++)
+  {
+    data = atomic_load_explicit(&sl_avr_emu_guards[i].data, memory_order_acquire);
+    if(0 == data || fault < data || fault >= (data + SL_AVR_EMU_DATA_SIZE))
+    {
+      continue;
+    }
+    guard   = sl_avr_emu_guards[i].guard;
+    address = fault - data;
+    page    = address/guard->page_size;
+
+#ifdef SL_AVR_EMU_GUARD_SINGLE_STEP
+    write = (0 != (((ucontext_t *) context)->uc_mcontext.gregs[REG_ERR] & SL_AVR_EMU_GUARD_FAULT_WRITE));
+#else
+    /* Without a fault error code only write-only pages tell reads and writes apart */
+    write = (PROT_READ == guard->protection[page]);
+#endif
+
+    for(j = 0; j < guard->range_count && !guard->triggered; j++)
+    {
+      if(address >= guard->ranges[j].start && address < guard->ranges[j].end &&
+         0 != (guard->ranges[j].access & (write?SL_AVR_EMU_WATCH_WRITE:SL_AVR_EMU_WATCH_READ)))
+      {
+        guard->triggered       = true;
+        guard->trigger_address = address;
+        guard->trigger_write   = write;
+        guard->trigger_range   = j;
+      }
+    }
+
+    mprotect(&guard->data[page*guard->page_size], guard->page_size, PROT_READ | PROT_WRITE);
+    guard->opened[page] = true;
+#ifdef SL_AVR_EMU_GUARD_SINGLE_STEP
+    ((ucontext_t *) context)->uc_mcontext.gregs[REG_EFL] |= SL_AVR_EMU_GUARD_TRAP_FLAG;
+    sl_avr_emu_guard_stepping = guard;
+    guard->pending = guard->triggered;
+#else
+    guard->pending = 1;
+#endif
+    return;
+  }
+
+  /* Not a guarded page, the retried access faults into the previous action */
+  sigaction(SIGSEGV, &sl_avr_emu_guard_previous_action, NULL);
+}
+
+#ifdef SL_AVR_EMU_GUARD_SINGLE_STEP
+/**
+ * @brief SIGTRAP handler, protects pages again once the faulting host instruction has run
+ * 
+ * @param signal
+ * @param info
+ * @param context
+ */
+static void sl_avr_emu_guard_trap(int signal, siginfo_t *info, void *context)
+{
+  sl_avr_emu_guard_s *guard = sl_avr_emu_guard_stepping;
+
+  if(guard != NULL)
+  {
+    sl_avr_emu_guard_stepping = NULL;
+    sl_avr_emu_guard_close(guard);
+    ((ucontext_t *) context)->uc_mcontext.gregs[REG_EFL] &= ~SL_AVR_EMU_GUARD_TRAP_FLAG;
+    return;
+  }
+
+  /* Not a guard step, hand the trap to the previous action */
+  sigaction(SIGTRAP, &sl_avr_emu_guard_previous_trap_action, NULL);
+  raise(SIGTRAP);
+}
+#endif
+
+/**
+ * @brief Recomputes the protection of each page from the guard ranges, applying it if armed
+ * 
+ * @param guard
+ */
+static void sl_avr_emu_guard_apply(sl_avr_emu_guard_s *guard)
+{
+  uint32_t page, i;
+  uint32_t page_start, page_end;
+  int      protection;
+
+  for(page = 0; page < guard->page_count; page++)
+  {
+    page_start = page*guard->page_size;
+    page_end   = page_start + guard->page_size;
+    protection = PROT_READ | PROT_WRITE;
+    for(i = 0; i < guard->range_count; i++)
+    {
+      if(guard->ranges[i].start < page_end && guard->ranges[i].end > page_start)
+      {
+        if(0 != (guard->ranges[i].access & SL_AVR_EMU_WATCH_READ))
+        {
+          protection = PROT_NONE;
+        }
+        else if(PROT_NONE != protection)
+        {
+          protection = PROT_READ;
+        }
+      }
+    }
+    guard->protection[page] = protection;
+    guard->opened[page]     = false;
+    mprotect(&guard->data[page_start], guard->page_size, guard->armed?protection:(PROT_READ | PROT_WRITE));
+  }
+  /* Every page is back to its protection, only a latched hit is left pending */
+  guard->pending = guard->triggered;
+}
+
+/**
+ * @brief Attaches a guard without ranges and registers it with the SIGSEGV handler
+ * 
+ * @param emulation
+ * @return sl_avr_emu_result_e
+ */
+static sl_avr_emu_result_e sl_avr_emu_guard_start(sl_avr_emu_emulation_s *emulation)
+{
+  sl_avr_emu_guard_s *guard;
+  struct sigaction    action;
+  long                page_size = sysconf(_SC_PAGESIZE);
+  uint32_t            i;
+
+  if(page_size < SL_AVR_EMU_GUARD_PAGE_SIZE_MIN || 0 != (SL_AVR_EMU_DATA_SIZE % page_size) || NULL == emulation->memory.data)
+  {
+    return SL_AVR_EMU_RESULT_FAILURE;
+  }
+
+  guard = calloc(1, sizeof(sl_avr_emu_guard_s));
+  if(NULL == guard)
+  {
+    return SL_AVR_EMU_RESULT_FAILURE;
+  }
+  guard->data       = emulation->memory.data;
+  guard->page_size  = page_size;
+  guard->page_count = SL_AVR_EMU_DATA_SIZE/page_size;
+  guard->armed      = true;
+
+  pthread_mutex_lock(&sl_avr_emu_guard_lock);
+  for(i = 0; i < SL_AVR_EMU_GUARD_EMULATIONS_MAX && 0 != atomic_load_explicit(&sl_avr_emu_guards[i].data, memory_order_relaxed); i++);
+  if(i == SL_AVR_EMU_GUARD_EMULATIONS_MAX)
+  {
+    pthread_mutex_unlock(&sl_avr_emu_guard_lock);
+    free(guard);
+    return SL_AVR_EMU_RESULT_FAILURE;
+  }
+
+  if(!sl_avr_emu_guard_handler_installed)
+  {
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = sl_avr_emu_guard_signal;
+    action.sa_flags     = SA_SIGINFO;
+    sigemptyset(&action.sa_mask);
+    if(0 != sigaction(SIGSEGV, &action, &sl_avr_emu_guard_previous_action))
+    {
+      pthread_mutex_unlock(&sl_avr_emu_guard_lock);
+      free(guard);
+      return SL_AVR_EMU_RESULT_FAILURE;
+    }
+#ifdef SL_AVR_EMU_GUARD_SINGLE_STEP
+    action.sa_sigaction = sl_avr_emu_guard_trap;
+    if(0 != sigaction(SIGTRAP, &action, &sl_avr_emu_guard_previous_trap_action))
+    {
+      sigaction(SIGSEGV, &sl_avr_emu_guard_previous_action, NULL);
+      pthread_mutex_unlock(&sl_avr_emu_guard_lock);
+      free(guard);
+      return SL_AVR_EMU_RESULT_FAILURE;
+    }
+#endif
+    sl_avr_emu_guard_handler_installed = true;
+  }
+
+  sl_avr_emu_guards[i].guard = guard;
+  atomic_store_explicit(&sl_avr_emu_guards[i].data, (uintptr_t) guard->data, memory_order_release);
+  pthread_mutex_unlock(&sl_avr_emu_guard_lock);
+  emulation->hooks.guard = guard;
+
+  return SL_AVR_EMU_RESULT_SUCCESS;
+}
+
+/**
+ * @brief Adds a guard range, protecting the host pages it covers.
+ *        Ranges sharing a page with the register file fault on every register access.
+ * 
+ * @param emulation
+ * @param start     - First data address watched
+ * @param size      - Bytes watched
+ * @param access    - Access kinds to trigger on
+ * @param callback  - NULL to stop emulation on a hit
+ * @param context   - Passed to callback
+ * @return sl_avr_emu_result_e - SL_AVR_EMU_RESULT_FAILURE if SL_AVR_EMU_GUARD_MAX ranges are already guarded
+ */
+sl_avr_emu_result_e sl_avr_emu_guard_add(sl_avr_emu_emulation_s *emulation, sl_avr_emu_extended_address_t start, uint32_t size,
+                                         sl_avr_emu_watch_access_e access, sl_avr_emu_watch_callback_f callback, void *context)
+{
+  sl_avr_emu_result_e       result = SL_AVR_EMU_RESULT_SUCCESS;
+  sl_avr_emu_guard_s       *guard;
+  sl_avr_emu_watch_range_s *range;
+
+  if(0 == size || !SL_AVR_EMU_DATA_ADDRESS_VALID(start))
+  {
+    return SL_AVR_EMU_RESULT_INVALID_DATA_ADDRESS;
+  }
+  if(NULL == emulation->hooks.guard)
+  {
+    result = sl_avr_emu_guard_start(emulation);
+  }
+  guard = emulation->hooks.guard;
+
+  if(SL_AVR_EMU_RESULT_SUCCESS == result && guard->range_count < SL_AVR_EMU_GUARD_MAX)
+  {
+    range           = &guard->ranges[guard->range_count++];
+    range->start    = start;
+    range->end      = (size < (SL_AVR_EMU_DATA_SIZE - start))?(start + size):SL_AVR_EMU_DATA_SIZE;
+    range->access   = access;
+    range->callback = callback;
+    range->context  = context;
+    sl_avr_emu_guard_apply(guard);
+  }
+  else
+  {
+    result = SL_AVR_EMU_RESULT_FAILURE;
+  }
+
+  return result;
+}
+
+/**
+ * @brief Arms or disarms page protection, so the host can access guarded data memory without hits
+ * 
+ * @param emulation
+ * @param protect
+ */
+void sl_avr_emu_guard_protect(const sl_avr_emu_emulation_s *emulation, bool protect)
+{
+  sl_avr_emu_guard_s *guard = emulation->hooks.guard;
+
+  if(guard->armed != protect)
+  {
+    guard->armed = protect;
+    sl_avr_emu_guard_apply(guard);
+  }
+}
+
+/**
+ * @brief Protects pages opened by faults again and runs the callback of a hit made by the instruction that just completed.
+ *        Called after an instruction when a fault is pending.
+ * 
+ * @param emulation
+ * @param pc        - Instruction that just completed
+ * @return sl_avr_emu_result_e - SL_AVR_EMU_RESULT_WATCHPOINT for hits on ranges without a callback
+ */
+sl_avr_emu_result_e sl_avr_emu_guard_check(sl_avr_emu_emulation_s *emulation, sl_avr_emu_extended_address_t pc)
+{
+  sl_avr_emu_result_e             result = SL_AVR_EMU_RESULT_SUCCESS;
+  sl_avr_emu_guard_s             *guard  = emulation->hooks.guard;
+  const sl_avr_emu_watch_range_s *range;
+
+  guard->pending = 0;
+  sl_avr_emu_guard_close(guard);
+
+  guard->stopped = false;
+  if(guard->triggered)
+  {
+    guard->triggered  = false;
+    guard->trigger_pc = pc;
+    range = &guard->ranges[guard->trigger_range];
+    if(range->callback != NULL)
+    {
+      result = range->callback(emulation, guard->trigger_address, guard->trigger_write, range->context);
+    }
+    else
+    {
+      result = SL_AVR_EMU_RESULT_WATCHPOINT;
+    }
+    guard->stopped = (result != SL_AVR_EMU_RESULT_SUCCESS);
+  }
+
+  return result;
+}
+
+/**
+ * @brief Removes all guard ranges, unprotects data memory and detaches the guard
+ * 
+ * @param emulation
+ */
+void sl_avr_emu_guard_stop(sl_avr_emu_emulation_s *emulation)
+{
+  sl_avr_emu_guard_s *guard = emulation->hooks.guard;
+  uint32_t            i;
+
+  if(NULL == guard)
+  {
+    return;
+  }
+
+  guard->range_count = 0;
+  sl_avr_emu_guard_apply(guard);
+  pthread_mutex_lock(&sl_avr_emu_guard_lock);
+  for(i = 0; i < SL_AVR_EMU_GUARD_EMULATIONS_MAX; i++)
+  {
+    if(guard == sl_avr_emu_guards[i].guard && 0 != atomic_load_explicit(&sl_avr_emu_guards[i].data, memory_order_relaxed))
+    {
+      atomic_store_explicit(&sl_avr_emu_guards[i].data, 0, memory_order_release);
+      sl_avr_emu_guards[i].guard = NULL;
+    }
+  }
+  pthread_mutex_unlock(&sl_avr_emu_guard_lock);
+  free(guard);
+  emulation->hooks.guard = NULL;
+}
@@ -7,47 +7,300 @@
  * 
  * @copyright Copyright (c) 2020
  * 
+ * The file is memory mapped and records are decoded in place through a nibble lookup table.
+ * Each record's bytes, checksum included, are summed once and must total zero.
  */
 
+#include <fcntl.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "sl_avr_emu_hex.h"
 
 /**
- * @brief Converts a hex string to integer
+ * @brief Intel HEX record types
  * 
- * @param str String representing integer in hex
- * @param n   Maximum number of string characters to parse
+ */
+typedef enum
+{
+  SL_AVR_EMU_HEX_RECORD_DATA                     = 0,
+  SL_AVR_EMU_HEX_RECORD_END_OF_FILE              = 1,
+  SL_AVR_EMU_HEX_RECORD_EXTENDED_SEGMENT_ADDRESS = 2,
+  SL_AVR_EMU_HEX_RECORD_START_SEGMENT_ADDRESS    = 3,
+  SL_AVR_EMU_HEX_RECORD_EXTENDED_LINEAR_ADDRESS  = 4,
+  SL_AVR_EMU_HEX_RECORD_START_LINEAR_ADDRESS     = 5,
+
+} sl_avr_emu_hex_record_e;
+
+/* Byte count, address (2), and record type */
+#define SL_AVR_EMU_HEX_HEADER_SIZE   4
+/* Header, up to 255 data bytes, and checksum */
+#define SL_AVR_EMU_HEX_RECORD_MAX    (SL_AVR_EMU_HEX_HEADER_SIZE + 255 + 1)
+/* Table marker for characters that are hex digits, characters that are not have no entry */
+#define SL_AVR_EMU_HEX_VALID_NIBBLE  0x10
+
+/**
+ * @brief ASCII character to nibble value lookup, the value ORed with SL_AVR_EMU_HEX_VALID_NIBBLE for hex digits and 0 otherwise.
+ *        Constant, so loads from any thread share it without initialization.
+ * 
+ */
+static const sl_avr_emu_byte_t sl_avr_emu_hex_nibble[256] =
+{
+  ['0'] = SL_AVR_EMU_HEX_VALID_NIBBLE | 0x0, ['1'] = SL_AVR_EMU_HEX_VALID_NIBBLE | 0x1,
+  ['2'] = SL_AVR_EMU_HEX_VALID_NIBBLE | 0x2, ['3'] = SL_AVR_EMU_HEX_VALID_NIBBLE | 0x3,
+  ['4'] = SL_AVR_EMU_HEX_VALID_NIBBLE | 0x4, ['5'] = SL_AVR_EMU_HEX_VALID_NIBBLE | 0x5,
+  ['6'] = SL_AVR_EMU_HEX_VALID_NIBBLE | 0x6, ['7'] = SL_AVR_EMU_HEX_VALID_NIBBLE | 0x7,
+  ['8'] = SL_AVR_EMU_HEX_VALID_NIBBLE | 0x8, ['9'] = SL_AVR_EMU_HEX_VALID_NIBBLE | 0x9,
+  ['A'] = SL_AVR_EMU_HEX_VALID_NIBBLE | 0xA, ['a'] = SL_AVR_EMU_HEX_VALID_NIBBLE | 0xA,
+  ['B'] = SL_AVR_EMU_HEX_VALID_NIBBLE | 0xB, ['b'] = SL_AVR_EMU_HEX_VALID_NIBBLE | 0xB,
+  ['C'] = SL_AVR_EMU_HEX_VALID_NIBBLE | 0xC, ['c'] = SL_AVR_EMU_HEX_VALID_NIBBLE | 0xC,
+  ['D'] = SL_AVR_EMU_HEX_VALID_NIBBLE | 0xD, ['d'] = SL_AVR_EMU_HEX_VALID_NIBBLE | 0xD,
+  ['E'] = SL_AVR_EMU_HEX_VALID_NIBBLE | 0xE, ['e'] = SL_AVR_EMU_HEX_VALID_NIBBLE | 0xE,
+  ['F'] = SL_AVR_EMU_HEX_VALID_NIBBLE | 0xF, ['f'] = SL_AVR_EMU_HEX_VALID_NIBBLE | 0xF,
+};
+
+/**
+ * @brief Decodes hex character pairs to bytes
+ * 
+ * @param text  - 2*n hex characters
+ * @param n     - Number of bytes to decode
+ * @param bytes - Decoded output
+ * @param sum   - Running byte sum, for checksum verification
+ * @return true if all characters were hex digits
+ */
+static bool sl_avr_emu_hex_decode(const unsigned char *text, size_t n, sl_avr_emu_byte_t *bytes, sl_avr_emu_byte_t *sum)
+{
+  size_t            i;
+  sl_avr_emu_byte_t high, low;
+  sl_avr_emu_byte_t valid   = SL_AVR_EMU_HEX_VALID_NIBBLE;
+  sl_avr_emu_byte_t total   = *sum;
+
+  for(i = 0; i < n; i++)
+  {
+    high      = sl_avr_emu_hex_nibble[text[2*i]];
+    low       = sl_avr_emu_hex_nibble[text[2*i+1]];
+    valid    &= high & low;
+    bytes[i]  = ((high & 0xF) << 4) | (low & 0xF);
+    total    += bytes[i];
+  }
+  *sum = total;
+
+  /* Any invalid character clears the marker */
+  return (0 != valid);
+}
+
+/**
+ * @brief Counts lines up to offset, only used for error reporting
+ * 
+ * @param text 
+ * @param offset 
  * @return uint32_t 
  */
-uint32_t sl_avr_emu_hex_str_to_int(char * str, size_t n)
+static uint32_t sl_avr_emu_hex_line(const unsigned char *text, size_t offset)
 {
-  size_t i;
-  uint32_t ret_val = 0;
+  const unsigned char *cursor = text;
+  const unsigned char *end    = text + offset;
+  uint32_t             line   = 1;
 
-  if(str != NULL)
+  while(cursor < end && NULL != (cursor = memchr(cursor, '\n', end - cursor)))
   {
-    for(i = 0; i < n && 0 != str[i]; i++)
+    cursor++;
+    line++;
+  }
+
+  return line;
+}
+
+/**
+ * @brief Writes a data record into flash
+ * 
+ * @param emulation 
+ * @param byte_address - Flash byte address of first byte
+ * @param data 
+ * @param num_bytes 
+ * @return sl_avr_emu_result_e 
+ */
+static sl_avr_emu_result_e sl_avr_emu_hex_write_flash(sl_avr_emu_emulation_s *emulation, uint32_t byte_address, const sl_avr_emu_byte_t *data, uint32_t num_bytes)
+{
+  sl_avr_emu_result_e result = SL_AVR_EMU_RESULT_SUCCESS;
+  uint32_t            i;
+  uint32_t            flash_address;
+
+  /* Flash is word addressed, hex file addresses are bytes */
+  if(!SL_AVR_EMU_FLASH_ADDRESS_VALID((byte_address + num_bytes - 1)/2))
+  {
+    result = SL_AVR_EMU_RESULT_INVALID_FLASH_ADDRESS;
+  }
+  else
+  {
+    for(i = 0; i < num_bytes; i++)
     {
-      ret_val <<= 4;
-      if(str[i] >= '0' && str[i] <= '9')
+      flash_address = (byte_address + i)/2;
+      if( 0 == ((byte_address + i) % 2) )
       {
-        ret_val += str[i] - '0';
+        emulation->memory.flash[flash_address] = (emulation->memory.flash[flash_address] & 0xFF00) | data[i];
       }
-      else if(str[i] >= 'a' && str[i] <= 'f')
+      else 
       {
-        ret_val += (str[i] - 'a') + 10;
+        emulation->memory.flash[flash_address] = (emulation->memory.flash[flash_address] & 0x00FF) | (data[i] << 8);
       }
-      else if(str[i] >= 'A' && str[i] <= 'F')
+    }
+  }
+
+  return result;
+}
+
+/**
+ * @brief Loads .hex text into emulation's flash
+ * 
+ * @param emulation 
+ * @param text 
+ * @param size 
+ * @return sl_avr_emu_result_e 
+ */
+static sl_avr_emu_result_e sl_avr_emu_hex_parse(sl_avr_emu_emulation_s *emulation, const unsigned char *text, size_t size)
+{
+  sl_avr_emu_result_e  result = SL_AVR_EMU_RESULT_SUCCESS;
+  size_t               offset = 0;
+  size_t               record_chars;
+  const unsigned char *newline;
+  bool                 end_of_file = false;
+
+  sl_avr_emu_byte_t    record[SL_AVR_EMU_HEX_RECORD_MAX];
+  sl_avr_emu_byte_t    checksum;
+  uint8_t              num_bytes;
+  uint16_t             address;
+  uint8_t              operation;
+  const sl_avr_emu_byte_t *data = &record[SL_AVR_EMU_HEX_HEADER_SIZE];
+  /* Added to record addresses by extended segment and linear address records */
+  uint32_t             address_base = 0;
+  uint32_t             start_address;
+
+  while(SL_AVR_EMU_RESULT_SUCCESS == result && offset < size && !end_of_file)
+  {
+    /* Each record should start with ':', anything else is skipped to the end of line */
+    if(':' != text[offset])
+    {
+      newline = memchr(&text[offset], '\n', size - offset);
+      offset  = (newline != NULL)?(size_t)(newline - text) + 1:size;
+      continue;
+    }
+
+    checksum = 0;
+    if( (size - offset) < (1 + 2*(SL_AVR_EMU_HEX_HEADER_SIZE + 1)) ||
+        !sl_avr_emu_hex_decode(&text[offset+1], SL_AVR_EMU_HEX_HEADER_SIZE, record, &checksum) )
+    {
+      result = SL_AVR_EMU_RESULT_INVALID_FILE_FORMAT;
+      break;
+    }
+    num_bytes    = record[0];
+    address      = (record[1] << 8) | record[2];
+    operation    = record[3];
+    record_chars = 1 + 2*(SL_AVR_EMU_HEX_HEADER_SIZE + num_bytes + 1);
+
+    /* Data and checksum, the sum of all record bytes is zero when the checksum is correct */
+    if( (size - offset) < record_chars ||
+        !sl_avr_emu_hex_decode(&text[offset+1+2*SL_AVR_EMU_HEX_HEADER_SIZE], num_bytes + 1, &record[SL_AVR_EMU_HEX_HEADER_SIZE], &checksum) )
+    {
+      result = SL_AVR_EMU_RESULT_INVALID_FILE_FORMAT;
+      break;
+    }
+    if(0 != checksum)
+    {
+      fprintf(stderr, "Checksum failure: checksum %x, answer %x\n", data[num_bytes], (sl_avr_emu_byte_t)(data[num_bytes] - checksum));
+      result = SL_AVR_EMU_RESULT_INVALID_FILE_FORMAT;
+      break;
+    }
+
+    switch(operation)
+    {
+      case SL_AVR_EMU_HEX_RECORD_DATA:
+      {
+        if(num_bytes > 0)
+        {
+          result = sl_avr_emu_hex_write_flash(emulation, address_base + address, data, num_bytes);
+        }
+        break;
+      }
+      case SL_AVR_EMU_HEX_RECORD_END_OF_FILE:
+      {
+        end_of_file = true;
+        break;
+      }
+      case SL_AVR_EMU_HEX_RECORD_EXTENDED_SEGMENT_ADDRESS:
+      case SL_AVR_EMU_HEX_RECORD_EXTENDED_LINEAR_ADDRESS:
+      {
+        if(2 == num_bytes)
+        {
+          address_base = (data[0] << 8) | data[1];
+          address_base <<= (SL_AVR_EMU_HEX_RECORD_EXTENDED_LINEAR_ADDRESS == operation)?16:4;
+        }
+        else
+        {
+          result = SL_AVR_EMU_RESULT_INVALID_FILE_FORMAT;
+        }
+        break;
+      }
+      case SL_AVR_EMU_HEX_RECORD_START_SEGMENT_ADDRESS:
+      case SL_AVR_EMU_HEX_RECORD_START_LINEAR_ADDRESS:
+      {
+        if(4 == num_bytes)
+        {
+          if(SL_AVR_EMU_HEX_RECORD_START_LINEAR_ADDRESS == operation)
+          {
+            start_address = ((uint32_t)data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+          }
+          else
+          {
+            /* CS:IP */
+            start_address = (((data[0] << 8) | data[1]) << 4) + ((data[2] << 8) | data[3]);
+          }
+          /* Entry point is a byte address, PC is in words */
+          if(SL_AVR_EMU_PC_ADDRESS_VALID(start_address/2))
+          {
+            emulation->memory.pc = start_address/2;
+            SL_AVR_EMU_VERBOSE_LOG(printf("Start address 0x%x, PC 0x%x\n", start_address, emulation->memory.pc));
+          }
+          else
+          {
+            result = SL_AVR_EMU_RESULT_INVALID_PC;
+          }
+        }
+        else
+        {
+          result = SL_AVR_EMU_RESULT_INVALID_FILE_FORMAT;
+        }
+        break;
+      }
+      default:
       {
-        ret_val += (str[i] - 'A') + 10;
+        fprintf(stderr, "Unrecognized operation %u\n", operation);
+        fprintf(stderr, "0x%02x, 0x%04x, 0x%02x\n", num_bytes, address, operation);
+        fprintf(stderr, "Line %u\n", sl_avr_emu_hex_line(text, offset));
+        break;
       }
     }
+
+    if(SL_AVR_EMU_RESULT_SUCCESS == result)
+    {
+      offset += record_chars;
+    }
+  }
+
+  if(SL_AVR_EMU_RESULT_SUCCESS != result)
+  {
+    newline = memchr(&text[offset], '\n', size - offset);
+    fprintf(stderr, "Failed to load record, aborting\n");
+    fprintf(stderr, "Line %u: %.*s\n", sl_avr_emu_hex_line(text, offset), 
+            (int)(((newline != NULL)?newline:&text[size]) - &text[offset]), &text[offset]);
   }
 
-  return ret_val;
+  return result;
 }
 
 /**
@@ -60,125 +313,41 @@ uint32_t sl_avr_emu_hex_str_to_int(char * str, size_t n)
 sl_avr_emu_result_e sl_avr_emu_load_hex(sl_avr_emu_emulation_s *emulation, char * file_path)
 {
   sl_avr_emu_result_e result = SL_AVR_EMU_RESULT_SUCCESS;
-  FILE         *fp;
-  const size_t  line_buffer_size = 1024;
-  char          line[line_buffer_size];
-  size_t        line_len;
-  size_t        line_i;
-  uint32_t      line_num = 0;
-  uint32_t      i;
-
-  uint8_t                       num_bytes  = 0;
-  uint16_t                      address    = 0;
-  uint8_t                       operation  = 0;
-  /* Max data is 16*16 bytes (two hex chars in file)*/
-  sl_avr_emu_byte_t             checksum, checksum_answer;
-  sl_avr_emu_byte_t             data[16*16];
-  sl_avr_emu_word_t             flash_word = 0;
-  sl_avr_emu_extended_address_t flash_address, flash_address_temp = 0;
-  sl_avr_emu_extended_address_t flash_address_prefix = 0;
+  int                 fd;
+  struct stat         file_stat;
+  void               *text;
 
   if(file_path != NULL)
   {
     printf("Loading flash from .hex file: %s\n", file_path);
-    fp = fopen(file_path, "r");
-    if(fp != NULL)
+
+    fd = open(file_path, O_RDONLY);
+    if(fd >= 0 && 0 == fstat(fd, &file_stat))
     {
-      while( (SL_AVR_EMU_RESULT_SUCCESS == result) && fgets(line, line_buffer_size, fp) )
+      if(file_stat.st_size > 0)
       {
-        line_num++;
-        line_len = strlen(line);
-        /* Each line should start with ':' */
-        if(line_len >= 9 && ':' == line[0])
+        text = mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(text != MAP_FAILED)
         {
-          checksum = 0;
-          /* First two nibbles are number of bytes */
-          num_bytes = sl_avr_emu_hex_str_to_int(&line[1], 2);
-          checksum += num_bytes; 
-          /* Next 4 nibbles are the byte address */
-          address   = sl_avr_emu_hex_str_to_int(&line[3], 4);
-          checksum += (address & 0xFF); 
-          checksum += (address >> 8); 
-          /* Next 2 nibbles are the operation */
-          operation = sl_avr_emu_hex_str_to_int(&line[7], 2);
-          checksum += operation; 
-
-          /* If line is long enough for prefix + number of nibbles + checksum */
-          if(line_len >= (9 + 2*num_bytes + 2))
-          {
-            for(i = 0; i < num_bytes; i++)
-            {
-              data[i] = sl_avr_emu_hex_str_to_int(&line[9+2*i], 2);
-              checksum += data[i];
-            }            
-            checksum = ((~checksum) & 0xFF) + 1;
-            checksum_answer = sl_avr_emu_hex_str_to_int(&line[9+2*num_bytes], 2);
-            if(checksum == checksum_answer)
-            {
-              if(0 == operation)
-              {
-                /* Flash address (word address) from hex file address (byte) */
-                flash_address = ((flash_address_prefix << 16) | address)/2;
-                for(i = 0; i < num_bytes && (SL_AVR_EMU_RESULT_SUCCESS == result); i++)
-                {
-                  flash_address_temp = flash_address + (i/2);
-                  if(SL_AVR_EMU_FLASH_ADDRESS_VALID(flash_address_temp))
-                  {
-                    if( 0 == (i % 2) )
-                    {
-                      emulation->memory.flash[flash_address_temp] = data[i];
-                    }
-                    else 
-                    {
-                      emulation->memory.flash[flash_address_temp] |= (data[i] << 8);
-                    }
-                  }
-                  else 
-                  {
-                    result = SL_AVR_EMU_RESULT_INVALID_FLASH_ADDRESS;
-                  }
-                }
-              }
-              else if(1 == operation)
-              {
-                /* end of file */
-                break;
-              }
-              else if(4 == operation)
-              {
-                flash_address_prefix = (data[0] << 8) | data[1];
-              }
-              else
-              {
-                fprintf(stderr, "Unrecognized operation %u\n", operation);
-                fprintf(stderr, "0x%02x, 0x%04x, 0x%02x\n", num_bytes, address, operation);
-                fprintf(stderr, "Line %u: %s\n", line_num, line);
-              }
-            }
-            else 
-            {
-              fprintf(stderr, "Checksum failure: checksum %x, answer %x\n", checksum, checksum_answer);
-              fprintf(stderr, "Line %u: %s\n", line_num, line);
-              result = SL_AVR_EMU_RESULT_INVALID_FILE_FORMAT;
-              break;
-            }
-          }
-          else 
-          {
-            fprintf(stderr, "Malformed line, aborting\n");
-            fprintf(stderr, "Line %u: %s\n", line_num, line);
-            result = SL_AVR_EMU_RESULT_INVALID_FILE_FORMAT;
-            break;
-          }
+          madvise(text, file_stat.st_size, MADV_SEQUENTIAL);
+          result = sl_avr_emu_hex_parse(emulation, text, file_stat.st_size);
+          munmap(text, file_stat.st_size);
+        }
+        else
+        {
+          result = SL_AVR_EMU_RESULT_INVALID_FILE_PATH;
         }
       }
-
-      fclose(fp);
     }
     else 
     {
       result = SL_AVR_EMU_RESULT_INVALID_FILE_PATH;
     }
+
+    if(fd >= 0)
+    {
+      close(fd);
+    }
   }
   else 
   {
@@ -186,4 +355,4 @@ sl_avr_emu_result_e sl_avr_emu_load_hex(sl_avr_emu_emulation_s *emulation, char
   }
 
   return result;
-}
\ No newline at end of file
+}
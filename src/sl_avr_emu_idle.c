@@ -0,0 +1,213 @@
+/**
+ * @file sl_avr_emu_idle.c
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator Register Poll Loop Detection Logic
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ * A poll loop only reads the polled register and a scratch register, so while no event runs and no interrupt
+ * is taken every iteration is identical.  Skipping iterations moves time forward by whole loop periods, which
+ * keeps the loop in phase: the iteration that finally sees the change reads it at the tick it would have anyway.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "sl_avr_emu_idle.h"
+#include "sl_avr_emu_bitops.h"
+#include "sl_avr_emu_interrupt.h"
+#include "sl_avr_emu_opcode.h"
+
+/* Instructions of one loop iteration, at most a load, a bit test and a jump */
+#define SL_AVR_EMU_IDLE_LOOP_SIZE 3
+
+/**
+ * @brief Recognized poll loop
+ * 
+ */
+typedef struct
+{
+  /* Ticks per iteration while spinning */
+  uint32_t                  period;
+  /* Loop continues while the polled bit reads as this */
+  bool                      spin_level;
+  sl_avr_emu_byte_t         bit;
+  /* Opcode group and class of each instruction, for the instruction-mix counters */
+  uint32_t                  count;
+  uint8_t                   groups[SL_AVR_EMU_IDLE_LOOP_SIZE];
+  sl_avr_emu_opcode_class_e classes[SL_AVR_EMU_IDLE_LOOP_SIZE];
+
+} sl_avr_emu_idle_loop_s;
+
+/**
+ * @brief Reads a flash word, if pc is in flash
+ * 
+ * @param emulation
+ * @param pc
+ * @param word
+ * @return true if pc is in flash
+ */
+static bool sl_avr_emu_idle_word(const sl_avr_emu_emulation_s *emulation, sl_avr_emu_extended_address_t pc, sl_avr_emu_word_t *word)
+{
+  if(!SL_AVR_EMU_PC_ADDRESS_VALID(pc))
+  {
+    return false;
+  }
+  *word = emulation->memory.flash[pc];
+
+  return true;
+}
+
+/**
+ * @brief Checks for rjmp back to start at pc
+ * 
+ * @param emulation
+ * @param pc
+ * @param start
+ * @return true if it is
+ */
+static bool sl_avr_emu_idle_jump_back(const sl_avr_emu_emulation_s *emulation, sl_avr_emu_extended_address_t pc, sl_avr_emu_extended_address_t start)
+{
+  sl_avr_emu_word_t word;
+  int32_t           offset;
+
+  if(!sl_avr_emu_idle_word(emulation, pc, &word) || (word & 0xF000) != 0xC000)
+  {
+    return false;
+  }
+  offset = (word & 0x0800)?((int32_t)(word & 0x0FFF) - 0x1000):(int32_t)(word & 0x0FFF);
+
+  return (int64_t)pc + 1 + offset == (int64_t)start;
+}
+
+/**
+ * @brief Recognizes a poll loop on address around the instruction reading it
+ * 
+ * @param emulation
+ * @param address
+ * @param loop
+ * @return true if the reading instruction is the head of a poll loop
+ */
+static bool sl_avr_emu_idle_match(const sl_avr_emu_emulation_s *emulation, sl_avr_emu_address_t address, sl_avr_emu_idle_loop_s *loop)
+{
+  const sl_avr_emu_extended_address_t pc = emulation->memory.pc;
+  sl_avr_emu_extended_address_t       start;
+  sl_avr_emu_word_t                   word;
+  sl_avr_emu_word_t                   operand;
+  sl_avr_emu_address_t                destination;
+  uint32_t                            load_cycles;
+
+  /* Handlers read registers at different points, in and lds after advancing PC and sbis/sbic before */
+  if(pc >= 1 && sl_avr_emu_idle_word(emulation, pc - 1, &word) && (word & 0xF800) == 0xB000 &&
+     SL_AVR_EMU_IO_TO_DATA_ADDRESS(((word >> 5) & 0x30) | (word & 0xF)) == address)
+  {
+    start            = pc - 1;
+    load_cycles      = 1;
+    loop->groups[0]  = 2;
+    loop->classes[0] = SL_AVR_EMU_OPCODE_CLASS_IN_OUT;
+  }
+  else if(pc >= 2 && SL_AVR_EMU_VERSION_AVRRC != emulation->version &&
+          sl_avr_emu_idle_word(emulation, pc - 2, &word) && SL_AVR_EMU_IS_LDS_STS(word) && !SL_AVR_EMU_CHECK_BIT(word, 9) &&
+          sl_avr_emu_idle_word(emulation, pc - 1, &operand) && operand == address)
+  {
+    start            = pc - 2;
+    load_cycles      = (SL_AVR_EMU_VERSION_AVRE == emulation->version)?2:3;
+    loop->groups[0]  = 2;
+    loop->classes[0] = SL_AVR_EMU_OPCODE_CLASS_LDS_STS;
+  }
+  else if(sl_avr_emu_idle_word(emulation, pc, &word) && SL_AVR_EMU_IS_SBIC_SBIS(word) &&
+          SL_AVR_EMU_IO_TO_DATA_ADDRESS((word >> 3) & 0x1F) == address && sl_avr_emu_idle_jump_back(emulation, pc + 1, pc))
+  {
+    loop->period     = 1 + ((SL_AVR_EMU_VERSION_AVRXM == emulation->version)?1:0) + 2;
+    loop->bit        = word & 0x7;
+    loop->spin_level = !SL_AVR_EMU_CHECK_BIT(word, 9);
+    loop->count      = 2;
+    loop->groups[0]  = 2;
+    loop->classes[0] = SL_AVR_EMU_OPCODE_CLASS_SBIC_SBIS;
+    loop->groups[1]  = 3;
+    loop->classes[1] = SL_AVR_EMU_OPCODE_CLASS_RJMP_RCALL;
+    return true;
+  }
+  else
+  {
+    return false;
+  }
+
+  /* Load, then a bit test of the loaded register and a jump back to the load */
+  destination = (word >> 4) & 0x1F;
+  if(!sl_avr_emu_idle_word(emulation, pc, &word) || !SL_AVR_EMU_IS_SBRC_SBRS(word) || ((word >> 4) & 0x1F) != destination ||
+     !sl_avr_emu_idle_jump_back(emulation, pc + 1, start))
+  {
+    return false;
+  }
+  loop->period     = load_cycles + 1 + 2;
+  loop->bit        = word & 0x7;
+  loop->spin_level = !SL_AVR_EMU_CHECK_BIT(word, 9);
+  loop->count      = 3;
+  loop->groups[1]  = 3;
+  loop->classes[1] = SL_AVR_EMU_OPCODE_CLASS_SBRC_SBRS;
+  loop->groups[2]  = 3;
+  loop->classes[2] = SL_AVR_EMU_OPCODE_CLASS_RJMP_RCALL;
+
+  return true;
+}
+
+/**
+ * @brief Fast-forwards firmware spinning on a register that will not change before ready_tick.
+ *        Called by a peripheral's read hook, with the register already refreshed in data memory.
+ * 
+ * @param emulation
+ * @param address    - Data address being read
+ * @param ready_tick - Earliest tick the register can change without firmware writing it
+ * @return true if iterations were skipped
+ */
+bool sl_avr_emu_idle_poll(sl_avr_emu_emulation_s *emulation, sl_avr_emu_address_t address, sl_avr_emu_tick_count_t ready_tick)
+{
+  sl_avr_emu_idle_loop_s  loop;
+  sl_avr_emu_tick_count_t horizon = ready_tick;
+  uint64_t                iterations;
+  uint64_t                ticks;
+  uint32_t                i;
+
+  /* Outside sl_avr_emu_run, or observed instruction by instruction */
+  if(emulation->tick_limit <= emulation->tick_count ||
+     NULL != emulation->hooks.fuzz_edge_map || NULL != emulation->hooks.profile || NULL != emulation->hooks.latency ||
+     NULL != emulation->hooks.watch || NULL != emulation->hooks.guard)
+  {
+    return false;
+  }
+  if(!sl_avr_emu_idle_match(emulation, address, &loop) ||
+     SL_AVR_EMU_CHECK_BIT(emulation->memory.data[address], loop.bit) != loop.spin_level ||
+     sl_avr_emu_interrupt_pending(emulation))
+  {
+    return false;
+  }
+
+  horizon = (emulation->events.next_tick < horizon)?emulation->events.next_tick:horizon;
+  horizon = (emulation->tick_limit < horizon)?emulation->tick_limit:horizon;
+  /* Later reads land at tick_count + k*period, all before horizon are skipped, the one at or after it runs */
+  if(horizon <= emulation->tick_count + 1)
+  {
+    return false;
+  }
+  iterations = (horizon - emulation->tick_count - 1) / loop.period;
+  if(0 == iterations)
+  {
+    return false;
+  }
+  ticks = iterations * loop.period;
+
+  emulation->tick_count    += ticks;
+  emulation->io_tick_count += ticks;
+  for(i = 0; i < loop.count; i++)
+  {
+    emulation->hooks.stats.dispatch[loop.groups[i]][loop.classes[i]] += iterations;
+  }
+  emulation->hooks.stats.idle_skips++;
+  emulation->hooks.stats.idle_ticks += ticks;
+  SL_AVR_EMU_VERBOSE_LOG(printf("Poll loop on 0x%04x skipped %lu iterations to tick %lu\n", address, iterations, emulation->tick_count));
+
+  return true;
+}
@@ -0,0 +1,378 @@
+/**
+ * @file sl_avr_emu_image.c
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator Precompiled Firmware Image Cache Logic
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ * Cache entries are named by a content hash of their source file and hold, in host byte order:
+ *   header, flash words, symbols, symbol name strings
+ * A hit maps the entry read-only; symbol names are used in place.
+ */
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "sl_avr_emu_hex.h"
+#include "sl_avr_emu_image.h"
+
+#define SL_AVR_EMU_IMAGE_MAGIC      "SLAVRIM\x02"
+#define SL_AVR_EMU_IMAGE_MAGIC_SIZE 8
+
+#define SL_AVR_EMU_IMAGE_FNV_OFFSET 0xcbf29ce484222325ULL
+#define SL_AVR_EMU_IMAGE_FNV_PRIME  0x100000001b3ULL
+
+/**
+ * @brief Cache entry header
+ * 
+ */
+typedef struct
+{
+  char     magic[SL_AVR_EMU_IMAGE_MAGIC_SIZE];
+  uint64_t source_hash;
+  uint32_t entry_pc;
+
+  uint32_t flash_words;
+  uint32_t flash_offset;
+
+  uint32_t symbol_count;
+  uint32_t symbols_offset;
+  uint32_t strings_size;
+  uint32_t strings_offset;
+
+} sl_avr_emu_image_header_s;
+
+/**
+ * @brief Cache entry symbol
+ * 
+ */
+typedef struct
+{
+  uint32_t address;
+  uint32_t size;
+  uint32_t name_offset;
+  uint32_t function;
+
+} sl_avr_emu_image_symbol_s;
+
+/**
+ * @brief Hashes a file's contents (FNV-1a)
+ * 
+ * @param file_path 
+ * @param hash 
+ * @param elf - Set if the file is an ELF
+ * @return sl_avr_emu_result_e 
+ */
+static sl_avr_emu_result_e sl_avr_emu_image_hash_file(const char *file_path, uint64_t *hash, bool *elf)
+{
+  sl_avr_emu_result_e      result = SL_AVR_EMU_RESULT_SUCCESS;
+  int                      fd;
+  struct stat              file_stat;
+  const sl_avr_emu_byte_t *map  = MAP_FAILED;
+  uint64_t                 hash_value = SL_AVR_EMU_IMAGE_FNV_OFFSET;
+  size_t                   i;
+
+  fd = open(file_path, O_RDONLY);
+  if(fd >= 0 && 0 == fstat(fd, &file_stat) && file_stat.st_size > 0)
+  {
+    map = mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  if(fd >= 0)
+  {
+    close(fd);
+  }
+
+  if(map != MAP_FAILED)
+  {
+    for(i = 0; i < file_stat.st_size; i++)
+    {
+      hash_value = (hash_value ^ map[i]) * SL_AVR_EMU_IMAGE_FNV_PRIME;
+    }
+    *hash = hash_value;
+    *elf  = (file_stat.st_size >= 4 && 0 == memcmp(map, "\x7f" "ELF", 4));
+    munmap((void *) map, file_stat.st_size);
+  }
+  else
+  {
+    result = SL_AVR_EMU_RESULT_INVALID_FILE_PATH;
+  }
+
+  return result;
+}
+
+/**
+ * @brief Writes a cache entry for the loaded flash, via a temporary file renamed into place
+ * 
+ * @param cache_path 
+ * @param emulation 
+ * @param symbols     - May be NULL
+ * @param source_hash 
+ * @return sl_avr_emu_result_e 
+ */
+static sl_avr_emu_result_e sl_avr_emu_image_write(const char *cache_path, const sl_avr_emu_emulation_s *emulation, const sl_avr_emu_symbols_s *symbols, uint64_t source_hash)
+{
+  sl_avr_emu_result_e        result = SL_AVR_EMU_RESULT_SUCCESS;
+  char                       temp_path[PATH_MAX];
+  FILE                      *fp;
+  sl_avr_emu_image_header_s  header;
+  sl_avr_emu_image_symbol_s  symbol;
+  uint32_t                   flash_words = SL_AVR_EMU_FLASH_SIZE;
+  uint32_t                   symbol_count = (symbols != NULL)?symbols->count:0;
+  uint32_t                   i;
+  size_t                     name_size;
+  bool                       written;
+
+  /* Trailing erased/unused flash is not stored */
+  while(flash_words > 0 && 0 == emulation->memory.flash[flash_words-1])
+  {
+    flash_words--;
+  }
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, SL_AVR_EMU_IMAGE_MAGIC, SL_AVR_EMU_IMAGE_MAGIC_SIZE);
+  header.source_hash    = source_hash;
+  header.entry_pc       = emulation->memory.pc;
+  header.flash_words    = flash_words;
+  header.flash_offset   = sizeof(header);
+  header.symbol_count   = symbol_count;
+  /* Symbols are 4 byte aligned */
+  header.symbols_offset = (header.flash_offset + flash_words*sizeof(sl_avr_emu_word_t) + 3) & ~3;
+  header.strings_offset = header.symbols_offset + symbol_count*sizeof(sl_avr_emu_image_symbol_s);
+  header.strings_size   = 1;
+  for(i = 0; i < symbol_count; i++)
+  {
+    header.strings_size += strlen(symbols->symbols[i].name) + 1;
+  }
+
+  /* A truncated name would no longer be unique to this process */
+  if(snprintf(temp_path, sizeof(temp_path), "%s.%d", cache_path, (int) getpid()) >= (int) sizeof(temp_path))
+  {
+    fprintf(stderr, "Image cache path too long %s\n", cache_path);
+    return SL_AVR_EMU_RESULT_INVALID_FILE_PATH;
+  }
+  fp = fopen(temp_path, "wb");
+  if(NULL == fp)
+  {
+    fprintf(stderr, "Unable to write image cache %s\n", cache_path);
+    return SL_AVR_EMU_RESULT_INVALID_FILE_PATH;
+  }
+
+  written  = (1 == fwrite(&header, sizeof(header), 1, fp));
+  written &= (flash_words == fwrite(emulation->memory.flash, sizeof(sl_avr_emu_word_t), flash_words, fp));
+  for(i = header.flash_offset + flash_words*sizeof(sl_avr_emu_word_t); i < header.symbols_offset; i++)
+  {
+    written &= (EOF != fputc(0, fp));
+  }
+  name_size = 1;
+  for(i = 0; i < symbol_count; i++)
+  {
+    symbol.address     = symbols->symbols[i].address;
+    symbol.size        = symbols->symbols[i].size;
+    symbol.name_offset = name_size;
+    symbol.function    = symbols->symbols[i].function;
+    written   &= (1 == fwrite(&symbol, sizeof(symbol), 1, fp));
+    name_size += strlen(symbols->symbols[i].name) + 1;
+  }
+  written &= (EOF != fputc(0, fp));
+  for(i = 0; i < symbol_count; i++)
+  {
+    written &= (EOF != fputs(symbols->symbols[i].name, fp));
+    written &= (EOF != fputc(0, fp));
+  }
+  written &= (0 == fclose(fp));
+
+  if(written && 0 == rename(temp_path, cache_path))
+  {
+    SL_AVR_EMU_VERBOSE_LOG(printf("Wrote image cache %s\n", cache_path));
+  }
+  else
+  {
+    fprintf(stderr, "Unable to write image cache %s\n", cache_path);
+    unlink(temp_path);
+    result = SL_AVR_EMU_RESULT_INVALID_FILE_PATH;
+  }
+
+  return result;
+}
+
+/**
+ * @brief Maps a cache entry and loads it if valid for source_hash
+ * 
+ * @param emulation 
+ * @param image 
+ * @param cache_path 
+ * @param source_hash 
+ * @return sl_avr_emu_result_e - SL_AVR_EMU_RESULT_SUCCESS on a hit
+ */
+static sl_avr_emu_result_e sl_avr_emu_image_map(sl_avr_emu_emulation_s *emulation, sl_avr_emu_image_s *image, const char *cache_path, uint64_t source_hash)
+{
+  sl_avr_emu_result_e              result = SL_AVR_EMU_RESULT_SUCCESS;
+  int                              fd;
+  struct stat                      file_stat;
+  const sl_avr_emu_byte_t         *map = MAP_FAILED;
+  size_t                           map_size = 0;
+  sl_avr_emu_image_header_s        header;
+  const sl_avr_emu_image_symbol_s *cached_symbols;
+  const char                      *strings;
+  uint32_t                         i;
+
+  fd = open(cache_path, O_RDONLY);
+  if(fd >= 0 && 0 == fstat(fd, &file_stat) && file_stat.st_size >= sizeof(header))
+  {
+    map_size = file_stat.st_size;
+    map      = mmap(NULL, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  if(fd >= 0)
+  {
+    close(fd);
+  }
+  if(MAP_FAILED == map)
+  {
+    return SL_AVR_EMU_RESULT_INVALID_FILE_PATH;
+  }
+
+  memcpy(&header, map, sizeof(header));
+  if( 0 != memcmp(header.magic, SL_AVR_EMU_IMAGE_MAGIC, SL_AVR_EMU_IMAGE_MAGIC_SIZE) ||
+      header.source_hash != source_hash ||
+      header.flash_words > SL_AVR_EMU_FLASH_SIZE ||
+      !SL_AVR_EMU_PC_ADDRESS_VALID(header.entry_pc) ||
+      header.flash_offset  > map_size || (header.flash_words*sizeof(sl_avr_emu_word_t)) > (map_size - header.flash_offset) ||
+      (header.symbols_offset % 4) != 0 ||
+      header.symbols_offset > map_size || ((size_t)header.symbol_count*sizeof(sl_avr_emu_image_symbol_s)) > (map_size - header.symbols_offset) ||
+      0 == header.strings_size ||
+      header.strings_offset > map_size || header.strings_size > (map_size - header.strings_offset) ||
+      0 != map[header.strings_offset + header.strings_size - 1] )
+  {
+    SL_AVR_EMU_VERBOSE_LOG(printf("Image cache %s is stale or invalid\n", cache_path));
+    munmap((void *) map, map_size);
+    return SL_AVR_EMU_RESULT_INVALID_FILE_FORMAT;
+  }
+
+  cached_symbols = (const sl_avr_emu_image_symbol_s *) &map[header.symbols_offset];
+  strings        = (const char *) &map[header.strings_offset];
+  memset(image, 0, sizeof(sl_avr_emu_image_s));
+  if(header.symbol_count > 0)
+  {
+    image->symbols.symbols = malloc(header.symbol_count * sizeof(sl_avr_emu_symbol_s));
+    if(NULL == image->symbols.symbols)
+    {
+      result = SL_AVR_EMU_RESULT_FAILURE;
+    }
+  }
+  for(i = 0; i < header.symbol_count && SL_AVR_EMU_RESULT_SUCCESS == result; i++)
+  {
+    if(cached_symbols[i].name_offset >= header.strings_size)
+    {
+      result = SL_AVR_EMU_RESULT_INVALID_FILE_FORMAT;
+    }
+    else
+    {
+      image->symbols.symbols[i].address  = cached_symbols[i].address;
+      image->symbols.symbols[i].size     = cached_symbols[i].size;
+      image->symbols.symbols[i].name     = &strings[cached_symbols[i].name_offset];
+      image->symbols.symbols[i].function = cached_symbols[i].function;
+      image->symbols.count++;
+    }
+  }
+
+  if(SL_AVR_EMU_RESULT_SUCCESS == result)
+  {
+    printf("Loading flash from image cache: %s\n", cache_path);
+    memcpy(emulation->memory.flash, &map[header.flash_offset], header.flash_words*sizeof(sl_avr_emu_word_t));
+    memset(&emulation->memory.flash[header.flash_words], 0, (SL_AVR_EMU_FLASH_SIZE - header.flash_words)*sizeof(sl_avr_emu_word_t));
+    emulation->memory.pc = header.entry_pc;
+
+    image->map         = (void *) map;
+    image->map_size    = map_size;
+    image->source_hash = source_hash;
+    image->flash_words = header.flash_words;
+    if(image->symbols.count > 0)
+    {
+      emulation->hooks.symbols = &image->symbols;
+    }
+  }
+  else
+  {
+    free(image->symbols.symbols);
+    memset(image, 0, sizeof(sl_avr_emu_image_s));
+    munmap((void *) map, map_size);
+  }
+
+  return result;
+}
+
+/**
+ * @brief Loads firmware through the image cache.  
+ *        On a cache miss the .hex or .elf source is loaded normally and its cache entry is (re)generated.
+ * 
+ * @param emulation 
+ * @param image 
+ * @param source_path - .hex or .elf file
+ * @param cache_dir   - Directory holding cache entries
+ * @return sl_avr_emu_result_e 
+ */
+sl_avr_emu_result_e sl_avr_emu_image_load(sl_avr_emu_emulation_s *emulation, sl_avr_emu_image_s *image, char *source_path, const char *cache_dir)
+{
+  sl_avr_emu_result_e  result;
+  uint64_t             source_hash;
+  bool                 elf;
+  char                 cache_path[PATH_MAX];
+  sl_avr_emu_symbols_s symbols;
+
+  if(NULL == emulation || NULL == image || NULL == source_path || NULL == cache_dir)
+  {
+    return SL_AVR_EMU_RESULT_INVALID_FILE_PATH;
+  }
+  memset(image, 0, sizeof(sl_avr_emu_image_s));
+
+  result = sl_avr_emu_image_hash_file(source_path, &source_hash, &elf);
+  if(SL_AVR_EMU_RESULT_SUCCESS == result)
+  {
+    snprintf(cache_path, sizeof(cache_path), "%s/%016llx.slimg", cache_dir, (unsigned long long) source_hash);
+    if(SL_AVR_EMU_RESULT_SUCCESS != sl_avr_emu_image_map(emulation, image, cache_path, source_hash))
+    {
+      /* Miss, load the source and regenerate */
+      memset(&symbols, 0, sizeof(symbols));
+      result = (elf)?sl_avr_emu_load_elf(emulation, source_path, &symbols):sl_avr_emu_load_hex(emulation, source_path);
+      if(SL_AVR_EMU_RESULT_SUCCESS == result)
+      {
+        emulation->hooks.symbols = NULL;
+        if( SL_AVR_EMU_RESULT_SUCCESS != sl_avr_emu_image_write(cache_path, emulation, &symbols, source_hash) ||
+            SL_AVR_EMU_RESULT_SUCCESS != sl_avr_emu_image_map(emulation, image, cache_path, source_hash) )
+        {
+          /* Flash is loaded regardless, only cached symbols are unavailable */
+          fprintf(stderr, "Continuing without image cache\n");
+        }
+      }
+      sl_avr_emu_symbols_free(&symbols);
+    }
+  }
+
+  return result;
+}
+
+/**
+ * @brief Unmaps an image
+ * 
+ * @param image 
+ */
+void sl_avr_emu_image_free(sl_avr_emu_image_s *image)
+{
+  if(image != NULL)
+  {
+    free(image->symbols.symbols);
+    if(image->map != NULL)
+    {
+      munmap(image->map, image->map_size);
+    }
+    memset(image, 0, sizeof(sl_avr_emu_image_s));
+  }
+}
@@ -12,21 +12,69 @@
 #include <stdio.h>
 
 #include "sl_avr_emu.h"
+#include "sl_avr_emu_adc.h"
 #include "sl_avr_emu_bitops.h"
+#include "sl_avr_emu_callgraph.h"
 #include "sl_avr_emu_interrupt.h"
+#include "sl_avr_emu_latency.h"
+#include "sl_avr_emu_spi.h"
 #include "sl_avr_emu_tick.h"
 #include "sl_avr_emu_timer.h"
+#include "sl_avr_emu_twi.h"
+#include "sl_avr_emu_usart.h"
+#include "sl_avr_emu_watch.h"
 
+const sl_avr_emu_interrupt_source_s sl_avr_emu_interrupt_sources[] =
+{
+  {0x000E, SL_AVR_EMU_IO_TO_DATA_ADDRESS(SL_AVR_EMU_TIMER_2_TIFR2), SL_AVR_EMU_TIMER_2_OCF2A, SL_AVR_EMU_TIMER_2_TIMSK2, SL_AVR_EMU_TIMER_2_OCIE2A, true,  "TIMER2_COMPA"},
+  {0x0010, SL_AVR_EMU_IO_TO_DATA_ADDRESS(SL_AVR_EMU_TIMER_2_TIFR2), SL_AVR_EMU_TIMER_2_OCF2B, SL_AVR_EMU_TIMER_2_TIMSK2, SL_AVR_EMU_TIMER_2_OCIE2B, true,  "TIMER2_COMPB"},
+  {0x0012, SL_AVR_EMU_IO_TO_DATA_ADDRESS(SL_AVR_EMU_TIMER_2_TIFR2), SL_AVR_EMU_TIMER_2_TOV2,  SL_AVR_EMU_TIMER_2_TIMSK2, SL_AVR_EMU_TIMER_2_TOIE2,  true,  "TIMER2_OVF"},
+  {0x0014, SL_AVR_EMU_IO_TO_DATA_ADDRESS(SL_AVR_EMU_TIMER_1_TIFR1), SL_AVR_EMU_TIMER_1_ICF1,  SL_AVR_EMU_TIMER_1_TIMSK1, SL_AVR_EMU_TIMER_1_ICIE1,  true,  "TIMER1_CAPT"},
+  {0x0016, SL_AVR_EMU_IO_TO_DATA_ADDRESS(SL_AVR_EMU_TIMER_1_TIFR1), SL_AVR_EMU_TIMER_1_OCF1A, SL_AVR_EMU_TIMER_1_TIMSK1, SL_AVR_EMU_TIMER_1_OCIE1A, true,  "TIMER1_COMPA"},
+  {0x0018, SL_AVR_EMU_IO_TO_DATA_ADDRESS(SL_AVR_EMU_TIMER_1_TIFR1), SL_AVR_EMU_TIMER_1_OCF1B, SL_AVR_EMU_TIMER_1_TIMSK1, SL_AVR_EMU_TIMER_1_OCIE1B, true,  "TIMER1_COMPB"},
+  {0x001A, SL_AVR_EMU_IO_TO_DATA_ADDRESS(SL_AVR_EMU_TIMER_1_TIFR1), SL_AVR_EMU_TIMER_1_TOV1,  SL_AVR_EMU_TIMER_1_TIMSK1, SL_AVR_EMU_TIMER_1_TOIE1,  true,  "TIMER1_OVF"},
+  {0x001C, SL_AVR_EMU_IO_TO_DATA_ADDRESS(SL_AVR_EMU_TIMER_0_TIFR0), SL_AVR_EMU_TIMER_0_OCF0A, SL_AVR_EMU_TIMER_0_TIMSK0, SL_AVR_EMU_TIMER_0_OCIE0A, true,  "TIMER0_COMPA"},
+  {0x001E, SL_AVR_EMU_IO_TO_DATA_ADDRESS(SL_AVR_EMU_TIMER_0_TIFR0), SL_AVR_EMU_TIMER_0_OCF0B, SL_AVR_EMU_TIMER_0_TIMSK0, SL_AVR_EMU_TIMER_0_OCIE0B, true,  "TIMER0_COMPB"},
+  {0x0020, SL_AVR_EMU_IO_TO_DATA_ADDRESS(SL_AVR_EMU_TIMER_0_TIFR0), SL_AVR_EMU_TIMER_0_TOV0,  SL_AVR_EMU_TIMER_0_TIMSK0, SL_AVR_EMU_TIMER_0_TOIE0,  true,  "TIMER0_OVF"},
+  {0x0022, SL_AVR_EMU_SPI_SPSR,                                     SL_AVR_EMU_SPI_SPIF,       SL_AVR_EMU_SPI_SPCR,       SL_AVR_EMU_SPI_SPIE,       true,  "SPI_STC"},
+  {0x0024, SL_AVR_EMU_USART_0_UCSR0A,                               SL_AVR_EMU_USART_0_RXC0,   SL_AVR_EMU_USART_0_UCSR0B, SL_AVR_EMU_USART_0_RXCIE0, false, "USART_RX"},
+  {0x0026, SL_AVR_EMU_USART_0_UCSR0A,                               SL_AVR_EMU_USART_0_UDRE0,  SL_AVR_EMU_USART_0_UCSR0B, SL_AVR_EMU_USART_0_UDRIE0, false, "USART_UDRE"},
+  {0x0028, SL_AVR_EMU_USART_0_UCSR0A,                               SL_AVR_EMU_USART_0_TXC0,   SL_AVR_EMU_USART_0_UCSR0B, SL_AVR_EMU_USART_0_TXCIE0, true,  "USART_TX"},
+  {0x002A, SL_AVR_EMU_ADC_ADCSRA,                                   SL_AVR_EMU_ADC_ADIF,       SL_AVR_EMU_ADC_ADCSRA,     SL_AVR_EMU_ADC_ADIE,       true,  "ADC"},
+  {0x0030, SL_AVR_EMU_TWI_TWCR,                                     SL_AVR_EMU_TWI_TWINT,      SL_AVR_EMU_TWI_TWCR,       SL_AVR_EMU_TWI_TWIE,       false, "TWI"},
+};
+const uint32_t sl_avr_emu_interrupt_source_count = sizeof(sl_avr_emu_interrupt_sources)/sizeof(sl_avr_emu_interrupt_source_s);
+
+/**
+ * @brief Pushes PC and vectors to interrupt_pc with interrupts disabled
+ * 
+ * @param emulation 
+ * @param interrupt_pc 
+ * @return sl_avr_emu_result_e 
+ */
 sl_avr_emu_result_e sl_avr_emu_interrupt(sl_avr_emu_emulation_s *emulation, sl_avr_emu_extended_address_t interrupt_pc)
 {
   sl_avr_emu_result_e result = SL_AVR_EMU_RESULT_SUCCESS;
 
   SL_AVR_EMU_CLEAR_SREG_BIT(*emulation, SL_AVR_EMU_SREG_INTERRUPT_FLAG);
 
+  if(NULL != emulation->hooks.watch)
+  {
+    sl_avr_emu_watch_stack(emulation, SL_AVR_EMU_EXTENDED_PC_ADDRESS?3:2, true);
+  }
   result = slf_var_emu_stack_push_pc(emulation, emulation->memory.pc);
 
   emulation->memory.pc = interrupt_pc;
 
+  if(NULL != emulation->hooks.callgraph)
+  {
+    sl_avr_emu_callgraph_interrupt(emulation);
+  }
+  if(NULL != emulation->hooks.latency)
+  {
+    sl_avr_emu_latency_interrupt(emulation);
+  }
+
   SL_AVR_EMU_VERBOSE_LOG(printf("INTERRUPT. PC 0x%06x. SREG 0x%02x\n", emulation->memory.pc, emulation->memory.data[SL_AVR_EMU_SREG_ADDRESS]));
 
   return result;
@@ -40,29 +88,29 @@ sl_avr_emu_result_e sl_avr_emu_interrupt(sl_avr_emu_emulation_s *emulation, sl_a
  */
 sl_avr_emu_result_e sl_avr_emu_interrupt_handling(sl_avr_emu_emulation_s *emulation)
 {
-  sl_avr_emu_result_e result = SL_AVR_EMU_RESULT_SUCCESS;
+  sl_avr_emu_result_e                  result = SL_AVR_EMU_RESULT_SUCCESS;
+  const sl_avr_emu_interrupt_source_s *source;
+  uint32_t                             i;
+
+  if(NULL != emulation->hooks.latency)
+  {
+    sl_avr_emu_latency_sample(emulation);
+  }
 
   if(SL_AVR_EMU_CHECK_SREG_BIT(*emulation, SL_AVR_EMU_SREG_INTERRUPT_FLAG))
   {
-    if(sl_avr_emu_timer_8_configured(&emulation->timer0))
+    for(i = 0; i < sl_avr_emu_interrupt_source_count; i++)
     {
-      if(SL_AVR_EMU_CHECK_BIT(*emulation->timer0.timsk, SL_AVR_EMU_TIMER_0_OCIE0A) &&
-         SL_AVR_EMU_CHECK_BIT(*emulation->timer0.tifr,  SL_AVR_EMU_TIMER_0_OCF0A))
-      {
-        SL_AVR_EMU_CLEAR_BIT(*emulation->timer0.tifr,  SL_AVR_EMU_TIMER_0_OCF0A);
-        sl_avr_emu_interrupt(emulation, 0x001C);
-      }
-      else if(SL_AVR_EMU_CHECK_BIT(*emulation->timer0.timsk, SL_AVR_EMU_TIMER_0_OCIE0B) &&
-         SL_AVR_EMU_CHECK_BIT(*emulation->timer0.tifr,  SL_AVR_EMU_TIMER_0_OCF0B))
-      {
-        SL_AVR_EMU_CLEAR_BIT(*emulation->timer0.tifr,  SL_AVR_EMU_TIMER_0_OCF0B);
-        sl_avr_emu_interrupt(emulation, 0x001E);
-      }
-      else if(SL_AVR_EMU_CHECK_BIT(*emulation->timer0.timsk, SL_AVR_EMU_TIMER_0_TOIE0) &&
-         SL_AVR_EMU_CHECK_BIT(*emulation->timer0.tifr,  SL_AVR_EMU_TIMER_0_TOV0))
+      source = &sl_avr_emu_interrupt_sources[i];
+      if(SL_AVR_EMU_CHECK_BIT(emulation->memory.data[source->enable_address], source->enable_bit) &&
+         SL_AVR_EMU_CHECK_BIT(emulation->memory.data[source->flag_address],   source->flag_bit))
       {
-        SL_AVR_EMU_CLEAR_BIT(*emulation->timer0.tifr,  SL_AVR_EMU_TIMER_0_TOV0);
-        sl_avr_emu_interrupt(emulation, 0x0020);
+        if(source->cleared_on_vector)
+        {
+          SL_AVR_EMU_CLEAR_BIT(emulation->memory.data[source->flag_address], source->flag_bit);
+        }
+        result = sl_avr_emu_interrupt(emulation, source->vector);
+        break;
       }
     }
   }
@@ -72,4 +120,32 @@ sl_avr_emu_result_e sl_avr_emu_interrupt_handling(sl_avr_emu_emulation_s *emulat
   }
 
   return result;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Returns whether an interrupt will be taken at the next instruction boundary
+ * 
+ * @param emulation 
+ * @return true if interrupts are enabled and an enabled source is flagged
+ */
+bool sl_avr_emu_interrupt_pending(const sl_avr_emu_emulation_s *emulation)
+{
+  const sl_avr_emu_interrupt_source_s *source;
+  uint32_t                             i;
+
+  if(!SL_AVR_EMU_CHECK_SREG_BIT(*emulation, SL_AVR_EMU_SREG_INTERRUPT_FLAG))
+  {
+    return false;
+  }
+  for(i = 0; i < sl_avr_emu_interrupt_source_count; i++)
+  {
+    source = &sl_avr_emu_interrupt_sources[i];
+    if(SL_AVR_EMU_CHECK_BIT(emulation->memory.data[source->enable_address], source->enable_bit) &&
+       SL_AVR_EMU_CHECK_BIT(emulation->memory.data[source->flag_address],   source->flag_bit))
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
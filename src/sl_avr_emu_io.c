@@ -0,0 +1,88 @@
+/**
+ * @file sl_avr_emu_io.c
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator Peripheral Register Hook Logic
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ * Most peripherals are modelled on their own schedule and only read or write their registers in data
+ * memory.  Hooks are for registers whose access itself has side effects, such as reading a receive buffer.
+ */
+
+#include <stdlib.h>
+
+#include "sl_avr_emu_io.h"
+
+/**
+ * @brief Hooks a register, replacing any hooks it already has
+ * 
+ * @param emulation
+ * @param address   - Data address of the register
+ * @param read      - NULL to read data memory as is
+ * @param write     - NULL to store writes in data memory as is
+ * @param context   - Passed to read and write
+ * @return sl_avr_emu_result_e - SL_AVR_EMU_RESULT_INVALID_DATA_ADDRESS if address is not an IO register
+ */
+sl_avr_emu_result_e sl_avr_emu_io_attach(sl_avr_emu_emulation_s *emulation, sl_avr_emu_address_t address,
+                                         sl_avr_emu_io_read_f read, sl_avr_emu_io_write_f write, void *context)
+{
+  sl_avr_emu_io_register_s *hook;
+
+  if(address < SL_AVR_EMU_IO_ADDRESS_SPACE_OFFSET || address >= SL_AVR_EMU_IO_HOOK_SIZE)
+  {
+    return SL_AVR_EMU_RESULT_INVALID_DATA_ADDRESS;
+  }
+
+  if(NULL == emulation->hooks.io)
+  {
+    emulation->hooks.io = calloc(1, sizeof(sl_avr_emu_io_s));
+    if(NULL == emulation->hooks.io)
+    {
+      return SL_AVR_EMU_RESULT_FAILURE;
+    }
+  }
+
+  hook = &emulation->hooks.io->registers[address];
+  if(NULL == hook->read && NULL == hook->write)
+  {
+    emulation->hooks.io->count++;
+  }
+  hook->read    = read;
+  hook->write   = write;
+  hook->context = context;
+
+  return SL_AVR_EMU_RESULT_SUCCESS;
+}
+
+/**
+ * @brief Removes the hooks of a register.  Detaches register hooks after the last is removed.
+ * 
+ * @param emulation
+ * @param address
+ */
+void sl_avr_emu_io_detach(sl_avr_emu_emulation_s *emulation, sl_avr_emu_address_t address)
+{
+  sl_avr_emu_io_register_s *hook;
+
+  if(NULL == emulation->hooks.io || address >= SL_AVR_EMU_IO_HOOK_SIZE)
+  {
+    return;
+  }
+
+  hook = &emulation->hooks.io->registers[address];
+  if(NULL != hook->read || NULL != hook->write)
+  {
+    hook->read    = NULL;
+    hook->write   = NULL;
+    hook->context = NULL;
+    emulation->hooks.io->count--;
+  }
+
+  if(0 == emulation->hooks.io->count)
+  {
+    free(emulation->hooks.io);
+    emulation->hooks.io = NULL;
+  }
+}
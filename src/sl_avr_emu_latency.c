@@ -0,0 +1,320 @@
+/**
+ * @file sl_avr_emu_latency.c
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator Interrupt Latency Instrumentation Logic
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ * Flags are timestamped on the IO tick that raised them, so latency includes the rest of the
+ * instruction in progress as well as any time spent with interrupts disabled.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sl_avr_emu_bitops.h"
+#include "sl_avr_emu_elf.h"
+#include "sl_avr_emu_interrupt.h"
+#include "sl_avr_emu_latency.h"
+
+/**
+ * @brief Adds value to histogram
+ * 
+ * @param histogram
+ * @param value
+ */
+static void sl_avr_emu_histogram_add(sl_avr_emu_histogram_s *histogram, uint64_t value)
+{
+  uint32_t bucket = 0;
+
+  while(bucket < (SL_AVR_EMU_LATENCY_BUCKETS - 1) && (value >> bucket) > 0)
+  {
+    bucket++;
+  }
+  histogram->buckets[bucket]++;
+
+  if(0 == histogram->count || value < histogram->min)
+  {
+    histogram->min = value;
+  }
+  if(value > histogram->max)
+  {
+    histogram->max = value;
+  }
+  histogram->count++;
+  histogram->sum += value;
+}
+
+/**
+ * @brief Prints a histogram summary and its non-empty buckets
+ * 
+ * @param output
+ * @param name
+ * @param histogram
+ */
+static void sl_avr_emu_histogram_print(FILE *output, const char *name, const sl_avr_emu_histogram_s *histogram)
+{
+  uint32_t bucket;
+  char     range[32];
+
+  if(0 == histogram->count)
+  {
+    return;
+  }
+
+  fprintf(output, "    %-8s min %lu, avg %.1f, max %lu ticks\n", name, histogram->min, (double) histogram->sum/histogram->count, histogram->max);
+  for(bucket = 0; bucket < SL_AVR_EMU_LATENCY_BUCKETS; bucket++)
+  {
+    if(histogram->buckets[bucket] > 0)
+    {
+      if(bucket <= 1)
+      {
+        snprintf(range, sizeof(range), "%u", bucket);
+      }
+      else if(bucket < (SL_AVR_EMU_LATENCY_BUCKETS - 1))
+      {
+        snprintf(range, sizeof(range), "%lu-%lu", 1UL << (bucket - 1), (1UL << bucket) - 1);
+      }
+      else
+      {
+        snprintf(range, sizeof(range), "%lu+", 1UL << (bucket - 1));
+      }
+      fprintf(output, "      %20s %12lu\n", range, histogram->buckets[bucket]);
+    }
+  }
+}
+
+/**
+ * @brief Attaches new latency instrumentation to emulation
+ * 
+ * @param emulation
+ * @return sl_avr_emu_result_e
+ */
+sl_avr_emu_result_e sl_avr_emu_latency_start(sl_avr_emu_emulation_s *emulation)
+{
+  sl_avr_emu_result_e   result = SL_AVR_EMU_RESULT_SUCCESS;
+  sl_avr_emu_latency_s *latency;
+
+  if(sl_avr_emu_interrupt_source_count > SL_AVR_EMU_LATENCY_SOURCE_MAX)
+  {
+    return SL_AVR_EMU_RESULT_FAILURE;
+  }
+
+  latency = calloc(1, sizeof(sl_avr_emu_latency_s));
+  if(latency != NULL)
+  {
+    latency->last_pc = emulation->memory.pc;
+    emulation->hooks.latency = latency;
+  }
+  else
+  {
+    result = SL_AVR_EMU_RESULT_FAILURE;
+  }
+
+  return result;
+}
+
+/**
+ * @brief Timestamps newly raised interrupt flags.  Called each tick after scheduled events are dispatched.
+ * 
+ * @param emulation
+ */
+void sl_avr_emu_latency_io_tick(sl_avr_emu_emulation_s *emulation)
+{
+  sl_avr_emu_latency_s                *latency = emulation->hooks.latency;
+  const sl_avr_emu_interrupt_source_s *source;
+  bool                                 flag;
+  uint32_t                             i;
+
+  for(i = 0; i < sl_avr_emu_interrupt_source_count; i++)
+  {
+    source = &sl_avr_emu_interrupt_sources[i];
+    flag   = SL_AVR_EMU_CHECK_BIT(emulation->memory.data[source->flag_address], source->flag_bit);
+
+    /* A flag cleared by firmware without its vector being taken is no longer pending */
+    if(flag && !latency->sources[i].raised)
+    {
+      latency->sources[i].pending   = true;
+      latency->sources[i].raised    = true;
+      latency->sources[i].flag_tick = emulation->io_tick_count;
+    }
+    else if(!flag)
+    {
+      latency->sources[i].pending = false;
+      latency->sources[i].raised  = false;
+    }
+  }
+}
+
+/**
+ * @brief Follows the SREG I flag.  Called on each instruction boundary.
+ * 
+ * @param emulation
+ */
+void sl_avr_emu_latency_sample(sl_avr_emu_emulation_s *emulation)
+{
+  sl_avr_emu_latency_s       *latency = emulation->hooks.latency;
+  sl_avr_emu_latency_window_s window;
+  uint32_t                    i;
+
+  if(SL_AVR_EMU_CHECK_SREG_BIT(*emulation, SL_AVR_EMU_SREG_INTERRUPT_FLAG))
+  {
+    if(latency->disabled)
+    {
+      window.ticks      = emulation->tick_count - latency->disabled_tick;
+      window.start_tick = latency->disabled_tick;
+      window.start_pc   = latency->disabled_pc;
+      window.end_pc     = latency->last_pc;
+
+      /* Insert into the longest windows, longest first */
+      for(i = SL_AVR_EMU_LATENCY_WINDOWS; i > 0 && latency->windows[i-1].ticks < window.ticks; i--)
+      {
+        if(i < SL_AVR_EMU_LATENCY_WINDOWS)
+        {
+          latency->windows[i] = latency->windows[i-1];
+        }
+      }
+      if(i < SL_AVR_EMU_LATENCY_WINDOWS)
+      {
+        latency->windows[i] = window;
+      }
+    }
+    latency->enabled_once = true;
+    latency->disabled     = false;
+  }
+  else if(latency->enabled_once && !latency->disabled)
+  {
+    latency->disabled      = true;
+    latency->disabled_tick = emulation->tick_count;
+    latency->disabled_pc   = latency->last_pc;
+  }
+
+  latency->last_pc = emulation->memory.pc;
+}
+
+/**
+ * @brief Accounts the vector at PC being taken.  Called after the vector is entered.
+ * 
+ * @param emulation
+ */
+void sl_avr_emu_latency_interrupt(sl_avr_emu_emulation_s *emulation)
+{
+  sl_avr_emu_latency_s        *latency = emulation->hooks.latency;
+  sl_avr_emu_latency_source_s *source;
+  sl_avr_emu_tick_count_t      period;
+  uint32_t                     i;
+
+  for(i = 0; i < sl_avr_emu_interrupt_source_count && sl_avr_emu_interrupt_sources[i].vector != emulation->memory.pc; i++);
+  if(i == sl_avr_emu_interrupt_source_count)
+  {
+    return;
+  }
+  source = &latency->sources[i];
+
+  if(source->pending)
+  {
+    sl_avr_emu_histogram_add(&source->latency, emulation->tick_count - source->flag_tick);
+    source->pending = false;
+  }
+
+  if(source->last_entry_tick > 0)
+  {
+    period = emulation->tick_count - source->last_entry_tick;
+    if(source->last_period > 0)
+    {
+      sl_avr_emu_histogram_add(&source->jitter, (period > source->last_period)?period - source->last_period:source->last_period - period);
+    }
+    source->last_period = period;
+  }
+  source->last_entry_tick = emulation->tick_count;
+
+  if(latency->depth < SL_AVR_EMU_LATENCY_NESTING_MAX)
+  {
+    latency->active[latency->depth].source     = i;
+    latency->active[latency->depth].entry_tick = emulation->tick_count;
+    latency->depth++;
+  }
+}
+
+/**
+ * @brief Accounts the innermost interrupt returning.  Called by RETI.
+ * 
+ * @param emulation
+ */
+void sl_avr_emu_latency_reti(sl_avr_emu_emulation_s *emulation)
+{
+  sl_avr_emu_latency_s *latency = emulation->hooks.latency;
+
+  if(latency->depth > 0)
+  {
+    latency->depth--;
+    sl_avr_emu_histogram_add(&latency->sources[latency->active[latency->depth].source].duration,
+                             emulation->tick_count - latency->active[latency->depth].entry_tick);
+  }
+}
+
+/**
+ * @brief Prints latency, duration and jitter per vector, and the longest interrupts-disabled windows
+ * 
+ * @param output
+ * @param emulation
+ */
+void sl_avr_emu_latency_report(FILE *output, sl_avr_emu_emulation_s *emulation)
+{
+  sl_avr_emu_latency_s              *latency = emulation->hooks.latency;
+  const sl_avr_emu_latency_source_s *source;
+  const char                        *name;
+  uint32_t                           offset;
+  uint32_t                           i;
+
+  if(NULL == latency)
+  {
+    return;
+  }
+
+  fprintf(output, "\nInterrupt latency:\n");
+  for(i = 0; i < sl_avr_emu_interrupt_source_count; i++)
+  {
+    source = &latency->sources[i];
+    if(source->latency.count > 0 || source->duration.count > 0)
+    {
+      fprintf(output, "  %s (vector 0x%x): %lu taken\n", sl_avr_emu_interrupt_sources[i].name, sl_avr_emu_interrupt_sources[i].vector*2,
+              source->latency.count);
+      sl_avr_emu_histogram_print(output, "latency", &source->latency);
+      sl_avr_emu_histogram_print(output, "duration", &source->duration);
+      sl_avr_emu_histogram_print(output, "jitter", &source->jitter);
+    }
+  }
+
+  fprintf(output, "\nLongest interrupts-disabled windows:\n");
+  fprintf(output, "  %10s %12s  %s\n", "ticks", "start tick", "disabled at -> enabled at");
+  for(i = 0; i < SL_AVR_EMU_LATENCY_WINDOWS && latency->windows[i].ticks > 0; i++)
+  {
+    fprintf(output, "  %10lu %12lu  0x%x", latency->windows[i].ticks, latency->windows[i].start_tick, latency->windows[i].start_pc*2);
+    name = sl_avr_emu_symbol_name_pc(emulation->hooks.symbols, latency->windows[i].start_pc, &offset);
+    if(name != NULL)
+    {
+      fprintf(output, " <%s+0x%x>", name, offset);
+    }
+    fprintf(output, " -> 0x%x", latency->windows[i].end_pc*2);
+    name = sl_avr_emu_symbol_name_pc(emulation->hooks.symbols, latency->windows[i].end_pc, &offset);
+    if(name != NULL)
+    {
+      fprintf(output, " <%s+0x%x>", name, offset);
+    }
+    fprintf(output, "\n");
+  }
+}
+
+/**
+ * @brief Detaches and frees emulation's latency instrumentation
+ * 
+ * @param emulation
+ */
+void sl_avr_emu_latency_stop(sl_avr_emu_emulation_s *emulation)
+{
+  free(emulation->hooks.latency);
+  emulation->hooks.latency = NULL;
+}
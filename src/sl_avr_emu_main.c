@@ -0,0 +1,917 @@
+/**
+ * @file sl_avr_emu_main.c
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator Command Line Entry Point
+ * @version 0.1
+ * @date 2020-09-05
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sl_avr_emu.h"
+#include "sl_avr_emu_adc.h"
+#include "sl_avr_emu_breakpoint.h"
+#include "sl_avr_emu_callgraph.h"
+#include "sl_avr_emu_cosim.h"
+#include "sl_avr_emu_coverage.h"
+#include "sl_avr_emu_elf.h"
+#include "sl_avr_emu_gdb.h"
+#include "sl_avr_emu_guard.h"
+#include "sl_avr_emu_hex.h"
+#include "sl_avr_emu_image.h"
+#include "sl_avr_emu_latency.h"
+#include "sl_avr_emu_profile.h"
+#include "sl_avr_emu_replay.h"
+#include "sl_avr_emu_spi.h"
+#include "sl_avr_emu_spi_flash.h"
+#include "sl_avr_emu_stack.h"
+#include "sl_avr_emu_stats.h"
+#include "sl_avr_emu_trace.h"
+#include "sl_avr_emu_twi.h"
+#include "sl_avr_emu_twi_eeprom.h"
+#include "sl_avr_emu_twi_sensor.h"
+#include "sl_avr_emu_usart.h"
+#include "sl_avr_emu_watch.h"
+#include "sl_avr_emu_waveform.h"
+
+/**
+ * @brief Parses a watch range given as address[:size[:r|w|rw]], writes by default
+ * 
+ * @param argument
+ * @param start
+ * @param size
+ * @param access
+ */
+static void sl_avr_emu_main_parse_watch(const char *argument, sl_avr_emu_extended_address_t *start, uint32_t *size, sl_avr_emu_watch_access_e *access)
+{
+  const char *size_string = strchr(argument, ':');
+
+  *access = SL_AVR_EMU_WATCH_WRITE;
+  if(NULL != strstr(argument, ":rw"))
+  {
+    *access = SL_AVR_EMU_WATCH_READ_WRITE;
+  }
+  else if(NULL != strstr(argument, ":r"))
+  {
+    *access = SL_AVR_EMU_WATCH_READ;
+  }
+  *start = strtoul(argument, NULL, 0);
+  *size  = (size_string != NULL && ':' != size_string[1])?strtoul(&size_string[1], NULL, 0):1;
+}
+
+/**
+ * @brief Runs several boards connected by serial links, each board a hex file
+ * 
+ * @param board_paths
+ * @param board_count
+ * @param uart_links  - Links given as from:to board indices
+ * @param link_count
+ * @param quantum
+ * @param thread_count
+ * @param tick_limit
+ * @param clock_hz
+ * @return sl_avr_emu_result_e
+ */
+static sl_avr_emu_result_e sl_avr_emu_main_cosim(char **board_paths, uint32_t board_count, char **uart_links, uint32_t link_count,
+                                                 sl_avr_emu_tick_count_t quantum, uint32_t thread_count,
+                                                 sl_avr_emu_tick_count_t tick_limit, uint32_t clock_hz)
+{
+  sl_avr_emu_result_e     result = SL_AVR_EMU_RESULT_SUCCESS;
+  sl_avr_emu_cosim_s     *cosim;
+  sl_avr_emu_emulation_s *boards[SL_AVR_EMU_COSIM_BOARDS_MAX] = {NULL};
+  char                   *link_end;
+  uint32_t                from;
+  uint32_t                to;
+  uint32_t                i;
+
+  cosim = malloc(sizeof(sl_avr_emu_cosim_s));
+  if(NULL == cosim)
+  {
+    return SL_AVR_EMU_RESULT_FAILURE;
+  }
+  sl_avr_emu_cosim_init(cosim, quantum);
+
+  for(i = 0; i < board_count && SL_AVR_EMU_RESULT_SUCCESS == result; i++)
+  {
+    boards[i] = malloc(sizeof(sl_avr_emu_emulation_s));
+    if(NULL == boards[i])
+    {
+      result = SL_AVR_EMU_RESULT_FAILURE;
+      break;
+    }
+    sl_avr_emu_init(boards[i]);
+    boards[i]->clock_hz = clock_hz;
+    result = sl_avr_emu_load_hex(boards[i], board_paths[i]);
+    if(result != SL_AVR_EMU_RESULT_SUCCESS)
+    {
+      fprintf(stderr, "Error! Failed to load board %u hex %u at %s\n", i, result, board_paths[i]);
+    }
+    else
+    {
+      result = sl_avr_emu_cosim_add_board(cosim, boards[i]);
+    }
+  }
+
+  for(i = 0; i < link_count && SL_AVR_EMU_RESULT_SUCCESS == result; i++)
+  {
+    from   = strtoul(uart_links[i], &link_end, 0);
+    to     = (':' == *link_end)?strtoul(&link_end[1], NULL, 0):board_count;
+    result = sl_avr_emu_cosim_connect_uart(cosim, from, to);
+    if(result != SL_AVR_EMU_RESULT_SUCCESS)
+    {
+      fprintf(stderr, "Error! Failed to connect USART0 link %s\n", uart_links[i]);
+    }
+  }
+
+  if(SL_AVR_EMU_RESULT_SUCCESS == result)
+  {
+    result = sl_avr_emu_cosim_run(cosim, tick_limit, thread_count);
+    sl_avr_emu_cosim_report(stdout, cosim);
+  }
+
+  sl_avr_emu_cosim_deinit(cosim);
+  free(cosim);
+  for(i = 0; i < board_count; i++)
+  {
+    if(boards[i] != NULL)
+    {
+      sl_avr_emu_usart_stop(boards[i]);
+      sl_avr_emu_deinit(boards[i]);
+      free(boards[i]);
+    }
+  }
+
+  return result;
+}
+
+int main(int argc, char *argv[])
+{
+  uint32_t i;
+  sl_avr_emu_result_e     result = SL_AVR_EMU_RESULT_SUCCESS;
+  sl_avr_emu_emulation_s  emulation;
+  sl_avr_emu_tick_count_t tick_limit  = SL_AVR_EMU_TICK_COUNT_MAX;
+  char                   *record_path = NULL;
+  char                   *replay_path = NULL;
+  sl_avr_emu_replay_s     replay;
+  sl_avr_emu_symbols_s    symbols = {0};
+  sl_avr_emu_image_s      image   = {0};
+  char                   *cache_dir = NULL;
+  uint32_t                profile_top_n = 0;
+  bool                    print_stats   = false;
+  bool                    measure_latency = false;
+  bool                    print_stack   = false;
+  char                   *callgraph_path = NULL;
+  FILE                   *callgraph_file;
+  char                   *coverage_path = NULL;
+  FILE                   *coverage_file;
+  uint32_t                heatmap_top_n = 0;
+  sl_avr_emu_watch_access_e watch_access;
+  sl_avr_emu_extended_address_t watch_start;
+  uint32_t                watch_size;
+  bool                    watch_write;
+  sl_avr_emu_address_t    watch_address;
+  sl_avr_emu_extended_address_t watch_pc;
+  char                   *breakpoint_names[SL_AVR_EMU_BREAKPOINT_MAX];
+  uint32_t                breakpoint_count = 0;
+  const sl_avr_emu_symbol_s *breakpoint_symbol;
+  char                   *breakpoint_end;
+  sl_avr_emu_extended_address_t breakpoint_pc;
+  char                   *gdb_address = NULL;
+  char                   *usart_endpoint = NULL;
+  char                   *spi_flash_path = NULL;
+  char                   *spi_flash_size;
+  sl_avr_emu_spi_device_s *spi_device;
+  char                   *twi_eeprom_paths[SL_AVR_EMU_TWI_DEVICES_MAX];
+  uint32_t                twi_eeprom_count = 0;
+  char                   *twi_sensor_specs[SL_AVR_EMU_TWI_DEVICES_MAX];
+  uint32_t                twi_sensor_count = 0;
+  char                   *twi_field;
+  sl_avr_emu_twi_device_s *twi_device;
+  unsigned long           twi_sensor_fields[4];
+  char                   *adc_spec = NULL;
+  char                   *adc_field;
+  unsigned long           adc_fields[2];
+  sl_avr_emu_adc_interpolation_e adc_interpolation = SL_AVR_EMU_ADC_INTERPOLATION_HOLD;
+  uint32_t                j;
+  bool                    measure_pwm   = false;
+  char                   *pwm_vcd_path  = NULL;
+  FILE                   *pwm_vcd_file;
+  char                   *trace_path    = NULL;
+  char                   *trace_vcd_path = NULL;
+  FILE                   *trace_input;
+  FILE                   *trace_output;
+  const char             *function;
+  uint32_t                function_offset;
+  char                   *board_paths[SL_AVR_EMU_COSIM_BOARDS_MAX];
+  uint32_t                board_count   = 0;
+  char                   *uart_links[SL_AVR_EMU_COSIM_LINKS_MAX];
+  uint32_t                uart_link_count = 0;
+  sl_avr_emu_tick_count_t quantum       = SL_AVR_EMU_COSIM_QUANTUM_DEFAULT;
+  uint32_t                thread_count  = 1;
+
+  sl_avr_emu_init(&emulation);
+
+  for(i = 1; i < argc; i++)
+  {
+    if(strcmp(argv[i],"-v") == 0)
+    {
+      printf("Verbose logging enabled.\n");
+      sl_avr_emu_verbose_logging_enabled = true;
+    }
+    else if(strcmp(argv[i],"-h") == 0)
+    {
+      if((i+1) < argc)
+      {
+        sl_avr_emu_image_free(&image);
+        result = (cache_dir != NULL)?sl_avr_emu_image_load(&emulation, &image, argv[i+1], cache_dir):
+                                     sl_avr_emu_load_hex(&emulation, argv[i+1]);
+
+        if(result != SL_AVR_EMU_RESULT_SUCCESS)
+        {
+          fprintf(stderr, "Error! Failed to load hex %u at %s\n", result, argv[i+1]);
+          return result;
+        }
+        i++;
+      }
+    }
+    else if(strcmp(argv[i],"-e") == 0)
+    {
+      if((i+1) < argc)
+      {
+        sl_avr_emu_symbols_free(&symbols);
+        sl_avr_emu_image_free(&image);
+        result = (cache_dir != NULL)?sl_avr_emu_image_load(&emulation, &image, argv[i+1], cache_dir):
+                                     sl_avr_emu_load_elf(&emulation, argv[i+1], &symbols);
+
+        if(result != SL_AVR_EMU_RESULT_SUCCESS)
+        {
+          fprintf(stderr, "Error! Failed to load elf %u at %s\n", result, argv[i+1]);
+          return result;
+        }
+        i++;
+      }
+    }
+    else if(strcmp(argv[i],"-c") == 0)
+    {
+      /* Image cache for subsequent -h/-e */
+      if((i+1) < argc)
+      {
+        cache_dir = argv[i+1];
+        i++;
+      }
+    }
+    else if(strcmp(argv[i],"-P") == 0)
+    {
+      /* Profile, reporting the N hottest functions/addresses at exit */
+      if((i+1) < argc)
+      {
+        profile_top_n = strtoul(argv[i+1], NULL, 0);
+        i++;
+      }
+    }
+    else if(strcmp(argv[i],"-g") == 0)
+    {
+      /* Call-graph profile, writing collapsed stacks for flame graphs at exit */
+      if((i+1) < argc)
+      {
+        callgraph_path = argv[i+1];
+        i++;
+      }
+    }
+    else if(strcmp(argv[i],"-C") == 0)
+    {
+      /* Code coverage, writing lcov (or address ranges without DWARF line info) at exit */
+      if((i+1) < argc)
+      {
+        coverage_path = argv[i+1];
+        i++;
+      }
+    }
+    else if(strcmp(argv[i],"-H") == 0)
+    {
+      /* Data access heatmap, reporting the N most accessed regions at exit */
+      if((i+1) < argc)
+      {
+        heatmap_top_n = strtoul(argv[i+1], NULL, 0);
+        if(0 == heatmap_top_n ||
+           (NULL == emulation.hooks.watch && SL_AVR_EMU_RESULT_SUCCESS != sl_avr_emu_watch_start(&emulation)))
+        {
+          fprintf(stderr, "Error! Failed to start data access counting\n");
+          return SL_AVR_EMU_RESULT_FAILURE;
+        }
+        i++;
+      }
+    }
+    else if(strcmp(argv[i],"-W") == 0)
+    {
+      /* Stop on access to a data range, given as address[:size[:r|w|rw]] */
+      if((i+1) < argc)
+      {
+        sl_avr_emu_main_parse_watch(argv[i+1], &watch_start, &watch_size, &watch_access);
+        if(SL_AVR_EMU_RESULT_SUCCESS != sl_avr_emu_watch_add(&emulation, watch_start, watch_size, watch_access, NULL, NULL))
+        {
+          fprintf(stderr, "Error! Failed to watch %s\n", argv[i+1]);
+          return SL_AVR_EMU_RESULT_FAILURE;
+        }
+        i++;
+      }
+    }
+    else if(strcmp(argv[i],"--guard") == 0)
+    {
+      /* As -W, but enforced by host page protection instead of instrumented accesses */
+      if((i+1) < argc)
+      {
+        sl_avr_emu_main_parse_watch(argv[i+1], &watch_start, &watch_size, &watch_access);
+        if(SL_AVR_EMU_RESULT_SUCCESS != sl_avr_emu_guard_add(&emulation, watch_start, watch_size, watch_access, NULL, NULL))
+        {
+          fprintf(stderr, "Error! Failed to guard %s\n", argv[i+1]);
+          return SL_AVR_EMU_RESULT_FAILURE;
+        }
+        i++;
+      }
+    }
+    else if(strcmp(argv[i],"-b") == 0)
+    {
+      /* Stop at a flash byte address or function, resolved once all firmware is loaded */
+      if((i+1) < argc && breakpoint_count < SL_AVR_EMU_BREAKPOINT_MAX)
+      {
+        breakpoint_names[breakpoint_count++] = argv[i+1];
+        i++;
+      }
+    }
+    else if(strcmp(argv[i],"-G") == 0)
+    {
+      /* Run under a GDB server on a loopback TCP port or Unix socket path */
+      if((i+1) < argc)
+      {
+        gdb_address = argv[i+1];
+        i++;
+      }
+    }
+    else if(strcmp(argv[i],"-U") == 0)
+    {
+      /* Bridge USART0 to stdin and stdout (-), a new pseudo-terminal (pty), or a FIFO, tty or file path */
+      if((i+1) < argc)
+      {
+        usart_endpoint = argv[i+1];
+        i++;
+      }
+    }
+    else if(strcmp(argv[i],"--spi-flash") == 0)
+    {
+      /* SPI NOR flash with chip select on PB2, backed by an image file, path[:size] */
+      if((i+1) < argc)
+      {
+        spi_flash_path = argv[i+1];
+        i++;
+      }
+    }
+    else if(strcmp(argv[i],"--twi-eeprom") == 0)
+    {
+      /* I2C EEPROM backed by an image file, path[:size], at bus addresses from 0x50 in order */
+      if((i+1) < argc && twi_eeprom_count < SL_AVR_EMU_TWI_DEVICES_MAX)
+      {
+        twi_eeprom_paths[twi_eeprom_count++] = argv[i+1];
+        i++;
+      }
+    }
+    else if(strcmp(argv[i],"--twi-sensor") == 0)
+    {
+      /* I2C sensor replaying a sample file, path:address:first data register:record bytes:sample Hz */
+      if((i+1) < argc && twi_sensor_count < SL_AVR_EMU_TWI_DEVICES_MAX)
+      {
+        twi_sensor_specs[twi_sensor_count++] = argv[i+1];
+        i++;
+      }
+    }
+    else if(strcmp(argv[i],"--adc") == 0)
+    {
+      /* ADC inputs from a sample file, path:channels:sample Hz[:hold|nearest|linear] */
+      if((i+1) < argc)
+      {
+        adc_spec = argv[i+1];
+        i++;
+      }
+    }
+    else if(strcmp(argv[i],"-B") == 0)
+    {
+      /* Co-simulate a board running this hex, boards are numbered from 0 in order */
+      if((i+1) < argc)
+      {
+        if(board_count >= SL_AVR_EMU_COSIM_BOARDS_MAX)
+        {
+          fprintf(stderr, "Error! At most %u boards\n", SL_AVR_EMU_COSIM_BOARDS_MAX);
+          return SL_AVR_EMU_RESULT_FAILURE;
+        }
+        board_paths[board_count++] = argv[i+1];
+        i++;
+      }
+    }
+    else if(strcmp(argv[i],"--uart") == 0)
+    {
+      /* Connect USART0 transmit of board a to USART0 receive of board b, given as a:b */
+      if((i+1) < argc)
+      {
+        if(uart_link_count >= SL_AVR_EMU_COSIM_LINKS_MAX)
+        {
+          fprintf(stderr, "Error! At most %u links\n", SL_AVR_EMU_COSIM_LINKS_MAX);
+          return SL_AVR_EMU_RESULT_FAILURE;
+        }
+        uart_links[uart_link_count++] = argv[i+1];
+        i++;
+      }
+    }
+    else if(strcmp(argv[i],"--quantum") == 0)
+    {
+      /* Co-simulation ticks between board synchronizations, also the latency of every link */
+      if((i+1) < argc)
+      {
+        quantum = strtoull(argv[i+1], NULL, 0);
+        i++;
+      }
+    }
+    else if(strcmp(argv[i],"--threads") == 0)
+    {
+      /* Threads co-simulated boards are run on */
+      if((i+1) < argc)
+      {
+        thread_count = strtoul(argv[i+1], NULL, 0);
+        i++;
+      }
+    }
+    else if(strcmp(argv[i],"--pwm") == 0)
+    {
+      /* Compare output period, duty cycle and jitter report at exit */
+      measure_pwm = true;
+    }
+    else if(strcmp(argv[i],"--pwm-vcd") == 0)
+    {
+      /* As --pwm, also writing the compare output edges as a VCD at exit */
+      if((i+1) < argc)
+      {
+        measure_pwm  = true;
+        pwm_vcd_path = argv[i+1];
+        i++;
+      }
+    }
+    else if(strcmp(argv[i],"--trace") == 0)
+    {
+      /* GPIO and compare output changes in the compact binary format */
+      if((i+1) < argc)
+      {
+        trace_path = argv[i+1];
+        i++;
+      }
+    }
+    else if(strcmp(argv[i],"--trace-vcd") == 0)
+    {
+      /* GPIO and compare output changes as a VCD */
+      if((i+1) < argc)
+      {
+        trace_vcd_path = argv[i+1];
+        i++;
+      }
+    }
+    else if(strcmp(argv[i],"--trace-convert") == 0)
+    {
+      /* Convert a binary trace to a VCD and exit */
+      if((i+2) < argc)
+      {
+        trace_input  = fopen(argv[i+1], "rb");
+        trace_output = fopen(argv[i+2], "w");
+        result = (NULL != trace_input && NULL != trace_output)?sl_avr_emu_trace_convert(trace_input, trace_output):SL_AVR_EMU_RESULT_INVALID_FILE_PATH;
+        if(result != SL_AVR_EMU_RESULT_SUCCESS)
+        {
+          fprintf(stderr, "Error! Failed to convert trace %s %u\n", argv[i+1], result);
+        }
+        if(trace_input != NULL)
+        {
+          fclose(trace_input);
+        }
+        if(trace_output != NULL)
+        {
+          fclose(trace_output);
+        }
+        sl_avr_emu_deinit(&emulation);
+        return result;
+      }
+    }
+    else if(strcmp(argv[i],"-L") == 0)
+    {
+      /* Interrupt latency, duration and jitter report at exit */
+      measure_latency = true;
+    }
+    else if(strcmp(argv[i],"--stack") == 0)
+    {
+      /* Stack high-water report at exit */
+      print_stack = true;
+    }
+    else if(strcmp(argv[i],"--stats") == 0)
+    {
+      /* Instruction mix summary at exit */
+      print_stats = true;
+    }
+    else if(strcmp(argv[i],"--clock") == 0)
+    {
+      /* CPU clock in Hz, for timers clocked from outside the CPU */
+      if((i+1) < argc)
+      {
+        emulation.clock_hz = strtoul(argv[i+1], NULL, 0);
+        i++;
+      }
+    }
+    else if(strcmp(argv[i],"-t") == 0)
+    {
+      if((i+1) < argc)
+      {
+        tick_limit = strtoull(argv[i+1], NULL, 0);
+        i++;
+      }
+    }
+    else if(strcmp(argv[i],"-r") == 0)
+    {
+      if((i+1) < argc)
+      {
+        record_path = argv[i+1];
+        i++;
+      }
+    }
+    else if(strcmp(argv[i],"-p") == 0)
+    {
+      if((i+1) < argc)
+      {
+        replay_path = argv[i+1];
+        i++;
+      }
+    }
+  }
+
+  if(board_count > 0)
+  {
+    result = sl_avr_emu_main_cosim(board_paths, board_count, uart_links, uart_link_count, quantum, thread_count, tick_limit, emulation.clock_hz);
+    sl_avr_emu_image_free(&image);
+    sl_avr_emu_deinit(&emulation);
+    return result;
+  }
+
+  if(record_path != NULL)
+  {
+    result = sl_avr_emu_replay_record_start(&emulation, &replay, record_path);
+  }
+  else if(replay_path != NULL)
+  {
+    result = sl_avr_emu_replay_playback_start(&emulation, &replay, replay_path);
+  }
+  if(result != SL_AVR_EMU_RESULT_SUCCESS)
+  {
+    fprintf(stderr, "Error! Failed to start stimulus %s %u\n", (record_path != NULL)?"recording":"replay", result);
+    return result;
+  }
+
+  for(i = 0; i < breakpoint_count; i++)
+  {
+    breakpoint_pc = strtoul(breakpoint_names[i], &breakpoint_end, 0)/2;
+    if('\0' != *breakpoint_end)
+    {
+      breakpoint_symbol = sl_avr_emu_symbol_find(emulation.hooks.symbols, breakpoint_names[i]);
+      breakpoint_pc     = (breakpoint_symbol != NULL)?breakpoint_symbol->address/2:SL_AVR_EMU_FLASH_SIZE;
+    }
+    if(SL_AVR_EMU_RESULT_SUCCESS != sl_avr_emu_breakpoint_set(&emulation, breakpoint_pc))
+    {
+      fprintf(stderr, "Error! Failed to set breakpoint at %s\n", breakpoint_names[i]);
+      return SL_AVR_EMU_RESULT_FAILURE;
+    }
+  }
+
+  if(profile_top_n > 0 && SL_AVR_EMU_RESULT_SUCCESS != sl_avr_emu_profile_start(&emulation))
+  {
+    fprintf(stderr, "Error! Failed to start profiling\n");
+    return SL_AVR_EMU_RESULT_FAILURE;
+  }
+
+  if(callgraph_path != NULL && SL_AVR_EMU_RESULT_SUCCESS != sl_avr_emu_callgraph_start(&emulation))
+  {
+    fprintf(stderr, "Error! Failed to start call-graph profiling\n");
+    return SL_AVR_EMU_RESULT_FAILURE;
+  }
+
+  if(coverage_path != NULL && SL_AVR_EMU_RESULT_SUCCESS != sl_avr_emu_coverage_start(&emulation))
+  {
+    fprintf(stderr, "Error! Failed to start coverage\n");
+    return SL_AVR_EMU_RESULT_FAILURE;
+  }
+
+  if(measure_latency && SL_AVR_EMU_RESULT_SUCCESS != sl_avr_emu_latency_start(&emulation))
+  {
+    fprintf(stderr, "Error! Failed to start latency measurement\n");
+    return SL_AVR_EMU_RESULT_FAILURE;
+  }
+
+  if(measure_pwm && SL_AVR_EMU_RESULT_SUCCESS != sl_avr_emu_waveform_start(&emulation))
+  {
+    fprintf(stderr, "Error! Failed to start compare output recording\n");
+    return SL_AVR_EMU_RESULT_FAILURE;
+  }
+
+  if((twi_eeprom_count > 0 || twi_sensor_count > 0) && SL_AVR_EMU_RESULT_SUCCESS != sl_avr_emu_twi_start(&emulation))
+  {
+    fprintf(stderr, "Error! Failed to start TWI\n");
+    return SL_AVR_EMU_RESULT_FAILURE;
+  }
+  for(i = 0; i < twi_eeprom_count; i++)
+  {
+    twi_field = strrchr(twi_eeprom_paths[i], ':');
+    if(twi_field != NULL)
+    {
+      *twi_field = '\0';
+      twi_field++;
+    }
+    twi_device = sl_avr_emu_twi_eeprom_open(&emulation, twi_eeprom_paths[i], (twi_field != NULL)?strtoul(twi_field, NULL, 0):0,
+                                            SL_AVR_EMU_TWI_EEPROM_ADDRESS + i);
+    if(twi_device == NULL || SL_AVR_EMU_RESULT_SUCCESS != sl_avr_emu_twi_attach(&emulation, twi_device))
+    {
+      fprintf(stderr, "Error! Failed to attach I2C EEPROM %s\n", twi_eeprom_paths[i]);
+      return SL_AVR_EMU_RESULT_FAILURE;
+    }
+  }
+  for(i = 0; i < twi_sensor_count; i++)
+  {
+    twi_field = strchr(twi_sensor_specs[i], ':');
+    for(j = 0; j < sizeof(twi_sensor_fields)/sizeof(twi_sensor_fields[0]); j++)
+    {
+      if(twi_field == NULL)
+      {
+        break;
+      }
+      *twi_field = '\0';
+      twi_sensor_fields[j] = strtoul(twi_field + 1, &twi_field, 0);
+      twi_field = (*twi_field == ':')?twi_field:NULL;
+    }
+    twi_device = (j == sizeof(twi_sensor_fields)/sizeof(twi_sensor_fields[0]))?
+                 sl_avr_emu_twi_sensor_open(&emulation, twi_sensor_specs[i], twi_sensor_fields[0], twi_sensor_fields[1],
+                                            twi_sensor_fields[2], twi_sensor_fields[3]):NULL;
+    if(twi_device == NULL || SL_AVR_EMU_RESULT_SUCCESS != sl_avr_emu_twi_attach(&emulation, twi_device))
+    {
+      fprintf(stderr, "Error! Failed to attach I2C sensor %s\n", twi_sensor_specs[i]);
+      return SL_AVR_EMU_RESULT_FAILURE;
+    }
+  }
+
+  if(adc_spec != NULL)
+  {
+    adc_field = strchr(adc_spec, ':');
+    for(j = 0; j < sizeof(adc_fields)/sizeof(adc_fields[0]); j++)
+    {
+      if(adc_field == NULL)
+      {
+        break;
+      }
+      *adc_field = '\0';
+      adc_fields[j] = strtoul(adc_field + 1, &adc_field, 0);
+      adc_field = (*adc_field == ':')?adc_field:NULL;
+    }
+    if(adc_field != NULL)
+    {
+      adc_interpolation = (strcmp(adc_field + 1, "linear") == 0)?SL_AVR_EMU_ADC_INTERPOLATION_LINEAR:
+                          (strcmp(adc_field + 1, "nearest") == 0)?SL_AVR_EMU_ADC_INTERPOLATION_NEAREST:SL_AVR_EMU_ADC_INTERPOLATION_HOLD;
+    }
+    if(j < sizeof(adc_fields)/sizeof(adc_fields[0]) ||
+       SL_AVR_EMU_RESULT_SUCCESS != sl_avr_emu_adc_start(&emulation, adc_spec, adc_fields[0], adc_fields[1], adc_interpolation))
+    {
+      fprintf(stderr, "Error! Failed to start ADC from %s\n", adc_spec);
+      return SL_AVR_EMU_RESULT_FAILURE;
+    }
+  }
+
+  /* Before tracing, which leaves the chip select port hooks to SPI */
+  if(spi_flash_path != NULL)
+  {
+    spi_flash_size = strrchr(spi_flash_path, ':');
+    if(spi_flash_size != NULL)
+    {
+      *spi_flash_size = '\0';
+      spi_flash_size++;
+    }
+    spi_device = sl_avr_emu_spi_flash_open(spi_flash_path, (spi_flash_size != NULL)?strtoul(spi_flash_size, NULL, 0):0);
+    if(spi_device == NULL)
+    {
+      fprintf(stderr, "Error! Failed to open SPI flash image %s\n", spi_flash_path);
+      return SL_AVR_EMU_RESULT_INVALID_FILE_PATH;
+    }
+    if(SL_AVR_EMU_RESULT_SUCCESS != sl_avr_emu_spi_start(&emulation) ||
+       SL_AVR_EMU_RESULT_SUCCESS != sl_avr_emu_spi_attach(&emulation, spi_device, SL_AVR_EMU_SPI_SS_PORT, SL_AVR_EMU_SPI_SS_BIT))
+    {
+      fprintf(stderr, "Error! Failed to attach SPI flash\n");
+      return SL_AVR_EMU_RESULT_FAILURE;
+    }
+  }
+
+  if((trace_path != NULL || trace_vcd_path != NULL) &&
+     SL_AVR_EMU_RESULT_SUCCESS != sl_avr_emu_trace_start(&emulation, trace_path, trace_vcd_path))
+  {
+    fprintf(stderr, "Error! Failed to start tracing\n");
+    return SL_AVR_EMU_RESULT_FAILURE;
+  }
+
+  if(usart_endpoint != NULL && SL_AVR_EMU_RESULT_SUCCESS != sl_avr_emu_usart_open(&emulation, usart_endpoint))
+  {
+    fprintf(stderr, "Error! Failed to open USART0 on %s\n", usart_endpoint);
+    return SL_AVR_EMU_RESULT_FAILURE;
+  }
+
+  if(gdb_address != NULL)
+  {
+    result = sl_avr_emu_gdb_serve(&emulation, gdb_address, tick_limit);
+    if(result != SL_AVR_EMU_RESULT_SUCCESS)
+    {
+      fprintf(stderr, "Error! Failed to serve GDB on %s\n", gdb_address);
+    }
+  }
+  else
+  {
+    result = sl_avr_emu_run(&emulation, tick_limit);
+  }
+  if(SL_AVR_EMU_RESULT_WATCHPOINT == result)
+  {
+    if(emulation.hooks.guard != NULL && emulation.hooks.guard->stopped)
+    {
+      watch_write   = emulation.hooks.guard->trigger_write;
+      watch_address = emulation.hooks.guard->trigger_address;
+      watch_pc      = emulation.hooks.guard->trigger_pc;
+    }
+    else
+    {
+      watch_write   = emulation.hooks.watch->trigger_write;
+      watch_address = emulation.hooks.watch->trigger_address;
+      watch_pc      = emulation.hooks.watch->trigger_pc;
+    }
+    printf("Watchpoint: %s 0x%04x at tick %lu, PC 0x%x", watch_write?"write":"read", watch_address, emulation.tick_count, watch_pc*2);
+    function = sl_avr_emu_symbol_name_pc(emulation.hooks.symbols, watch_pc, &function_offset);
+    if(function != NULL)
+    {
+      printf(" <%s+0x%x>", function, function_offset);
+    }
+    printf("\n");
+  }
+  else if(SL_AVR_EMU_RESULT_BREAKPOINT == result)
+  {
+    printf("Breakpoint: tick %lu, PC 0x%x", emulation.tick_count, emulation.memory.pc*2);
+    function = sl_avr_emu_symbol_name_pc(emulation.hooks.symbols, emulation.memory.pc, &function_offset);
+    if(function != NULL)
+    {
+      printf(" <%s+0x%x>", function, function_offset);
+    }
+    printf("\n");
+  }
+  else if(result != SL_AVR_EMU_RESULT_SUCCESS)
+  {
+    fprintf(stderr, "Error! Emulation result %u\n", result);
+    function = sl_avr_emu_symbol_name_pc(emulation.hooks.symbols, emulation.memory.pc, &function_offset);
+    if(function != NULL)
+    {
+      fprintf(stderr, "PC 0x%x (%s+0x%x)\n", emulation.memory.pc, function, function_offset);
+    }
+  }
+
+  if(emulation.hooks.profile != NULL)
+  {
+    sl_avr_emu_profile_report(stdout, &emulation, profile_top_n);
+    sl_avr_emu_profile_stop(&emulation);
+  }
+
+  if(emulation.hooks.callgraph != NULL)
+  {
+    callgraph_file = fopen(callgraph_path, "w");
+    if(callgraph_file != NULL)
+    {
+      sl_avr_emu_callgraph_write_collapsed(callgraph_file, &emulation);
+      fclose(callgraph_file);
+    }
+    else
+    {
+      fprintf(stderr, "Error! Failed to write call graph to %s\n", callgraph_path);
+    }
+    sl_avr_emu_callgraph_report(stdout, &emulation, 20);
+    sl_avr_emu_callgraph_stop(&emulation);
+  }
+
+  if(emulation.hooks.coverage != NULL)
+  {
+    coverage_file = fopen(coverage_path, "w");
+    if(NULL == coverage_file || SL_AVR_EMU_RESULT_SUCCESS != sl_avr_emu_coverage_write(coverage_file, &emulation))
+    {
+      fprintf(stderr, "Error! Failed to write coverage to %s\n", coverage_path);
+    }
+    if(coverage_file != NULL)
+    {
+      fclose(coverage_file);
+    }
+    sl_avr_emu_coverage_stop(&emulation);
+  }
+
+  if(emulation.hooks.watch != NULL)
+  {
+    if(heatmap_top_n > 0)
+    {
+      sl_avr_emu_watch_report(stdout, &emulation, heatmap_top_n);
+    }
+    sl_avr_emu_watch_stop(&emulation);
+  }
+
+  if(emulation.hooks.latency != NULL)
+  {
+    sl_avr_emu_latency_report(stdout, &emulation);
+    sl_avr_emu_latency_stop(&emulation);
+  }
+
+  if(emulation.hooks.waveform != NULL)
+  {
+    if(pwm_vcd_path != NULL)
+    {
+      pwm_vcd_file = fopen(pwm_vcd_path, "w");
+      if(NULL == pwm_vcd_file || SL_AVR_EMU_RESULT_SUCCESS != sl_avr_emu_waveform_write_vcd(pwm_vcd_file, &emulation))
+      {
+        fprintf(stderr, "Error! Failed to write compare output VCD to %s\n", pwm_vcd_path);
+      }
+      if(pwm_vcd_file != NULL)
+      {
+        fclose(pwm_vcd_file);
+      }
+    }
+    sl_avr_emu_waveform_report(stdout, &emulation);
+    sl_avr_emu_waveform_stop(&emulation);
+  }
+
+  if(print_stack)
+  {
+    sl_avr_emu_stack_report(stdout, &emulation);
+  }
+
+  if(print_stats)
+  {
+    sl_avr_emu_stats_print(stdout, &emulation);
+  }
+
+  if(emulation.hooks.usart0 != NULL)
+  {
+    if(print_stats)
+    {
+      sl_avr_emu_usart_report(stdout, &emulation);
+    }
+    sl_avr_emu_usart_stop(&emulation);
+  }
+
+  if(emulation.hooks.trace != NULL)
+  {
+    if(print_stats)
+    {
+      sl_avr_emu_trace_report(stdout, &emulation);
+    }
+    sl_avr_emu_trace_stop(&emulation);
+  }
+
+  if(emulation.hooks.spi != NULL)
+  {
+    if(print_stats)
+    {
+      sl_avr_emu_spi_report(stdout, &emulation);
+    }
+    sl_avr_emu_spi_stop(&emulation);
+  }
+
+  if(emulation.hooks.twi != NULL)
+  {
+    if(print_stats)
+    {
+      sl_avr_emu_twi_report(stdout, &emulation);
+    }
+    sl_avr_emu_twi_stop(&emulation);
+  }
+
+  if(emulation.hooks.adc != NULL)
+  {
+    if(print_stats)
+    {
+      sl_avr_emu_adc_report(stdout, &emulation);
+    }
+    sl_avr_emu_adc_stop(&emulation);
+  }
+
+  if(emulation.hooks.replay != NULL)
+  {
+    sl_avr_emu_replay_stop(&emulation, &replay);
+  }
+
+  sl_avr_emu_breakpoint_clear_all(&emulation);
+  sl_avr_emu_guard_stop(&emulation);
+  sl_avr_emu_symbols_free(&symbols);
+  sl_avr_emu_image_free(&image);
+  sl_avr_emu_deinit(&emulation);
+
+  return result;
+}
@@ -0,0 +1,275 @@
+/**
+ * @file sl_avr_emu_profile.c
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator Per-PC Profiler Logic
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ * Counting happens once per instruction: an instruction's cycles are the ticks 
+ * from its dispatch until the next dispatch, so nothing is added to multi-cycle ticks.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sl_avr_emu_disasm.h"
+#include "sl_avr_emu_elf.h"
+#include "sl_avr_emu_profile.h"
+
+/* Functions or hot spots given annotated disassembly */
+#define SL_AVR_EMU_PROFILE_ANNOTATE_MAX 5
+/* Words listed for a function without a size, or around a hot spot without symbols */
+#define SL_AVR_EMU_PROFILE_WINDOW_WORDS 12
+
+/**
+ * @brief Report entry, a flash word or a function
+ * 
+ */
+typedef struct
+{
+  uint32_t index;
+  uint64_t instructions;
+  uint64_t cycles;
+
+} sl_avr_emu_profile_entry_s;
+
+/**
+ * @brief Orders entries by cycles, descending
+ * 
+ * @param a 
+ * @param b 
+ * @return int 
+ */
+static int sl_avr_emu_profile_compare(const void *a, const void *b)
+{
+  const sl_avr_emu_profile_entry_s *entry_a = a;
+  const sl_avr_emu_profile_entry_s *entry_b = b;
+
+  return (entry_a->cycles < entry_b->cycles)?1:(entry_a->cycles > entry_b->cycles)?-1:
+         (entry_a->index > entry_b->index);
+}
+
+/**
+ * @brief Orders flash word addresses ascending
+ * 
+ * @param a 
+ * @param b 
+ * @return int 
+ */
+static int sl_avr_emu_profile_compare_pc(const void *a, const void *b)
+{
+  return (*(const uint32_t *) a > *(const uint32_t *) b) - (*(const uint32_t *) a < *(const uint32_t *) b);
+}
+
+/**
+ * @brief Attaches a new profile to emulation
+ * 
+ * @param emulation 
+ * @return sl_avr_emu_result_e 
+ */
+sl_avr_emu_result_e sl_avr_emu_profile_start(sl_avr_emu_emulation_s *emulation)
+{
+  sl_avr_emu_result_e   result = SL_AVR_EMU_RESULT_SUCCESS;
+  sl_avr_emu_profile_s *profile;
+
+  profile = calloc(1, sizeof(sl_avr_emu_profile_s));
+  if(profile != NULL)
+  {
+    profile->last_pc   = emulation->memory.pc;
+    /* Nothing is in progress, so the first dispatch accounts zero cycles */
+    profile->last_tick = emulation->tick_count + 1;
+    emulation->hooks.profile = profile;
+  }
+  else
+  {
+    result = SL_AVR_EMU_RESULT_FAILURE;
+  }
+
+  return result;
+}
+
+/**
+ * @brief Prints annotated disassembly of [start, end)
+ * 
+ * @param output 
+ * @param emulation 
+ * @param start 
+ * @param end 
+ * @param total_cycles 
+ */
+static void sl_avr_emu_profile_annotate(FILE *output, const sl_avr_emu_emulation_s *emulation, sl_avr_emu_extended_address_t start, sl_avr_emu_extended_address_t end, uint64_t total_cycles)
+{
+  const sl_avr_emu_profile_s   *profile = emulation->hooks.profile;
+  sl_avr_emu_extended_address_t pc;
+  char                          instruction[SL_AVR_EMU_DISASM_BUFFER_SIZE];
+
+  for(pc = start; pc < end && SL_AVR_EMU_FLASH_ADDRESS_VALID(pc); )
+  {
+    fprintf(output, "  %12lu %6.2f%% %12lu  %6x:  ", profile->cycles[pc], (total_cycles > 0)?100.0*profile->cycles[pc]/total_cycles:0.0,
+            profile->instructions[pc], pc*2);
+    pc += sl_avr_emu_disassemble(emulation->memory.flash, pc, instruction, sizeof(instruction));
+    fprintf(output, "%s\n", instruction);
+  }
+}
+
+/**
+ * @brief Prints the top_n hottest functions (when symbols are available) and addresses, 
+ *        followed by annotated disassembly of the hottest code
+ * 
+ * @param output 
+ * @param emulation 
+ * @param top_n 
+ */
+void sl_avr_emu_profile_report(FILE *output, sl_avr_emu_emulation_s *emulation, uint32_t top_n)
+{
+  sl_avr_emu_profile_s       *profile = emulation->hooks.profile;
+  const sl_avr_emu_symbols_s *symbols = emulation->hooks.symbols;
+  sl_avr_emu_profile_entry_s *addresses;
+  sl_avr_emu_profile_entry_s *functions = NULL;
+  uint32_t                    address_count = 0;
+  uint32_t                    function_count;
+  uint64_t                    total_instructions = 0;
+  uint64_t                    total_cycles = 0;
+  const sl_avr_emu_symbol_s  *symbol;
+  uint32_t                    offset;
+  uint32_t                    hot_spots[SL_AVR_EMU_PROFILE_ANNOTATE_MAX];
+  uint32_t                    hot_spot_count;
+  uint32_t                    i, j;
+  sl_avr_emu_extended_address_t pc, start, end;
+  char                        instruction[SL_AVR_EMU_DISASM_BUFFER_SIZE];
+
+  if(NULL == profile)
+  {
+    return;
+  }
+
+  /* Account the instruction in progress */
+  if(emulation->tick_count >= profile->last_tick)
+  {
+    profile->cycles[profile->last_pc] += emulation->tick_count - profile->last_tick + 1;
+    profile->last_tick = emulation->tick_count + 1;
+  }
+
+  addresses = malloc(SL_AVR_EMU_FLASH_SIZE * sizeof(sl_avr_emu_profile_entry_s));
+  if(symbols != NULL && symbols->count > 0)
+  {
+    /* Last entry collects code outside any symbol */
+    functions = calloc(symbols->count + 1, sizeof(sl_avr_emu_profile_entry_s));
+  }
+  if(NULL == addresses)
+  {
+    free(functions);
+    return;
+  }
+
+  for(pc = 0; pc < SL_AVR_EMU_FLASH_SIZE; pc++)
+  {
+    if(profile->instructions[pc] > 0 || profile->cycles[pc] > 0)
+    {
+      addresses[address_count].index        = pc;
+      addresses[address_count].instructions = profile->instructions[pc];
+      addresses[address_count].cycles       = profile->cycles[pc];
+      address_count++;
+      total_instructions += profile->instructions[pc];
+      total_cycles       += profile->cycles[pc];
+
+      if(functions != NULL)
+      {
+        symbol = sl_avr_emu_symbol_lookup(symbols, pc*2, NULL);
+        i      = (symbol != NULL)?(symbol - symbols->symbols):symbols->count;
+        functions[i].index         = i;
+        functions[i].instructions += profile->instructions[pc];
+        functions[i].cycles       += profile->cycles[pc];
+      }
+    }
+  }
+  qsort(addresses, address_count, sizeof(sl_avr_emu_profile_entry_s), sl_avr_emu_profile_compare);
+
+  fprintf(output, "\nProfile: %lu instructions, %lu cycles\n", total_instructions, total_cycles);
+
+  if(functions != NULL)
+  {
+    function_count = symbols->count + 1;
+    qsort(functions, function_count, sizeof(sl_avr_emu_profile_entry_s), sl_avr_emu_profile_compare);
+
+    fprintf(output, "\nFlat profile by function:\n");
+    fprintf(output, "  %12s %7s %12s  %s\n", "cycles", "%", "instructions", "function");
+    for(i = 0; i < top_n && i < function_count && functions[i].cycles > 0; i++)
+    {
+      fprintf(output, "  %12lu %6.2f%% %12lu  %s\n", functions[i].cycles, 100.0*functions[i].cycles/total_cycles, functions[i].instructions,
+              (functions[i].index < symbols->count)?symbols->symbols[functions[i].index].name:"??");
+    }
+  }
+
+  fprintf(output, "\nFlat profile by address:\n");
+  fprintf(output, "  %12s %7s %12s  %6s   %s\n", "cycles", "%", "instructions", "addr", "instruction");
+  for(i = 0; i < top_n && i < address_count; i++)
+  {
+    pc = addresses[i].index;
+    sl_avr_emu_disassemble(emulation->memory.flash, pc, instruction, sizeof(instruction));
+    symbol = sl_avr_emu_symbol_lookup(symbols, pc*2, &offset);
+    fprintf(output, "  %12lu %6.2f%% %12lu  %6x:  ", addresses[i].cycles, (total_cycles > 0)?100.0*addresses[i].cycles/total_cycles:0.0,
+            addresses[i].instructions, pc*2);
+    if(symbol != NULL)
+    {
+      fprintf(output, "%-24s <%s+0x%x>\n", instruction, symbol->name, offset);
+    }
+    else
+    {
+      fprintf(output, "%s\n", instruction);
+    }
+  }
+
+  fprintf(output, "\nAnnotated disassembly:\n");
+  if(functions != NULL)
+  {
+    for(i = 0; i < SL_AVR_EMU_PROFILE_ANNOTATE_MAX && i < top_n && i < function_count && functions[i].cycles > 0; i++)
+    {
+      if(functions[i].index < symbols->count)
+      {
+        symbol = &symbols->symbols[functions[i].index];
+        start  = symbol->address/2;
+        end    = (symbol->size > 0)?(symbol->address + symbol->size + 1)/2:start + SL_AVR_EMU_PROFILE_WINDOW_WORDS;
+        fprintf(output, "\n<%s>:\n", symbol->name);
+        sl_avr_emu_profile_annotate(output, emulation, start, end, total_cycles);
+      }
+    }
+  }
+  else
+  {
+    /* Windows around the hottest addresses, in address order with overlapping windows merged */
+    for(i = 0; i < SL_AVR_EMU_PROFILE_ANNOTATE_MAX && i < top_n && i < address_count; i++)
+    {
+      hot_spots[i] = addresses[i].index;
+    }
+    hot_spot_count = i;
+    qsort(hot_spots, hot_spot_count, sizeof(uint32_t), sl_avr_emu_profile_compare_pc);
+    for(i = 0; i < hot_spot_count; i = j)
+    {
+      start = (hot_spots[i] > SL_AVR_EMU_PROFILE_WINDOW_WORDS/2)?hot_spots[i] - SL_AVR_EMU_PROFILE_WINDOW_WORDS/2:0;
+      end   = hot_spots[i] + SL_AVR_EMU_PROFILE_WINDOW_WORDS/2;
+      for(j = i + 1; j < hot_spot_count && hot_spots[j] <= (end + SL_AVR_EMU_PROFILE_WINDOW_WORDS/2); j++)
+      {
+        end = hot_spots[j] + SL_AVR_EMU_PROFILE_WINDOW_WORDS/2;
+      }
+      fprintf(output, "\n<0x%x>:\n", start*2);
+      sl_avr_emu_profile_annotate(output, emulation, start, end, total_cycles);
+    }
+  }
+
+  free(addresses);
+  free(functions);
+}
+
+/**
+ * @brief Detaches and frees emulation's profile
+ * 
+ * @param emulation 
+ */
+void sl_avr_emu_profile_stop(sl_avr_emu_emulation_s *emulation)
+{
+  free(emulation->hooks.profile);
+  emulation->hooks.profile = NULL;
+}
@@ -0,0 +1,463 @@
+/**
+ * @file sl_avr_emu_replay.c
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator External Stimulus Record/Replay Logic
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ * Log format: 8 byte header (SL_AVR_EMU_REPLAY_MAGIC) followed by records of
+ *   varint tick delta, type byte, varint address, value byte
+ */
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "sl_avr_emu.h"
+#include "sl_avr_emu_event.h"
+#include "sl_avr_emu_replay.h"
+#include "sl_avr_emu_reverse.h"
+#include "sl_avr_emu_timer.h"
+#include "sl_avr_emu_trace.h"
+
+#define SL_AVR_EMU_REPLAY_MAGIC      "SLAVRRP\x01"
+#define SL_AVR_EMU_REPLAY_MAGIC_SIZE 8
+
+/**
+ * @brief Stimuli are carried to their application event packed into the event context
+ * 
+ */
+#define SL_AVR_EMU_STIMULUS_PACK(type, address, value) \
+  ((void *)(uintptr_t)(((uint32_t)(type) << 24) | ((uint32_t)(address) << 8) | (value)))
+#define SL_AVR_EMU_STIMULUS_TYPE(context)    ((sl_avr_emu_stimulus_type_e)(((uintptr_t)(context) >> 24) & 0xFF))
+#define SL_AVR_EMU_STIMULUS_ADDRESS(context) ((sl_avr_emu_address_t)(((uintptr_t)(context) >> 8) & 0xFFFF))
+#define SL_AVR_EMU_STIMULUS_VALUE(context)   ((sl_avr_emu_byte_t)((uintptr_t)(context) & 0xFF))
+
+/**
+ * @brief Applies a stimulus to emulation state
+ * 
+ * @param emulation 
+ * @param type 
+ * @param address 
+ * @param value 
+ * @return sl_avr_emu_result_e 
+ */
+static sl_avr_emu_result_e sl_avr_emu_stimulus_apply(sl_avr_emu_emulation_s *emulation, sl_avr_emu_stimulus_type_e type, sl_avr_emu_address_t address, sl_avr_emu_byte_t value)
+{
+  sl_avr_emu_result_e result = SL_AVR_EMU_RESULT_SUCCESS;
+
+  SL_AVR_EMU_VERBOSE_LOG(printf("tick %lu: stimulus type %u, address 0x%04x, value 0x%02x\n", emulation->tick_count, type, address, value));
+
+  switch(type)
+  {
+    case SL_AVR_EMU_STIMULUS_IO_WRITE:
+    {
+      emulation->memory.data[address] = value;
+      sl_avr_emu_trace_data(emulation, address);
+      break;
+    }
+    case SL_AVR_EMU_STIMULUS_IO_SET_BITS:
+    {
+      emulation->memory.data[address] |= value;
+      sl_avr_emu_trace_data(emulation, address);
+      break;
+    }
+    case SL_AVR_EMU_STIMULUS_IO_CLEAR_BITS:
+    {
+      emulation->memory.data[address] &= ~value;
+      sl_avr_emu_trace_data(emulation, address);
+      break;
+    }
+    case SL_AVR_EMU_STIMULUS_SERIAL_RX:
+    {
+      if(emulation->hooks.serial_rx_handler != NULL)
+      {
+        result = emulation->hooks.serial_rx_handler(emulation, address, value, emulation->hooks.serial_rx_context);
+      }
+      else
+      {
+        SL_AVR_EMU_VERBOSE_LOG(printf("No serial port to receive 0x%02x\n", value));
+      }
+      break;
+    }
+    case SL_AVR_EMU_STIMULUS_TIMER_CAPTURE:
+    {
+      result = sl_avr_emu_timer_capture(emulation);
+      break;
+    }
+    default:
+    {
+      fprintf(stderr, "Unrecognized stimulus type %u\n", type);
+      result = SL_AVR_EMU_RESULT_INVALID_FILE_FORMAT;
+      break;
+    }
+  }
+
+  return result;
+}
+
+/**
+ * @brief Writes an unsigned LEB128 varint
+ * 
+ * @param file 
+ * @param value 
+ */
+static void sl_avr_emu_replay_write_varint(FILE *file, uint64_t value)
+{
+  while(value >= 0x80)
+  {
+    fputc((value & 0x7F) | 0x80, file);
+    value >>= 7;
+  }
+  fputc(value, file);
+}
+
+/**
+ * @brief Reads an unsigned LEB128 varint from the playback log
+ * 
+ * @param replay 
+ * @param value 
+ * @return true if a complete varint was read
+ */
+static bool sl_avr_emu_replay_read_varint(sl_avr_emu_replay_s *replay, uint64_t *value)
+{
+  uint32_t shift = 0;
+  uint8_t  byte;
+
+  *value = 0;
+  do
+  {
+    if(replay->log_offset >= replay->log_size || shift > 63)
+    {
+      return false;
+    }
+    byte = replay->log[replay->log_offset++];
+    *value |= ((uint64_t)(byte & 0x7F)) << shift;
+    shift += 7;
+  } while(byte & 0x80);
+
+  return true;
+}
+
+/**
+ * @brief Event applying a live stimulus, recording it if recording
+ * 
+ * @param emulation 
+ * @param context - Packed stimulus
+ * @return sl_avr_emu_result_e 
+ */
+static sl_avr_emu_result_e sl_avr_emu_stimulus_event(sl_avr_emu_emulation_s *emulation, void *context)
+{
+  sl_avr_emu_replay_s *replay = emulation->hooks.replay;
+
+  if(replay != NULL && SL_AVR_EMU_REPLAY_MODE_RECORD == replay->mode)
+  {
+    sl_avr_emu_replay_write_varint(replay->file, emulation->tick_count - replay->last_tick);
+    fputc(SL_AVR_EMU_STIMULUS_TYPE(context), replay->file);
+    sl_avr_emu_replay_write_varint(replay->file, SL_AVR_EMU_STIMULUS_ADDRESS(context));
+    fputc(SL_AVR_EMU_STIMULUS_VALUE(context), replay->file);
+    replay->last_tick = emulation->tick_count;
+    replay->stimulus_count++;
+  }
+
+  return sl_avr_emu_stimulus_apply(emulation, SL_AVR_EMU_STIMULUS_TYPE(context), SL_AVR_EMU_STIMULUS_ADDRESS(context), SL_AVR_EMU_STIMULUS_VALUE(context));
+}
+
+/**
+ * @brief Playback event, applies all logged stimuli due this tick and schedules the next
+ * 
+ * @param emulation 
+ * @param context - Replay state
+ * @return sl_avr_emu_result_e 
+ */
+static sl_avr_emu_result_e sl_avr_emu_replay_playback_event(sl_avr_emu_emulation_s *emulation, void *context)
+{
+  sl_avr_emu_result_e  result = SL_AVR_EMU_RESULT_SUCCESS;
+  sl_avr_emu_replay_s *replay = context;
+  uint64_t             delta, address;
+  size_t               record_offset;
+  uint8_t              type, value;
+
+  while(SL_AVR_EMU_RESULT_SUCCESS == result && replay->log_offset < replay->log_size)
+  {
+    record_offset = replay->log_offset;
+    if(!sl_avr_emu_replay_read_varint(replay, &delta) ||
+       replay->log_offset >= replay->log_size)
+    {
+      result = SL_AVR_EMU_RESULT_INVALID_FILE_FORMAT;
+      break;
+    }
+    if((replay->last_tick + delta) > emulation->tick_count)
+    {
+      /* Not due yet, rewind and wait for its tick */
+      replay->log_offset = record_offset;
+      result = sl_avr_emu_event_schedule(emulation, replay->last_tick + delta, sl_avr_emu_replay_playback_event, replay);
+      break;
+    }
+    type = replay->log[replay->log_offset++];
+    if(!sl_avr_emu_replay_read_varint(replay, &address) ||
+       replay->log_offset >= replay->log_size ||
+       !SL_AVR_EMU_DATA_ADDRESS_VALID(address))
+    {
+      result = SL_AVR_EMU_RESULT_INVALID_FILE_FORMAT;
+      break;
+    }
+    value = replay->log[replay->log_offset++];
+
+    replay->last_tick += delta;
+    replay->stimulus_count++;
+    result = sl_avr_emu_stimulus_apply(emulation, type, address, value);
+  }
+
+  if(SL_AVR_EMU_RESULT_INVALID_FILE_FORMAT == result)
+  {
+    fprintf(stderr, "Malformed stimulus log at offset %lu\n", replay->log_offset);
+  }
+
+  return result;
+}
+
+/**
+ * @brief Injects an external stimulus.  It is applied at the start of the next tick and recorded if recording.
+ *        Live stimuli are dropped during playback, the log is the only input source, and while reverse execution re-executes.
+ * 
+ * @param emulation 
+ * @param type 
+ * @param address - Data address, or serial port number for SL_AVR_EMU_STIMULUS_SERIAL_RX
+ * @param value 
+ * @return sl_avr_emu_result_e 
+ */
+sl_avr_emu_result_e sl_avr_emu_stimulus_inject(sl_avr_emu_emulation_s *emulation, sl_avr_emu_stimulus_type_e type, sl_avr_emu_address_t address, sl_avr_emu_byte_t value)
+{
+  sl_avr_emu_result_e   result   = SL_AVR_EMU_RESULT_SUCCESS;
+  sl_avr_emu_stimulus_s stimulus = { emulation->tick_count + 1, type, address, value };
+
+  if(type >= SL_AVR_EMU_STIMULUS_TYPE_COUNT)
+  {
+    result = SL_AVR_EMU_RESULT_FAILURE;
+  }
+  else if(emulation->hooks.replay != NULL && SL_AVR_EMU_REPLAY_MODE_PLAYBACK == emulation->hooks.replay->mode)
+  {
+    SL_AVR_EMU_VERBOSE_LOG(printf("Live stimulus dropped during playback\n"));
+  }
+  else if(emulation->hooks.reverse != NULL && emulation->hooks.reverse->reexecuting)
+  {
+    SL_AVR_EMU_VERBOSE_LOG(printf("Live stimulus dropped during re-execution\n"));
+  }
+  else
+  {
+    if(emulation->hooks.reverse != NULL)
+    {
+      result = sl_avr_emu_reverse_stimulus(emulation->hooks.reverse, &stimulus);
+    }
+    if(SL_AVR_EMU_RESULT_SUCCESS == result)
+    {
+      result = sl_avr_emu_event_schedule(emulation, stimulus.tick, sl_avr_emu_stimulus_event, 
+                                         SL_AVR_EMU_STIMULUS_PACK(type, address, value));
+    }
+  }
+
+  return result;
+}
+
+/**
+ * @brief Schedules live stimuli again after a snapshot restore, replacing copies the restored event queue already holds
+ * 
+ * @param emulation 
+ * @param stimuli   - Stimuli applied after the snapshot was taken
+ * @param count 
+ * @return sl_avr_emu_result_e 
+ */
+sl_avr_emu_result_e sl_avr_emu_stimulus_reinject(sl_avr_emu_emulation_s *emulation, const sl_avr_emu_stimulus_s *stimuli, uint32_t count)
+{
+  sl_avr_emu_result_e result = SL_AVR_EMU_RESULT_SUCCESS;
+  uint32_t            i;
+
+  /* Stimuli injected before the snapshot but applied after it are in its event queue.  All copies are cancelled 
+     before any is scheduled, so identical stimuli are each scheduled once. */
+  for(i = 0; i < count; i++)
+  {
+    sl_avr_emu_event_cancel(emulation, sl_avr_emu_stimulus_event, SL_AVR_EMU_STIMULUS_PACK(stimuli[i].type, stimuli[i].address, stimuli[i].value));
+  }
+  for(i = 0; i < count && SL_AVR_EMU_RESULT_SUCCESS == result; i++)
+  {
+    result = sl_avr_emu_event_schedule(emulation, stimuli[i].tick, sl_avr_emu_stimulus_event, 
+                                       SL_AVR_EMU_STIMULUS_PACK(stimuli[i].type, stimuli[i].address, stimuli[i].value));
+  }
+
+  return result;
+}
+
+/**
+ * @brief Starts recording applied stimuli to a binary log
+ * 
+ * @param emulation 
+ * @param replay 
+ * @param file_path 
+ * @return sl_avr_emu_result_e 
+ */
+sl_avr_emu_result_e sl_avr_emu_replay_record_start(sl_avr_emu_emulation_s *emulation, sl_avr_emu_replay_s *replay, const char *file_path)
+{
+  sl_avr_emu_result_e result = SL_AVR_EMU_RESULT_SUCCESS;
+
+  if(emulation != NULL && replay != NULL && file_path != NULL && NULL == emulation->hooks.replay)
+  {
+    memset(replay, 0, sizeof(sl_avr_emu_replay_s));
+    replay->mode       = SL_AVR_EMU_REPLAY_MODE_RECORD;
+    replay->start_tick = emulation->tick_count;
+    replay->last_tick  = emulation->tick_count;
+    replay->file      = fopen(file_path, "wb");
+    if(replay->file != NULL)
+    {
+      /* Large buffer so recording rarely reaches the kernel */
+      setvbuf(replay->file, NULL, _IOFBF, 1 << 20);
+      fwrite(SL_AVR_EMU_REPLAY_MAGIC, 1, SL_AVR_EMU_REPLAY_MAGIC_SIZE, replay->file);
+      emulation->hooks.replay = replay;
+      printf("Recording stimulus to %s\n", file_path);
+    }
+    else
+    {
+      result = SL_AVR_EMU_RESULT_INVALID_FILE_PATH;
+    }
+  }
+  else
+  {
+    result = SL_AVR_EMU_RESULT_FAILURE;
+  }
+
+  return result;
+}
+
+/**
+ * @brief Starts playing back a binary stimulus log at the recorded ticks
+ * 
+ * @param emulation 
+ * @param replay 
+ * @param file_path 
+ * @return sl_avr_emu_result_e 
+ */
+sl_avr_emu_result_e sl_avr_emu_replay_playback_start(sl_avr_emu_emulation_s *emulation, sl_avr_emu_replay_s *replay, const char *file_path)
+{
+  sl_avr_emu_result_e result = SL_AVR_EMU_RESULT_SUCCESS;
+  int                 fd;
+  struct stat         file_stat;
+  void               *log;
+
+  if(emulation != NULL && replay != NULL && file_path != NULL && NULL == emulation->hooks.replay)
+  {
+    memset(replay, 0, sizeof(sl_avr_emu_replay_s));
+    replay->mode       = SL_AVR_EMU_REPLAY_MODE_PLAYBACK;
+    replay->start_tick = emulation->tick_count;
+    replay->last_tick  = emulation->tick_count;
+
+    fd = open(file_path, O_RDONLY);
+    if(fd >= 0 && 0 == fstat(fd, &file_stat) && file_stat.st_size >= SL_AVR_EMU_REPLAY_MAGIC_SIZE)
+    {
+      log = mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if(log != MAP_FAILED)
+      {
+        replay->log        = log;
+        replay->log_size   = file_stat.st_size;
+        replay->log_offset = SL_AVR_EMU_REPLAY_MAGIC_SIZE;
+        madvise(log, file_stat.st_size, MADV_SEQUENTIAL);
+        if(0 == memcmp(replay->log, SL_AVR_EMU_REPLAY_MAGIC, SL_AVR_EMU_REPLAY_MAGIC_SIZE))
+        {
+          emulation->hooks.replay = replay;
+          printf("Replaying stimulus from %s\n", file_path);
+          result = sl_avr_emu_event_schedule(emulation, emulation->tick_count + 1, sl_avr_emu_replay_playback_event, replay);
+        }
+        else
+        {
+          munmap(log, file_stat.st_size);
+          replay->log = NULL;
+          result = SL_AVR_EMU_RESULT_INVALID_FILE_FORMAT;
+        }
+      }
+      else
+      {
+        result = SL_AVR_EMU_RESULT_FAILURE;
+      }
+    }
+    else
+    {
+      result = SL_AVR_EMU_RESULT_INVALID_FILE_PATH;
+    }
+    if(fd >= 0)
+    {
+      close(fd);
+    }
+  }
+  else
+  {
+    result = SL_AVR_EMU_RESULT_FAILURE;
+  }
+
+  return result;
+}
+
+/**
+ * @brief Rewinds playback to the start of the log, for a restored snapshot taken before playback started
+ * 
+ * @param emulation 
+ * @param replay 
+ * @return sl_avr_emu_result_e 
+ */
+sl_avr_emu_result_e sl_avr_emu_replay_rewind(sl_avr_emu_emulation_s *emulation, sl_avr_emu_replay_s *replay)
+{
+  sl_avr_emu_result_e result = SL_AVR_EMU_RESULT_FAILURE;
+
+  if(emulation != NULL && replay != NULL && SL_AVR_EMU_REPLAY_MODE_PLAYBACK == replay->mode)
+  {
+    replay->log_offset     = SL_AVR_EMU_REPLAY_MAGIC_SIZE;
+    replay->last_tick      = replay->start_tick;
+    replay->stimulus_count = 0;
+    sl_avr_emu_event_cancel(emulation, sl_avr_emu_replay_playback_event, replay);
+    result = sl_avr_emu_event_schedule(emulation, replay->start_tick + 1, sl_avr_emu_replay_playback_event, replay);
+  }
+
+  return result;
+}
+
+/**
+ * @brief Stops recording or playback, flushing and closing the log
+ * 
+ * @param emulation 
+ * @param replay 
+ * @return sl_avr_emu_result_e 
+ */
+sl_avr_emu_result_e sl_avr_emu_replay_stop(sl_avr_emu_emulation_s *emulation, sl_avr_emu_replay_s *replay)
+{
+  sl_avr_emu_result_e result = SL_AVR_EMU_RESULT_SUCCESS;
+
+  if(emulation != NULL && replay != NULL && emulation->hooks.replay == replay)
+  {
+    if(SL_AVR_EMU_REPLAY_MODE_RECORD == replay->mode)
+    {
+      if(fclose(replay->file) != 0)
+      {
+        result = SL_AVR_EMU_RESULT_FAILURE;
+      }
+      replay->file = NULL;
+    }
+    else
+    {
+      sl_avr_emu_event_cancel(emulation, sl_avr_emu_replay_playback_event, replay);
+      munmap((void *) replay->log, replay->log_size);
+      replay->log = NULL;
+    }
+    printf("%lu stimuli %s\n", replay->stimulus_count, (SL_AVR_EMU_REPLAY_MODE_RECORD == replay->mode)?"recorded":"replayed");
+    emulation->hooks.replay = NULL;
+  }
+  else
+  {
+    result = SL_AVR_EMU_RESULT_FAILURE;
+  }
+
+  return result;
+}
@@ -0,0 +1,432 @@
+/**
+ * @file sl_avr_emu_reverse.c
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator Reverse Execution Logic
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ * Reverse execution restores the nearest earlier checkpoint and re-executes forward, 
+ * so its cost is bounded by the checkpoint interval rather than the run length.
+ * When the checkpoint budget is exhausted every other checkpoint is dropped and the interval doubles.
+ * Live stimuli are not part of a checkpoint, so they are kept separately and scheduled again whenever 
+ * a checkpoint taken before them is restored.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sl_avr_emu.h"
+#include "sl_avr_emu_replay.h"
+#include "sl_avr_emu_reverse.h"
+#include "sl_avr_emu_tick.h"
+
+/**
+ * @brief True between instructions, i.e. the next tick decodes a new instruction
+ * 
+ */
+#define SL_AVR_EMU_REVERSE_AT_BOUNDARY(emulation) (0 == (emulation)->op_cycles_remaining)
+
+/**
+ * @brief Halves checkpoint density, keeping even indexed checkpoints, and doubles the interval
+ * 
+ * @param reverse 
+ */
+static void sl_avr_emu_reverse_thin(sl_avr_emu_reverse_s *reverse)
+{
+  uint32_t i;
+  uint32_t kept = 0;
+
+  for(i = 0; i < reverse->checkpoint_count; i++)
+  {
+    if(0 == (i % 2))
+    {
+      reverse->checkpoints[kept++] = reverse->checkpoints[i];
+    }
+    else
+    {
+      sl_avr_emu_snapshot_free(&reverse->checkpoints[i].snapshot);
+    }
+  }
+  memset(&reverse->checkpoints[kept], 0, (reverse->checkpoint_count - kept) * sizeof(sl_avr_emu_checkpoint_s));
+  reverse->checkpoint_count = kept;
+  reverse->interval *= 2;
+
+  SL_AVR_EMU_VERBOSE_LOG(printf("Checkpoint budget reached, interval now %lu ticks\n", reverse->interval));
+}
+
+/**
+ * @brief Drops checkpoints taken after tick
+ * 
+ * @param reverse 
+ * @param tick 
+ */
+static void sl_avr_emu_reverse_truncate(sl_avr_emu_reverse_s *reverse, sl_avr_emu_tick_count_t tick)
+{
+  while(reverse->checkpoint_count > 1 && reverse->checkpoints[reverse->checkpoint_count-1].tick > tick)
+  {
+    reverse->checkpoint_count--;
+    sl_avr_emu_snapshot_free(&reverse->checkpoints[reverse->checkpoint_count].snapshot);
+  }
+  reverse->next_checkpoint_tick = reverse->checkpoints[reverse->checkpoint_count-1].tick + reverse->interval;
+}
+
+/**
+ * @brief Takes a checkpoint at the current tick
+ * 
+ * @param reverse 
+ * @return sl_avr_emu_result_e 
+ */
+static sl_avr_emu_result_e sl_avr_emu_reverse_checkpoint(sl_avr_emu_reverse_s *reverse)
+{
+  sl_avr_emu_result_e      result;
+  sl_avr_emu_checkpoint_s *checkpoint;
+  sl_avr_emu_replay_s     *replay = reverse->emulation->hooks.replay;
+
+  if(reverse->checkpoint_count >= reverse->checkpoint_capacity)
+  {
+    sl_avr_emu_reverse_thin(reverse);
+  }
+
+  checkpoint = &reverse->checkpoints[reverse->checkpoint_count];
+  result = sl_avr_emu_snapshot_take(reverse->emulation, &checkpoint->snapshot);
+  if(SL_AVR_EMU_RESULT_SUCCESS == result)
+  {
+    checkpoint->tick         = reverse->emulation->tick_count;
+    checkpoint->replay_saved = (replay != NULL && SL_AVR_EMU_REPLAY_MODE_PLAYBACK == replay->mode);
+    if(checkpoint->replay_saved)
+    {
+      checkpoint->replay_offset         = replay->log_offset;
+      checkpoint->replay_last_tick      = replay->last_tick;
+      checkpoint->replay_stimulus_count = replay->stimulus_count;
+    }
+    reverse->checkpoint_count++;
+  }
+  reverse->next_checkpoint_tick = reverse->emulation->tick_count + reverse->interval;
+
+  return result;
+}
+
+/**
+ * @brief Restores the checkpoint at index, rewinding stimulus playback and scheduling the live stimuli applied after it
+ * 
+ * @param reverse 
+ * @param index 
+ * @return sl_avr_emu_result_e 
+ */
+static sl_avr_emu_result_e sl_avr_emu_reverse_restore(sl_avr_emu_reverse_s *reverse, uint32_t index)
+{
+  sl_avr_emu_result_e      result;
+  sl_avr_emu_checkpoint_s *checkpoint = &reverse->checkpoints[index];
+  sl_avr_emu_replay_s     *replay     = reverse->emulation->hooks.replay;
+  uint32_t                 first      = reverse->stimulus_count;
+
+  result = sl_avr_emu_snapshot_restore(reverse->emulation, &checkpoint->snapshot);
+  if(SL_AVR_EMU_RESULT_SUCCESS == result && replay != NULL && SL_AVR_EMU_REPLAY_MODE_PLAYBACK == replay->mode)
+  {
+    if(checkpoint->replay_saved)
+    {
+      /* The restored event queue holds the playback event due for the record at this position */
+      replay->log_offset     = checkpoint->replay_offset;
+      replay->last_tick      = checkpoint->replay_last_tick;
+      replay->stimulus_count = checkpoint->replay_stimulus_count;
+    }
+    else
+    {
+      /* Taken before playback started */
+      result = sl_avr_emu_replay_rewind(reverse->emulation, replay);
+    }
+  }
+
+  while(first > 0 && reverse->stimuli[first-1].tick > checkpoint->tick)
+  {
+    first--;
+  }
+  if(SL_AVR_EMU_RESULT_SUCCESS == result && first < reverse->stimulus_count)
+  {
+    result = sl_avr_emu_stimulus_reinject(reverse->emulation, &reverse->stimuli[first], reverse->stimulus_count - first);
+  }
+
+  return result;
+}
+
+/**
+ * @brief Re-executes from checkpoint index up to (not including) end_tick, 
+ *        finding the last instruction boundary where stop is true (any boundary if stop is NULL)
+ * 
+ * @param reverse 
+ * @param index 
+ * @param end_tick 
+ * @param stop 
+ * @param context 
+ * @param found_tick - Set to the boundary found
+ * @return true if a boundary was found
+ */
+static bool sl_avr_emu_reverse_search(sl_avr_emu_reverse_s *reverse, uint32_t index, sl_avr_emu_tick_count_t end_tick, 
+                                      sl_avr_emu_reverse_stop_f stop, void *context, sl_avr_emu_tick_count_t *found_tick)
+{
+  sl_avr_emu_result_e     result;
+  sl_avr_emu_emulation_s *emulation = reverse->emulation;
+  bool                    found     = false;
+
+  result = sl_avr_emu_reverse_restore(reverse, index);
+  while(SL_AVR_EMU_RESULT_SUCCESS == result && emulation->tick_count < end_tick)
+  {
+    if(SL_AVR_EMU_REVERSE_AT_BOUNDARY(emulation) && (NULL == stop || stop(emulation, context)))
+    {
+      found       = true;
+      *found_tick = emulation->tick_count;
+    }
+    if((emulation->tick_count + 1) >= end_tick)
+    {
+      break;
+    }
+    result = sl_avr_emu_run(emulation, emulation->tick_count + 1);
+  }
+
+  return found;
+}
+
+/**
+ * @brief Searches checkpoint segments backwards from the current tick and moves to the boundary found
+ * 
+ * @param reverse 
+ * @param stop 
+ * @param context 
+ * @param found 
+ * @return sl_avr_emu_result_e 
+ */
+static sl_avr_emu_result_e sl_avr_emu_reverse_seek(sl_avr_emu_reverse_s *reverse, sl_avr_emu_reverse_stop_f stop, void *context, bool *found)
+{
+  sl_avr_emu_result_e     result     = SL_AVR_EMU_RESULT_SUCCESS;
+  sl_avr_emu_emulation_s *emulation  = reverse->emulation;
+  sl_avr_emu_tick_count_t end_tick   = emulation->tick_count;
+  sl_avr_emu_tick_count_t found_tick = 0;
+  sl_avr_emu_replay_s    *recording  = NULL;
+  uint32_t                index      = reverse->checkpoint_count;
+
+  *found = false;
+  reverse->reexecuting = true;
+
+  /* Stimuli re-applied while re-executing must not be recorded twice */
+  if(emulation->hooks.replay != NULL && SL_AVR_EMU_REPLAY_MODE_RECORD == emulation->hooks.replay->mode)
+  {
+    recording = emulation->hooks.replay;
+    emulation->hooks.replay = NULL;
+  }
+
+  while(index > 0 && reverse->checkpoints[index-1].tick >= end_tick)
+  {
+    index--;
+  }
+
+  while(index > 0 && !(*found))
+  {
+    index--;
+    *found   = sl_avr_emu_reverse_search(reverse, index, end_tick, stop, context, &found_tick);
+    end_tick = reverse->checkpoints[index].tick;
+  }
+
+  if(*found)
+  {
+    result = sl_avr_emu_reverse_restore(reverse, index);
+    if(SL_AVR_EMU_RESULT_SUCCESS == result)
+    {
+      result = sl_avr_emu_run(emulation, found_tick);
+    }
+  }
+  else if(end_tick < emulation->tick_count)
+  {
+    /* Nothing found, stay at the earliest checkpoint searched */
+    result = sl_avr_emu_reverse_restore(reverse, 0);
+  }
+
+  sl_avr_emu_reverse_truncate(reverse, emulation->tick_count);
+  emulation->hooks.replay = (recording != NULL)?recording:emulation->hooks.replay;
+  reverse->reexecuting = false;
+
+  return result;
+}
+
+/**
+ * @brief Initializes reverse execution, taking the first checkpoint at the current tick, and attaches it to emulation
+ * 
+ * @param reverse 
+ * @param emulation 
+ * @param memory_budget - Bytes available for checkpoints
+ * @param interval      - Initial ticks between checkpoints
+ * @return sl_avr_emu_result_e 
+ */
+sl_avr_emu_result_e sl_avr_emu_reverse_init(sl_avr_emu_reverse_s *reverse, sl_avr_emu_emulation_s *emulation, size_t memory_budget, sl_avr_emu_tick_count_t interval)
+{
+  sl_avr_emu_result_e result = SL_AVR_EMU_RESULT_SUCCESS;
+
+  if(reverse != NULL && emulation != NULL && interval > 0)
+  {
+    memset(reverse, 0, sizeof(sl_avr_emu_reverse_s));
+    reverse->emulation           = emulation;
+    reverse->interval            = interval;
+    reverse->checkpoint_capacity = memory_budget / (sl_avr_emu_snapshot_size() + sizeof(sl_avr_emu_checkpoint_s));
+
+    if(reverse->checkpoint_capacity >= 2)
+    {
+      reverse->checkpoints = calloc(reverse->checkpoint_capacity, sizeof(sl_avr_emu_checkpoint_s));
+    }
+
+    if(reverse->checkpoints != NULL)
+    {
+      result = sl_avr_emu_reverse_checkpoint(reverse);
+      if(SL_AVR_EMU_RESULT_SUCCESS == result)
+      {
+        emulation->hooks.reverse = reverse;
+      }
+    }
+    else
+    {
+      fprintf(stderr, "Checkpoint budget of %lu bytes is too small\n", memory_budget);
+      result = SL_AVR_EMU_RESULT_FAILURE;
+    }
+  }
+  else
+  {
+    result = SL_AVR_EMU_RESULT_FAILURE;
+  }
+
+  return result;
+}
+
+/**
+ * @brief Keeps a live stimulus so re-execution from earlier checkpoints applies it too.  Called when a stimulus is injected.
+ * 
+ * @param reverse 
+ * @param stimulus 
+ * @return sl_avr_emu_result_e 
+ */
+sl_avr_emu_result_e sl_avr_emu_reverse_stimulus(sl_avr_emu_reverse_s *reverse, const sl_avr_emu_stimulus_s *stimulus)
+{
+  sl_avr_emu_stimulus_s *stimuli;
+  uint32_t               capacity;
+  uint32_t               i;
+
+  if(reverse->stimulus_count >= reverse->stimulus_capacity)
+  {
+    capacity = (0 == reverse->stimulus_capacity)?64:(reverse->stimulus_capacity * 2);
+    stimuli  = realloc(reverse->stimuli, capacity * sizeof(sl_avr_emu_stimulus_s));
+    if(NULL == stimuli)
+    {
+      return SL_AVR_EMU_RESULT_FAILURE;
+    }
+    reverse->stimuli           = stimuli;
+    reverse->stimulus_capacity = capacity;
+  }
+
+  /* Stimuli kept from a later point of a timeline that was reversed are still due, so new ones are inserted in tick order */
+  i = reverse->stimulus_count;
+  while(i > 0 && reverse->stimuli[i-1].tick > stimulus->tick)
+  {
+    reverse->stimuli[i] = reverse->stimuli[i-1];
+    i--;
+  }
+  reverse->stimuli[i] = *stimulus;
+  reverse->stimulus_count++;
+
+  return SL_AVR_EMU_RESULT_SUCCESS;
+}
+
+/**
+ * @brief Runs forward until an error or tick_limit, taking periodic checkpoints
+ * 
+ * @param reverse 
+ * @param tick_limit 
+ * @return sl_avr_emu_result_e 
+ */
+sl_avr_emu_result_e sl_avr_emu_reverse_run(sl_avr_emu_reverse_s *reverse, sl_avr_emu_tick_count_t tick_limit)
+{
+  sl_avr_emu_result_e     result    = SL_AVR_EMU_RESULT_SUCCESS;
+  sl_avr_emu_emulation_s *emulation = reverse->emulation;
+
+  while(SL_AVR_EMU_RESULT_SUCCESS == result && emulation->tick_count < tick_limit)
+  {
+    result = sl_avr_emu_run(emulation, (reverse->next_checkpoint_tick < tick_limit)?reverse->next_checkpoint_tick:tick_limit);
+    if(SL_AVR_EMU_RESULT_SUCCESS == result && emulation->tick_count >= reverse->next_checkpoint_tick)
+    {
+      result = sl_avr_emu_reverse_checkpoint(reverse);
+    }
+  }
+
+  return result;
+}
+
+/**
+ * @brief Moves execution back to the start of the previous instruction
+ * 
+ * @param reverse 
+ * @return sl_avr_emu_result_e - SL_AVR_EMU_RESULT_FAILURE if there is no earlier instruction boundary
+ */
+sl_avr_emu_result_e sl_avr_emu_reverse_step(sl_avr_emu_reverse_s *reverse)
+{
+  sl_avr_emu_result_e result;
+  bool                found;
+
+  result = sl_avr_emu_reverse_seek(reverse, NULL, NULL, &found);
+  if(SL_AVR_EMU_RESULT_SUCCESS == result && !found)
+  {
+    result = SL_AVR_EMU_RESULT_FAILURE;
+  }
+
+  return result;
+}
+
+/**
+ * @brief Moves execution back to the most recent instruction boundary where stop returns true.
+ *        Stops at the earliest checkpoint if stop never returns true.
+ * 
+ * @param reverse 
+ * @param stop 
+ * @param context - Passed to stop
+ * @param found   - Optional, set if stop returned true
+ * @return sl_avr_emu_result_e 
+ */
+sl_avr_emu_result_e sl_avr_emu_reverse_continue(sl_avr_emu_reverse_s *reverse, sl_avr_emu_reverse_stop_f stop, void *context, bool *found)
+{
+  sl_avr_emu_result_e result = SL_AVR_EMU_RESULT_FAILURE;
+  bool                found_local;
+
+  if(reverse != NULL && stop != NULL)
+  {
+    result = sl_avr_emu_reverse_seek(reverse, stop, context, &found_local);
+    if(found != NULL)
+    {
+      *found = found_local;
+    }
+  }
+
+  return result;
+}
+
+/**
+ * @brief Detaches reverse execution and frees checkpoint and stimulus storage
+ * 
+ * @param reverse 
+ */
+void sl_avr_emu_reverse_deinit(sl_avr_emu_reverse_s *reverse)
+{
+  uint32_t i;
+
+  if(reverse != NULL && reverse->checkpoints != NULL)
+  {
+    if(reverse->emulation->hooks.reverse == reverse)
+    {
+      reverse->emulation->hooks.reverse = NULL;
+    }
+    for(i = 0; i < reverse->checkpoint_count; i++)
+    {
+      sl_avr_emu_snapshot_free(&reverse->checkpoints[i].snapshot);
+    }
+    free(reverse->checkpoints);
+    free(reverse->stimuli);
+    memset(reverse, 0, sizeof(sl_avr_emu_reverse_s));
+  }
+}
@@ -0,0 +1,119 @@
+/**
+ * @file sl_avr_emu_samples.c
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator Memory-Mapped Sample Stream Logic
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ * Lookups are plain loads from the mapping, no system call is made after the file is opened.
+ * The mapping is advised sequential, so the kernel reads ahead of emulated time and drops pages behind it.
+ */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "sl_avr_emu_samples.h"
+
+/**
+ * @brief Maps a sample file
+ * 
+ * @param samples
+ * @param path
+ * @param record_size - Bytes per record, trailing bytes of the file short of a record are ignored
+ * @param sample_hz   - Records per second of emulated time
+ * @return sl_avr_emu_result_e - SL_AVR_EMU_RESULT_INVALID_FILE_PATH if the file could not be mapped or holds no record
+ */
+sl_avr_emu_result_e sl_avr_emu_samples_open(sl_avr_emu_samples_s *samples, const char *path, uint32_t record_size, uint32_t sample_hz)
+{
+  int                      fd;
+  struct stat              file_stat;
+  const sl_avr_emu_byte_t *map = MAP_FAILED;
+
+  if(0 == record_size || 0 == sample_hz)
+  {
+    return SL_AVR_EMU_RESULT_FAILURE;
+  }
+
+  fd = open(path, O_RDONLY | O_CLOEXEC);
+  if(fd >= 0 && 0 == fstat(fd, &file_stat) && file_stat.st_size >= record_size)
+  {
+    map = mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  if(fd >= 0)
+  {
+    close(fd);
+  }
+  if(MAP_FAILED == map)
+  {
+    return SL_AVR_EMU_RESULT_INVALID_FILE_PATH;
+  }
+  madvise((void *) map, file_stat.st_size, MADV_SEQUENTIAL);
+
+  samples->map          = map;
+  samples->map_size     = file_stat.st_size;
+  samples->record_size  = record_size;
+  samples->record_count = file_stat.st_size / record_size;
+  samples->sample_hz    = sample_hz;
+  samples->overruns     = 0;
+
+  return SL_AVR_EMU_RESULT_SUCCESS;
+}
+
+/**
+ * @brief Index of the record current at a tick
+ * 
+ * @param samples
+ * @param tick
+ * @param clock_hz
+ * @param fraction - Set to the time since that record, in 1/65536ths of a sample period.  May be NULL.
+ * @return uint64_t - May be past the last record
+ */
+uint64_t sl_avr_emu_samples_index(const sl_avr_emu_samples_s *samples, sl_avr_emu_tick_count_t tick, uint32_t clock_hz, uint32_t *fraction)
+{
+  /* tick * sample_hz / clock_hz without overflowing, whole seconds and the remainder separately */
+  const uint64_t seconds   = tick / clock_hz;
+  const uint64_t remainder = (tick % clock_hz) * samples->sample_hz;
+
+  if(NULL != fraction)
+  {
+    *fraction = ((remainder % clock_hz) << 16) / clock_hz;
+  }
+
+  return seconds * samples->sample_hz + remainder / clock_hz;
+}
+
+/**
+ * @brief Record at an index, the last record past the end
+ * 
+ * @param samples
+ * @param index
+ * @return const sl_avr_emu_byte_t*
+ */
+const sl_avr_emu_byte_t *sl_avr_emu_samples_record(sl_avr_emu_samples_s *samples, uint64_t index)
+{
+  if(index >= samples->record_count)
+  {
+    index = samples->record_count - 1;
+    samples->overruns++;
+  }
+
+  return &samples->map[index * samples->record_size];
+}
+
+/**
+ * @brief Unmaps a sample file
+ * 
+ * @param samples
+ */
+void sl_avr_emu_samples_close(sl_avr_emu_samples_s *samples)
+{
+  if(NULL != samples->map)
+  {
+    munmap((void *) samples->map, samples->map_size);
+    samples->map = NULL;
+  }
+}
@@ -0,0 +1,127 @@
+/**
+ * @file sl_avr_emu_snapshot.c
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator Snapshot Logic
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sl_avr_emu_guard.h"
+#include "sl_avr_emu_snapshot.h"
+
+/* Machine state is the emulation struct minus flash and the trailing hooks, followed by data memory.
+   Region A covers everything before flash, region B everything between flash and hooks. */
+#define SL_AVR_EMU_SNAPSHOT_A_OFFSET 0
+#define SL_AVR_EMU_SNAPSHOT_A_SIZE   offsetof(sl_avr_emu_emulation_s, memory.flash)
+#define SL_AVR_EMU_SNAPSHOT_B_OFFSET (offsetof(sl_avr_emu_emulation_s, memory.flash) + sizeof(((sl_avr_emu_emulation_s *)0)->memory.flash))
+#define SL_AVR_EMU_SNAPSHOT_B_SIZE   (offsetof(sl_avr_emu_emulation_s, hooks) - SL_AVR_EMU_SNAPSHOT_B_OFFSET)
+#define SL_AVR_EMU_SNAPSHOT_DATA_OFFSET (SL_AVR_EMU_SNAPSHOT_A_SIZE + SL_AVR_EMU_SNAPSHOT_B_SIZE)
+
+/**
+ * @brief Returns the number of bytes held by a snapshot
+ * 
+ * @return size_t 
+ */
+size_t sl_avr_emu_snapshot_size(void)
+{
+  return SL_AVR_EMU_SNAPSHOT_DATA_OFFSET + SL_AVR_EMU_DATA_SIZE;
+}
+
+/**
+ * @brief Saves emulation's machine state into snapshot, allocating storage on first use
+ * 
+ * @param emulation 
+ * @param snapshot 
+ * @return sl_avr_emu_result_e 
+ */
+sl_avr_emu_result_e sl_avr_emu_snapshot_take(const sl_avr_emu_emulation_s *emulation, sl_avr_emu_snapshot_s *snapshot)
+{
+  sl_avr_emu_result_e result = SL_AVR_EMU_RESULT_SUCCESS;
+  const sl_avr_emu_byte_t *source;
+
+  if(emulation != NULL && snapshot != NULL)
+  {
+    if(NULL == snapshot->state)
+    {
+      snapshot->state = malloc(sl_avr_emu_snapshot_size());
+    }
+
+    if(snapshot->state != NULL)
+    {
+      source = (const sl_avr_emu_byte_t *) emulation;
+      memcpy(snapshot->state, 
+             &source[SL_AVR_EMU_SNAPSHOT_A_OFFSET], SL_AVR_EMU_SNAPSHOT_A_SIZE);
+      memcpy(&snapshot->state[SL_AVR_EMU_SNAPSHOT_A_SIZE], 
+             &source[SL_AVR_EMU_SNAPSHOT_B_OFFSET], SL_AVR_EMU_SNAPSHOT_B_SIZE);
+      SL_AVR_EMU_GUARD_PROTECT(emulation, false);
+      memcpy(&snapshot->state[SL_AVR_EMU_SNAPSHOT_DATA_OFFSET], emulation->memory.data, SL_AVR_EMU_DATA_SIZE);
+      SL_AVR_EMU_GUARD_PROTECT(emulation, true);
+    }
+    else
+    {
+      result = SL_AVR_EMU_RESULT_FAILURE;
+    }
+  }
+  else
+  {
+    result = SL_AVR_EMU_RESULT_FAILURE;
+  }
+
+  return result;
+}
+
+/**
+ * @brief Restores emulation's machine state from snapshot
+ * 
+ * @param emulation 
+ * @param snapshot 
+ * @return sl_avr_emu_result_e 
+ */
+sl_avr_emu_result_e sl_avr_emu_snapshot_restore(sl_avr_emu_emulation_s *emulation, const sl_avr_emu_snapshot_s *snapshot)
+{
+  sl_avr_emu_result_e result = SL_AVR_EMU_RESULT_SUCCESS;
+  sl_avr_emu_byte_t *destination;
+  sl_avr_emu_byte_t *data;
+
+  if(emulation != NULL && snapshot != NULL && snapshot->state != NULL)
+  {
+    /* Region A holds the data pointer, which stays with the emulation */
+    data        = emulation->memory.data;
+    destination = (sl_avr_emu_byte_t *) emulation;
+    memcpy(&destination[SL_AVR_EMU_SNAPSHOT_A_OFFSET], 
+           snapshot->state, SL_AVR_EMU_SNAPSHOT_A_SIZE);
+    memcpy(&destination[SL_AVR_EMU_SNAPSHOT_B_OFFSET], 
+           &snapshot->state[SL_AVR_EMU_SNAPSHOT_A_SIZE], SL_AVR_EMU_SNAPSHOT_B_SIZE);
+    emulation->memory.data = data;
+    SL_AVR_EMU_GUARD_PROTECT(emulation, false);
+    memcpy(emulation->memory.data, &snapshot->state[SL_AVR_EMU_SNAPSHOT_DATA_OFFSET], SL_AVR_EMU_DATA_SIZE);
+    SL_AVR_EMU_GUARD_PROTECT(emulation, true);
+  }
+  else
+  {
+    result = SL_AVR_EMU_RESULT_FAILURE;
+  }
+
+  return result;
+}
+
+/**
+ * @brief Frees storage held by snapshot
+ * 
+ * @param snapshot 
+ */
+void sl_avr_emu_snapshot_free(sl_avr_emu_snapshot_s *snapshot)
+{
+  if(snapshot != NULL)
+  {
+    free(snapshot->state);
+    snapshot->state = NULL;
+  }
+}
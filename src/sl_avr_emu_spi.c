@@ -0,0 +1,404 @@
+/**
+ * @file sl_avr_emu_spi.c
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator SPI Peripheral Logic
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ * A transfer is one scheduled event 8 SCK periods after SPDR is written, the byte is exchanged with the
+ * selected devices all at once when it completes.  Device models run on the emulation thread and must not block.
+ * Firmware polling SPIF in between is fast-forwarded to the completion.  Transfer state lives in the emulation
+ * structure, so snapshots restore it with the event.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sl_avr_emu_bitops.h"
+#include "sl_avr_emu_event.h"
+#include "sl_avr_emu_idle.h"
+#include "sl_avr_emu_io.h"
+#include "sl_avr_emu_spi.h"
+#include "sl_avr_emu_trace.h"
+
+/**
+ * @brief Ticks per SCK period in master mode, from SPR1:0 and SPI2X
+ * 
+ * @param emulation
+ * @return sl_avr_emu_tick_count_t
+ */
+static sl_avr_emu_tick_count_t sl_avr_emu_spi_bit_ticks(const sl_avr_emu_emulation_s *emulation)
+{
+  static const sl_avr_emu_tick_count_t dividers[] = {4, 16, 64, 128};
+  const sl_avr_emu_byte_t             *data       = emulation->memory.data;
+
+  return dividers[data[SL_AVR_EMU_SPI_SPCR] & ((1 << SL_AVR_EMU_SPI_SPR1) | (1 << SL_AVR_EMU_SPI_SPR0))] >>
+         (SL_AVR_EMU_CHECK_BIT(data[SL_AVR_EMU_SPI_SPSR], SL_AVR_EMU_SPI_SPI2X)?1:0);
+}
+
+/**
+ * @brief Reverses the bits of a byte, converting between LSB first data order and the wire order devices see
+ * 
+ * @param byte
+ * @return sl_avr_emu_byte_t
+ */
+static sl_avr_emu_byte_t sl_avr_emu_spi_reverse(sl_avr_emu_byte_t byte)
+{
+  byte = ((byte & 0xF0) >> 4) | ((byte & 0x0F) << 4);
+  byte = ((byte & 0xCC) >> 2) | ((byte & 0x33) << 2);
+  byte = ((byte & 0xAA) >> 1) | ((byte & 0x55) << 1);
+
+  return byte;
+}
+
+/**
+ * @brief Clears SPIF and WCOL on the SPDR access following an SPSR read that saw SPIF set
+ * 
+ * @param emulation
+ */
+static void sl_avr_emu_spi_acknowledge(sl_avr_emu_emulation_s *emulation)
+{
+  if(emulation->spi.status_read)
+  {
+    emulation->memory.data[SL_AVR_EMU_SPI_SPSR] &= ~((1 << SL_AVR_EMU_SPI_SPIF) | (1 << SL_AVR_EMU_SPI_WCOL));
+    emulation->spi.status_read = false;
+  }
+}
+
+/**
+ * @brief Transfer complete event.  Exchanges the byte with the selected devices as master, or takes the external master's byte as slave.
+ * 
+ * @param emulation
+ * @param context   - SPI state
+ * @return sl_avr_emu_result_e
+ */
+static sl_avr_emu_result_e sl_avr_emu_spi_done_event(sl_avr_emu_emulation_s *emulation, void *context)
+{
+  sl_avr_emu_spi_s  *spi   = context;
+  const bool         lsb   = SL_AVR_EMU_CHECK_BIT(emulation->memory.data[SL_AVR_EMU_SPI_SPCR], SL_AVR_EMU_SPI_DORD);
+  sl_avr_emu_byte_t  mosi;
+  sl_avr_emu_byte_t  miso;
+  uint32_t           i;
+
+  if(emulation->spi.master)
+  {
+    mosi = lsb?sl_avr_emu_spi_reverse(emulation->spi.shift):emulation->spi.shift;
+    /* MISO idles high, several selected devices drive it wired-AND */
+    miso = 0xFF;
+    for(i = 0; i < spi->device_count; i++)
+    {
+      if(spi->devices[i]->selected)
+      {
+        miso &= spi->devices[i]->transfer(spi->devices[i], mosi);
+      }
+    }
+    emulation->spi.rx_data = lsb?sl_avr_emu_spi_reverse(miso):miso;
+  }
+  else
+  {
+    emulation->spi.rx_data      = emulation->spi.slave_input;
+    emulation->spi.slave_output = emulation->spi.shift;
+  }
+
+  emulation->spi.busy = false;
+  spi->transfers++;
+  SL_AVR_EMU_SET_BIT(emulation->memory.data[SL_AVR_EMU_SPI_SPSR], SL_AVR_EMU_SPI_SPIF);
+
+  return SL_AVR_EMU_RESULT_SUCCESS;
+}
+
+/**
+ * @brief SPSR read hook.  Arms the flag clear, and fast-forwards firmware polling for the transfer to complete.
+ * 
+ * @param emulation
+ * @param address
+ * @param context   - Unused
+ */
+static void sl_avr_emu_spi_spsr_read(sl_avr_emu_emulation_s *emulation, sl_avr_emu_address_t address, void *context)
+{
+  if(SL_AVR_EMU_CHECK_BIT(emulation->memory.data[address], SL_AVR_EMU_SPI_SPIF))
+  {
+    emulation->spi.status_read = true;
+  }
+  else if(emulation->spi.busy)
+  {
+    sl_avr_emu_idle_poll(emulation, address, emulation->spi.done_tick);
+  }
+}
+
+/**
+ * @brief SPSR write hook, only SPI2X is writable
+ * 
+ * @param emulation
+ * @param address
+ * @param value
+ * @param context   - SPI state
+ */
+static void sl_avr_emu_spi_spsr_write(sl_avr_emu_emulation_s *emulation, sl_avr_emu_address_t address, sl_avr_emu_byte_t value, void *context)
+{
+  const sl_avr_emu_byte_t writable = (1 << SL_AVR_EMU_SPI_SPI2X);
+
+  emulation->memory.data[address] = (emulation->memory.data[address] & ~writable) | (value & writable);
+}
+
+/**
+ * @brief SPCR write hook, disabling SPI abandons the transfer in progress
+ * 
+ * @param emulation
+ * @param address
+ * @param value
+ * @param context   - SPI state
+ */
+static void sl_avr_emu_spi_spcr_write(sl_avr_emu_emulation_s *emulation, sl_avr_emu_address_t address, sl_avr_emu_byte_t value, void *context)
+{
+  sl_avr_emu_spi_s *spi = context;
+
+  emulation->memory.data[address] = value;
+  if(emulation->spi.busy && !SL_AVR_EMU_CHECK_BIT(value, SL_AVR_EMU_SPI_SPE))
+  {
+    sl_avr_emu_event_cancel(emulation, sl_avr_emu_spi_done_event, spi);
+    emulation->spi.busy = false;
+  }
+}
+
+/**
+ * @brief SPDR read hook, returns the received byte
+ * 
+ * @param emulation
+ * @param address
+ * @param context   - Unused
+ */
+static void sl_avr_emu_spi_spdr_read(sl_avr_emu_emulation_s *emulation, sl_avr_emu_address_t address, void *context)
+{
+  emulation->memory.data[address] = emulation->spi.rx_data;
+  sl_avr_emu_spi_acknowledge(emulation);
+}
+
+/**
+ * @brief SPDR write hook.  Loads the byte to shift out, and starts a transfer as master.
+ *        Writing during a transfer is a collision, the byte is ignored.
+ * 
+ * @param emulation
+ * @param address
+ * @param value
+ * @param context   - SPI state
+ */
+static void sl_avr_emu_spi_spdr_write(sl_avr_emu_emulation_s *emulation, sl_avr_emu_address_t address, sl_avr_emu_byte_t value, void *context)
+{
+  sl_avr_emu_spi_s        *spi  = context;
+  const sl_avr_emu_byte_t  spcr = emulation->memory.data[SL_AVR_EMU_SPI_SPCR];
+
+  sl_avr_emu_spi_acknowledge(emulation);
+  if(emulation->spi.busy)
+  {
+    SL_AVR_EMU_SET_BIT(emulation->memory.data[SL_AVR_EMU_SPI_SPSR], SL_AVR_EMU_SPI_WCOL);
+    spi->collisions++;
+    return;
+  }
+
+  emulation->spi.shift = value;
+  if(SL_AVR_EMU_CHECK_BIT(spcr, SL_AVR_EMU_SPI_SPE) && SL_AVR_EMU_CHECK_BIT(spcr, SL_AVR_EMU_SPI_MSTR))
+  {
+    emulation->spi.busy      = true;
+    emulation->spi.master    = true;
+    emulation->spi.done_tick = emulation->tick_count + 8 * sl_avr_emu_spi_bit_ticks(emulation);
+    sl_avr_emu_event_schedule(emulation, emulation->spi.done_tick, sl_avr_emu_spi_done_event, spi);
+  }
+}
+
+/**
+ * @brief Chip select port or direction write hook, selects and releases devices on the port
+ * 
+ * @param emulation
+ * @param address
+ * @param value
+ * @param context   - SPI state
+ */
+static void sl_avr_emu_spi_cs_write(sl_avr_emu_emulation_s *emulation, sl_avr_emu_address_t address, sl_avr_emu_byte_t value, void *context)
+{
+  sl_avr_emu_spi_s        *spi = context;
+  sl_avr_emu_spi_device_s *device;
+  bool                     selected;
+  uint32_t                 i;
+
+  emulation->memory.data[address] = value;
+  sl_avr_emu_trace_data(emulation, address);
+
+  for(i = 0; i < spi->device_count; i++)
+  {
+    device = spi->devices[i];
+    if(address != device->cs_port && address != device->cs_port - 1)
+    {
+      continue;
+    }
+    /* DDRx is one below PORTx */
+    selected = SL_AVR_EMU_CHECK_BIT(emulation->memory.data[device->cs_port - 1], device->cs_bit) &&
+               !SL_AVR_EMU_CHECK_BIT(emulation->memory.data[device->cs_port], device->cs_bit);
+    if(selected != device->selected)
+    {
+      device->selected = selected;
+      device->select(device, selected);
+    }
+  }
+}
+
+/**
+ * @brief Attaches SPI to emulation
+ * 
+ * @param emulation
+ * @return sl_avr_emu_result_e
+ */
+sl_avr_emu_result_e sl_avr_emu_spi_start(sl_avr_emu_emulation_s *emulation)
+{
+  sl_avr_emu_result_e  result = SL_AVR_EMU_RESULT_SUCCESS;
+  sl_avr_emu_spi_s    *spi;
+
+  if(NULL != emulation->hooks.spi)
+  {
+    return SL_AVR_EMU_RESULT_FAILURE;
+  }
+
+  spi = calloc(1, sizeof(sl_avr_emu_spi_s));
+  if(NULL == spi)
+  {
+    return SL_AVR_EMU_RESULT_FAILURE;
+  }
+  emulation->hooks.spi = spi;
+  memset(&emulation->spi, 0, sizeof(emulation->spi));
+
+  result = sl_avr_emu_io_attach(emulation, SL_AVR_EMU_SPI_SPDR, sl_avr_emu_spi_spdr_read, sl_avr_emu_spi_spdr_write, spi);
+  if(SL_AVR_EMU_RESULT_SUCCESS == result)
+  {
+    result = sl_avr_emu_io_attach(emulation, SL_AVR_EMU_SPI_SPSR, sl_avr_emu_spi_spsr_read, sl_avr_emu_spi_spsr_write, spi);
+  }
+  if(SL_AVR_EMU_RESULT_SUCCESS == result)
+  {
+    result = sl_avr_emu_io_attach(emulation, SL_AVR_EMU_SPI_SPCR, NULL, sl_avr_emu_spi_spcr_write, spi);
+  }
+
+  if(SL_AVR_EMU_RESULT_SUCCESS != result)
+  {
+    sl_avr_emu_spi_stop(emulation);
+  }
+
+  return result;
+}
+
+/**
+ * @brief Attaches a device to the bus, selected while its chip select pin is an output driven low.
+ *        The SPI owns the device from then on and closes it on stop.
+ * 
+ * @param emulation
+ * @param device
+ * @param cs_port   - Data address of the chip select pin's PORTx register
+ * @param cs_bit
+ * @return sl_avr_emu_result_e - SL_AVR_EMU_RESULT_FAILURE if SPI is not attached or SL_AVR_EMU_SPI_DEVICES_MAX devices are
+ */
+sl_avr_emu_result_e sl_avr_emu_spi_attach(sl_avr_emu_emulation_s *emulation, sl_avr_emu_spi_device_s *device,
+                                          sl_avr_emu_address_t cs_port, sl_avr_emu_byte_t cs_bit)
+{
+  sl_avr_emu_result_e  result;
+  sl_avr_emu_spi_s    *spi = emulation->hooks.spi;
+
+  if(NULL == spi || spi->device_count >= SL_AVR_EMU_SPI_DEVICES_MAX)
+  {
+    return SL_AVR_EMU_RESULT_FAILURE;
+  }
+
+  result = sl_avr_emu_io_attach(emulation, cs_port - 1, NULL, sl_avr_emu_spi_cs_write, spi);
+  if(SL_AVR_EMU_RESULT_SUCCESS == result)
+  {
+    result = sl_avr_emu_io_attach(emulation, cs_port, NULL, sl_avr_emu_spi_cs_write, spi);
+  }
+  if(SL_AVR_EMU_RESULT_SUCCESS == result)
+  {
+    device->cs_port  = cs_port;
+    device->cs_bit   = cs_bit;
+    device->selected = false;
+    spi->devices[spi->device_count++] = device;
+  }
+
+  return result;
+}
+
+/**
+ * @brief Clocks one byte from an external master into SPI in slave mode, completing after 8 periods of bit_ticks.
+ *        The byte the firmware loaded into SPDR is left in slave_output.
+ * 
+ * @param emulation
+ * @param mosi
+ * @param bit_ticks - SCK period of the external master in ticks
+ * @return sl_avr_emu_result_e - SL_AVR_EMU_RESULT_FAILURE unless SPI is enabled as a slave and idle
+ */
+sl_avr_emu_result_e sl_avr_emu_spi_slave_transfer(sl_avr_emu_emulation_s *emulation, sl_avr_emu_byte_t mosi, uint32_t bit_ticks)
+{
+  sl_avr_emu_spi_s        *spi  = emulation->hooks.spi;
+  const sl_avr_emu_byte_t  spcr = emulation->memory.data[SL_AVR_EMU_SPI_SPCR];
+
+  if(NULL == spi || emulation->spi.busy || 0 == bit_ticks ||
+     !SL_AVR_EMU_CHECK_BIT(spcr, SL_AVR_EMU_SPI_SPE) || SL_AVR_EMU_CHECK_BIT(spcr, SL_AVR_EMU_SPI_MSTR))
+  {
+    return SL_AVR_EMU_RESULT_FAILURE;
+  }
+
+  emulation->spi.busy        = true;
+  emulation->spi.master      = false;
+  emulation->spi.slave_input = mosi;
+  emulation->spi.done_tick   = emulation->tick_count + 8 * (sl_avr_emu_tick_count_t)bit_ticks;
+
+  return sl_avr_emu_event_schedule(emulation, emulation->spi.done_tick, sl_avr_emu_spi_done_event, spi);
+}
+
+/**
+ * @brief Prints SPI and device counters
+ * 
+ * @param output
+ * @param emulation
+ */
+void sl_avr_emu_spi_report(FILE *output, const sl_avr_emu_emulation_s *emulation)
+{
+  const sl_avr_emu_spi_s *spi = emulation->hooks.spi;
+  uint32_t                i;
+
+  fprintf(output, "SPI: %lu transfers, %lu write collisions\n", spi->transfers, spi->collisions);
+  for(i = 0; i < spi->device_count; i++)
+  {
+    if(NULL != spi->devices[i]->report)
+    {
+      spi->devices[i]->report(output, spi->devices[i]);
+    }
+  }
+}
+
+/**
+ * @brief Closes attached devices and detaches SPI
+ * 
+ * @param emulation
+ */
+void sl_avr_emu_spi_stop(sl_avr_emu_emulation_s *emulation)
+{
+  sl_avr_emu_spi_s        *spi = emulation->hooks.spi;
+  sl_avr_emu_spi_device_s *device;
+  uint32_t                 i;
+
+  if(NULL == spi)
+  {
+    return;
+  }
+
+  sl_avr_emu_event_cancel(emulation, sl_avr_emu_spi_done_event, spi);
+  sl_avr_emu_io_detach(emulation, SL_AVR_EMU_SPI_SPDR);
+  sl_avr_emu_io_detach(emulation, SL_AVR_EMU_SPI_SPSR);
+  sl_avr_emu_io_detach(emulation, SL_AVR_EMU_SPI_SPCR);
+  for(i = 0; i < spi->device_count; i++)
+  {
+    device = spi->devices[i];
+    sl_avr_emu_io_detach(emulation, device->cs_port - 1);
+    sl_avr_emu_io_detach(emulation, device->cs_port);
+    device->close(device);
+  }
+  free(spi);
+  emulation->hooks.spi = NULL;
+}
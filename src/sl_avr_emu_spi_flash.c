@@ -0,0 +1,322 @@
+/**
+ * @file sl_avr_emu_spi_flash.c
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator SPI NOR Flash Device Logic
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ * The common 25-series command set over a shared mapping of the image file.  Programs and erases complete
+ * as soon as they are issued, so the status register never reports busy.
+ */
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "sl_avr_emu_bitops.h"
+#include "sl_avr_emu_spi_flash.h"
+
+/* Bytes of a command before its data, the command byte and a 24-bit address */
+#define SL_AVR_EMU_SPI_FLASH_HEADER_SIZE 4
+
+/**
+ * @brief SPI NOR flash device
+ * 
+ */
+typedef struct
+{
+  sl_avr_emu_spi_device_s  device;
+
+  sl_avr_emu_byte_t       *memory;
+  size_t                   size;
+  /* Capacity code of the JEDEC ID, log2 of size */
+  sl_avr_emu_byte_t        capacity;
+
+  /* Command being received, and the position of the next byte in it */
+  sl_avr_emu_byte_t        command;
+  uint32_t                 position;
+  uint32_t                 address;
+  bool                     write_enabled;
+
+  uint64_t                 commands;
+  uint64_t                 bytes_read;
+  uint64_t                 bytes_programmed;
+  uint64_t                 erases;
+
+} sl_avr_emu_spi_flash_s;
+
+/**
+ * @brief Erases a block containing the received address, or the whole chip
+ * 
+ * @param flash
+ * @param block_size - 0 for the whole chip
+ */
+static void sl_avr_emu_spi_flash_erase(sl_avr_emu_spi_flash_s *flash, size_t block_size)
+{
+  size_t start = 0;
+
+  if(0 == block_size || block_size > flash->size)
+  {
+    block_size = flash->size;
+  }
+  else
+  {
+    start = (flash->address & (flash->size - 1)) & ~(block_size - 1);
+  }
+  memset(&flash->memory[start], 0xFF, block_size);
+  flash->erases++;
+}
+
+/**
+ * @brief Chip select hook.  Erases take effect when chip select is released, after their address was received.
+ * 
+ * @param device
+ * @param selected
+ */
+static void sl_avr_emu_spi_flash_select(sl_avr_emu_spi_device_s *device, bool selected)
+{
+  sl_avr_emu_spi_flash_s *flash = (sl_avr_emu_spi_flash_s *) device;
+
+  if(!selected && flash->position > 0)
+  {
+    flash->commands++;
+    switch(flash->command)
+    {
+      case SL_AVR_EMU_SPI_FLASH_PAGE_PROGRAM:
+      {
+        flash->write_enabled = false;
+        break;
+      }
+      case SL_AVR_EMU_SPI_FLASH_ERASE_4K:
+      case SL_AVR_EMU_SPI_FLASH_ERASE_32K:
+      case SL_AVR_EMU_SPI_FLASH_ERASE_64K:
+      {
+        if(flash->write_enabled && flash->position >= SL_AVR_EMU_SPI_FLASH_HEADER_SIZE)
+        {
+          sl_avr_emu_spi_flash_erase(flash, (SL_AVR_EMU_SPI_FLASH_ERASE_4K == flash->command)?(4 << 10):
+                                            (SL_AVR_EMU_SPI_FLASH_ERASE_32K == flash->command)?(32 << 10):(64 << 10));
+        }
+        flash->write_enabled = false;
+        break;
+      }
+      case SL_AVR_EMU_SPI_FLASH_ERASE_CHIP:
+      case SL_AVR_EMU_SPI_FLASH_ERASE_CHIP_2:
+      {
+        if(flash->write_enabled)
+        {
+          sl_avr_emu_spi_flash_erase(flash, 0);
+        }
+        flash->write_enabled = false;
+        break;
+      }
+      default:
+      {
+        break;
+      }
+    }
+  }
+  flash->position = 0;
+  flash->address  = 0;
+}
+
+/**
+ * @brief Transfer hook, decodes commands byte by byte
+ * 
+ * @param device
+ * @param mosi
+ * @return sl_avr_emu_byte_t - Byte shifted out, 0xFF while the flash does not drive the line
+ */
+static sl_avr_emu_byte_t sl_avr_emu_spi_flash_transfer(sl_avr_emu_spi_device_s *device, sl_avr_emu_byte_t mosi)
+{
+  sl_avr_emu_spi_flash_s *flash    = (sl_avr_emu_spi_flash_s *) device;
+  const uint32_t          position = flash->position;
+  const uint32_t          mask     = flash->size - 1;
+  sl_avr_emu_byte_t       miso     = 0xFF;
+  uint32_t                page;
+
+  /* Saturates one past the header, data phases only need to know they are in it */
+  if(flash->position <= SL_AVR_EMU_SPI_FLASH_HEADER_SIZE)
+  {
+    flash->position++;
+  }
+
+  if(0 == position)
+  {
+    flash->command = mosi;
+    if(SL_AVR_EMU_SPI_FLASH_WRITE_ENABLE == mosi)
+    {
+      flash->write_enabled = true;
+    }
+    else if(SL_AVR_EMU_SPI_FLASH_WRITE_DISABLE == mosi)
+    {
+      flash->write_enabled = false;
+    }
+    return miso;
+  }
+
+  switch(flash->command)
+  {
+    case SL_AVR_EMU_SPI_FLASH_READ_STATUS:
+    {
+      miso = (flash->write_enabled?(1 << SL_AVR_EMU_SPI_FLASH_WEL):0);
+      break;
+    }
+    case SL_AVR_EMU_SPI_FLASH_JEDEC_ID:
+    {
+      miso = (1 == position)?SL_AVR_EMU_SPI_FLASH_MANUFACTURER:
+             (2 == position)?SL_AVR_EMU_SPI_FLASH_MEMORY_TYPE:
+             (3 == position)?flash->capacity:0x00;
+      break;
+    }
+    case SL_AVR_EMU_SPI_FLASH_RELEASE:
+    {
+      /* Device ID after three dummy bytes */
+      if(position >= SL_AVR_EMU_SPI_FLASH_HEADER_SIZE)
+      {
+        miso = flash->capacity - 1;
+      }
+      break;
+    }
+    case SL_AVR_EMU_SPI_FLASH_READ:
+    case SL_AVR_EMU_SPI_FLASH_FAST_READ:
+    case SL_AVR_EMU_SPI_FLASH_PAGE_PROGRAM:
+    case SL_AVR_EMU_SPI_FLASH_DEVICE_ID:
+    case SL_AVR_EMU_SPI_FLASH_ERASE_4K:
+    case SL_AVR_EMU_SPI_FLASH_ERASE_32K:
+    case SL_AVR_EMU_SPI_FLASH_ERASE_64K:
+    {
+      if(position < SL_AVR_EMU_SPI_FLASH_HEADER_SIZE)
+      {
+        flash->address = (flash->address << 8) | mosi;
+        break;
+      }
+      if(SL_AVR_EMU_SPI_FLASH_READ == flash->command ||
+         /* Fast read has one dummy byte after the address */
+         (SL_AVR_EMU_SPI_FLASH_FAST_READ == flash->command && position > SL_AVR_EMU_SPI_FLASH_HEADER_SIZE))
+      {
+        miso = flash->memory[flash->address & mask];
+        flash->address++;
+        flash->bytes_read++;
+      }
+      else if(SL_AVR_EMU_SPI_FLASH_PAGE_PROGRAM == flash->command && flash->write_enabled)
+      {
+        /* Programming only clears bits, and wraps within the page */
+        flash->memory[flash->address & mask] &= mosi;
+        page           = flash->address & ~(SL_AVR_EMU_SPI_FLASH_PAGE_SIZE - 1);
+        flash->address = page | ((flash->address + 1) & (SL_AVR_EMU_SPI_FLASH_PAGE_SIZE - 1));
+        flash->bytes_programmed++;
+      }
+      else if(SL_AVR_EMU_SPI_FLASH_DEVICE_ID == flash->command)
+      {
+        /* Manufacturer and device ID alternate, starting with the device ID at odd addresses */
+        miso = ((flash->address++) & 0x1)?(flash->capacity - 1):SL_AVR_EMU_SPI_FLASH_MANUFACTURER;
+      }
+      break;
+    }
+    default:
+    {
+      break;
+    }
+  }
+
+  return miso;
+}
+
+/**
+ * @brief Prints flash counters
+ * 
+ * @param output
+ * @param device
+ */
+static void sl_avr_emu_spi_flash_report(FILE *output, const sl_avr_emu_spi_device_s *device)
+{
+  const sl_avr_emu_spi_flash_s *flash = (const sl_avr_emu_spi_flash_s *) device;
+
+  fprintf(output, "  %s: %zu bytes, %lu commands, %lu bytes read, %lu bytes programmed, %lu erases\n",
+          device->name, flash->size, flash->commands, flash->bytes_read, flash->bytes_programmed, flash->erases);
+}
+
+/**
+ * @brief Writes the image back and unmaps it
+ * 
+ * @param device
+ */
+static void sl_avr_emu_spi_flash_close(sl_avr_emu_spi_device_s *device)
+{
+  sl_avr_emu_spi_flash_s *flash = (sl_avr_emu_spi_flash_s *) device;
+
+  msync(flash->memory, flash->size, MS_SYNC);
+  munmap(flash->memory, flash->size);
+  free(flash);
+}
+
+/**
+ * @brief Opens a flash image as a SPI NOR flash device.  The image is mapped, so the host page cache holds the
+ *        contents and writes reach the file without system calls on the emulation thread.
+ * 
+ * @param path
+ * @param size - Flash size in bytes, a power of 2.  0 to use the size of an existing image, or SL_AVR_EMU_SPI_FLASH_SIZE_DEFAULT.
+ *               Smaller images are extended with erased bytes.
+ * @return sl_avr_emu_spi_device_s* - NULL if the image could not be opened or the size is invalid
+ */
+sl_avr_emu_spi_device_s *sl_avr_emu_spi_flash_open(const char *path, size_t size)
+{
+  sl_avr_emu_spi_flash_s *flash;
+  int                     fd;
+  struct stat             file_stat;
+  sl_avr_emu_byte_t      *map = MAP_FAILED;
+
+  fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if(fd < 0)
+  {
+    return NULL;
+  }
+  if(0 == fstat(fd, &file_stat))
+  {
+    if(0 == size)
+    {
+      size = (file_stat.st_size > 0)?(size_t) file_stat.st_size:SL_AVR_EMU_SPI_FLASH_SIZE_DEFAULT;
+    }
+    if(size >= SL_AVR_EMU_SPI_FLASH_SIZE_MIN && size <= SL_AVR_EMU_SPI_FLASH_SIZE_MAX && 0 == (size & (size - 1)) &&
+       (file_stat.st_size >= size || 0 == ftruncate(fd, size)))
+    {
+      map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+  }
+  close(fd);
+
+  if(MAP_FAILED == map)
+  {
+    return NULL;
+  }
+  flash = calloc(1, sizeof(sl_avr_emu_spi_flash_s));
+  if(NULL == flash)
+  {
+    munmap(map, size);
+    return NULL;
+  }
+
+  /* Extended bytes read as erased */
+  if(file_stat.st_size < size)
+  {
+    memset(&map[file_stat.st_size], 0xFF, size - file_stat.st_size);
+  }
+  flash->memory          = map;
+  flash->size            = size;
+  while((1UL << flash->capacity) < size)
+  {
+    flash->capacity++;
+  }
+  flash->device.name     = "SPI flash";
+  flash->device.select   = sl_avr_emu_spi_flash_select;
+  flash->device.transfer = sl_avr_emu_spi_flash_transfer;
+  flash->device.report   = sl_avr_emu_spi_flash_report;
+  flash->device.close    = sl_avr_emu_spi_flash_close;
+
+  return &flash->device;
+}
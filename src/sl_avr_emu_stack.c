@@ -0,0 +1,183 @@
+/**
+ * @file sl_avr_emu_stack.c
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator Stack Usage Tracking Logic
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ * Only a new low-water mark does any work: it copies the stack above it so the call chain can be
+ * unwound at report time.  Return addresses are found by scanning for values that follow a
+ * CALL/RCALL/ICALL, so frames entered through an interrupt are counted in the interrupted function.
+ */
+
+#include <string.h>
+
+#include "sl_avr_emu_elf.h"
+#include "sl_avr_emu_guard.h"
+#include "sl_avr_emu_opcode.h"
+#include "sl_avr_emu_stack.h"
+
+/* Bytes in a pushed return address */
+#define SL_AVR_EMU_STACK_PC_BYTES (SL_AVR_EMU_EXTENDED_PC_ADDRESS?3:2)
+
+/**
+ * @brief Checks if pc follows a call instruction
+ * 
+ * @param emulation
+ * @param pc
+ * @return true
+ * @return false
+ */
+static bool sl_avr_emu_stack_return_address(const sl_avr_emu_emulation_s *emulation, sl_avr_emu_extended_address_t pc)
+{
+  const sl_avr_emu_word_t *flash = emulation->memory.flash;
+
+  if(!SL_AVR_EMU_FLASH_ADDRESS_VALID(pc) || pc < 1)
+  {
+    return false;
+  }
+  if((SL_AVR_EMU_IS_RJMP_RCALL(flash[pc-1]) && 0 != (flash[pc-1] & 0x1000)) ||
+     (SL_AVR_EMU_IS_IJMP_ICALL(flash[pc-1]) && 0 != (flash[pc-1] & 0x0100)))
+  {
+    return true;
+  }
+  return (pc >= 2 && SL_AVR_EMU_IS_JMP_CALL(flash[pc-2]) && 0 != (flash[pc-2] & 0x2));
+}
+
+/**
+ * @brief Prints a PC with its symbol when known
+ * 
+ * @param output
+ * @param emulation
+ * @param pc
+ */
+static void sl_avr_emu_stack_print_pc(FILE *output, const sl_avr_emu_emulation_s *emulation, sl_avr_emu_extended_address_t pc)
+{
+  const char *name;
+  uint32_t    offset;
+
+  fprintf(output, "0x%06x", pc*2);
+  name = sl_avr_emu_symbol_name_pc(emulation->hooks.symbols, pc, &offset);
+  if(name != NULL)
+  {
+    fprintf(output, " <%s+0x%x>", name, offset);
+  }
+}
+
+/**
+ * @brief Records a new low-water mark with the stack contents above it
+ * 
+ * @param emulation
+ * @param sp        - New lowest Stack-Pointer
+ * @param pc        - Instruction that moved the Stack-Pointer
+ */
+void sl_avr_emu_stack_low_water(sl_avr_emu_emulation_s *emulation, sl_avr_emu_extended_address_t sp, sl_avr_emu_extended_address_t pc)
+{
+  sl_avr_emu_stack_usage_s *usage = &emulation->hooks.stack_usage;
+
+  usage->low_water      = sp;
+  usage->low_water_pc   = pc;
+  usage->low_water_tick = emulation->tick_count;
+
+  /* SP points at the next free byte, the stack is (sp, top] */
+  usage->trace_size = (usage->top > sp)?(usage->top - sp):0;
+  if(usage->trace_size > SL_AVR_EMU_STACK_TRACE_SIZE)
+  {
+    usage->trace_size = SL_AVR_EMU_STACK_TRACE_SIZE;
+  }
+  SL_AVR_EMU_GUARD_PROTECT(emulation, false);
+  memcpy(usage->trace, &emulation->memory.data[sp + 1], usage->trace_size);
+  SL_AVR_EMU_GUARD_PROTECT(emulation, true);
+}
+
+/**
+ * @brief Accounts a Stack-Pointer write.  Called when SPL or SPH is written.
+ * 
+ * @param emulation
+ * @param address   - SL_AVR_EMU_SPL_ADDRESS or SL_AVR_EMU_SPH_ADDRESS
+ * @param pc        - Instruction that wrote the Stack-Pointer
+ */
+void sl_avr_emu_stack_sp_written(sl_avr_emu_emulation_s *emulation, sl_avr_emu_address_t address, sl_avr_emu_extended_address_t pc)
+{
+  sl_avr_emu_extended_address_t sp = SL_AVR_EMU_GET_SP(emulation);
+
+  if(sp > emulation->hooks.stack_usage.top)
+  {
+    /* Setting up the stack, not growing it */
+    emulation->hooks.stack_usage.top = sp;
+  }
+  else if(SL_AVR_EMU_SPL_ADDRESS == address)
+  {
+    /* Frame allocation writes SPH then SPL, the SP between the two writes is not real */
+    sl_avr_emu_stack_track(emulation, sp, pc);
+  }
+}
+
+/**
+ * @brief Clears the low-water mark
+ * 
+ * @param emulation
+ */
+void sl_avr_emu_stack_usage_reset(sl_avr_emu_emulation_s *emulation)
+{
+  emulation->hooks.stack_usage.low_water  = SL_AVR_EMU_DATA_SIZE;
+  emulation->hooks.stack_usage.trace_size = 0;
+}
+
+/**
+ * @brief Prints the deepest stack reached and the call chain that reached it, with each frame's size
+ * 
+ * @param output
+ * @param emulation
+ */
+void sl_avr_emu_stack_report(FILE *output, const sl_avr_emu_emulation_s *emulation)
+{
+  const sl_avr_emu_stack_usage_s *usage = &emulation->hooks.stack_usage;
+  sl_avr_emu_extended_address_t   pc;
+  sl_avr_emu_extended_address_t   frame_pc = usage->low_water_pc;
+  uint32_t                        frame_start = 0;
+  uint32_t                        frame = 0;
+  uint32_t                        i, j;
+
+  if(usage->low_water >= SL_AVR_EMU_DATA_SIZE || usage->low_water > usage->top)
+  {
+    fprintf(output, "\nStack: unused\n");
+    return;
+  }
+
+  fprintf(output, "\nStack: top 0x%x, low water 0x%x, %u bytes deep at tick %lu\n", usage->top, usage->low_water,
+          usage->top - usage->low_water, usage->low_water_tick);
+  fprintf(output, "  %-5s %8s  %s\n", "frame", "bytes", "location");
+
+  for(i = 0; i + SL_AVR_EMU_STACK_PC_BYTES <= usage->trace_size; i++)
+  {
+    /* Return addresses are pushed low byte first, so they read big-endian upward */
+    pc = 0;
+    for(j = 0; j < SL_AVR_EMU_STACK_PC_BYTES; j++)
+    {
+      pc = (pc << 8) | usage->trace[i + j];
+    }
+    if(!sl_avr_emu_stack_return_address(emulation, pc))
+    {
+      continue;
+    }
+
+    fprintf(output, "  #%-4u %8u  ", frame, i + SL_AVR_EMU_STACK_PC_BYTES - frame_start);
+    sl_avr_emu_stack_print_pc(output, emulation, frame_pc);
+    fprintf(output, "\n");
+    frame_pc    = pc;
+    frame_start = i + SL_AVR_EMU_STACK_PC_BYTES;
+    frame++;
+    i = frame_start - 1;
+  }
+
+  fprintf(output, "  #%-4u %8u  ", frame, usage->trace_size - frame_start);
+  sl_avr_emu_stack_print_pc(output, emulation, frame_pc);
+  fprintf(output, "\n");
+  if(usage->top - usage->low_water > usage->trace_size)
+  {
+    fprintf(output, "  (outer %u bytes not recorded)\n", usage->top - usage->low_water - usage->trace_size);
+  }
+}
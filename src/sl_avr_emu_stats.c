@@ -0,0 +1,199 @@
+/**
+ * @file sl_avr_emu_stats.c
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator Instruction-Mix Statistics Logic
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ * Counters are bumped by the dispatch branches themselves, one increment per instruction,
+ * and live in the hooks so snapshots and reverse execution leave them alone.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sl_avr_emu_stats.h"
+
+/* Names indexed by sl_avr_emu_opcode_class_e */
+static const char * const sl_avr_emu_opcode_class_names[SL_AVR_EMU_OPCODE_CLASS_COUNT] =
+{
+  [SL_AVR_EMU_OPCODE_CLASS_UNRECOGNIZED] = "unrecognized",
+  [SL_AVR_EMU_OPCODE_CLASS_NOP]          = "nop",
+  [SL_AVR_EMU_OPCODE_CLASS_ADD]          = "add/adc",
+  [SL_AVR_EMU_OPCODE_CLASS_ADIW]         = "adiw",
+  [SL_AVR_EMU_OPCODE_CLASS_AND]          = "and",
+  [SL_AVR_EMU_OPCODE_CLASS_BRBS_BRBC]    = "brbs/brbc",
+  [SL_AVR_EMU_OPCODE_CLASS_BREAK]        = "break",
+  [SL_AVR_EMU_OPCODE_CLASS_COM]          = "com",
+  [SL_AVR_EMU_OPCODE_CLASS_CP_CPC]       = "cp/cpc",
+  [SL_AVR_EMU_OPCODE_CLASS_CPI]          = "cpi",
+  [SL_AVR_EMU_OPCODE_CLASS_CPSE]         = "cpse",
+  [SL_AVR_EMU_OPCODE_CLASS_DEC]          = "dec",
+  [SL_AVR_EMU_OPCODE_CLASS_EOR]          = "eor",
+  [SL_AVR_EMU_OPCODE_CLASS_IN_OUT]       = "in/out",
+  [SL_AVR_EMU_OPCODE_CLASS_JMP_CALL]     = "jmp/call",
+  [SL_AVR_EMU_OPCODE_CLASS_LD_ST]        = "ld/st",
+  [SL_AVR_EMU_OPCODE_CLASS_LDI]          = "ldi",
+  [SL_AVR_EMU_OPCODE_CLASS_LDS_STS]      = "lds/sts",
+  [SL_AVR_EMU_OPCODE_CLASS_LPM_ELPM]     = "lpm/elpm",
+  [SL_AVR_EMU_OPCODE_CLASS_MOV]          = "mov",
+  [SL_AVR_EMU_OPCODE_CLASS_MOVW]         = "movw",
+  [SL_AVR_EMU_OPCODE_CLASS_OR]           = "or",
+  [SL_AVR_EMU_OPCODE_CLASS_ORI]          = "ori",
+  [SL_AVR_EMU_OPCODE_CLASS_PUSH_POP]     = "push/pop",
+  [SL_AVR_EMU_OPCODE_CLASS_RET]          = "ret",
+  [SL_AVR_EMU_OPCODE_CLASS_RETI]         = "reti",
+  [SL_AVR_EMU_OPCODE_CLASS_RJMP_RCALL]   = "rjmp/rcall",
+  [SL_AVR_EMU_OPCODE_CLASS_SBIC_SBIS]    = "sbic/sbis",
+  [SL_AVR_EMU_OPCODE_CLASS_SBIW]         = "sbiw",
+  [SL_AVR_EMU_OPCODE_CLASS_SBRC_SBRS]    = "sbrc/sbrs",
+  [SL_AVR_EMU_OPCODE_CLASS_SEX_CLX]      = "bset/bclr",
+  [SL_AVR_EMU_OPCODE_CLASS_SUB]          = "sub/sbc",
+  [SL_AVR_EMU_OPCODE_CLASS_SUBI_SBCI]    = "subi/sbci",
+};
+
+/**
+ * @brief Report entry for one opcode class
+ * 
+ */
+typedef struct
+{
+  sl_avr_emu_opcode_class_e opcode_class;
+  uint64_t                  count;
+
+} sl_avr_emu_stats_entry_s;
+
+/**
+ * @brief Orders entries by count, descending
+ * 
+ * @param a
+ * @param b
+ * @return int
+ */
+static int sl_avr_emu_stats_compare(const void *a, const void *b)
+{
+  const sl_avr_emu_stats_entry_s *entry_a = a;
+  const sl_avr_emu_stats_entry_s *entry_b = b;
+
+  return (entry_a->count < entry_b->count)?1:(entry_a->count > entry_b->count)?-1:
+         (entry_a->opcode_class > entry_b->opcode_class);
+}
+
+/**
+ * @brief Returns a printable name for an opcode class
+ * 
+ * @param opcode_class
+ * @return const char*
+ */
+const char *sl_avr_emu_opcode_class_name(sl_avr_emu_opcode_class_e opcode_class)
+{
+  return (opcode_class < SL_AVR_EMU_OPCODE_CLASS_COUNT)?sl_avr_emu_opcode_class_names[opcode_class]:"??";
+}
+
+/**
+ * @brief Returns the number of instructions dispatched of opcode_class across all groups
+ * 
+ * @param emulation
+ * @param opcode_class
+ * @return uint64_t
+ */
+uint64_t sl_avr_emu_stats_class_count(const sl_avr_emu_emulation_s *emulation, sl_avr_emu_opcode_class_e opcode_class)
+{
+  uint64_t result = 0;
+  uint32_t group;
+
+  if(opcode_class < SL_AVR_EMU_OPCODE_CLASS_COUNT)
+  {
+    for(group = 0; group < SL_AVR_EMU_OPCODE_GROUP_COUNT; group++)
+    {
+      result += emulation->hooks.stats.dispatch[group][opcode_class];
+    }
+  }
+
+  return result;
+}
+
+/**
+ * @brief Returns the number of instructions dispatched through opcode group (0-3)
+ * 
+ * @param emulation
+ * @param group
+ * @return uint64_t
+ */
+uint64_t sl_avr_emu_stats_group_count(const sl_avr_emu_emulation_s *emulation, uint32_t group)
+{
+  uint64_t result = 0;
+  uint32_t opcode_class;
+
+  if(group < SL_AVR_EMU_OPCODE_GROUP_COUNT)
+  {
+    for(opcode_class = 0; opcode_class < SL_AVR_EMU_OPCODE_CLASS_COUNT; opcode_class++)
+    {
+      result += emulation->hooks.stats.dispatch[group][opcode_class];
+    }
+  }
+
+  return result;
+}
+
+/**
+ * @brief Clears all instruction-mix counters
+ * 
+ * @param emulation
+ */
+void sl_avr_emu_stats_reset(sl_avr_emu_emulation_s *emulation)
+{
+  memset(&emulation->hooks.stats, 0, sizeof(sl_avr_emu_stats_s));
+}
+
+/**
+ * @brief Prints the instruction mix, hottest class first, followed by the per-group breakdown
+ * 
+ * @param output
+ * @param emulation
+ */
+void sl_avr_emu_stats_print(FILE *output, const sl_avr_emu_emulation_s *emulation)
+{
+  sl_avr_emu_stats_entry_s entries[SL_AVR_EMU_OPCODE_CLASS_COUNT];
+  uint64_t                 groups[SL_AVR_EMU_OPCODE_GROUP_COUNT];
+  uint64_t                 total = 0;
+  uint32_t                 i, group;
+
+  for(i = 0; i < SL_AVR_EMU_OPCODE_CLASS_COUNT; i++)
+  {
+    entries[i].opcode_class = i;
+    entries[i].count        = sl_avr_emu_stats_class_count(emulation, i);
+    total                  += entries[i].count;
+  }
+  for(group = 0; group < SL_AVR_EMU_OPCODE_GROUP_COUNT; group++)
+  {
+    groups[group] = sl_avr_emu_stats_group_count(emulation, group);
+  }
+  qsort(entries, SL_AVR_EMU_OPCODE_CLASS_COUNT, sizeof(sl_avr_emu_stats_entry_s), sl_avr_emu_stats_compare);
+
+  fprintf(output, "\nInstruction mix: %lu instructions, %lu ticks\n", total, emulation->tick_count);
+  fprintf(output, "  %-12s %12s %7s   %10s %10s %10s %10s\n", "class", "count", "%", "group 0", "group 1", "group 2", "group 3");
+  for(i = 0; i < SL_AVR_EMU_OPCODE_CLASS_COUNT && entries[i].count > 0; i++)
+  {
+    fprintf(output, "  %-12s %12lu %6.2f%%  ", sl_avr_emu_opcode_class_name(entries[i].opcode_class), entries[i].count,
+            100.0*entries[i].count/total);
+    for(group = 0; group < SL_AVR_EMU_OPCODE_GROUP_COUNT; group++)
+    {
+      fprintf(output, " %10lu", emulation->hooks.stats.dispatch[group][entries[i].opcode_class]);
+    }
+    fprintf(output, "\n");
+  }
+  fprintf(output, "  %-12s %12lu %7s  ", "total", total, "");
+  for(group = 0; group < SL_AVR_EMU_OPCODE_GROUP_COUNT; group++)
+  {
+    fprintf(output, " %10lu", groups[group]);
+  }
+  fprintf(output, "\n");
+  if(emulation->hooks.stats.idle_skips > 0)
+  {
+    fprintf(output, "  %lu register poll loops fast-forwarded, %lu ticks skipped\n",
+            emulation->hooks.stats.idle_skips, emulation->hooks.stats.idle_ticks);
+  }
+}
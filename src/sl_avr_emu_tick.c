@@ -13,42 +13,22 @@
 
 #include "sl_avr_emu.h"
 #include "sl_avr_emu_bitops.h"
+#include "sl_avr_emu_breakpoint.h"
+#include "sl_avr_emu_callgraph.h"
+#include "sl_avr_emu_coverage.h"
+#include "sl_avr_emu_event.h"
+#include "sl_avr_emu_fuzz.h"
+#include "sl_avr_emu_guard.h"
 #include "sl_avr_emu_interrupt.h"
+#include "sl_avr_emu_io.h"
+#include "sl_avr_emu_latency.h"
+#include "sl_avr_emu_opcode.h"
+#include "sl_avr_emu_profile.h"
+#include "sl_avr_emu_stack.h"
+#include "sl_avr_emu_stats.h"
 #include "sl_avr_emu_tick.h"
 #include "sl_avr_emu_timer.h"
-
-#define SL_AVR_EMU_IS_ADD(opcode)        (((opcode) & 0xEC00) == 0x0C00)
-#define SL_AVR_EMU_IS_ADIW(opcode)       (((opcode) & 0xFF00) == 0x9600)
-#define SL_AVR_EMU_IS_AND(opcode)        (((opcode) & 0xFC00) == 0x2000)
-#define SL_AVR_EMU_IS_BRBS_BRBC(opcode)  (((opcode) & 0xF800) == 0xF000)
-#define SL_AVR_EMU_IS_COM(opcode)        (((opcode) & 0xFE0C) == 0x9400)
-#define SL_AVR_EMU_IS_CP_CPC(opcode)     (((opcode) & 0xEC00) == 0x0400)
-#define SL_AVR_EMU_IS_CPI(opcode)        (((opcode) & 0xF000) == 0x3000)
-#define SL_AVR_EMU_IS_CPSE(opcode)       (((opcode) & 0xFC00) == 0x1000)
-#define SL_AVR_EMU_IS_DEC(opcode)        (((opcode) & 0xFE0F) == 0x940A)
-#define SL_AVR_EMU_IS_EOR(opcode)        (((opcode) & 0xFC00) == 0x2400)
-#define SL_AVR_EMU_IS_IN_OUT(opcode)     (((opcode) & 0xF000) == 0xB000)
-#define SL_AVR_EMU_IS_JMP_CALL(opcode)   (((opcode) & 0xFE0C) == 0x940C)
-#define SL_AVR_EMU_IS_PUSH_POP(opcode)   (((opcode) & 0xFC0F) == 0x900F)
-#define SL_AVR_EMU_IS_LD_ST(opcode)      ((((opcode) & 0xFC0C) == 0x900C) && !SL_AVR_EMU_IS_PUSH_POP(opcode))
-#define SL_AVR_EMU_IS_LDI(opcode)        (((opcode) & 0xF000) == 0xE000)
-#define SL_AVR_EMU_IS_LDS_STS(opcode)    (((opcode) & 0xFC0F) == 0x9000)
-#define SL_AVR_EMU_IS_LPM_ELPM(opcode)   (((opcode) & 0xFFEF) == 0x95C8)
-#define SL_AVR_EMU_IS_LPMZ_ELPMZ(opcode) (((opcode) & 0xFE0C) == 0x9004)
-#define SL_AVR_EMU_IS_MOV(opcode)        (((opcode) & 0xFC00) == 0x2C00)
-#define SL_AVR_EMU_IS_MOVW(opcode)       (((opcode) & 0xFF00) == 0x0100)
-#define SL_AVR_EMU_IS_OR(opcode)         (((opcode) & 0xFC00) == 0x2800)
-#define SL_AVR_EMU_IS_ORI(opcode)        (((opcode) & 0xF000) == 0x6000)
-#define SL_AVR_EMU_IS_RET(opcode)        (((opcode) & 0xFFFF) == 0x9508)
-#define SL_AVR_EMU_IS_RETI(opcode)       (((opcode) & 0xFFFF) == 0x9518)
-#define SL_AVR_EMU_IS_RJMP_RCALL(opcode) (((opcode) & 0xE000) == 0xC000)
-#define SL_AVR_EMU_IS_SBIC_SBIS(opcode)  (((opcode) & 0xFD00) == 0x9900)
-#define SL_AVR_EMU_IS_SBIW(opcode)       (((opcode) & 0xFF00) == 0x9700)
-#define SL_AVR_EMU_IS_SEX_CLX(opcode)    (((opcode) & 0xFF0F) == 0x9408)
-#define SL_AVR_EMU_IS_SUB(opcode)        (((opcode) & 0xEC00) == 0x0800)
-#define SL_AVR_EMU_IS_SUBI_SBCI(opcode)  (((opcode) & 0xE000) == 0x4000)
-
-#define SL_AVR_EMU_IS_TWO_WORD_OPCODE(opcode) (SL_AVR_EMU_IS_JMP_CALL(opcode) || SL_AVR_EMU_IS_LDS_STS(opcode))
+#include "sl_avr_emu_watch.h"
 
 sl_avr_emu_extended_address_t sl_avr_emu_get_x_address(sl_avr_emu_emulation_s * emulation)
 {
@@ -126,6 +106,7 @@ sl_avr_emu_result_e sl_avr_emu_stack_push_byte(sl_avr_emu_emulation_s * emulatio
       {
         emulation->memory.data[SL_AVR_EMU_SPH_ADDRESS] = ((sp >> 8) & 0xFF);
       }
+      sl_avr_emu_stack_track(emulation, sp, emulation->memory.pc);
     }
     else 
     {
@@ -569,7 +550,7 @@ sl_avr_emu_result_e sl_avr_emu_opcode_cpse(sl_avr_emu_emulation_s * emulation)
   {
     if(SL_AVR_EMU_PC_ADDRESS_VALID(emulation->memory.pc+1))
     {
-      if(SL_AVR_EMU_IS_TWO_WORD_OPCODE(emulation->memory.flash[emulation->memory.pc+1]))
+      if(SL_AVR_EMU_IS_TWO_WORD_OPCODE(sl_avr_emu_breakpoint_word(emulation, emulation->memory.pc+1)))
       {
         if(SL_AVR_EMU_VERSION_AVRRC == emulation->version)
         {
@@ -916,53 +897,65 @@ sl_avr_emu_result_e sl_avr_emu_opcode_0(sl_avr_emu_emulation_s * emulation)
   sl_avr_emu_result_e result = SL_AVR_EMU_RESULT_SUCCESS;
   if(emulation->memory.flash[emulation->memory.pc] == 0)
   {
+    SL_AVR_EMU_STATS_COUNT(emulation, 0, SL_AVR_EMU_OPCODE_CLASS_NOP);
     /* NOP Handling */
     emulation->memory.pc++;
     SL_AVR_EMU_VERBOSE_LOG(printf("NOP. PC 0x%06x\n", emulation->memory.pc));
   }
   else if(SL_AVR_EMU_IS_ADD(emulation->memory.flash[emulation->memory.pc]))
   {
+    SL_AVR_EMU_STATS_COUNT(emulation, 0, SL_AVR_EMU_OPCODE_CLASS_ADD);
     sl_avr_emu_opcode_add(emulation);
   }
   else if(SL_AVR_EMU_IS_AND(emulation->memory.flash[emulation->memory.pc]))
   {
+    SL_AVR_EMU_STATS_COUNT(emulation, 0, SL_AVR_EMU_OPCODE_CLASS_AND);
     sl_avr_emu_opcode_and(emulation);
   }
   else if(SL_AVR_EMU_IS_CP_CPC(emulation->memory.flash[emulation->memory.pc]))
   {
+    SL_AVR_EMU_STATS_COUNT(emulation, 0, SL_AVR_EMU_OPCODE_CLASS_CP_CPC);
     sl_avr_emu_opcode_cp_cpc(emulation);
   }
   else if(SL_AVR_EMU_IS_CPI(emulation->memory.flash[emulation->memory.pc]))
   {
+    SL_AVR_EMU_STATS_COUNT(emulation, 0, SL_AVR_EMU_OPCODE_CLASS_CPI);
     sl_avr_emu_opcode_cpi(emulation);
   }
   else if(SL_AVR_EMU_IS_CPSE(emulation->memory.flash[emulation->memory.pc]))
   {
+    SL_AVR_EMU_STATS_COUNT(emulation, 0, SL_AVR_EMU_OPCODE_CLASS_CPSE);
     sl_avr_emu_opcode_cpse(emulation);
   }
   else if(SL_AVR_EMU_IS_EOR(emulation->memory.flash[emulation->memory.pc]))
   {
+    SL_AVR_EMU_STATS_COUNT(emulation, 0, SL_AVR_EMU_OPCODE_CLASS_EOR);
     sl_avr_emu_opcode_eor(emulation);
   }
   else if(SL_AVR_EMU_IS_MOV(emulation->memory.flash[emulation->memory.pc]))
   {
+    SL_AVR_EMU_STATS_COUNT(emulation, 0, SL_AVR_EMU_OPCODE_CLASS_MOV);
     sl_avr_emu_opcode_mov(emulation);
   }
   else if(SL_AVR_EMU_IS_MOVW(emulation->memory.flash[emulation->memory.pc]))
   {
+    SL_AVR_EMU_STATS_COUNT(emulation, 0, SL_AVR_EMU_OPCODE_CLASS_MOVW);
     sl_avr_emu_opcode_movw(emulation);
   }
   else if(SL_AVR_EMU_IS_OR(emulation->memory.flash[emulation->memory.pc]))
   {
+    SL_AVR_EMU_STATS_COUNT(emulation, 0, SL_AVR_EMU_OPCODE_CLASS_OR);
     sl_avr_emu_opcode_or(emulation);
   }
   else if(SL_AVR_EMU_IS_SUB(emulation->memory.flash[emulation->memory.pc]))
   {
+    SL_AVR_EMU_STATS_COUNT(emulation, 0, SL_AVR_EMU_OPCODE_CLASS_SUB);
     sl_avr_emu_opcode_sub(emulation);
   }
   else
   {
     /* Unrecognized OPCODE Handling */
+    SL_AVR_EMU_STATS_COUNT(emulation, 0, SL_AVR_EMU_OPCODE_CLASS_UNRECOGNIZED);
     result = sl_avr_emu_opcode_unrecognized(emulation);
   }
   return result;
@@ -1018,15 +1011,18 @@ sl_avr_emu_result_e sl_avr_emu_opcode_1(sl_avr_emu_emulation_s * emulation)
   sl_avr_emu_result_e result = SL_AVR_EMU_RESULT_SUCCESS;
   if(SL_AVR_EMU_IS_ORI(emulation->memory.flash[emulation->memory.pc]))
   {
+    SL_AVR_EMU_STATS_COUNT(emulation, 1, SL_AVR_EMU_OPCODE_CLASS_ORI);
     sl_avr_emu_opcode_ori(emulation);
   }
   else if(SL_AVR_EMU_IS_SUBI_SBCI(emulation->memory.flash[emulation->memory.pc]))
   {
+    SL_AVR_EMU_STATS_COUNT(emulation, 1, SL_AVR_EMU_OPCODE_CLASS_SUBI_SBCI);
     sl_avr_emu_opcode_subi_sbci(emulation);
   }
   else
   {
     /* Unrecognized OPCODE Handling */
+    SL_AVR_EMU_STATS_COUNT(emulation, 1, SL_AVR_EMU_OPCODE_CLASS_UNRECOGNIZED);
     result = sl_avr_emu_opcode_unrecognized(emulation);
   }
   return result;
@@ -1041,7 +1037,7 @@ sl_avr_emu_result_e sl_avr_emu_opcode_adiw(sl_avr_emu_emulation_s * emulation)
   k_data      = (emulation->memory.flash[emulation->memory.pc] & 0xF) | ((emulation->memory.flash[emulation->memory.pc] >> 2) & 0x30);
   destination = ((emulation->memory.flash[emulation->memory.pc] >> 4) & 0x3);
 
-  destination = (destination<<2) + 24;
+  destination = (destination<<1) + 24;
 
   d_data = emulation->memory.data[destination] | emulation->memory.data[destination+1]<<8;
 
@@ -1173,11 +1169,17 @@ sl_avr_emu_result_e sl_avr_emu_opcode_in_out(sl_avr_emu_emulation_s * emulation)
   if(SL_AVR_EMU_CHECK_BIT(emulation->memory.flash[emulation->memory.pc], 11))
   {
     emulation->memory.pc++;
-    emulation->memory.data[SL_AVR_EMU_IO_TO_DATA_ADDRESS(io_address)] = emulation->memory.data[destination];
+    SL_AVR_EMU_IO_WRITE(emulation, SL_AVR_EMU_IO_TO_DATA_ADDRESS(io_address), emulation->memory.data[destination]);
+    if(SL_AVR_EMU_SPL_ADDRESS == SL_AVR_EMU_IO_TO_DATA_ADDRESS(io_address) ||
+       SL_AVR_EMU_SPH_ADDRESS == SL_AVR_EMU_IO_TO_DATA_ADDRESS(io_address))
+    {
+      sl_avr_emu_stack_sp_written(emulation, SL_AVR_EMU_IO_TO_DATA_ADDRESS(io_address), emulation->memory.pc - 1);
+    }
     SL_AVR_EMU_VERBOSE_LOG(printf("OUT. PC 0x%06x. io 0x%04x, dest 0x%04x data 0x%02x\n", emulation->memory.pc, io_address, destination, emulation->memory.data[SL_AVR_EMU_IO_TO_DATA_ADDRESS(io_address)]));
   }
   else {
     emulation->memory.pc++;
+    SL_AVR_EMU_IO_READ(emulation, SL_AVR_EMU_IO_TO_DATA_ADDRESS(io_address));
     emulation->memory.data[destination] = emulation->memory.data[SL_AVR_EMU_IO_TO_DATA_ADDRESS(io_address)];
     SL_AVR_EMU_VERBOSE_LOG(printf("IN. PC 0x%06x. io 0x%04x, dest 0x%04x, data 0x%02x\n", emulation->memory.pc, io_address, destination, emulation->memory.data[destination]));
   }
@@ -1204,6 +1206,10 @@ sl_avr_emu_result_e sl_avr_emu_opcode_jmp_call(sl_avr_emu_emulation_s * emulatio
     if(0 != (emulation->memory.flash[pc_prev] & 0x2))
     {
       result = slf_var_emu_stack_push_pc(emulation, (pc_prev + 2));
+      if(NULL != emulation->hooks.callgraph)
+      {
+        sl_avr_emu_callgraph_call(emulation);
+      }
       emulation->op_cycles_remaining = (SL_AVR_EMU_VERSION_AVRE == emulation->version)?3:2;
       if(SL_AVR_EMU_EXTENDED_PC_ADDRESS)
       {
@@ -1255,11 +1261,12 @@ sl_avr_emu_result_e sl_avr_emu_opcode_ld_st(sl_avr_emu_emulation_s * emulation)
       emulation->memory.pc++;
       if(store)
       {
-        emulation->memory.data[x_address] = emulation->memory.data[destination];
+        SL_AVR_EMU_IO_WRITE(emulation, x_address, emulation->memory.data[destination]);
         SL_AVR_EMU_VERBOSE_LOG(printf("ST. PC 0x%06x. x 0x%06x, data 0x%02x\n", emulation->memory.pc, x_address, emulation->memory.data[destination]));
       }
       else 
       {
+        SL_AVR_EMU_IO_READ(emulation, x_address);
         emulation->memory.data[destination] = emulation->memory.data[x_address];
         SL_AVR_EMU_VERBOSE_LOG(printf("LD. PC 0x%06x. x 0x%06x, data 0x%02x\n", emulation->memory.pc, x_address, emulation->memory.data[destination]));
       }
@@ -1317,13 +1324,14 @@ sl_avr_emu_result_e sl_avr_emu_opcode_lds_sts(sl_avr_emu_emulation_s * emulation
     emulation->memory.pc += 2;
     if(set)
     {
-      emulation->memory.data[ram_address] = emulation->memory.data[destination];
+      SL_AVR_EMU_IO_WRITE(emulation, ram_address, emulation->memory.data[destination]);
       SL_AVR_EMU_VERBOSE_LOG(printf("STS. PC 0x%06x. ram_address 0x%06x, dest 0x%02x, r_data 0x%02x\n", emulation->memory.pc, ram_address, destination, emulation->memory.data[destination]));
 
       emulation->op_cycles_remaining = 1;
     }
     else
     {
+      SL_AVR_EMU_IO_READ(emulation, ram_address);
       emulation->memory.data[destination] = emulation->memory.data[ram_address];
       SL_AVR_EMU_VERBOSE_LOG(printf("LDS. PC 0x%06x. ram_address 0x%06x, dest 0x%02x, r_data 0x%02x\n", emulation->memory.pc, ram_address, destination, emulation->memory.data[destination]));
 
@@ -1371,7 +1379,7 @@ sl_avr_emu_result_e sl_avr_emu_opcode_lpm_elpm(sl_avr_emu_emulation_s * emulatio
 
   if(SL_AVR_EMU_RESULT_SUCCESS == result && SL_AVR_EMU_FLASH_ADDRESS_VALID(z_pointer))
   {
-    emulation->memory.data[destination] = emulation->memory.flash[z_pointer];
+    emulation->memory.data[destination] = sl_avr_emu_breakpoint_word(emulation, z_pointer);
 
     if(inc)
     {
@@ -1471,6 +1479,10 @@ sl_avr_emu_result_e sl_avr_emu_opcode_ret(sl_avr_emu_emulation_s * emulation)
 {
   sl_avr_emu_result_e result = SL_AVR_EMU_RESULT_SUCCESS;
   
+  if(NULL != emulation->hooks.callgraph)
+  {
+    sl_avr_emu_callgraph_return(emulation);
+  }
   result = slf_var_emu_stack_pop_pc(emulation, &emulation->memory.pc);
 
   if(SL_AVR_EMU_VERSION_AVRRC == emulation->version)
@@ -1503,6 +1515,10 @@ sl_avr_emu_result_e sl_avr_emu_opcode_reti(sl_avr_emu_emulation_s * emulation)
 {
   sl_avr_emu_result_e result = SL_AVR_EMU_RESULT_SUCCESS;
   
+  if(NULL != emulation->hooks.callgraph)
+  {
+    sl_avr_emu_callgraph_return(emulation);
+  }
   result = slf_var_emu_stack_pop_pc(emulation, &emulation->memory.pc);
 
   if(SL_AVR_EMU_VERSION_AVRRC == emulation->version)
@@ -1528,6 +1544,11 @@ sl_avr_emu_result_e sl_avr_emu_opcode_reti(sl_avr_emu_emulation_s * emulation)
 
   SL_AVR_EMU_SET_SREG_BIT(*emulation, SL_AVR_EMU_SREG_INTERRUPT_FLAG);
 
+  if(NULL != emulation->hooks.latency)
+  {
+    sl_avr_emu_latency_reti(emulation);
+  }
+
   SL_AVR_EMU_VERBOSE_LOG(printf("RETI. PC 0x%06x.\n", emulation->memory.pc));
 
   return result;
@@ -1545,6 +1566,7 @@ sl_avr_emu_result_e sl_avr_emu_opcode_sbic_sbis(sl_avr_emu_emulation_s * emulati
   io_address = ((emulation->memory.flash[emulation->memory.pc] >> 3) & 0x1F);
   if_set = SL_AVR_EMU_CHECK_BIT(emulation->memory.flash[emulation->memory.pc], 9);
 
+  SL_AVR_EMU_IO_READ(emulation, SL_AVR_EMU_IO_TO_DATA_ADDRESS(io_address));
   skip = SL_AVR_EMU_CHECK_BIT(emulation->memory.data[SL_AVR_EMU_IO_TO_DATA_ADDRESS(io_address)], io_bit);
 
   if(!if_set)
@@ -1556,7 +1578,7 @@ sl_avr_emu_result_e sl_avr_emu_opcode_sbic_sbis(sl_avr_emu_emulation_s * emulati
   {
     if(SL_AVR_EMU_PC_ADDRESS_VALID(emulation->memory.pc+1))
     {
-      if(SL_AVR_EMU_IS_TWO_WORD_OPCODE(emulation->memory.flash[emulation->memory.pc+1]))
+      if(SL_AVR_EMU_IS_TWO_WORD_OPCODE(sl_avr_emu_breakpoint_word(emulation, emulation->memory.pc+1)))
       {
         if(SL_AVR_EMU_VERSION_AVRRC == emulation->version)
         {
@@ -1603,7 +1625,7 @@ sl_avr_emu_result_e sl_avr_emu_opcode_sbiw(sl_avr_emu_emulation_s * emulation)
   k_data      = (emulation->memory.flash[emulation->memory.pc] & 0xF) | ((emulation->memory.flash[emulation->memory.pc] >> 2) & 0x30);
   destination = ((emulation->memory.flash[emulation->memory.pc] >> 4) & 0x3);
 
-  destination = (destination<<2) + 24;
+  destination = (destination<<1) + 24;
 
   d_data = emulation->memory.data[destination] | emulation->memory.data[destination+1]<<8;
 
@@ -1659,7 +1681,7 @@ sl_avr_emu_result_e sl_avr_emu_opcode_sbiw(sl_avr_emu_emulation_s * emulation)
 
   emulation->op_cycles_remaining=1;
   emulation->memory.pc++;
-  SL_AVR_EMU_VERBOSE_LOG(printf("ADIW. PC 0x%06x. dest 0x%04x, k_data 0x%02x, d_data 0x%04x, difference 0x%04x, sreg 0x%02x\n", emulation->memory.pc, destination, k_data, d_data, difference, emulation->memory.data[SL_AVR_EMU_SREG_ADDRESS]));
+  SL_AVR_EMU_VERBOSE_LOG(printf("SBIW. PC 0x%06x. dest 0x%04x, k_data 0x%02x, d_data 0x%04x, difference 0x%04x, sreg 0x%02x\n", emulation->memory.pc, destination, k_data, d_data, difference, emulation->memory.data[SL_AVR_EMU_SREG_ADDRESS]));
 
   return result;
 }
@@ -1690,6 +1712,75 @@ sl_avr_emu_result_e sl_avr_emu_opcode_sex_clx(sl_avr_emu_emulation_s * emulation
 }
 
 
+/**
+ * @brief Executes the instruction at PC
+ * 
+ * @param emulation 
+ * @return sl_avr_emu_result_e 
+ */
+static sl_avr_emu_result_e sl_avr_emu_dispatch(sl_avr_emu_emulation_s * emulation)
+{
+  sl_avr_emu_result_e result = SL_AVR_EMU_RESULT_SUCCESS;
+
+  switch (emulation->memory.flash[emulation->memory.pc] >> (16-2)) {
+    case 0b00:
+    {
+      result = sl_avr_emu_opcode_0(emulation);
+      break;
+    }
+    case 0b01:
+    {
+      result = sl_avr_emu_opcode_1(emulation);
+      break;
+    }
+    case 0b10:
+    {
+      result = sl_avr_emu_opcode_2(emulation);
+      break;
+    }
+    case 0b11:
+    {
+      result = sl_avr_emu_opcode_3(emulation);
+      break;
+    }
+  }
+
+  return result;
+}
+
+sl_avr_emu_result_e sl_avr_emu_opcode_break(sl_avr_emu_emulation_s * emulation)
+{
+  sl_avr_emu_result_e       result = SL_AVR_EMU_RESULT_BREAKPOINT;
+  sl_avr_emu_breakpoints_s *breakpoints = emulation->hooks.breakpoints;
+  sl_avr_emu_breakpoint_s  *breakpoint  = sl_avr_emu_breakpoint_find(emulation, emulation->memory.pc);
+  sl_avr_emu_extended_address_t pc = emulation->memory.pc;
+
+  if(NULL == breakpoint)
+  {
+    /* BREAK in firmware, stop after it so that resuming continues past it */
+    emulation->memory.pc++;
+    SL_AVR_EMU_VERBOSE_LOG(printf("BREAK. PC 0x%06x.\n", emulation->memory.pc));
+  }
+  else if(breakpoints->resuming && pc == breakpoints->resume_pc)
+  {
+    /* Resuming from this breakpoint, execute the instruction it replaced.  It is counted as itself, not as BREAK. */
+    breakpoints->resuming = false;
+    emulation->hooks.stats.dispatch[2][SL_AVR_EMU_OPCODE_CLASS_BREAK]--;
+    emulation->memory.flash[pc] = breakpoint->original;
+    result = sl_avr_emu_dispatch(emulation);
+    emulation->memory.flash[pc] = SL_AVR_EMU_BREAKPOINT_OPCODE;
+  }
+  else
+  {
+    /* Dispatched outside sl_avr_emu_tick(), which stops before reaching here.  Stop before the instruction. */
+    breakpoints->resuming  = true;
+    breakpoints->resume_pc = pc;
+    SL_AVR_EMU_VERBOSE_LOG(printf("Breakpoint. PC 0x%06x.\n", pc));
+  }
+
+  return result;
+}
+
 /**
  * @brief Opcodes with 0b10 prefix handling
  * 
@@ -1702,64 +1793,84 @@ sl_avr_emu_result_e sl_avr_emu_opcode_2(sl_avr_emu_emulation_s * emulation)
 
   if(SL_AVR_EMU_IS_ADIW(emulation->memory.flash[emulation->memory.pc]))
   {
+    SL_AVR_EMU_STATS_COUNT(emulation, 2, SL_AVR_EMU_OPCODE_CLASS_ADIW);
     result = sl_avr_emu_opcode_adiw(emulation);
   }
   else if(SL_AVR_EMU_IS_DEC(emulation->memory.flash[emulation->memory.pc]))
   {
+    SL_AVR_EMU_STATS_COUNT(emulation, 2, SL_AVR_EMU_OPCODE_CLASS_DEC);
     result = sl_avr_emu_opcode_dec(emulation);
   }
   else if(SL_AVR_EMU_IS_IN_OUT(emulation->memory.flash[emulation->memory.pc]) )
   {
+    SL_AVR_EMU_STATS_COUNT(emulation, 2, SL_AVR_EMU_OPCODE_CLASS_IN_OUT);
     result = sl_avr_emu_opcode_in_out(emulation);
   }
   else if(SL_AVR_EMU_IS_JMP_CALL(emulation->memory.flash[emulation->memory.pc]) )
   {
+    SL_AVR_EMU_STATS_COUNT(emulation, 2, SL_AVR_EMU_OPCODE_CLASS_JMP_CALL);
     result = sl_avr_emu_opcode_jmp_call(emulation);
   }
   else if(SL_AVR_EMU_IS_LD_ST(emulation->memory.flash[emulation->memory.pc]))
   {
+    SL_AVR_EMU_STATS_COUNT(emulation, 2, SL_AVR_EMU_OPCODE_CLASS_LD_ST);
     result = sl_avr_emu_opcode_ld_st(emulation);
   }
   else if(SL_AVR_EMU_IS_LDS_STS(emulation->memory.flash[emulation->memory.pc]))
   {
+    SL_AVR_EMU_STATS_COUNT(emulation, 2, SL_AVR_EMU_OPCODE_CLASS_LDS_STS);
     result = sl_avr_emu_opcode_lds_sts(emulation);
   }
   else if(SL_AVR_EMU_IS_LPM_ELPM(emulation->memory.flash[emulation->memory.pc]) ||
           SL_AVR_EMU_IS_LPMZ_ELPMZ(emulation->memory.flash[emulation->memory.pc]))
   {
+    SL_AVR_EMU_STATS_COUNT(emulation, 2, SL_AVR_EMU_OPCODE_CLASS_LPM_ELPM);
     result = sl_avr_emu_opcode_lpm_elpm(emulation);
   }
   else if(SL_AVR_EMU_IS_COM(emulation->memory.flash[emulation->memory.pc]))
   {
+    SL_AVR_EMU_STATS_COUNT(emulation, 2, SL_AVR_EMU_OPCODE_CLASS_COM);
     result = sl_avr_emu_opcode_com(emulation);
   }
   else if(SL_AVR_EMU_IS_PUSH_POP(emulation->memory.flash[emulation->memory.pc]))
   {
+    SL_AVR_EMU_STATS_COUNT(emulation, 2, SL_AVR_EMU_OPCODE_CLASS_PUSH_POP);
     result = sl_avr_emu_opcode_push_pop(emulation);
   }
   else if(SL_AVR_EMU_IS_RET(emulation->memory.flash[emulation->memory.pc]))
   {
+    SL_AVR_EMU_STATS_COUNT(emulation, 2, SL_AVR_EMU_OPCODE_CLASS_RET);
     result = sl_avr_emu_opcode_ret(emulation);
   }
   else if(SL_AVR_EMU_IS_RETI(emulation->memory.flash[emulation->memory.pc]))
   {
+    SL_AVR_EMU_STATS_COUNT(emulation, 2, SL_AVR_EMU_OPCODE_CLASS_RETI);
     result = sl_avr_emu_opcode_reti(emulation);
   }
   else if(SL_AVR_EMU_IS_SBIC_SBIS(emulation->memory.flash[emulation->memory.pc]))
   {
+    SL_AVR_EMU_STATS_COUNT(emulation, 2, SL_AVR_EMU_OPCODE_CLASS_SBIC_SBIS);
     result = sl_avr_emu_opcode_sbic_sbis(emulation);
   }
   else if(SL_AVR_EMU_IS_SBIW(emulation->memory.flash[emulation->memory.pc]))
   {
+    SL_AVR_EMU_STATS_COUNT(emulation, 2, SL_AVR_EMU_OPCODE_CLASS_SBIW);
     result = sl_avr_emu_opcode_sbiw(emulation);
   }
   else if(SL_AVR_EMU_IS_SEX_CLX(emulation->memory.flash[emulation->memory.pc]))
   {
+    SL_AVR_EMU_STATS_COUNT(emulation, 2, SL_AVR_EMU_OPCODE_CLASS_SEX_CLX);
     result = sl_avr_emu_opcode_sex_clx(emulation);
   }
+  else if(SL_AVR_EMU_IS_BREAK(emulation->memory.flash[emulation->memory.pc]))
+  {
+    SL_AVR_EMU_STATS_COUNT(emulation, 2, SL_AVR_EMU_OPCODE_CLASS_BREAK);
+    result = sl_avr_emu_opcode_break(emulation);
+  }
   else
   {
     /* Unrecognized OPCODE Handling */
+    SL_AVR_EMU_STATS_COUNT(emulation, 2, SL_AVR_EMU_OPCODE_CLASS_UNRECOGNIZED);
     result = sl_avr_emu_opcode_unrecognized(emulation);
   }
   return result;
@@ -1845,6 +1956,10 @@ sl_avr_emu_result_e sl_avr_emu_opcode_rjmp_rcall(sl_avr_emu_emulation_s * emulat
   if(SL_AVR_EMU_CHECK_BIT(emulation->memory.flash[pc_prev], 12))
   {
     result = slf_var_emu_stack_push_pc(emulation, (pc_prev + 1));
+    if(NULL != emulation->hooks.callgraph)
+    {
+      sl_avr_emu_callgraph_call(emulation);
+    }
     emulation->op_cycles_remaining = (SL_AVR_EMU_VERSION_AVRE == emulation->version || SL_AVR_EMU_VERSION_AVRRC == emulation->version)?2:1;
     if(SL_AVR_EMU_EXTENDED_PC_ADDRESS)
     {
@@ -1869,6 +1984,61 @@ sl_avr_emu_result_e sl_avr_emu_opcode_rjmp_rcall(sl_avr_emu_emulation_s * emulat
 }
 
 
+sl_avr_emu_result_e sl_avr_emu_opcode_sbrc_sbrs(sl_avr_emu_emulation_s * emulation)
+{
+  sl_avr_emu_result_e  result = SL_AVR_EMU_RESULT_SUCCESS;
+  sl_avr_emu_address_t source = 0;
+  sl_avr_emu_address_t bit    = 0;
+  bool skip, if_set;
+
+  bit    = (emulation->memory.flash[emulation->memory.pc] & 0x7);
+  source = ((emulation->memory.flash[emulation->memory.pc] >> 4) & 0x1F);
+  if_set = SL_AVR_EMU_CHECK_BIT(emulation->memory.flash[emulation->memory.pc], 9);
+
+  skip = SL_AVR_EMU_CHECK_BIT(emulation->memory.data[source], bit);
+
+  if(!if_set)
+  {
+    skip = !skip;
+  }
+
+  if(skip)
+  {
+    if(SL_AVR_EMU_PC_ADDRESS_VALID(emulation->memory.pc+1))
+    {
+      if(SL_AVR_EMU_IS_TWO_WORD_OPCODE(sl_avr_emu_breakpoint_word(emulation, emulation->memory.pc+1)))
+      {
+        if(SL_AVR_EMU_VERSION_AVRRC == emulation->version)
+        {
+          result = sl_avr_emu_opcode_unsupported(emulation);
+        }
+        else
+        {
+          emulation->memory.pc += 3;
+          emulation->op_cycles_remaining = 2;
+        }
+      }
+      else 
+      {
+        emulation->memory.pc += 2;
+        emulation->op_cycles_remaining = 1;
+      }
+    }
+    else 
+    {
+      result = SL_AVR_EMU_RESULT_INVALID_PC;
+    }
+  }
+  else 
+  {
+    emulation->memory.pc++;
+  }
+
+  SL_AVR_EMU_VERBOSE_LOG(printf("%s. PC 0x%06x. source 0x%02x data 0x%02x bit 0x%x\n", (if_set)?"SBRS":"SBRC", emulation->memory.pc, source, emulation->memory.data[source], bit));
+
+  return result;
+}
+
 /**
  * @brief Opcodes with 0b11 prefix handling
  * 
@@ -1881,19 +2051,28 @@ sl_avr_emu_result_e sl_avr_emu_opcode_3(sl_avr_emu_emulation_s * emulation)
 
   if(SL_AVR_EMU_IS_BRBS_BRBC(emulation->memory.flash[emulation->memory.pc]))
   {
+    SL_AVR_EMU_STATS_COUNT(emulation, 3, SL_AVR_EMU_OPCODE_CLASS_BRBS_BRBC);
     result = sl_avr_emu_opcode_brbs_brbc(emulation);
   }
   else if(SL_AVR_EMU_IS_LDI(emulation->memory.flash[emulation->memory.pc]))
   {
+    SL_AVR_EMU_STATS_COUNT(emulation, 3, SL_AVR_EMU_OPCODE_CLASS_LDI);
     result = sl_avr_emu_opcode_ldi(emulation);
   }
   else if(SL_AVR_EMU_IS_RJMP_RCALL(emulation->memory.flash[emulation->memory.pc]))
   {
+    SL_AVR_EMU_STATS_COUNT(emulation, 3, SL_AVR_EMU_OPCODE_CLASS_RJMP_RCALL);
     result = sl_avr_emu_opcode_rjmp_rcall(emulation);
   }
+  else if(SL_AVR_EMU_IS_SBRC_SBRS(emulation->memory.flash[emulation->memory.pc]))
+  {
+    SL_AVR_EMU_STATS_COUNT(emulation, 3, SL_AVR_EMU_OPCODE_CLASS_SBRC_SBRS);
+    result = sl_avr_emu_opcode_sbrc_sbrs(emulation);
+  }
   else
   {
     /* Unrecognized OPCODE Handling */
+    SL_AVR_EMU_STATS_COUNT(emulation, 3, SL_AVR_EMU_OPCODE_CLASS_UNRECOGNIZED);
     result = sl_avr_emu_opcode_unrecognized(emulation);
   }
   return result;
@@ -1908,10 +2087,26 @@ sl_avr_emu_result_e sl_avr_emu_opcode_3(sl_avr_emu_emulation_s * emulation)
 sl_avr_emu_result_e sl_avr_emu_tick(sl_avr_emu_emulation_s * emulation)
 {
   sl_avr_emu_result_e result = SL_AVR_EMU_RESULT_SUCCESS;
+  sl_avr_emu_result_e guard_result;
+  sl_avr_emu_extended_address_t pc;
   
   emulation->tick_count++;
 
-  if(emulation->op_cycles_remaining > 0)
+  if(emulation->tick_count >= emulation->events.next_tick)
+  {
+    result = sl_avr_emu_event_dispatch(emulation);
+  }
+  if(NULL != emulation->hooks.latency)
+  {
+    /* After events, which raise peripheral flags, and before the interrupt controller can take and clear them */
+    sl_avr_emu_latency_io_tick(emulation);
+  }
+
+  if(SL_AVR_EMU_RESULT_SUCCESS != result)
+  {
+    /* Event failure, stop emulation */
+  }
+  else if(emulation->op_cycles_remaining > 0)
   {
     emulation->op_cycles_remaining--;
     SL_AVR_EMU_VERBOSE_LOG(printf("tick %lu: %u cycles for remaining for current operation\n", emulation->tick_count, emulation->op_cycles_remaining));
@@ -1923,28 +2118,44 @@ sl_avr_emu_result_e sl_avr_emu_tick(sl_avr_emu_emulation_s * emulation)
     if(SL_AVR_EMU_PC_ADDRESS_VALID(emulation->memory.pc))
     {
       SL_AVR_EMU_VERBOSE_LOG(printf("tick %lu: PC 0x%06x. OP 0x%04x.\n", emulation->tick_count, emulation->memory.pc, emulation->memory.flash[emulation->memory.pc]));
-      switch (emulation->memory.flash[emulation->memory.pc] >> (16-2)) {
-        case 0b00:
-        {
-          result = sl_avr_emu_opcode_0(emulation);
-          break;
-        }
-        case 0b01:
-        {
-          result = sl_avr_emu_opcode_1(emulation);
-          break;
-        }
-        case 0b10:
-        {
-          result = sl_avr_emu_opcode_2(emulation);
-          break;
-        }
-        case 0b11:
+      if(NULL != emulation->hooks.breakpoints && sl_avr_emu_breakpoint_stop(emulation))
+      {
+        /* Nothing executed, so nothing is traced or counted */
+        return SL_AVR_EMU_RESULT_BREAKPOINT;
+      }
+      if(NULL != emulation->hooks.fuzz_edge_map)
+      {
+        sl_avr_emu_fuzz_trace_pc(emulation);
+      }
+      if(NULL != emulation->hooks.profile)
+      {
+        sl_avr_emu_profile_trace(emulation);
+      }
+      if(NULL != emulation->hooks.coverage)
+      {
+        sl_avr_emu_coverage_trace(emulation);
+      }
+      pc = emulation->memory.pc;
+      if(NULL == emulation->hooks.watch)
+      {
+        result = sl_avr_emu_dispatch(emulation);
+      }
+      else
+      {
+        /* Accesses are decoded up front so the instruction handlers carry no per-access test for counters */
+        sl_avr_emu_watch_instruction(emulation);
+        result = sl_avr_emu_dispatch(emulation);
+        if(SL_AVR_EMU_RESULT_SUCCESS == result)
         {
-          result = sl_avr_emu_opcode_3(emulation);
-          break;
+          result = sl_avr_emu_watch_check(emulation, pc);
         }
       }
+      if(NULL != emulation->hooks.guard && emulation->hooks.guard->pending)
+      {
+        /* Protect pages opened by the instruction's faults again, even if it failed */
+        guard_result = sl_avr_emu_guard_check(emulation, pc);
+        result = (SL_AVR_EMU_RESULT_SUCCESS == result)?guard_result:result;
+      }
     }
     else
     {
@@ -1963,7 +2174,35 @@ sl_avr_emu_result_e sl_avr_emu_tick(sl_avr_emu_emulation_s * emulation)
  */
 sl_avr_emu_result_e sl_avr_emu_io_tick(sl_avr_emu_emulation_s * emulation)
 {
+  sl_avr_emu_result_e result = SL_AVR_EMU_RESULT_SUCCESS;
+
   emulation->io_tick_count++;
   SL_AVR_EMU_VERBOSE_LOG(printf("IO tick %lu\n", emulation->io_tick_count));
-  sl_avr_emu_timer_8_tick(&emulation->timer0);
+
+  return result;
+}
+
+/**
+ * @brief Runs IO and CPU ticks until an error occurs or tick_limit is reached
+ * 
+ * @param emulation  - Pointer to emulation to simulate
+ * @param tick_limit - Tick count at which to stop, SL_AVR_EMU_TICK_COUNT_MAX to run until error
+ * @return sl_avr_emu_result_e
+ */
+sl_avr_emu_result_e sl_avr_emu_run(sl_avr_emu_emulation_s * emulation, sl_avr_emu_tick_count_t tick_limit)
+{
+  sl_avr_emu_result_e result = SL_AVR_EMU_RESULT_SUCCESS;
+
+  emulation->tick_limit = tick_limit;
+  while(SL_AVR_EMU_RESULT_SUCCESS == result && emulation->tick_count < tick_limit)
+  {
+    result = sl_avr_emu_io_tick(emulation);
+    if(SL_AVR_EMU_RESULT_SUCCESS == result)
+    {
+      result = sl_avr_emu_tick(emulation);
+    }
+  }
+  emulation->tick_limit = 0;
+
+  return result;
 }
\ No newline at end of file
@@ -1,166 +1,869 @@
 /**
  * @file sl_avr_emu_timer.c
  * @author Ed Sandor (ed@ewsandor.com)
- * @brief Sandor Labs AVR Emulator Timer/Counter Logic
+ * @brief Sandor Labs AVR Emulator Timer Logic
  * @version 0.1
- * @date 2020-09-07
+ * @date 2020-09-05
  * 
  * @copyright Copyright (c) 2020
  * 
+ * Timers are not ticked.  Between two stops (a compare value, TOP, BOTTOM or MAX) a counter only
+ * counts, so each timer schedules one event for the timer clock edge that leaves its next stop and
+ * is brought up to date there, or when firmware accesses its registers.  As in the datasheet timing
+ * diagrams, flags are set on the timer clock edge after the counter held the matching value.
  */
 
-#include <stdbool.h>
-#include <stddef.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "sl_avr_emu.h"
 #include "sl_avr_emu_bitops.h"
+#include "sl_avr_emu_event.h"
+#include "sl_avr_emu_io.h"
 #include "sl_avr_emu_timer.h"
+#include "sl_avr_emu_trace.h"
+#include "sl_avr_emu_waveform.h"
+
+/* Flag bits, at the same positions in TIFR0, TIFR1 and TIFR2 */
+#define SL_AVR_EMU_TIMER_TOV  SL_AVR_EMU_TIMER_1_TOV1
+#define SL_AVR_EMU_TIMER_OCFA SL_AVR_EMU_TIMER_1_OCF1A
+#define SL_AVR_EMU_TIMER_OCFB SL_AVR_EMU_TIMER_1_OCF1B
+#define SL_AVR_EMU_TIMER_ICF  SL_AVR_EMU_TIMER_1_ICF1
+
+/* Clock select bits of TCCRnB */
+#define SL_AVR_EMU_TIMER_CS_MASK 0x7
+/* Force output compare strobes of TCCR0B, TCCR1C and TCCR2B, always read as zero */
+#define SL_AVR_EMU_TIMER_FOC_MASK 0xC0
+#define SL_AVR_EMU_TIMER_FOCA     0x7
+/* Compare output mode bits of TCCRnA, COMnA in bits 7:6 and COMnB in bits 5:4 */
+#define SL_AVR_EMU_TIMER_COM_MASK 0xF0
+#define SL_AVR_EMU_TIMER_COM(tccra, channel) (((tccra) >> (6 - 2*(channel))) & 0x3)
 
 /**
- * @brief Checks if 8-bit timer is properly configured
+ * @brief Register layout of a timer
  * 
- * @param timer - Timer to check
- * @return true 
- * @return false 
  */
-bool sl_avr_emu_timer_8_configured(sl_avr_emu_timer_8_s *timer)
+typedef struct
 {
-  bool ret_val = true;
+  /* Data addresses, 16-bit registers have their high byte at the next address */
+  sl_avr_emu_address_t tccra;
+  sl_avr_emu_address_t tccrb;
+  sl_avr_emu_address_t tcnt;
+  sl_avr_emu_address_t ocra;
+  sl_avr_emu_address_t ocrb;
+  /* 0 for timers without input capture */
+  sl_avr_emu_address_t icr;
+  sl_avr_emu_address_t tifr;
+  /* Register with the force output compare strobes */
+  sl_avr_emu_address_t foc;
+  bool                 wide;
+  /* Timer clock prescaler of each clock select, 0 for external clocks, which are not modelled and stop the timer */
+  uint16_t             prescalers[SL_AVR_EMU_TIMER_CS_MASK + 1];
+
+} sl_avr_emu_timer_layout_s;
 
-  ret_val = (timer        != NULL &&
-             timer->tccra != NULL &&
-             timer->tccrb != NULL &&
-             timer->tcnt  != NULL &&
-             timer->ocra  != NULL &&
-             timer->ocrb  != NULL &&
-             timer->timsk != NULL &&
-             timer->tifr  != NULL );
+static const sl_avr_emu_timer_layout_s sl_avr_emu_timer_layouts[] =
+{
+  {SL_AVR_EMU_IO_TO_DATA_ADDRESS(SL_AVR_EMU_TIMER_0_TCCR0A), SL_AVR_EMU_IO_TO_DATA_ADDRESS(SL_AVR_EMU_TIMER_0_TCCR0B),
+   SL_AVR_EMU_IO_TO_DATA_ADDRESS(SL_AVR_EMU_TIMER_0_TCNT0),  SL_AVR_EMU_IO_TO_DATA_ADDRESS(SL_AVR_EMU_TIMER_0_OCR0A),
+   SL_AVR_EMU_IO_TO_DATA_ADDRESS(SL_AVR_EMU_TIMER_0_OCR0B),  0,
+   SL_AVR_EMU_IO_TO_DATA_ADDRESS(SL_AVR_EMU_TIMER_0_TIFR0),  SL_AVR_EMU_IO_TO_DATA_ADDRESS(SL_AVR_EMU_TIMER_0_TCCR0B),
+   false, {0, 1, 8, 64, 256, 1024, 0, 0}},
+  {SL_AVR_EMU_TIMER_1_TCCR1A, SL_AVR_EMU_TIMER_1_TCCR1B, SL_AVR_EMU_TIMER_1_TCNT1L, SL_AVR_EMU_TIMER_1_OCR1AL,
+   SL_AVR_EMU_TIMER_1_OCR1BL, SL_AVR_EMU_TIMER_1_ICR1L,
+   SL_AVR_EMU_IO_TO_DATA_ADDRESS(SL_AVR_EMU_TIMER_1_TIFR1),  SL_AVR_EMU_TIMER_1_TCCR1C,
+   true,  {0, 1, 8, 64, 256, 1024, 0, 0}},
+  {SL_AVR_EMU_TIMER_2_TCCR2A, SL_AVR_EMU_TIMER_2_TCCR2B, SL_AVR_EMU_TIMER_2_TCNT2,  SL_AVR_EMU_TIMER_2_OCR2A,
+   SL_AVR_EMU_TIMER_2_OCR2B,  0,
+   SL_AVR_EMU_IO_TO_DATA_ADDRESS(SL_AVR_EMU_TIMER_2_TIFR2),  SL_AVR_EMU_TIMER_2_TCCR2B,
+   false, {0, 1, 8, 32, 64, 128, 256, 1024}},
+};
 
-  return ret_val;
+/**
+ * @brief Source of a mode's TOP
+ * 
+ */
+typedef enum
+{
+  SL_AVR_EMU_TIMER_TOP_FIXED,
+  SL_AVR_EMU_TIMER_TOP_OCRA,
+  SL_AVR_EMU_TIMER_TOP_ICR,
+} sl_avr_emu_timer_top_e;
+
+/**
+ * @brief Point in the count sequence where an event happens
+ * 
+ */
+typedef enum
+{
+  SL_AVR_EMU_TIMER_AT_IMMEDIATE,
+  SL_AVR_EMU_TIMER_AT_MAX,
+  SL_AVR_EMU_TIMER_AT_TOP,
+  SL_AVR_EMU_TIMER_AT_BOTTOM,
+} sl_avr_emu_timer_at_e;
+
+/**
+ * @brief Compare output actions, numbered as the non-PWM COMnx settings
+ * 
+ */
+typedef enum
+{
+  SL_AVR_EMU_TIMER_OUTPUT_NONE   = 0,
+  SL_AVR_EMU_TIMER_OUTPUT_TOGGLE = 1,
+  SL_AVR_EMU_TIMER_OUTPUT_CLEAR  = 2,
+  SL_AVR_EMU_TIMER_OUTPUT_SET    = 3,
+} sl_avr_emu_timer_output_e;
+
+/**
+ * @brief Waveform generation mode
+ * 
+ */
+typedef struct
+{
+  sl_avr_emu_timer_top_e top_source;
+  /* TOP of SL_AVR_EMU_TIMER_TOP_FIXED modes, else resolved by sl_avr_emu_timer_mode */
+  sl_avr_emu_word_t      top;
+  /* Counts up to TOP and back down to BOTTOM (phase correct modes) */
+  bool                   dual_slope;
+  /* When buffered OCRnx writes take effect */
+  sl_avr_emu_timer_at_e  update;
+  /* When TOVn is set */
+  sl_avr_emu_timer_at_e  overflow;
+
+} sl_avr_emu_timer_mode_s;
+
+/* TCCRnA/B WGM bits of 8-bit timers */
+static const sl_avr_emu_timer_mode_s sl_avr_emu_timer_8_modes[] =
+{
+  [SL_AVR_EMU_TIMER_WGM_NORMAL]        = {SL_AVR_EMU_TIMER_TOP_FIXED, 0xFF, false, SL_AVR_EMU_TIMER_AT_IMMEDIATE, SL_AVR_EMU_TIMER_AT_MAX},
+  [SL_AVR_EMU_TIMER_WGM_PWM]           = {SL_AVR_EMU_TIMER_TOP_FIXED, 0xFF, true,  SL_AVR_EMU_TIMER_AT_TOP,       SL_AVR_EMU_TIMER_AT_BOTTOM},
+  [SL_AVR_EMU_TIMER_WGM_CTC]           = {SL_AVR_EMU_TIMER_TOP_OCRA,  0,    false, SL_AVR_EMU_TIMER_AT_IMMEDIATE, SL_AVR_EMU_TIMER_AT_MAX},
+  [SL_AVR_EMU_TIMER_WGM_FAST_PWM]      = {SL_AVR_EMU_TIMER_TOP_FIXED, 0xFF, false, SL_AVR_EMU_TIMER_AT_BOTTOM,    SL_AVR_EMU_TIMER_AT_TOP},
+  [SL_AVR_EMU_TIMER_WGM_RESERVED_0]    = {SL_AVR_EMU_TIMER_TOP_FIXED, 0xFF, false, SL_AVR_EMU_TIMER_AT_IMMEDIATE, SL_AVR_EMU_TIMER_AT_MAX},
+  [SL_AVR_EMU_TIMER_WGM_PWM_OCRA]      = {SL_AVR_EMU_TIMER_TOP_OCRA,  0,    true,  SL_AVR_EMU_TIMER_AT_TOP,       SL_AVR_EMU_TIMER_AT_BOTTOM},
+  [SL_AVR_EMU_TIMER_WGM_RESERVED_1]    = {SL_AVR_EMU_TIMER_TOP_FIXED, 0xFF, false, SL_AVR_EMU_TIMER_AT_IMMEDIATE, SL_AVR_EMU_TIMER_AT_MAX},
+  [SL_AVR_EMU_TIMER_WGM_FAST_PWM_OCRA] = {SL_AVR_EMU_TIMER_TOP_OCRA,  0,    false, SL_AVR_EMU_TIMER_AT_BOTTOM,    SL_AVR_EMU_TIMER_AT_TOP},
+};
+
+/* TCCR1A/B WGM1 bits */
+static const sl_avr_emu_timer_mode_s sl_avr_emu_timer_16_modes[] =
+{
+  /* Normal */
+  {SL_AVR_EMU_TIMER_TOP_FIXED, 0xFFFF, false, SL_AVR_EMU_TIMER_AT_IMMEDIATE, SL_AVR_EMU_TIMER_AT_MAX},
+  /* PWM, phase correct, 8, 9 and 10-bit */
+  {SL_AVR_EMU_TIMER_TOP_FIXED, 0x00FF, true,  SL_AVR_EMU_TIMER_AT_TOP,       SL_AVR_EMU_TIMER_AT_BOTTOM},
+  {SL_AVR_EMU_TIMER_TOP_FIXED, 0x01FF, true,  SL_AVR_EMU_TIMER_AT_TOP,       SL_AVR_EMU_TIMER_AT_BOTTOM},
+  {SL_AVR_EMU_TIMER_TOP_FIXED, 0x03FF, true,  SL_AVR_EMU_TIMER_AT_TOP,       SL_AVR_EMU_TIMER_AT_BOTTOM},
+  /* CTC, OCR1A */
+  {SL_AVR_EMU_TIMER_TOP_OCRA,  0,      false, SL_AVR_EMU_TIMER_AT_IMMEDIATE, SL_AVR_EMU_TIMER_AT_MAX},
+  /* Fast PWM, 8, 9 and 10-bit */
+  {SL_AVR_EMU_TIMER_TOP_FIXED, 0x00FF, false, SL_AVR_EMU_TIMER_AT_BOTTOM,    SL_AVR_EMU_TIMER_AT_TOP},
+  {SL_AVR_EMU_TIMER_TOP_FIXED, 0x01FF, false, SL_AVR_EMU_TIMER_AT_BOTTOM,    SL_AVR_EMU_TIMER_AT_TOP},
+  {SL_AVR_EMU_TIMER_TOP_FIXED, 0x03FF, false, SL_AVR_EMU_TIMER_AT_BOTTOM,    SL_AVR_EMU_TIMER_AT_TOP},
+  /* PWM, phase and frequency correct, ICR1 and OCR1A */
+  {SL_AVR_EMU_TIMER_TOP_ICR,   0,      true,  SL_AVR_EMU_TIMER_AT_BOTTOM,    SL_AVR_EMU_TIMER_AT_BOTTOM},
+  {SL_AVR_EMU_TIMER_TOP_OCRA,  0,      true,  SL_AVR_EMU_TIMER_AT_BOTTOM,    SL_AVR_EMU_TIMER_AT_BOTTOM},
+  /* PWM, phase correct, ICR1 and OCR1A */
+  {SL_AVR_EMU_TIMER_TOP_ICR,   0,      true,  SL_AVR_EMU_TIMER_AT_TOP,       SL_AVR_EMU_TIMER_AT_BOTTOM},
+  {SL_AVR_EMU_TIMER_TOP_OCRA,  0,      true,  SL_AVR_EMU_TIMER_AT_TOP,       SL_AVR_EMU_TIMER_AT_BOTTOM},
+  /* CTC, ICR1 */
+  {SL_AVR_EMU_TIMER_TOP_ICR,   0,      false, SL_AVR_EMU_TIMER_AT_IMMEDIATE, SL_AVR_EMU_TIMER_AT_MAX},
+  /* Reserved */
+  {SL_AVR_EMU_TIMER_TOP_FIXED, 0xFFFF, false, SL_AVR_EMU_TIMER_AT_IMMEDIATE, SL_AVR_EMU_TIMER_AT_MAX},
+  /* Fast PWM, ICR1 and OCR1A */
+  {SL_AVR_EMU_TIMER_TOP_ICR,   0,      false, SL_AVR_EMU_TIMER_AT_BOTTOM,    SL_AVR_EMU_TIMER_AT_TOP},
+  {SL_AVR_EMU_TIMER_TOP_OCRA,  0,      false, SL_AVR_EMU_TIMER_AT_BOTTOM,    SL_AVR_EMU_TIMER_AT_TOP},
+};
+
+/**
+ * @brief Reads a timer register, both bytes of 16-bit registers
+ * 
+ * @param emulation
+ * @param layout
+ * @param address   - Low byte data address
+ * @return sl_avr_emu_word_t
+ */
+static sl_avr_emu_word_t sl_avr_emu_timer_register(const sl_avr_emu_emulation_s *emulation, const sl_avr_emu_timer_layout_s *layout, sl_avr_emu_address_t address)
+{
+  return emulation->memory.data[address] | (layout->wide?(emulation->memory.data[address + 1] << 8):0);
 }
 
 /**
- * @brief Configures timer counter 0 registers as 8-bit timer
+ * @brief Resolves the waveform generation mode set in a timer's control registers
  * 
- * @param memory - memory containing timer 0's register
- * @param timer  - timer to configure
- * @return sl_avr_emu_result_e 
+ * @param emulation
+ * @param timer
+ * @param mode      - Mode with TOP resolved
+ * @return sl_avr_emu_word_t - MAX of the counter
  */
-sl_avr_emu_result_e sl_avr_emu_configure_timer0(sl_avr_emu_memory_s * memory, sl_avr_emu_timer_8_s *timer)
+static sl_avr_emu_word_t sl_avr_emu_timer_mode(const sl_avr_emu_emulation_s *emulation, const sl_avr_emu_timer_s *timer, sl_avr_emu_timer_mode_s *mode)
 {
-  sl_avr_emu_result_e result = SL_AVR_EMU_RESULT_SUCCESS;
+  const sl_avr_emu_timer_layout_s *layout = &sl_avr_emu_timer_layouts[timer->number];
+  sl_avr_emu_byte_t                tccra  = emulation->memory.data[layout->tccra];
+  sl_avr_emu_byte_t                tccrb  = emulation->memory.data[layout->tccrb];
 
-  if(timer != NULL)
+  if(layout->wide)
   {
-    memset(timer, 0, sizeof(sl_avr_emu_timer_8_s));
-
-    timer->tccra = &memory->data[SL_AVR_EMU_IO_TO_DATA_ADDRESS(SL_AVR_EMU_TIMER_0_TCCR0A)];
-    timer->tccrb = &memory->data[SL_AVR_EMU_IO_TO_DATA_ADDRESS(SL_AVR_EMU_TIMER_0_TCCR0B)];
-    timer->tcnt  = &memory->data[SL_AVR_EMU_IO_TO_DATA_ADDRESS(SL_AVR_EMU_TIMER_0_TCNT0) ];
-    timer->ocra  = &memory->data[SL_AVR_EMU_IO_TO_DATA_ADDRESS(SL_AVR_EMU_TIMER_0_OCR0A) ];
-    timer->ocrb  = &memory->data[SL_AVR_EMU_IO_TO_DATA_ADDRESS(SL_AVR_EMU_TIMER_0_OCR0B) ];
-    timer->timsk = &memory->data[SL_AVR_EMU_TIMER_0_TIMSK0];
-    timer->tifr  = &memory->data[SL_AVR_EMU_IO_TO_DATA_ADDRESS(SL_AVR_EMU_TIMER_0_TIFR0) ];
+    *mode = sl_avr_emu_timer_16_modes[(tccra & 0x3) | ((tccrb >> 1) & 0xC)];
   }
   else
   {
-    result = SL_AVR_EMU_RESULT_FAILURE;    
+    *mode = sl_avr_emu_timer_8_modes[(tccra & 0x3) | ((tccrb >> 1) & 0x4)];
   }
 
-  return result;
+  if(SL_AVR_EMU_TIMER_TOP_OCRA == mode->top_source)
+  {
+    mode->top = timer->ocr[0];
+  }
+  else if(SL_AVR_EMU_TIMER_TOP_ICR == mode->top_source)
+  {
+    mode->top = sl_avr_emu_timer_register(emulation, layout, layout->icr);
+  }
+
+  return layout->wide?0xFFFF:0xFF;
 }
 
 /**
- * @brief Simulates tick of 8-bit timer/counter
+ * @brief Sets up the timer clock from the clock select, restarting the prescaler if it changed
  * 
- * @param timer Timer to simulate
- * @return sl_avr_emu_result_e 
+ * @param emulation
+ * @param timer
  */
-sl_avr_emu_result_e sl_avr_emu_timer_8_tick(sl_avr_emu_timer_8_s *timer)
+static void sl_avr_emu_timer_clock(const sl_avr_emu_emulation_s *emulation, sl_avr_emu_timer_s *timer)
 {
-  sl_avr_emu_result_e result = SL_AVR_EMU_RESULT_SUCCESS;
-  sl_avr_emu_timer_clock_select_e    clock_select;
-  sl_avr_emu_timer_wgm_e             timer_wgm;
-  sl_avr_emu_timer_prescaler_count_t prescaler_reference;
-  sl_avr_emu_byte_t                  tcnt_prev;
+  const sl_avr_emu_timer_layout_s *layout = &sl_avr_emu_timer_layouts[timer->number];
+  uint64_t                         ticks;
+  uint64_t                         edges  = 1;
 
-  if(sl_avr_emu_timer_8_configured(timer))
+  ticks = layout->prescalers[emulation->memory.data[layout->tccrb] & SL_AVR_EMU_TIMER_CS_MASK];
+  if(2 == timer->number && SL_AVR_EMU_CHECK_BIT(emulation->memory.data[SL_AVR_EMU_TIMER_2_ASSR], SL_AVR_EMU_TIMER_2_AS2))
   {
-    clock_select = (*timer->tccrb & 0x7);
-    timer_wgm    = (*timer->tccra & 0x3) | ((*timer->tccrb >> 1) & 0x4);
+    ticks *= emulation->clock_hz;
+    edges  = SL_AVR_EMU_TIMER_2_ASYNC_HZ;
+  }
+  if(0 == ticks)
+  {
+    edges = 0;
+  }
+
+  if(ticks != timer->clock_ticks || edges != timer->clock_edges)
+  {
+    timer->clock_ticks  = ticks;
+    timer->clock_edges  = edges;
+    timer->clock_origin = emulation->tick_count;
+    timer->edges        = 0;
+  }
+}
+
+/**
+ * @brief Timer clock edges from the counter's current value until the edge that leaves its next stop
+ * 
+ * @param timer
+ * @param mode
+ * @param max
+ * @return uint64_t
+ */
+static uint64_t sl_avr_emu_timer_distance(const sl_avr_emu_timer_s *timer, const sl_avr_emu_timer_mode_s *mode, sl_avr_emu_word_t max)
+{
+  sl_avr_emu_word_t count = timer->count;
+  sl_avr_emu_word_t stop;
+  uint32_t          i;
 
-    if(SL_AVR_EMU_CLOCK_SELECT_NONE != clock_select)
+  if(mode->dual_slope && timer->down)
+  {
+    stop = 0;
+    for(i = 0; i < 2; i++)
     {
-      switch(clock_select)
+      if(timer->ocr[i] <= count && timer->ocr[i] > stop)
       {
-        case SL_AVR_EMU_CLOCK_SELECT_IO:
-        case SL_AVR_EMU_CLOCK_SELECT_T0_FALLING:
-        case SL_AVR_EMU_CLOCK_SELECT_T0_RISING:
-        {
-          prescaler_reference = 1;
-          break;
-        }
-        case SL_AVR_EMU_CLOCK_SELECT_IO_8:
-        {
-          prescaler_reference = 8;
-          break;
-        }
-        case SL_AVR_EMU_CLOCK_SELECT_IO_64:
-        {
-          prescaler_reference = 64;
-          break;
-        }
-        case SL_AVR_EMU_CLOCK_SELECT_IO_256:
-        {
-          prescaler_reference = 256;
-          break;
-        }
-        case SL_AVR_EMU_CLOCK_SELECT_IO_1024:
-        {
-          prescaler_reference = 1024;
-          break;
-        }
-        default:
-        {
-          break;
-        }
+        stop = timer->ocr[i];
       }
+    }
+    return count - stop + 1;
+  }
+
+  /* Above TOP single-slope counters run on to MAX, dual-slope counters turn */
+  stop = (count <= mode->top)?mode->top:(mode->dual_slope?count:max);
+  for(i = 0; i < 2; i++)
+  {
+    if(timer->ocr[i] >= count && timer->ocr[i] < stop)
+    {
+      stop = timer->ocr[i];
+    }
+  }
+  return stop - count + 1;
+}
+
+/**
+ * @brief Takes buffered compare values into use
+ * 
+ * @param emulation
+ * @param timer
+ */
+static void sl_avr_emu_timer_update(const sl_avr_emu_emulation_s *emulation, sl_avr_emu_timer_s *timer)
+{
+  const sl_avr_emu_timer_layout_s *layout = &sl_avr_emu_timer_layouts[timer->number];
 
-      timer->prescaler_count++;
-      if(timer->prescaler_count >= prescaler_reference)
+  timer->ocr[0] = sl_avr_emu_timer_register(emulation, layout, layout->ocra);
+  timer->ocr[1] = sl_avr_emu_timer_register(emulation, layout, layout->ocrb);
+}
+
+/**
+ * @brief Tick of a timer clock edge
+ * 
+ * @param timer
+ * @param edge      - Edges since clock_origin
+ * @return sl_avr_emu_tick_count_t
+ */
+static sl_avr_emu_tick_count_t sl_avr_emu_timer_edge_tick(const sl_avr_emu_timer_s *timer, uint64_t edge)
+{
+  return timer->clock_origin + (edge * timer->clock_ticks + timer->clock_edges - 1) / timer->clock_edges;
+}
+
+/**
+ * @brief Applies a compare output action, reporting level changes to the waveform recorder
+ * 
+ * @param emulation
+ * @param timer
+ * @param channel   - 0 for OCnA, 1 for OCnB
+ * @param action
+ * @param tick      - Tick of the change
+ */
+static void sl_avr_emu_timer_output(sl_avr_emu_emulation_s *emulation, sl_avr_emu_timer_s *timer, uint32_t channel,
+                                    sl_avr_emu_timer_output_e action, sl_avr_emu_tick_count_t tick)
+{
+  bool level = SL_AVR_EMU_CHECK_BIT(timer->oc, channel);
+
+  switch(action)
+  {
+    case SL_AVR_EMU_TIMER_OUTPUT_TOGGLE:
+    {
+      level = !level;
+      break;
+    }
+    case SL_AVR_EMU_TIMER_OUTPUT_CLEAR:
+    {
+      level = false;
+      break;
+    }
+    case SL_AVR_EMU_TIMER_OUTPUT_SET:
+    {
+      level = true;
+      break;
+    }
+    default:
+    {
+      return;
+    }
+  }
+
+  if(level != SL_AVR_EMU_CHECK_BIT(timer->oc, channel))
+  {
+    timer->oc ^= (1 << channel);
+    if(NULL != emulation->hooks.waveform)
+    {
+      sl_avr_emu_waveform_edge(emulation, tick, timer->number*2 + channel, level);
+    }
+    if(NULL != emulation->hooks.trace)
+    {
+      sl_avr_emu_trace_signal(emulation, tick, SL_AVR_EMU_TRACE_OC0A + timer->number*2 + channel, level);
+    }
+  }
+}
+
+/**
+ * @brief Runs the compare output units on a timer clock edge
+ * 
+ * @param emulation
+ * @param timer
+ * @param mode
+ * @param flags     - Flags set by the edge
+ * @param bottom    - Single-slope counter wrapped to BOTTOM
+ * @param edge      - Edges since clock_origin
+ */
+static void sl_avr_emu_timer_compare_output(sl_avr_emu_emulation_s *emulation, sl_avr_emu_timer_s *timer, const sl_avr_emu_timer_mode_s *mode,
+                                            sl_avr_emu_byte_t flags, bool bottom, uint64_t edge)
+{
+  sl_avr_emu_byte_t       tccra = emulation->memory.data[sl_avr_emu_timer_layouts[timer->number].tccra];
+  sl_avr_emu_tick_count_t tick  = sl_avr_emu_timer_edge_tick(timer, edge);
+  uint32_t                com;
+  bool                    match;
+  uint32_t                i;
+
+  for(i = 0; i < 2; i++)
+  {
+    com   = SL_AVR_EMU_TIMER_COM(tccra, i);
+    match = SL_AVR_EMU_CHECK_BIT(flags, (SL_AVR_EMU_TIMER_OCFA + i));
+    if(SL_AVR_EMU_TIMER_OUTPUT_NONE == com)
+    {
+      continue;
+    }
+
+    if(SL_AVR_EMU_TIMER_AT_IMMEDIATE == mode->update)
+    {
+      /* Non-PWM, toggle, clear or set on match */
+      sl_avr_emu_timer_output(emulation, timer, i, match?com:SL_AVR_EMU_TIMER_OUTPUT_NONE, tick);
+    }
+    else if(SL_AVR_EMU_TIMER_OUTPUT_TOGGLE == com)
+    {
+      /* PWM modes only toggle OCnA, and only when TOP is not fixed */
+      if(match && 0 == i && SL_AVR_EMU_TIMER_TOP_FIXED != mode->top_source)
       {
-        timer->prescaler_count = 0;
-        tcnt_prev=*timer->tcnt;
-        *timer->tcnt = *timer->tcnt + 1;
-        if(0 == *timer->tcnt && 0xFF == tcnt_prev)
-        {
-          SL_AVR_EMU_SET_BIT(*timer->tifr, SL_AVR_EMU_TIMER_0_TOV0);
-        }
-        if(*timer->tcnt == *timer->ocra)
+        sl_avr_emu_timer_output(emulation, timer, i, SL_AVR_EMU_TIMER_OUTPUT_TOGGLE, tick);
+      }
+    }
+    else if(!mode->dual_slope)
+    {
+      /* Fast PWM, clear (set when inverting) on match and set at BOTTOM */
+      sl_avr_emu_timer_output(emulation, timer, i, match?com:SL_AVR_EMU_TIMER_OUTPUT_NONE, tick);
+      sl_avr_emu_timer_output(emulation, timer, i, bottom?(com ^ 1):SL_AVR_EMU_TIMER_OUTPUT_NONE, tick);
+    }
+    else if(match)
+    {
+      /* Phase correct, clear (set when inverting) on match up-counting and set on match down-counting.
+         Matches at TOP and BOTTOM go with the slope that follows, so OCR at TOP or BOTTOM gives a constant output. */
+      sl_avr_emu_timer_output(emulation, timer, i, timer->down?(com ^ 1):com, tick);
+    }
+  }
+}
+
+/**
+ * @brief Forces compare matches on the compare outputs, without flags.  Ignored in PWM modes.
+ * 
+ * @param emulation
+ * @param timer
+ * @param strobes   - FOCnA and FOCnB bits written
+ */
+static void sl_avr_emu_timer_force(sl_avr_emu_emulation_s *emulation, sl_avr_emu_timer_s *timer, sl_avr_emu_byte_t strobes)
+{
+  sl_avr_emu_byte_t       tccra = emulation->memory.data[sl_avr_emu_timer_layouts[timer->number].tccra];
+  sl_avr_emu_timer_mode_s mode;
+  uint32_t                i;
+
+  sl_avr_emu_timer_mode(emulation, timer, &mode);
+  if(SL_AVR_EMU_TIMER_AT_IMMEDIATE != mode.update)
+  {
+    return;
+  }
+
+  for(i = 0; i < 2; i++)
+  {
+    if(SL_AVR_EMU_CHECK_BIT(strobes, (SL_AVR_EMU_TIMER_FOCA - i)))
+    {
+      sl_avr_emu_timer_output(emulation, timer, i, SL_AVR_EMU_TIMER_COM(tccra, i), emulation->tick_count);
+    }
+  }
+}
+
+/**
+ * @brief One timer clock edge, from the counter at a stop
+ * 
+ * @param emulation
+ * @param timer
+ * @param mode
+ * @param max
+ * @param edge      - Edges since clock_origin, counting this one
+ */
+static void sl_avr_emu_timer_step(sl_avr_emu_emulation_s *emulation, sl_avr_emu_timer_s *timer, const sl_avr_emu_timer_mode_s *mode, sl_avr_emu_word_t max,
+                                  uint64_t edge)
+{
+  sl_avr_emu_word_t count  = timer->count;
+  sl_avr_emu_byte_t flags  = 0;
+  bool              bottom = false;
+
+  if(count == timer->ocr[0])
+  {
+    flags |= (1 << SL_AVR_EMU_TIMER_OCFA);
+  }
+  if(count == timer->ocr[1])
+  {
+    flags |= (1 << SL_AVR_EMU_TIMER_OCFB);
+  }
+
+  if(!mode->dual_slope)
+  {
+    if(count == mode->top || count == max)
+    {
+      if(count == mode->top)
+      {
+        flags |= (SL_AVR_EMU_TIMER_AT_TOP == mode->overflow)?(1 << SL_AVR_EMU_TIMER_TOV):0;
+        flags |= (SL_AVR_EMU_TIMER_TOP_ICR == mode->top_source)?(1 << SL_AVR_EMU_TIMER_ICF):0;
+        if(SL_AVR_EMU_TIMER_AT_IMMEDIATE != mode->update)
         {
-          SL_AVR_EMU_SET_BIT(*timer->tifr, SL_AVR_EMU_TIMER_0_OCF0A);
-          if(SL_AVR_EMU_TIMER_WGM_CTC           == timer_wgm ||
-             SL_AVR_EMU_TIMER_WGM_PWM_OCRA      == timer_wgm ||
-             SL_AVR_EMU_TIMER_WGM_FAST_PWM_OCRA == timer_wgm )
-          {
-            *timer->tcnt = 0;
-          }
+          sl_avr_emu_timer_update(emulation, timer);
         }
-        if(*timer->tcnt == *timer->ocrb)
+      }
+      if(count == max && SL_AVR_EMU_TIMER_AT_MAX == mode->overflow)
+      {
+        flags |= (1 << SL_AVR_EMU_TIMER_TOV);
+      }
+      timer->count = 0;
+      bottom       = true;
+    }
+    else
+    {
+      timer->count = count + 1;
+    }
+  }
+  else if(!timer->down)
+  {
+    if(count >= mode->top)
+    {
+      timer->down  = true;
+      timer->count = (count > 0)?(count - 1):0;
+      if(count == mode->top)
+      {
+        flags |= (SL_AVR_EMU_TIMER_TOP_ICR == mode->top_source)?(1 << SL_AVR_EMU_TIMER_ICF):0;
+        if(SL_AVR_EMU_TIMER_AT_TOP == mode->update)
         {
-          SL_AVR_EMU_SET_BIT(*timer->tifr, SL_AVR_EMU_TIMER_0_OCF0B);
+          sl_avr_emu_timer_update(emulation, timer);
         }
       }
-
-      SL_AVR_EMU_VERBOSE_LOG(printf("Timer 0 tick, tcnt0 0x%02x, prescaler count %u, tifr 0x%02x\n", *timer->tcnt, timer->prescaler_count, *timer->tifr));
+    }
+    else
+    {
+      timer->count = count + 1;
     }
   }
   else
   {
-    result = SL_AVR_EMU_RESULT_INVALID_HARDWARE;    
+    if(0 == count)
+    {
+      timer->down  = false;
+      timer->count = (mode->top > 0)?1:0;
+      flags |= (SL_AVR_EMU_TIMER_AT_BOTTOM == mode->overflow)?(1 << SL_AVR_EMU_TIMER_TOV):0;
+      if(SL_AVR_EMU_TIMER_AT_BOTTOM == mode->update)
+      {
+        sl_avr_emu_timer_update(emulation, timer);
+      }
+    }
+    else
+    {
+      timer->count = count - 1;
+    }
+  }
+
+  emulation->memory.data[sl_avr_emu_timer_layouts[timer->number].tifr] |= flags;
+
+  if(0 != (emulation->memory.data[sl_avr_emu_timer_layouts[timer->number].tccra] & SL_AVR_EMU_TIMER_COM_MASK))
+  {
+    sl_avr_emu_timer_compare_output(emulation, timer, mode, flags, bottom, edge);
+  }
+}
+
+/**
+ * @brief Brings a timer's counter and flags up to the current tick
+ * 
+ * @param emulation
+ * @param timer
+ */
+void sl_avr_emu_timer_sync(sl_avr_emu_emulation_s *emulation, sl_avr_emu_timer_s *timer)
+{
+  sl_avr_emu_timer_mode_s mode;
+  sl_avr_emu_word_t       max;
+  uint64_t                total;
+  uint64_t                pending;
+  uint64_t                distance;
+
+  if(0 == timer->clock_ticks)
+  {
+    return;
+  }
+
+  total   = ((emulation->tick_count - timer->clock_origin) * timer->clock_edges) / timer->clock_ticks;
+  pending = total - timer->edges;
+
+  while(pending > 0)
+  {
+    max      = sl_avr_emu_timer_mode(emulation, timer, &mode);
+    distance = sl_avr_emu_timer_distance(timer, &mode, max);
+    if(pending < distance)
+    {
+      timer->count = timer->down?(timer->count - pending):(timer->count + pending);
+      break;
+    }
+    timer->count  = timer->down?(timer->count - (distance - 1)):(timer->count + (distance - 1));
+    timer->edges += distance;
+    sl_avr_emu_timer_step(emulation, timer, &mode, max, timer->edges);
+    pending -= distance;
+  }
+
+  timer->edges = total;
+  /* Edge clock_edges falls exactly clock_ticks after the origin, keep the products small */
+  if(timer->edges >= timer->clock_edges)
+  {
+    timer->clock_origin += (timer->edges / timer->clock_edges) * timer->clock_ticks;
+    timer->edges        %= timer->clock_edges;
+  }
+}
+
+/**
+ * @brief Timer event, the counter is leaving a stop
+ * 
+ * @param emulation
+ * @param context   - Timer
+ * @return sl_avr_emu_result_e
+ */
+static sl_avr_emu_result_e sl_avr_emu_timer_event(sl_avr_emu_emulation_s *emulation, void *context);
+
+/**
+ * @brief Schedules the timer event for the edge leaving the counter's next stop
+ * 
+ * @param emulation
+ * @param timer
+ * @return sl_avr_emu_result_e
+ */
+static sl_avr_emu_result_e sl_avr_emu_timer_plan(sl_avr_emu_emulation_s *emulation, sl_avr_emu_timer_s *timer)
+{
+  sl_avr_emu_result_e     result = SL_AVR_EMU_RESULT_SUCCESS;
+  sl_avr_emu_timer_mode_s mode;
+  sl_avr_emu_word_t       max;
+  sl_avr_emu_tick_count_t tick   = SL_AVR_EMU_TICK_COUNT_MAX;
+  uint64_t                edge;
+
+  if(0 != timer->clock_ticks)
+  {
+    max  = sl_avr_emu_timer_mode(emulation, timer, &mode);
+    edge = timer->edges + sl_avr_emu_timer_distance(timer, &mode, max);
+    tick = sl_avr_emu_timer_edge_tick(timer, edge);
+  }
+
+  if(tick != timer->event_tick)
+  {
+    if(SL_AVR_EMU_TICK_COUNT_MAX != timer->event_tick)
+    {
+      sl_avr_emu_event_cancel(emulation, sl_avr_emu_timer_event, timer);
+    }
+    timer->event_tick = tick;
+    if(SL_AVR_EMU_TICK_COUNT_MAX != tick)
+    {
+      result = sl_avr_emu_event_schedule(emulation, tick, sl_avr_emu_timer_event, timer);
+    }
   }
 
   return result;
-}
\ No newline at end of file
+}
+
+static sl_avr_emu_result_e sl_avr_emu_timer_event(sl_avr_emu_emulation_s *emulation, void *context)
+{
+  sl_avr_emu_timer_s *timer = context;
+
+  timer->event_tick = SL_AVR_EMU_TICK_COUNT_MAX;
+  sl_avr_emu_timer_sync(emulation, timer);
+  SL_AVR_EMU_VERBOSE_LOG(printf("Timer %u event, count 0x%04x, tifr 0x%02x\n", timer->number, timer->count,
+                                emulation->memory.data[sl_avr_emu_timer_layouts[timer->number].tifr]));
+
+  return sl_avr_emu_timer_plan(emulation, timer);
+}
+
+/**
+ * @brief TCNTn (low byte) read hook, latches the high byte of 16-bit counters
+ * 
+ * @param emulation
+ * @param address
+ * @param context   - Timer
+ */
+static void sl_avr_emu_timer_tcnt_read(sl_avr_emu_emulation_s *emulation, sl_avr_emu_address_t address, void *context)
+{
+  sl_avr_emu_timer_s *timer = context;
+
+  sl_avr_emu_timer_sync(emulation, timer);
+  emulation->memory.data[address] = timer->count & 0xFF;
+  if(sl_avr_emu_timer_layouts[timer->number].wide)
+  {
+    emulation->memory.data[address + 1] = timer->count >> 8;
+  }
+}
+
+/**
+ * @brief High byte write hook of 16-bit registers, the byte waits for the low byte write
+ * 
+ * @param emulation
+ * @param address
+ * @param value
+ * @param context   - Timer
+ */
+static void sl_avr_emu_timer_high_write(sl_avr_emu_emulation_s *emulation, sl_avr_emu_address_t address, sl_avr_emu_byte_t value, void *context)
+{
+  sl_avr_emu_timer_s *timer = context;
+
+  timer->temp = value;
+}
+
+/**
+ * @brief Low byte write hook of TCNTn, OCRnx and ICRn
+ * 
+ * @param emulation
+ * @param address
+ * @param value
+ * @param context   - Timer
+ */
+static void sl_avr_emu_timer_low_write(sl_avr_emu_emulation_s *emulation, sl_avr_emu_address_t address, sl_avr_emu_byte_t value, void *context)
+{
+  sl_avr_emu_timer_s              *timer  = context;
+  const sl_avr_emu_timer_layout_s *layout = &sl_avr_emu_timer_layouts[timer->number];
+  sl_avr_emu_timer_mode_s          mode;
+
+  sl_avr_emu_timer_sync(emulation, timer);
+  sl_avr_emu_timer_mode(emulation, timer, &mode);
+
+  if(address == layout->icr && SL_AVR_EMU_TIMER_TOP_ICR != mode.top_source)
+  {
+    /* ICRn is only writable while it sets TOP */
+    return;
+  }
+
+  emulation->memory.data[address] = value;
+  if(layout->wide)
+  {
+    emulation->memory.data[address + 1] = timer->temp;
+  }
+
+  if(address == layout->tcnt)
+  {
+    timer->count = sl_avr_emu_timer_register(emulation, layout, address);
+  }
+  else if(SL_AVR_EMU_TIMER_AT_IMMEDIATE == mode.update)
+  {
+    sl_avr_emu_timer_update(emulation, timer);
+  }
+
+  sl_avr_emu_timer_plan(emulation, timer);
+}
+
+/**
+ * @brief TCCRnA, TCCRnB and TCCR1C write hook, and ASSR for timer 2
+ * 
+ * @param emulation
+ * @param address
+ * @param value
+ * @param context   - Timer
+ */
+static void sl_avr_emu_timer_control_write(sl_avr_emu_emulation_s *emulation, sl_avr_emu_address_t address, sl_avr_emu_byte_t value, void *context)
+{
+  sl_avr_emu_timer_s              *timer  = context;
+  const sl_avr_emu_timer_layout_s *layout = &sl_avr_emu_timer_layouts[timer->number];
+  sl_avr_emu_timer_mode_s          mode;
+
+  sl_avr_emu_timer_sync(emulation, timer);
+
+  if(SL_AVR_EMU_TIMER_2_ASSR == address)
+  {
+    /* Writes take effect at once, so the update busy flags always read clear */
+    value &= 0x60;
+  }
+  else if(address == layout->foc)
+  {
+    sl_avr_emu_timer_force(emulation, timer, value & SL_AVR_EMU_TIMER_FOC_MASK);
+    value &= ~SL_AVR_EMU_TIMER_FOC_MASK;
+  }
+  emulation->memory.data[address] = value;
+
+  sl_avr_emu_timer_clock(emulation, timer);
+  sl_avr_emu_timer_mode(emulation, timer, &mode);
+  if(!mode.dual_slope)
+  {
+    timer->down = false;
+  }
+  if(SL_AVR_EMU_TIMER_AT_IMMEDIATE == mode.update)
+  {
+    sl_avr_emu_timer_update(emulation, timer);
+  }
+
+  sl_avr_emu_timer_plan(emulation, timer);
+}
+
+/**
+ * @brief TIFRn write hook, flags are cleared by writing one to them
+ * 
+ * @param emulation
+ * @param address
+ * @param value
+ * @param context   - Timer
+ */
+static void sl_avr_emu_timer_tifr_write(sl_avr_emu_emulation_s *emulation, sl_avr_emu_address_t address, sl_avr_emu_byte_t value, void *context)
+{
+  emulation->memory.data[address] &= ~value;
+}
+
+/**
+ * @brief Resets timer counters 0, 1 and 2 and hooks their registers
+ * 
+ * @param emulation
+ * @return sl_avr_emu_result_e
+ */
+sl_avr_emu_result_e sl_avr_emu_timer_init(sl_avr_emu_emulation_s *emulation)
+{
+  sl_avr_emu_result_e              result = SL_AVR_EMU_RESULT_SUCCESS;
+  sl_avr_emu_timer_s              *timers[] = {&emulation->timer0, &emulation->timer1, &emulation->timer2};
+  const sl_avr_emu_timer_layout_s *layout;
+  uint32_t                         i;
+
+  for(i = 0; SL_AVR_EMU_RESULT_SUCCESS == result && i < sizeof(timers)/sizeof(timers[0]); i++)
+  {
+    layout = &sl_avr_emu_timer_layouts[i];
+    memset(timers[i], 0, sizeof(sl_avr_emu_timer_s));
+    timers[i]->number     = i;
+    timers[i]->event_tick = SL_AVR_EMU_TICK_COUNT_MAX;
+
+    result = sl_avr_emu_io_attach(emulation, layout->tcnt, sl_avr_emu_timer_tcnt_read, sl_avr_emu_timer_low_write, timers[i]);
+    if(SL_AVR_EMU_RESULT_SUCCESS == result)
+    {
+      result = sl_avr_emu_io_attach(emulation, layout->ocra, NULL, sl_avr_emu_timer_low_write, timers[i]);
+    }
+    if(SL_AVR_EMU_RESULT_SUCCESS == result)
+    {
+      result = sl_avr_emu_io_attach(emulation, layout->ocrb, NULL, sl_avr_emu_timer_low_write, timers[i]);
+    }
+    if(SL_AVR_EMU_RESULT_SUCCESS == result)
+    {
+      result = sl_avr_emu_io_attach(emulation, layout->tccra, NULL, sl_avr_emu_timer_control_write, timers[i]);
+    }
+    if(SL_AVR_EMU_RESULT_SUCCESS == result)
+    {
+      result = sl_avr_emu_io_attach(emulation, layout->tccrb, NULL, sl_avr_emu_timer_control_write, timers[i]);
+    }
+    if(SL_AVR_EMU_RESULT_SUCCESS == result)
+    {
+      result = sl_avr_emu_io_attach(emulation, layout->tifr, NULL, sl_avr_emu_timer_tifr_write, timers[i]);
+    }
+    if(SL_AVR_EMU_RESULT_SUCCESS == result && layout->wide)
+    {
+      sl_avr_emu_io_attach(emulation, layout->tcnt + 1, NULL, sl_avr_emu_timer_high_write, timers[i]);
+      sl_avr_emu_io_attach(emulation, layout->ocra + 1, NULL, sl_avr_emu_timer_high_write, timers[i]);
+      sl_avr_emu_io_attach(emulation, layout->ocrb + 1, NULL, sl_avr_emu_timer_high_write, timers[i]);
+      sl_avr_emu_io_attach(emulation, layout->icr,      NULL, sl_avr_emu_timer_low_write,  timers[i]);
+      sl_avr_emu_io_attach(emulation, layout->foc,      NULL, sl_avr_emu_timer_control_write, timers[i]);
+      result = sl_avr_emu_io_attach(emulation, layout->icr + 1, NULL, sl_avr_emu_timer_high_write, timers[i]);
+    }
+  }
+  if(SL_AVR_EMU_RESULT_SUCCESS == result)
+  {
+    result = sl_avr_emu_io_attach(emulation, SL_AVR_EMU_TIMER_2_ASSR, NULL, sl_avr_emu_timer_control_write, &emulation->timer2);
+  }
+
+  return result;
+}
+
+/**
+ * @brief Captures timer 1 into ICR1, as on an input capture edge.  Ignored while ICR1 sets TOP.
+ * 
+ * @param emulation
+ * @return sl_avr_emu_result_e
+ */
+sl_avr_emu_result_e sl_avr_emu_timer_capture(sl_avr_emu_emulation_s *emulation)
+{
+  sl_avr_emu_timer_mode_s mode;
+
+  sl_avr_emu_timer_sync(emulation, &emulation->timer1);
+  sl_avr_emu_timer_mode(emulation, &emulation->timer1, &mode);
+  if(SL_AVR_EMU_TIMER_TOP_ICR != mode.top_source)
+  {
+    emulation->memory.data[SL_AVR_EMU_TIMER_1_ICR1L] = emulation->timer1.count & 0xFF;
+    emulation->memory.data[SL_AVR_EMU_TIMER_1_ICR1H] = emulation->timer1.count >> 8;
+    SL_AVR_EMU_SET_BIT(emulation->memory.data[SL_AVR_EMU_IO_TO_DATA_ADDRESS(SL_AVR_EMU_TIMER_1_TIFR1)], SL_AVR_EMU_TIMER_1_ICF1);
+  }
+
+  return SL_AVR_EMU_RESULT_SUCCESS;
+}
@@ -0,0 +1,524 @@
+/**
+ * @file sl_avr_emu_trace.c
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator Signal Trace Logic
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ * GPIO registers are traced through register hooks attached only while tracing, and the timers
+ * report compare output changes, so emulation without a trace does no tracing work.  Changes are
+ * handed to a writer thread through a ring, formatting and file IO stay off the emulation thread.
+ */
+
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sl_avr_emu_io.h"
+#include "sl_avr_emu_trace.h"
+
+#define SL_AVR_EMU_TRACE_MAGIC      "SLAVRTR\x01"
+#define SL_AVR_EMU_TRACE_MAGIC_SIZE 8
+/* Output buffer of each file */
+#define SL_AVR_EMU_TRACE_FILE_BUFFER (1 << 20)
+
+/**
+ * @brief Name and width in bits of a signal
+ * 
+ */
+typedef struct
+{
+  const char *name;
+  uint8_t     width;
+
+} sl_avr_emu_trace_definition_s;
+
+static const sl_avr_emu_trace_definition_s sl_avr_emu_trace_definitions[SL_AVR_EMU_TRACE_SIGNAL_COUNT] =
+{
+  [SL_AVR_EMU_TRACE_PINB]  = {"PINB",  8},
+  [SL_AVR_EMU_TRACE_DDRB]  = {"DDRB",  8},
+  [SL_AVR_EMU_TRACE_PORTB] = {"PORTB", 8},
+  [SL_AVR_EMU_TRACE_PINC]  = {"PINC",  8},
+  [SL_AVR_EMU_TRACE_DDRC]  = {"DDRC",  8},
+  [SL_AVR_EMU_TRACE_PORTC] = {"PORTC", 8},
+  [SL_AVR_EMU_TRACE_PIND]  = {"PIND",  8},
+  [SL_AVR_EMU_TRACE_DDRD]  = {"DDRD",  8},
+  [SL_AVR_EMU_TRACE_PORTD] = {"PORTD", 8},
+  [SL_AVR_EMU_TRACE_OC0A]  = {"OC0A",  1},
+  [SL_AVR_EMU_TRACE_OC0B]  = {"OC0B",  1},
+  [SL_AVR_EMU_TRACE_OC1A]  = {"OC1A",  1},
+  [SL_AVR_EMU_TRACE_OC1B]  = {"OC1B",  1},
+  [SL_AVR_EMU_TRACE_OC2A]  = {"OC2A",  1},
+  [SL_AVR_EMU_TRACE_OC2B]  = {"OC2B",  1},
+};
+
+/**
+ * @brief Writes an unsigned LEB128 varint
+ * 
+ * @param file
+ * @param value
+ */
+static void sl_avr_emu_trace_write_varint(FILE *file, uint64_t value)
+{
+  while(value >= 0x80)
+  {
+    fputc((value & 0x7F) | 0x80, file);
+    value >>= 7;
+  }
+  fputc(value, file);
+}
+
+/**
+ * @brief Reads an unsigned LEB128 varint
+ * 
+ * @param file
+ * @param value
+ * @return true if a complete varint was read
+ */
+static bool sl_avr_emu_trace_read_varint(FILE *file, uint64_t *value)
+{
+  uint32_t shift = 0;
+  int      byte;
+
+  *value = 0;
+  do
+  {
+    byte = fgetc(file);
+    if(EOF == byte || shift > 63)
+    {
+      return false;
+    }
+    *value |= ((uint64_t)(byte & 0x7F)) << shift;
+    shift += 7;
+  } while(byte & 0x80);
+
+  return true;
+}
+
+/**
+ * @brief Writes a VCD header, signal i gets identifier '!' + i
+ * 
+ * @param vcd
+ * @param clock_hz
+ * @param definitions
+ * @param count
+ */
+static void sl_avr_emu_trace_vcd_header(FILE *vcd, uint32_t clock_hz, const sl_avr_emu_trace_definition_s *definitions, uint32_t count)
+{
+  uint32_t i;
+
+  fprintf(vcd, "$comment sl_avr_emu trace, %u Hz clock $end\n", clock_hz);
+  fprintf(vcd, "$timescale 1 ps $end\n");
+  fprintf(vcd, "$scope module avr $end\n");
+  for(i = 0; i < count; i++)
+  {
+    fprintf(vcd, "$var %s %u %c %s $end\n", (1 == definitions[i].width)?"wire":"reg", definitions[i].width, '!' + i, definitions[i].name);
+  }
+  fprintf(vcd, "$upscope $end\n$enddefinitions $end\n");
+}
+
+/**
+ * @brief Writes a VCD value
+ * 
+ * @param vcd
+ * @param signal
+ * @param width
+ * @param value
+ */
+static void sl_avr_emu_trace_vcd_value(FILE *vcd, uint32_t signal, uint8_t width, sl_avr_emu_byte_t value)
+{
+  int bit;
+
+  if(1 == width)
+  {
+    fprintf(vcd, "%u%c\n", value & 0x1, '!' + signal);
+    return;
+  }
+
+  fputc('b', vcd);
+  for(bit = width - 1; bit >= 0; bit--)
+  {
+    fputc('0' + ((value >> bit) & 0x1), vcd);
+  }
+  fprintf(vcd, " %c\n", '!' + signal);
+}
+
+/**
+ * @brief VCD time of a tick, in picoseconds rounded for clocks that are not a whole number of them
+ * 
+ * @param tick
+ * @param clock_hz
+ * @return uint64_t
+ */
+static uint64_t sl_avr_emu_trace_vcd_time(sl_avr_emu_tick_count_t tick, uint32_t clock_hz)
+{
+  return tick * ((1000000000000ULL + clock_hz/2) / clock_hz);
+}
+
+/**
+ * @brief Writes buffered changes to the outputs
+ * 
+ * @param trace
+ * @return uint32_t - Changes written
+ */
+static uint32_t sl_avr_emu_trace_drain(sl_avr_emu_trace_s *trace)
+{
+  uint_fast32_t                    tail  = atomic_load_explicit(&trace->tail, memory_order_relaxed);
+  uint_fast32_t                    head  = atomic_load_explicit(&trace->head, memory_order_acquire);
+  uint32_t                         count = head - tail;
+  const sl_avr_emu_trace_change_s *change;
+
+  for(; tail != head; tail++)
+  {
+    change = &trace->ring[tail & (SL_AVR_EMU_TRACE_RING_SIZE - 1)];
+    if(NULL != trace->binary)
+    {
+      sl_avr_emu_trace_write_varint(trace->binary, change->tick - trace->last_tick);
+      fputc(change->signal, trace->binary);
+      fputc(change->value, trace->binary);
+    }
+    if(NULL != trace->vcd)
+    {
+      if(change->tick != trace->last_tick)
+      {
+        fprintf(trace->vcd, "#%lu\n", sl_avr_emu_trace_vcd_time(change->tick, trace->clock_hz));
+      }
+      sl_avr_emu_trace_vcd_value(trace->vcd, change->signal, sl_avr_emu_trace_definitions[change->signal].width, change->value);
+    }
+    trace->last_tick = change->tick;
+  }
+  atomic_store_explicit(&trace->tail, tail, memory_order_release);
+
+  return count;
+}
+
+/**
+ * @brief Writer thread, drains the ring until stopped and empty
+ * 
+ * @param context - Trace
+ * @return void*
+ */
+static void *sl_avr_emu_trace_thread(void *context)
+{
+  sl_avr_emu_trace_s *trace = context;
+  struct timespec     sleep_time = {0, SL_AVR_EMU_TRACE_FLUSH_MS * 1000000};
+  bool                running;
+
+  do
+  {
+    running = atomic_load(&trace->running);
+    if(0 == sl_avr_emu_trace_drain(trace) && running)
+    {
+      nanosleep(&sleep_time, NULL);
+    }
+  } while(running);
+  sl_avr_emu_trace_drain(trace);
+
+  return NULL;
+}
+
+/**
+ * @brief Buffers a change for the writer thread, waiting for space if the ring is full
+ * 
+ * @param trace
+ * @param tick
+ * @param signal
+ * @param value
+ */
+static void sl_avr_emu_trace_push(sl_avr_emu_trace_s *trace, sl_avr_emu_tick_count_t tick, uint8_t signal, sl_avr_emu_byte_t value)
+{
+  uint_fast32_t              head = atomic_load_explicit(&trace->head, memory_order_relaxed);
+  sl_avr_emu_trace_change_s *change;
+
+  if((head - atomic_load_explicit(&trace->tail, memory_order_acquire)) >= SL_AVR_EMU_TRACE_RING_SIZE)
+  {
+    trace->stalls++;
+    while((head - atomic_load_explicit(&trace->tail, memory_order_acquire)) >= SL_AVR_EMU_TRACE_RING_SIZE)
+    {
+      sched_yield();
+    }
+  }
+
+  change         = &trace->ring[head & (SL_AVR_EMU_TRACE_RING_SIZE - 1)];
+  change->tick   = tick;
+  change->signal = signal;
+  change->value  = value;
+  atomic_store_explicit(&trace->head, head + 1, memory_order_release);
+  trace->changes++;
+}
+
+/**
+ * @brief Records a signal value, if it changed
+ * 
+ * @param emulation
+ * @param tick
+ * @param signal
+ * @param value
+ */
+void sl_avr_emu_trace_signal(sl_avr_emu_emulation_s *emulation, sl_avr_emu_tick_count_t tick, sl_avr_emu_trace_signal_e signal, sl_avr_emu_byte_t value)
+{
+  sl_avr_emu_trace_s *trace = emulation->hooks.trace;
+
+  if(value != trace->values[signal])
+  {
+    trace->values[signal] = value;
+    sl_avr_emu_trace_push(trace, tick, signal, value);
+  }
+}
+
+/**
+ * @brief Records the value of a data address that was changed without a firmware write, if it is traced
+ * 
+ * @param emulation
+ * @param address
+ */
+void sl_avr_emu_trace_data(sl_avr_emu_emulation_s *emulation, sl_avr_emu_address_t address)
+{
+  if(NULL != emulation->hooks.trace && address >= SL_AVR_EMU_TRACE_GPIO_FIRST && address <= SL_AVR_EMU_TRACE_GPIO_LAST)
+  {
+    sl_avr_emu_trace_signal(emulation, emulation->tick_count, SL_AVR_EMU_TRACE_PINB + (address - SL_AVR_EMU_TRACE_GPIO_FIRST),
+                            emulation->memory.data[address]);
+  }
+}
+
+/**
+ * @brief GPIO register write hook
+ * 
+ * @param emulation
+ * @param address
+ * @param value
+ * @param context
+ */
+static void sl_avr_emu_trace_gpio_write(sl_avr_emu_emulation_s *emulation, sl_avr_emu_address_t address, sl_avr_emu_byte_t value, void *context)
+{
+  emulation->memory.data[address] = value;
+  sl_avr_emu_trace_data(emulation, address);
+}
+
+/**
+ * @brief Starts tracing GPIO registers and compare outputs.  Emulation pauses whenever the writer falls a full ring behind.
+ * 
+ * @param emulation
+ * @param binary_path - Compact binary trace, NULL for none
+ * @param vcd_path    - Value Change Dump, NULL for none
+ * @return sl_avr_emu_result_e - SL_AVR_EMU_RESULT_INVALID_FILE_PATH if an output could not be created
+ */
+sl_avr_emu_result_e sl_avr_emu_trace_start(sl_avr_emu_emulation_s *emulation, const char *binary_path, const char *vcd_path)
+{
+  sl_avr_emu_result_e       result = SL_AVR_EMU_RESULT_SUCCESS;
+  sl_avr_emu_trace_s       *trace;
+  const sl_avr_emu_timer_s *timers[] = {&emulation->timer0, &emulation->timer1, &emulation->timer2};
+  sl_avr_emu_address_t      address;
+  uint32_t                  i;
+
+  if(NULL != emulation->hooks.trace || 0 == emulation->clock_hz)
+  {
+    return SL_AVR_EMU_RESULT_FAILURE;
+  }
+
+  trace = calloc(1, sizeof(sl_avr_emu_trace_s));
+  if(NULL == trace)
+  {
+    return SL_AVR_EMU_RESULT_FAILURE;
+  }
+  trace->clock_hz  = emulation->clock_hz;
+  trace->last_tick = emulation->tick_count;
+  emulation->hooks.trace = trace;
+
+  if(NULL != binary_path)
+  {
+    trace->binary = fopen(binary_path, "wb");
+    result        = (NULL != trace->binary)?SL_AVR_EMU_RESULT_SUCCESS:SL_AVR_EMU_RESULT_INVALID_FILE_PATH;
+  }
+  if(SL_AVR_EMU_RESULT_SUCCESS == result && NULL != vcd_path)
+  {
+    trace->vcd = fopen(vcd_path, "w");
+    result     = (NULL != trace->vcd)?SL_AVR_EMU_RESULT_SUCCESS:SL_AVR_EMU_RESULT_INVALID_FILE_PATH;
+  }
+  if(SL_AVR_EMU_RESULT_SUCCESS != result)
+  {
+    sl_avr_emu_trace_stop(emulation);
+    return result;
+  }
+
+  /* Headers and the starting values, written before the writer thread owns the files */
+  if(NULL != trace->binary)
+  {
+    setvbuf(trace->binary, NULL, _IOFBF, SL_AVR_EMU_TRACE_FILE_BUFFER);
+    fwrite(SL_AVR_EMU_TRACE_MAGIC, 1, SL_AVR_EMU_TRACE_MAGIC_SIZE, trace->binary);
+    sl_avr_emu_trace_write_varint(trace->binary, trace->clock_hz);
+    sl_avr_emu_trace_write_varint(trace->binary, SL_AVR_EMU_TRACE_SIGNAL_COUNT);
+    for(i = 0; i < SL_AVR_EMU_TRACE_SIGNAL_COUNT; i++)
+    {
+      fputc(sl_avr_emu_trace_definitions[i].width, trace->binary);
+      fputc(strlen(sl_avr_emu_trace_definitions[i].name), trace->binary);
+      fputs(sl_avr_emu_trace_definitions[i].name, trace->binary);
+    }
+  }
+  if(NULL != trace->vcd)
+  {
+    setvbuf(trace->vcd, NULL, _IOFBF, SL_AVR_EMU_TRACE_FILE_BUFFER);
+    sl_avr_emu_trace_vcd_header(trace->vcd, trace->clock_hz, sl_avr_emu_trace_definitions, SL_AVR_EMU_TRACE_SIGNAL_COUNT);
+    fprintf(trace->vcd, "#%lu\n", sl_avr_emu_trace_vcd_time(trace->last_tick, trace->clock_hz));
+  }
+  for(address = SL_AVR_EMU_TRACE_GPIO_FIRST; address <= SL_AVR_EMU_TRACE_GPIO_LAST; address++)
+  {
+    trace->values[SL_AVR_EMU_TRACE_PINB + (address - SL_AVR_EMU_TRACE_GPIO_FIRST)] = emulation->memory.data[address];
+  }
+  for(i = 0; i < SL_AVR_EMU_TRACE_SIGNAL_COUNT - SL_AVR_EMU_TRACE_OC0A; i++)
+  {
+    trace->values[SL_AVR_EMU_TRACE_OC0A + i] = (timers[i/2]->oc >> (i%2)) & 0x1;
+  }
+  for(i = 0; i < SL_AVR_EMU_TRACE_SIGNAL_COUNT; i++)
+  {
+    sl_avr_emu_trace_push(trace, trace->last_tick, i, trace->values[i]);
+  }
+
+  for(address = SL_AVR_EMU_TRACE_GPIO_FIRST; SL_AVR_EMU_RESULT_SUCCESS == result && address <= SL_AVR_EMU_TRACE_GPIO_LAST; address++)
+  {
+    /* Peripherals hooking a port, for chip selects, trace their writes themselves */
+    if(NULL == emulation->hooks.io || NULL == emulation->hooks.io->registers[address].write)
+    {
+      result = sl_avr_emu_io_attach(emulation, address, NULL, sl_avr_emu_trace_gpio_write, trace);
+    }
+  }
+  if(SL_AVR_EMU_RESULT_SUCCESS == result)
+  {
+    atomic_store(&trace->running, true);
+    if(0 != pthread_create(&trace->thread, NULL, sl_avr_emu_trace_thread, trace))
+    {
+      atomic_store(&trace->running, false);
+      result = SL_AVR_EMU_RESULT_FAILURE;
+    }
+  }
+
+  if(SL_AVR_EMU_RESULT_SUCCESS != result)
+  {
+    sl_avr_emu_trace_stop(emulation);
+  }
+
+  return result;
+}
+
+/**
+ * @brief Converts a binary trace to a Value Change Dump
+ * 
+ * @param binary
+ * @param vcd
+ * @return sl_avr_emu_result_e - SL_AVR_EMU_RESULT_INVALID_FILE_FORMAT if binary is not a trace
+ */
+sl_avr_emu_result_e sl_avr_emu_trace_convert(FILE *binary, FILE *vcd)
+{
+  sl_avr_emu_trace_definition_s  definitions[UINT8_MAX + 1];
+  char                           names[UINT8_MAX + 1][UINT8_MAX + 1];
+  char                           magic[SL_AVR_EMU_TRACE_MAGIC_SIZE];
+  uint64_t                       clock_hz;
+  uint64_t                       count;
+  uint64_t                       delta;
+  sl_avr_emu_tick_count_t        tick = 0;
+  bool                           first = true;
+  int                            width, length, signal, value;
+  uint32_t                       i;
+
+  if(SL_AVR_EMU_TRACE_MAGIC_SIZE != fread(magic, 1, SL_AVR_EMU_TRACE_MAGIC_SIZE, binary) ||
+     0 != memcmp(magic, SL_AVR_EMU_TRACE_MAGIC, SL_AVR_EMU_TRACE_MAGIC_SIZE) ||
+     !sl_avr_emu_trace_read_varint(binary, &clock_hz) || 0 == clock_hz || clock_hz > UINT32_MAX ||
+     !sl_avr_emu_trace_read_varint(binary, &count) || count > UINT8_MAX + 1)
+  {
+    return SL_AVR_EMU_RESULT_INVALID_FILE_FORMAT;
+  }
+
+  for(i = 0; i < count; i++)
+  {
+    width  = fgetc(binary);
+    length = fgetc(binary);
+    if(width < 1 || width > 8 || EOF == length || (size_t)length != fread(names[i], 1, length, binary))
+    {
+      return SL_AVR_EMU_RESULT_INVALID_FILE_FORMAT;
+    }
+    names[i][length]     = '\0';
+    definitions[i].name  = names[i];
+    definitions[i].width = width;
+  }
+  sl_avr_emu_trace_vcd_header(vcd, clock_hz, definitions, count);
+
+  while(sl_avr_emu_trace_read_varint(binary, &delta))
+  {
+    signal = fgetc(binary);
+    value  = fgetc(binary);
+    if(EOF == value || signal >= (int)count)
+    {
+      return SL_AVR_EMU_RESULT_INVALID_FILE_FORMAT;
+    }
+    tick += delta;
+    if(first || 0 != delta)
+    {
+      fprintf(vcd, "#%lu\n", sl_avr_emu_trace_vcd_time(tick, clock_hz));
+      first = false;
+    }
+    sl_avr_emu_trace_vcd_value(vcd, signal, definitions[signal].width, value);
+  }
+
+  return ferror(vcd)?SL_AVR_EMU_RESULT_FAILURE:SL_AVR_EMU_RESULT_SUCCESS;
+}
+
+/**
+ * @brief Prints trace counters
+ * 
+ * @param output
+ * @param emulation
+ */
+void sl_avr_emu_trace_report(FILE *output, const sl_avr_emu_emulation_s *emulation)
+{
+  const sl_avr_emu_trace_s *trace = emulation->hooks.trace;
+
+  if(NULL == trace)
+  {
+    return;
+  }
+
+  fprintf(output, "\nTrace: %lu value changes, %lu writer stalls\n", trace->changes, trace->stalls);
+}
+
+/**
+ * @brief Stops tracing, writing out buffered changes and closing the outputs
+ * 
+ * @param emulation
+ */
+void sl_avr_emu_trace_stop(sl_avr_emu_emulation_s *emulation)
+{
+  sl_avr_emu_trace_s   *trace = emulation->hooks.trace;
+  sl_avr_emu_address_t  address;
+
+  if(NULL == trace)
+  {
+    return;
+  }
+
+  if(atomic_load(&trace->running))
+  {
+    atomic_store(&trace->running, false);
+    pthread_join(trace->thread, NULL);
+  }
+  for(address = SL_AVR_EMU_TRACE_GPIO_FIRST; address <= SL_AVR_EMU_TRACE_GPIO_LAST; address++)
+  {
+    if(NULL != emulation->hooks.io && sl_avr_emu_trace_gpio_write == emulation->hooks.io->registers[address].write)
+    {
+      sl_avr_emu_io_detach(emulation, address);
+    }
+  }
+
+  if(NULL != trace->binary)
+  {
+    fclose(trace->binary);
+  }
+  if(NULL != trace->vcd)
+  {
+    fclose(trace->vcd);
+  }
+  free(trace);
+  emulation->hooks.trace = NULL;
+}
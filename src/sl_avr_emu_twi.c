@@ -0,0 +1,440 @@
+/**
+ * @file sl_avr_emu_twi.c
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator TWI Peripheral and I2C Bus Logic
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ * Firmware drives the bus a step at a time, each step taking one scheduled event: a START or STOP condition
+ * takes one SCL period and a byte with its acknowledge nine.  Devices answer when their byte completes,
+ * on the emulation thread, and must not block.  Firmware polling TWINT in between is fast-forwarded.
+ * Bus state lives in the emulation structure, so snapshots restore it with the event.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sl_avr_emu_bitops.h"
+#include "sl_avr_emu_event.h"
+#include "sl_avr_emu_idle.h"
+#include "sl_avr_emu_io.h"
+#include "sl_avr_emu_twi.h"
+
+/**
+ * @brief Ticks per SCL period, from TWBR and the TWPS prescaler
+ * 
+ * @param emulation
+ * @return sl_avr_emu_tick_count_t
+ */
+static sl_avr_emu_tick_count_t sl_avr_emu_twi_scl_ticks(const sl_avr_emu_emulation_s *emulation)
+{
+  const sl_avr_emu_byte_t *data = emulation->memory.data;
+
+  return 16 + 2 * (sl_avr_emu_tick_count_t) data[SL_AVR_EMU_TWI_TWBR] * (1 << (2 * (data[SL_AVR_EMU_TWI_TWSR] & SL_AVR_EMU_TWI_TWPS_MASK)));
+}
+
+static sl_avr_emu_result_e sl_avr_emu_twi_done_event(sl_avr_emu_emulation_s *emulation, void *context);
+
+/**
+ * @brief Starts a bus condition or byte
+ * 
+ * @param emulation
+ * @param twi
+ * @param operation
+ * @param scl_periods
+ */
+static void sl_avr_emu_twi_begin(sl_avr_emu_emulation_s *emulation, sl_avr_emu_twi_s *twi, sl_avr_emu_twi_operation_e operation, uint32_t scl_periods)
+{
+  emulation->twi.operation = operation;
+  emulation->twi.done_tick = emulation->tick_count + scl_periods * sl_avr_emu_twi_scl_ticks(emulation);
+  sl_avr_emu_event_schedule(emulation, emulation->twi.done_tick, sl_avr_emu_twi_done_event, twi);
+}
+
+/**
+ * @brief Finds the device at a bus address
+ * 
+ * @param twi
+ * @param address
+ * @return sl_avr_emu_twi_device_s* - NULL if none
+ */
+static sl_avr_emu_twi_device_s *sl_avr_emu_twi_find(const sl_avr_emu_twi_s *twi, sl_avr_emu_byte_t address)
+{
+  uint32_t i;
+
+  for(i = 0; i < twi->device_count; i++)
+  {
+    if(address == twi->devices[i]->address)
+    {
+      return twi->devices[i];
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * @brief Finds the device that acknowledged its address
+ * 
+ * @param emulation
+ * @param twi
+ * @return sl_avr_emu_twi_device_s* - NULL if none did
+ */
+static sl_avr_emu_twi_device_s *sl_avr_emu_twi_target(const sl_avr_emu_emulation_s *emulation, const sl_avr_emu_twi_s *twi)
+{
+  return emulation->twi.addressed?sl_avr_emu_twi_find(twi, emulation->twi.target):NULL;
+}
+
+/**
+ * @brief Ends the transaction with the addressed device
+ * 
+ * @param emulation
+ * @param twi
+ */
+static void sl_avr_emu_twi_release(sl_avr_emu_emulation_s *emulation, sl_avr_emu_twi_s *twi)
+{
+  sl_avr_emu_twi_device_s *target = sl_avr_emu_twi_target(emulation, twi);
+
+  if(NULL != target)
+  {
+    target->stop(target);
+  }
+  emulation->twi.addressed = false;
+}
+
+/**
+ * @brief Bus condition or byte complete event.  Updates the status code and sets TWINT, except after a STOP.
+ * 
+ * @param emulation
+ * @param context   - TWI state
+ * @return sl_avr_emu_result_e
+ */
+static sl_avr_emu_result_e sl_avr_emu_twi_done_event(sl_avr_emu_emulation_s *emulation, void *context)
+{
+  sl_avr_emu_twi_s        *twi  = context;
+  sl_avr_emu_byte_t       *data = emulation->memory.data;
+  sl_avr_emu_twi_device_s *device;
+  sl_avr_emu_byte_t        status = SL_AVR_EMU_TWI_NO_INFO;
+  bool                     read;
+  bool                     ack;
+
+  switch(emulation->twi.operation)
+  {
+    case SL_AVR_EMU_TWI_SENDING_START:
+    {
+      status                   = emulation->twi.bus_owner?SL_AVR_EMU_TWI_REP_START:SL_AVR_EMU_TWI_START;
+      emulation->twi.bus_owner = true;
+      twi->starts++;
+      break;
+    }
+    case SL_AVR_EMU_TWI_SENDING_STOP:
+    {
+      sl_avr_emu_twi_release(emulation, twi);
+      emulation->twi.bus_owner = false;
+      emulation->twi.operation = SL_AVR_EMU_TWI_IDLE;
+      SL_AVR_EMU_CLEAR_BIT(data[SL_AVR_EMU_TWI_TWCR], SL_AVR_EMU_TWI_TWSTO);
+      data[SL_AVR_EMU_TWI_TWSR] = SL_AVR_EMU_TWI_NO_INFO | (data[SL_AVR_EMU_TWI_TWSR] & SL_AVR_EMU_TWI_TWPS_MASK);
+      /* STOP followed by START when both were requested */
+      if(SL_AVR_EMU_CHECK_BIT(data[SL_AVR_EMU_TWI_TWCR], SL_AVR_EMU_TWI_TWSTA))
+      {
+        sl_avr_emu_twi_begin(emulation, twi, SL_AVR_EMU_TWI_SENDING_START, 1);
+      }
+      return SL_AVR_EMU_RESULT_SUCCESS;
+    }
+    case SL_AVR_EMU_TWI_SENDING_ADDRESS:
+    {
+      read   = SL_AVR_EMU_CHECK_BIT(data[SL_AVR_EMU_TWI_TWDR], 0);
+      device = sl_avr_emu_twi_find(twi, data[SL_AVR_EMU_TWI_TWDR] >> 1);
+      ack    = (NULL != device && device->start(device, read));
+      /* A repeated START to another device ends the transaction with the last one */
+      if(device != sl_avr_emu_twi_target(emulation, twi) || !ack)
+      {
+        sl_avr_emu_twi_release(emulation, twi);
+      }
+      emulation->twi.addressed = ack;
+      emulation->twi.target    = data[SL_AVR_EMU_TWI_TWDR] >> 1;
+      twi->nacks += ack?0:1;
+      status = read?(ack?SL_AVR_EMU_TWI_MR_SLA_ACK:SL_AVR_EMU_TWI_MR_SLA_NACK):
+                    (ack?SL_AVR_EMU_TWI_MT_SLA_ACK:SL_AVR_EMU_TWI_MT_SLA_NACK);
+      break;
+    }
+    case SL_AVR_EMU_TWI_SENDING_DATA:
+    {
+      device = sl_avr_emu_twi_target(emulation, twi);
+      ack    = (NULL != device && device->write(device, data[SL_AVR_EMU_TWI_TWDR]));
+      twi->nacks += ack?0:1;
+      twi->bytes++;
+      status = ack?SL_AVR_EMU_TWI_MT_DATA_ACK:SL_AVR_EMU_TWI_MT_DATA_NACK;
+      break;
+    }
+    case SL_AVR_EMU_TWI_RECEIVING_DATA:
+    {
+      /* SDA idles high when no device drives it */
+      device                    = sl_avr_emu_twi_target(emulation, twi);
+      data[SL_AVR_EMU_TWI_TWDR] = (NULL != device)?device->read(device):0xFF;
+      twi->bytes++;
+      status = SL_AVR_EMU_CHECK_BIT(data[SL_AVR_EMU_TWI_TWCR], SL_AVR_EMU_TWI_TWEA)?SL_AVR_EMU_TWI_MR_DATA_ACK:SL_AVR_EMU_TWI_MR_DATA_NACK;
+      break;
+    }
+    default:
+    {
+      break;
+    }
+  }
+
+  emulation->twi.operation  = SL_AVR_EMU_TWI_IDLE;
+  data[SL_AVR_EMU_TWI_TWSR] = status | (data[SL_AVR_EMU_TWI_TWSR] & SL_AVR_EMU_TWI_TWPS_MASK);
+  SL_AVR_EMU_SET_BIT(data[SL_AVR_EMU_TWI_TWCR], SL_AVR_EMU_TWI_TWINT);
+
+  return SL_AVR_EMU_RESULT_SUCCESS;
+}
+
+/**
+ * @brief TWCR read hook, fast-forwards firmware polling for the step in progress to complete
+ * 
+ * @param emulation
+ * @param address
+ * @param context   - Unused
+ */
+static void sl_avr_emu_twi_twcr_read(sl_avr_emu_emulation_s *emulation, sl_avr_emu_address_t address, void *context)
+{
+  if(SL_AVR_EMU_TWI_IDLE != emulation->twi.operation)
+  {
+    sl_avr_emu_idle_poll(emulation, address, emulation->twi.done_tick);
+  }
+}
+
+/**
+ * @brief TWCR write hook.  Writing TWINT one clears it and starts the next step: STOP, START,
+ *        or the byte following the current status.
+ * 
+ * @param emulation
+ * @param address
+ * @param value
+ * @param context   - TWI state
+ */
+static void sl_avr_emu_twi_twcr_write(sl_avr_emu_emulation_s *emulation, sl_avr_emu_address_t address, sl_avr_emu_byte_t value, void *context)
+{
+  sl_avr_emu_twi_s        *twi    = context;
+  sl_avr_emu_byte_t       *data   = emulation->memory.data;
+  const bool               resume = SL_AVR_EMU_CHECK_BIT(value, SL_AVR_EMU_TWI_TWINT);
+  const sl_avr_emu_byte_t  kept   = data[address] & ((resume?0:(1 << SL_AVR_EMU_TWI_TWINT)) | (1 << SL_AVR_EMU_TWI_TWWC));
+
+  /* TWINT is cleared by writing one, TWWC is read only */
+  data[address] = (value & ~((1 << SL_AVR_EMU_TWI_TWINT) | (1 << SL_AVR_EMU_TWI_TWWC))) | kept;
+
+  if(!SL_AVR_EMU_CHECK_BIT(value, SL_AVR_EMU_TWI_TWEN))
+  {
+    /* Disabling TWI abandons the bus at once */
+    sl_avr_emu_event_cancel(emulation, sl_avr_emu_twi_done_event, twi);
+    sl_avr_emu_twi_release(emulation, twi);
+    emulation->twi.operation = SL_AVR_EMU_TWI_IDLE;
+    emulation->twi.bus_owner = false;
+    SL_AVR_EMU_CLEAR_BIT(data[address], SL_AVR_EMU_TWI_TWSTO);
+    data[SL_AVR_EMU_TWI_TWSR] = SL_AVR_EMU_TWI_NO_INFO | (data[SL_AVR_EMU_TWI_TWSR] & SL_AVR_EMU_TWI_TWPS_MASK);
+    return;
+  }
+  if(!resume || SL_AVR_EMU_TWI_IDLE != emulation->twi.operation)
+  {
+    return;
+  }
+
+  if(SL_AVR_EMU_CHECK_BIT(value, SL_AVR_EMU_TWI_TWSTO))
+  {
+    if(emulation->twi.bus_owner)
+    {
+      sl_avr_emu_twi_begin(emulation, twi, SL_AVR_EMU_TWI_SENDING_STOP, 1);
+      return;
+    }
+    /* STOP without the bus only resets TWI */
+    SL_AVR_EMU_CLEAR_BIT(data[address], SL_AVR_EMU_TWI_TWSTO);
+  }
+  if(SL_AVR_EMU_CHECK_BIT(value, SL_AVR_EMU_TWI_TWSTA))
+  {
+    sl_avr_emu_twi_begin(emulation, twi, SL_AVR_EMU_TWI_SENDING_START, 1);
+    return;
+  }
+
+  switch(data[SL_AVR_EMU_TWI_TWSR] & SL_AVR_EMU_TWI_STATUS_MASK)
+  {
+    case SL_AVR_EMU_TWI_START:
+    case SL_AVR_EMU_TWI_REP_START:
+    {
+      sl_avr_emu_twi_begin(emulation, twi, SL_AVR_EMU_TWI_SENDING_ADDRESS, 9);
+      break;
+    }
+    case SL_AVR_EMU_TWI_MT_SLA_ACK:
+    case SL_AVR_EMU_TWI_MT_SLA_NACK:
+    case SL_AVR_EMU_TWI_MT_DATA_ACK:
+    case SL_AVR_EMU_TWI_MT_DATA_NACK:
+    {
+      sl_avr_emu_twi_begin(emulation, twi, SL_AVR_EMU_TWI_SENDING_DATA, 9);
+      break;
+    }
+    case SL_AVR_EMU_TWI_MR_SLA_ACK:
+    case SL_AVR_EMU_TWI_MR_DATA_ACK:
+    {
+      sl_avr_emu_twi_begin(emulation, twi, SL_AVR_EMU_TWI_RECEIVING_DATA, 9);
+      break;
+    }
+    default:
+    {
+      /* Only STOP or START continue from here */
+      break;
+    }
+  }
+}
+
+/**
+ * @brief TWDR write hook, writing while TWINT is clear is a collision and the byte is ignored
+ * 
+ * @param emulation
+ * @param address
+ * @param value
+ * @param context   - TWI state
+ */
+static void sl_avr_emu_twi_twdr_write(sl_avr_emu_emulation_s *emulation, sl_avr_emu_address_t address, sl_avr_emu_byte_t value, void *context)
+{
+  sl_avr_emu_twi_s  *twi  = context;
+  sl_avr_emu_byte_t *twcr = &emulation->memory.data[SL_AVR_EMU_TWI_TWCR];
+
+  if(SL_AVR_EMU_CHECK_BIT(*twcr, SL_AVR_EMU_TWI_TWEN) && !SL_AVR_EMU_CHECK_BIT(*twcr, SL_AVR_EMU_TWI_TWINT))
+  {
+    SL_AVR_EMU_SET_BIT(*twcr, SL_AVR_EMU_TWI_TWWC);
+    twi->collisions++;
+    return;
+  }
+  SL_AVR_EMU_CLEAR_BIT(*twcr, SL_AVR_EMU_TWI_TWWC);
+  emulation->memory.data[address] = value;
+}
+
+/**
+ * @brief TWSR write hook, only the prescaler is writable
+ * 
+ * @param emulation
+ * @param address
+ * @param value
+ * @param context   - TWI state
+ */
+static void sl_avr_emu_twi_twsr_write(sl_avr_emu_emulation_s *emulation, sl_avr_emu_address_t address, sl_avr_emu_byte_t value, void *context)
+{
+  emulation->memory.data[address] = (emulation->memory.data[address] & ~SL_AVR_EMU_TWI_TWPS_MASK) | (value & SL_AVR_EMU_TWI_TWPS_MASK);
+}
+
+/**
+ * @brief Attaches TWI to emulation
+ * 
+ * @param emulation
+ * @return sl_avr_emu_result_e
+ */
+sl_avr_emu_result_e sl_avr_emu_twi_start(sl_avr_emu_emulation_s *emulation)
+{
+  sl_avr_emu_result_e  result = SL_AVR_EMU_RESULT_SUCCESS;
+  sl_avr_emu_twi_s    *twi;
+
+  if(NULL != emulation->hooks.twi)
+  {
+    return SL_AVR_EMU_RESULT_FAILURE;
+  }
+
+  twi = calloc(1, sizeof(sl_avr_emu_twi_s));
+  if(NULL == twi)
+  {
+    return SL_AVR_EMU_RESULT_FAILURE;
+  }
+  emulation->hooks.twi = twi;
+  memset(&emulation->twi, 0, sizeof(emulation->twi));
+
+  /* Reset values */
+  emulation->memory.data[SL_AVR_EMU_TWI_TWSR] = SL_AVR_EMU_TWI_NO_INFO;
+  emulation->memory.data[SL_AVR_EMU_TWI_TWAR] = 0xFE;
+  emulation->memory.data[SL_AVR_EMU_TWI_TWDR] = 0xFF;
+
+  result = sl_avr_emu_io_attach(emulation, SL_AVR_EMU_TWI_TWCR, sl_avr_emu_twi_twcr_read, sl_avr_emu_twi_twcr_write, twi);
+  if(SL_AVR_EMU_RESULT_SUCCESS == result)
+  {
+    result = sl_avr_emu_io_attach(emulation, SL_AVR_EMU_TWI_TWDR, NULL, sl_avr_emu_twi_twdr_write, twi);
+  }
+  if(SL_AVR_EMU_RESULT_SUCCESS == result)
+  {
+    result = sl_avr_emu_io_attach(emulation, SL_AVR_EMU_TWI_TWSR, NULL, sl_avr_emu_twi_twsr_write, twi);
+  }
+
+  if(SL_AVR_EMU_RESULT_SUCCESS != result)
+  {
+    sl_avr_emu_twi_stop(emulation);
+  }
+
+  return result;
+}
+
+/**
+ * @brief Attaches a device to the bus.  The TWI owns the device from then on and closes it on stop.
+ * 
+ * @param emulation
+ * @param device
+ * @return sl_avr_emu_result_e - SL_AVR_EMU_RESULT_FAILURE if TWI is not attached, SL_AVR_EMU_TWI_DEVICES_MAX devices are,
+ *                               or a device already has the address
+ */
+sl_avr_emu_result_e sl_avr_emu_twi_attach(sl_avr_emu_emulation_s *emulation, sl_avr_emu_twi_device_s *device)
+{
+  sl_avr_emu_twi_s *twi = emulation->hooks.twi;
+
+  if(NULL == twi || twi->device_count >= SL_AVR_EMU_TWI_DEVICES_MAX || NULL != sl_avr_emu_twi_find(twi, device->address))
+  {
+    return SL_AVR_EMU_RESULT_FAILURE;
+  }
+  twi->devices[twi->device_count++] = device;
+
+  return SL_AVR_EMU_RESULT_SUCCESS;
+}
+
+/**
+ * @brief Prints bus and device counters
+ * 
+ * @param output
+ * @param emulation
+ */
+void sl_avr_emu_twi_report(FILE *output, const sl_avr_emu_emulation_s *emulation)
+{
+  const sl_avr_emu_twi_s *twi = emulation->hooks.twi;
+  uint32_t                i;
+
+  fprintf(output, "TWI: %lu starts, %lu bytes, %lu not acknowledged, %lu write collisions\n",
+          twi->starts, twi->bytes, twi->nacks, twi->collisions);
+  for(i = 0; i < twi->device_count; i++)
+  {
+    if(NULL != twi->devices[i]->report)
+    {
+      twi->devices[i]->report(output, twi->devices[i]);
+    }
+  }
+}
+
+/**
+ * @brief Closes attached devices and detaches TWI
+ * 
+ * @param emulation
+ */
+void sl_avr_emu_twi_stop(sl_avr_emu_emulation_s *emulation)
+{
+  sl_avr_emu_twi_s *twi = emulation->hooks.twi;
+  uint32_t          i;
+
+  if(NULL == twi)
+  {
+    return;
+  }
+
+  sl_avr_emu_event_cancel(emulation, sl_avr_emu_twi_done_event, twi);
+  sl_avr_emu_io_detach(emulation, SL_AVR_EMU_TWI_TWCR);
+  sl_avr_emu_io_detach(emulation, SL_AVR_EMU_TWI_TWDR);
+  sl_avr_emu_io_detach(emulation, SL_AVR_EMU_TWI_TWSR);
+  for(i = 0; i < twi->device_count; i++)
+  {
+    twi->devices[i]->close(twi->devices[i]);
+  }
+  free(twi);
+  emulation->hooks.twi = NULL;
+}
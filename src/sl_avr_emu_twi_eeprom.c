@@ -0,0 +1,233 @@
+/**
+ * @file sl_avr_emu_twi_eeprom.c
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator I2C EEPROM Device Logic
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ * Written bytes land in the image at once, the write cycle only shows as the EEPROM ignoring its address
+ * until it would have finished, which is what firmware acknowledge polling waits on.
+ */
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "sl_avr_emu_twi_eeprom.h"
+
+/**
+ * @brief I2C EEPROM device
+ * 
+ */
+typedef struct
+{
+  sl_avr_emu_twi_device_s       device;
+  const sl_avr_emu_emulation_s *emulation;
+
+  sl_avr_emu_byte_t            *memory;
+  size_t                        size;
+  uint32_t                      page_size;
+  uint32_t                      address_size;
+
+  /* Word address, and its bytes received in this write */
+  uint32_t                      address;
+  uint32_t                      address_received;
+  /* Bytes were written in this transaction, the write cycle starts at STOP */
+  bool                          written;
+  sl_avr_emu_tick_count_t       busy_until;
+
+  uint64_t                      bytes_read;
+  uint64_t                      bytes_written;
+  uint64_t                      write_cycles;
+  /* Addressing ignored during a write cycle */
+  uint64_t                      busy_nacks;
+
+} sl_avr_emu_twi_eeprom_s;
+
+/**
+ * @brief START hook, the EEPROM does not acknowledge during its write cycle
+ * 
+ * @param device
+ * @param read
+ * @return true to acknowledge
+ */
+static bool sl_avr_emu_twi_eeprom_start(sl_avr_emu_twi_device_s *device, bool read)
+{
+  sl_avr_emu_twi_eeprom_s *eeprom = (sl_avr_emu_twi_eeprom_s *) device;
+
+  if(eeprom->emulation->tick_count < eeprom->busy_until)
+  {
+    eeprom->busy_nacks++;
+    return false;
+  }
+  eeprom->address_received = read?eeprom->address_size:0;
+
+  return true;
+}
+
+/**
+ * @brief Write hook, takes the word address and then data, wrapping within the page
+ * 
+ * @param device
+ * @param byte
+ * @return true to acknowledge
+ */
+static bool sl_avr_emu_twi_eeprom_write(sl_avr_emu_twi_device_s *device, sl_avr_emu_byte_t byte)
+{
+  sl_avr_emu_twi_eeprom_s *eeprom = (sl_avr_emu_twi_eeprom_s *) device;
+  uint32_t                 page;
+
+  if(eeprom->address_received < eeprom->address_size)
+  {
+    eeprom->address = ((eeprom->address << 8) | byte) & (eeprom->size - 1);
+    eeprom->address_received++;
+    return true;
+  }
+
+  eeprom->memory[eeprom->address] = byte;
+  page            = eeprom->address & ~(eeprom->page_size - 1);
+  eeprom->address = page | ((eeprom->address + 1) & (eeprom->page_size - 1));
+  eeprom->written = true;
+  eeprom->bytes_written++;
+
+  return true;
+}
+
+/**
+ * @brief Read hook, sequential reads wrap around the whole EEPROM
+ * 
+ * @param device
+ * @return sl_avr_emu_byte_t
+ */
+static sl_avr_emu_byte_t sl_avr_emu_twi_eeprom_read(sl_avr_emu_twi_device_s *device)
+{
+  sl_avr_emu_twi_eeprom_s *eeprom = (sl_avr_emu_twi_eeprom_s *) device;
+  sl_avr_emu_byte_t        byte   = eeprom->memory[eeprom->address];
+
+  eeprom->address = (eeprom->address + 1) & (eeprom->size - 1);
+  eeprom->bytes_read++;
+
+  return byte;
+}
+
+/**
+ * @brief STOP hook, starts the write cycle after a write
+ * 
+ * @param device
+ */
+static void sl_avr_emu_twi_eeprom_stop(sl_avr_emu_twi_device_s *device)
+{
+  sl_avr_emu_twi_eeprom_s *eeprom = (sl_avr_emu_twi_eeprom_s *) device;
+
+  if(eeprom->written)
+  {
+    eeprom->busy_until = eeprom->emulation->tick_count +
+                         (sl_avr_emu_tick_count_t) eeprom->emulation->clock_hz * SL_AVR_EMU_TWI_EEPROM_WRITE_US / 1000000;
+    eeprom->written    = false;
+    eeprom->write_cycles++;
+  }
+}
+
+/**
+ * @brief Prints EEPROM counters
+ * 
+ * @param output
+ * @param device
+ */
+static void sl_avr_emu_twi_eeprom_report(FILE *output, const sl_avr_emu_twi_device_s *device)
+{
+  const sl_avr_emu_twi_eeprom_s *eeprom = (const sl_avr_emu_twi_eeprom_s *) device;
+
+  fprintf(output, "  %s 0x%02x: %zu bytes, %lu bytes read, %lu bytes written in %lu write cycles, %lu addressed while busy\n",
+          device->name, device->address, eeprom->size, eeprom->bytes_read, eeprom->bytes_written, eeprom->write_cycles, eeprom->busy_nacks);
+}
+
+/**
+ * @brief Writes the image back and unmaps it
+ * 
+ * @param device
+ */
+static void sl_avr_emu_twi_eeprom_close(sl_avr_emu_twi_device_s *device)
+{
+  sl_avr_emu_twi_eeprom_s *eeprom = (sl_avr_emu_twi_eeprom_s *) device;
+
+  msync(eeprom->memory, eeprom->size, MS_SYNC);
+  munmap(eeprom->memory, eeprom->size);
+  free(eeprom);
+}
+
+/**
+ * @brief Opens an EEPROM image as a 24-series I2C EEPROM.  The image is mapped, so writes reach the file without
+ *        system calls on the emulation thread.  EEPROMs over 256 bytes take two address bytes.
+ * 
+ * @param emulation   - Emulation the EEPROM is timed by
+ * @param path
+ * @param size        - EEPROM size in bytes, a power of 2.  0 to use the size of an existing image, or SL_AVR_EMU_TWI_EEPROM_SIZE_DEFAULT.
+ *                      Smaller images are extended with erased bytes.
+ * @param bus_address - 7-bit bus address
+ * @return sl_avr_emu_twi_device_s* - NULL if the image could not be opened or the size is invalid
+ */
+sl_avr_emu_twi_device_s *sl_avr_emu_twi_eeprom_open(const sl_avr_emu_emulation_s *emulation, const char *path, size_t size, sl_avr_emu_byte_t bus_address)
+{
+  sl_avr_emu_twi_eeprom_s *eeprom;
+  int                      fd;
+  struct stat              file_stat;
+  sl_avr_emu_byte_t       *map = MAP_FAILED;
+
+  fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if(fd < 0)
+  {
+    return NULL;
+  }
+  if(0 == fstat(fd, &file_stat))
+  {
+    if(0 == size)
+    {
+      size = (file_stat.st_size > 0)?(size_t) file_stat.st_size:SL_AVR_EMU_TWI_EEPROM_SIZE_DEFAULT;
+    }
+    if(size >= SL_AVR_EMU_TWI_EEPROM_SIZE_MIN && size <= SL_AVR_EMU_TWI_EEPROM_SIZE_MAX && 0 == (size & (size - 1)) &&
+       (file_stat.st_size >= size || 0 == ftruncate(fd, size)))
+    {
+      map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+  }
+  close(fd);
+
+  if(MAP_FAILED == map)
+  {
+    return NULL;
+  }
+  eeprom = calloc(1, sizeof(sl_avr_emu_twi_eeprom_s));
+  if(NULL == eeprom)
+  {
+    munmap(map, size);
+    return NULL;
+  }
+
+  /* Extended bytes read as erased */
+  if(file_stat.st_size < size)
+  {
+    memset(&map[file_stat.st_size], 0xFF, size - file_stat.st_size);
+  }
+  eeprom->emulation      = emulation;
+  eeprom->memory         = map;
+  eeprom->size           = size;
+  eeprom->address_size   = (size > 256)?2:1;
+  /* Page sizes of the 24C02 through 24C512 */
+  eeprom->page_size      = (size <= 256)?8:(size <= (2 << 10))?16:(size <= (8 << 10))?32:(size <= (32 << 10))?64:128;
+  eeprom->device.name    = "EEPROM";
+  eeprom->device.address = bus_address;
+  eeprom->device.start   = sl_avr_emu_twi_eeprom_start;
+  eeprom->device.write   = sl_avr_emu_twi_eeprom_write;
+  eeprom->device.read    = sl_avr_emu_twi_eeprom_read;
+  eeprom->device.stop    = sl_avr_emu_twi_eeprom_stop;
+  eeprom->device.report  = sl_avr_emu_twi_eeprom_report;
+  eeprom->device.close   = sl_avr_emu_twi_eeprom_close;
+
+  return &eeprom->device;
+}
@@ -0,0 +1,189 @@
+/**
+ * @file sl_avr_emu_twi_sensor.c
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator I2C Sensor Device Logic
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ * Output registers are latched from the sample file as a read starts, like the shadow registers of real sensors,
+ * so a multi-byte reading is never torn between samples.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sl_avr_emu_samples.h"
+#include "sl_avr_emu_twi_sensor.h"
+
+/**
+ * @brief I2C sensor device
+ * 
+ */
+typedef struct
+{
+  sl_avr_emu_twi_device_s       device;
+  const sl_avr_emu_emulation_s *emulation;
+  sl_avr_emu_samples_s          samples;
+
+  sl_avr_emu_byte_t             registers[SL_AVR_EMU_TWI_SENSOR_REGISTERS];
+  sl_avr_emu_byte_t             data_register;
+  sl_avr_emu_byte_t             pointer;
+  /* Register pointer was received in this write */
+  bool                          pointer_set;
+
+  uint64_t                      latches;
+
+} sl_avr_emu_twi_sensor_s;
+
+/**
+ * @brief START hook, latches the current sample ahead of a read
+ * 
+ * @param device
+ * @param read
+ * @return true to acknowledge
+ */
+static bool sl_avr_emu_twi_sensor_start(sl_avr_emu_twi_device_s *device, bool read)
+{
+  sl_avr_emu_twi_sensor_s *sensor = (sl_avr_emu_twi_sensor_s *) device;
+
+  if(read)
+  {
+    memcpy(&sensor->registers[sensor->data_register],
+           sl_avr_emu_samples_record(&sensor->samples, sl_avr_emu_samples_index(&sensor->samples, sensor->emulation->tick_count,
+                                                                                sensor->emulation->clock_hz, NULL)),
+           sensor->samples.record_size);
+    sensor->latches++;
+  }
+  else
+  {
+    sensor->pointer_set = false;
+  }
+
+  return true;
+}
+
+/**
+ * @brief Write hook, takes the register pointer and then register values.  Output registers are read only.
+ * 
+ * @param device
+ * @param byte
+ * @return true to acknowledge
+ */
+static bool sl_avr_emu_twi_sensor_write(sl_avr_emu_twi_device_s *device, sl_avr_emu_byte_t byte)
+{
+  sl_avr_emu_twi_sensor_s *sensor = (sl_avr_emu_twi_sensor_s *) device;
+
+  if(!sensor->pointer_set)
+  {
+    sensor->pointer     = byte;
+    sensor->pointer_set = true;
+    return true;
+  }
+
+  if(sensor->pointer < sensor->data_register || sensor->pointer >= sensor->data_register + sensor->samples.record_size)
+  {
+    sensor->registers[sensor->pointer] = byte;
+  }
+  sensor->pointer++;
+
+  return true;
+}
+
+/**
+ * @brief Read hook
+ * 
+ * @param device
+ * @return sl_avr_emu_byte_t
+ */
+static sl_avr_emu_byte_t sl_avr_emu_twi_sensor_read(sl_avr_emu_twi_device_s *device)
+{
+  sl_avr_emu_twi_sensor_s *sensor = (sl_avr_emu_twi_sensor_s *) device;
+
+  return sensor->registers[sensor->pointer++];
+}
+
+/**
+ * @brief STOP hook
+ * 
+ * @param device
+ */
+static void sl_avr_emu_twi_sensor_stop(sl_avr_emu_twi_device_s *device)
+{
+}
+
+/**
+ * @brief Prints sensor counters
+ * 
+ * @param output
+ * @param device
+ */
+static void sl_avr_emu_twi_sensor_report(FILE *output, const sl_avr_emu_twi_device_s *device)
+{
+  const sl_avr_emu_twi_sensor_s *sensor = (const sl_avr_emu_twi_sensor_s *) device;
+
+  fprintf(output, "  %s 0x%02x: %lu samples of %u bytes, %lu read, %lu past the end\n",
+          device->name, device->address, sensor->samples.record_count, sensor->samples.record_size, sensor->latches, sensor->samples.overruns);
+}
+
+/**
+ * @brief Unmaps the sample file
+ * 
+ * @param device
+ */
+static void sl_avr_emu_twi_sensor_close(sl_avr_emu_twi_device_s *device)
+{
+  sl_avr_emu_twi_sensor_s *sensor = (sl_avr_emu_twi_sensor_s *) device;
+
+  sl_avr_emu_samples_close(&sensor->samples);
+  free(sensor);
+}
+
+/**
+ * @brief Opens a sample file as an I2C sensor with the usual register interface: a write sets the register pointer
+ *        and writes registers from it, a read reads registers from it, the pointer incrementing after each byte.
+ *        Output registers hold the sample record current at the START of each read, byte for byte as in the file.
+ *        Other registers read back what was written to them.
+ * 
+ * @param emulation     - Emulation whose time indexes samples
+ * @param path
+ * @param bus_address   - 7-bit bus address
+ * @param data_register - First output register
+ * @param record_size   - Bytes per sample record, the number of output registers
+ * @param sample_hz     - Records per second of emulated time
+ * @return sl_avr_emu_twi_device_s* - NULL if the file could not be mapped or the records do not fit in the registers
+ */
+sl_avr_emu_twi_device_s *sl_avr_emu_twi_sensor_open(const sl_avr_emu_emulation_s *emulation, const char *path, sl_avr_emu_byte_t bus_address,
+                                                    sl_avr_emu_byte_t data_register, uint32_t record_size, uint32_t sample_hz)
+{
+  sl_avr_emu_twi_sensor_s *sensor;
+
+  if(record_size > SL_AVR_EMU_TWI_SENSOR_REGISTERS - data_register)
+  {
+    return NULL;
+  }
+  sensor = calloc(1, sizeof(sl_avr_emu_twi_sensor_s));
+  if(NULL == sensor)
+  {
+    return NULL;
+  }
+  if(SL_AVR_EMU_RESULT_SUCCESS != sl_avr_emu_samples_open(&sensor->samples, path, record_size, sample_hz))
+  {
+    free(sensor);
+    return NULL;
+  }
+
+  sensor->emulation      = emulation;
+  sensor->data_register  = data_register;
+  sensor->device.name    = "Sensor";
+  sensor->device.address = bus_address;
+  sensor->device.start   = sl_avr_emu_twi_sensor_start;
+  sensor->device.write   = sl_avr_emu_twi_sensor_write;
+  sensor->device.read    = sl_avr_emu_twi_sensor_read;
+  sensor->device.stop    = sl_avr_emu_twi_sensor_stop;
+  sensor->device.report  = sl_avr_emu_twi_sensor_report;
+  sensor->device.close   = sl_avr_emu_twi_sensor_close;
+
+  return &sensor->device;
+}
@@ -0,0 +1,584 @@
+/**
+ * @file sl_avr_emu_usart.c
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator USART Logic
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ * Frames take their UBRR0 time through scheduled events, nothing is checked per tick.  Shift and
+ * data registers live in the emulation structure, so snapshots restore them with the events.  The host
+ * side runs on its own thread, waiting in epoll on the input descriptor and moving bytes through
+ * two single-producer single-consumer rings, so the emulation thread never makes a system call.
+ * The receive ring doubles as flow control, a byte is only taken from it once firmware has read
+ * the previous one.  Bytes from stimuli arrive like bytes on the wire, and can overrun.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "sl_avr_emu_bitops.h"
+#include "sl_avr_emu_event.h"
+#include "sl_avr_emu_io.h"
+#include "sl_avr_emu_replay.h"
+#include "sl_avr_emu_usart.h"
+
+#define SL_AVR_EMU_USART_RING_MASK (SL_AVR_EMU_USART_RING_SIZE - 1)
+
+/**
+ * @brief Ticks to shift one frame, from the baud rate and frame format set by firmware
+ * 
+ * @param emulation
+ * @return sl_avr_emu_tick_count_t
+ */
+static sl_avr_emu_tick_count_t sl_avr_emu_usart_frame_ticks(const sl_avr_emu_emulation_s *emulation)
+{
+  const sl_avr_emu_byte_t *data = emulation->memory.data;
+  sl_avr_emu_tick_count_t  bit_ticks;
+  uint32_t                 data_bits;
+  uint32_t                 frame_bits;
+
+  bit_ticks = (SL_AVR_EMU_CHECK_BIT(data[SL_AVR_EMU_USART_0_UCSR0A], SL_AVR_EMU_USART_0_U2X0)?8:16) *
+              ((((data[SL_AVR_EMU_USART_0_UBRR0H] & 0x0F) << 8) | data[SL_AVR_EMU_USART_0_UBRR0L]) + 1);
+
+  data_bits = 5 + ((data[SL_AVR_EMU_USART_0_UCSR0C] >> SL_AVR_EMU_USART_0_UCSZ00) & 0x3);
+  if(SL_AVR_EMU_CHECK_BIT(data[SL_AVR_EMU_USART_0_UCSR0B], SL_AVR_EMU_USART_0_UCSZ02))
+  {
+    data_bits = 9;
+  }
+
+  /* Start bit, data bits, parity bit and stop bits */
+  frame_bits = 1 + data_bits +
+               (SL_AVR_EMU_CHECK_BIT(data[SL_AVR_EMU_USART_0_UCSR0C], SL_AVR_EMU_USART_0_UPM01)?1:0) +
+               (SL_AVR_EMU_CHECK_BIT(data[SL_AVR_EMU_USART_0_UCSR0C], SL_AVR_EMU_USART_0_USBS0)?2:1);
+
+  return bit_ticks * frame_bits;
+}
+
+/**
+ * @brief Receive frame event.  Takes the next host byte if firmware has read the last one, while the receiver is enabled.
+ * 
+ * @param emulation
+ * @param context   - USART state
+ * @return sl_avr_emu_result_e
+ */
+static sl_avr_emu_result_e sl_avr_emu_usart_rx_event(sl_avr_emu_emulation_s *emulation, void *context)
+{
+  sl_avr_emu_result_e  result = SL_AVR_EMU_RESULT_SUCCESS;
+  sl_avr_emu_usart_s  *usart  = context;
+  uint_fast32_t        tail;
+  sl_avr_emu_byte_t    byte;
+
+  if(!SL_AVR_EMU_CHECK_BIT(emulation->memory.data[SL_AVR_EMU_USART_0_UCSR0B], SL_AVR_EMU_USART_0_RXEN0))
+  {
+    return SL_AVR_EMU_RESULT_SUCCESS;
+  }
+
+  tail = atomic_load_explicit(&usart->rx.tail, memory_order_relaxed);
+  if(!SL_AVR_EMU_CHECK_BIT(emulation->memory.data[SL_AVR_EMU_USART_0_UCSR0A], SL_AVR_EMU_USART_0_RXC0) &&
+     tail != atomic_load_explicit(&usart->rx.head, memory_order_acquire))
+  {
+    byte = usart->rx.buffer[tail & SL_AVR_EMU_USART_RING_MASK];
+    atomic_store_explicit(&usart->rx.tail, tail + 1, memory_order_release);
+
+    /* Through the stimulus path when recording, replaying or reverse executing, so the byte is logged */
+    result = (NULL != emulation->hooks.replay || NULL != emulation->hooks.reverse)?sl_avr_emu_stimulus_inject(emulation, SL_AVR_EMU_STIMULUS_SERIAL_RX, SL_AVR_EMU_USART_0_PORT, byte):
+                                               sl_avr_emu_usart_receive(emulation, SL_AVR_EMU_USART_0_PORT, byte, usart);
+  }
+
+  if(SL_AVR_EMU_RESULT_SUCCESS == result)
+  {
+    result = sl_avr_emu_event_schedule(emulation, emulation->tick_count + sl_avr_emu_usart_frame_ticks(emulation), sl_avr_emu_usart_rx_event, usart);
+  }
+
+  return result;
+}
+
+/**
+ * @brief Transmit frame event.  The shifted byte is handed to the serial transmit handler or the host,
+ *        and the buffered byte, if any, is shifted next.
+ * 
+ * @param emulation
+ * @param context   - USART state
+ * @return sl_avr_emu_result_e
+ */
+static sl_avr_emu_result_e sl_avr_emu_usart_tx_event(sl_avr_emu_emulation_s *emulation, void *context)
+{
+  sl_avr_emu_result_e  result = SL_AVR_EMU_RESULT_SUCCESS;
+  sl_avr_emu_usart_s  *usart  = context;
+  uint_fast32_t        head;
+
+  head = atomic_load_explicit(&usart->tx.head, memory_order_relaxed);
+  if(NULL != emulation->hooks.serial_tx_handler)
+  {
+    result = emulation->hooks.serial_tx_handler(emulation, SL_AVR_EMU_USART_0_PORT, emulation->usart0.tx_shift, emulation->hooks.serial_tx_context);
+  }
+  else if((head - atomic_load_explicit(&usart->tx.tail, memory_order_acquire)) < SL_AVR_EMU_USART_RING_SIZE)
+  {
+    usart->tx.buffer[head & SL_AVR_EMU_USART_RING_MASK] = emulation->usart0.tx_shift;
+    atomic_store_explicit(&usart->tx.head, head + 1, memory_order_release);
+  }
+  else
+  {
+    usart->tx_dropped++;
+  }
+  usart->tx_bytes++;
+
+  if(SL_AVR_EMU_RESULT_SUCCESS != result)
+  {
+    return result;
+  }
+  if(emulation->usart0.tx_buffered)
+  {
+    emulation->usart0.tx_shift    = emulation->usart0.tx_buffer;
+    emulation->usart0.tx_buffered = false;
+    SL_AVR_EMU_SET_BIT(emulation->memory.data[SL_AVR_EMU_USART_0_UCSR0A], SL_AVR_EMU_USART_0_UDRE0);
+    result = sl_avr_emu_event_schedule(emulation, emulation->tick_count + sl_avr_emu_usart_frame_ticks(emulation), sl_avr_emu_usart_tx_event, usart);
+  }
+  else
+  {
+    emulation->usart0.tx_shifting = false;
+    SL_AVR_EMU_SET_BIT(emulation->memory.data[SL_AVR_EMU_USART_0_UCSR0A], SL_AVR_EMU_USART_0_TXC0);
+  }
+
+  return result;
+}
+
+/**
+ * @brief UDR0 read hook, returns the received byte and frees the receive buffer
+ * 
+ * @param emulation
+ * @param address
+ * @param context   - Unused
+ */
+static void sl_avr_emu_usart_udr_read(sl_avr_emu_emulation_s *emulation, sl_avr_emu_address_t address, void *context)
+{
+  emulation->memory.data[address] = emulation->usart0.rx_data;
+  emulation->memory.data[SL_AVR_EMU_USART_0_UCSR0A] &= ~((1 << SL_AVR_EMU_USART_0_RXC0) | (1 << SL_AVR_EMU_USART_0_FE0) |
+                                                         (1 << SL_AVR_EMU_USART_0_DOR0) | (1 << SL_AVR_EMU_USART_0_UPE0));
+}
+
+/**
+ * @brief UDR0 write hook, shifts the byte out or buffers it behind the byte being shifted
+ * 
+ * @param emulation
+ * @param address
+ * @param value
+ * @param context   - USART state
+ */
+static void sl_avr_emu_usart_udr_write(sl_avr_emu_emulation_s *emulation, sl_avr_emu_address_t address, sl_avr_emu_byte_t value, void *context)
+{
+  sl_avr_emu_usart_s *usart = context;
+
+  if(!SL_AVR_EMU_CHECK_BIT(emulation->memory.data[SL_AVR_EMU_USART_0_UCSR0B], SL_AVR_EMU_USART_0_TXEN0))
+  {
+    return;
+  }
+
+  if(!emulation->usart0.tx_shifting)
+  {
+    emulation->usart0.tx_shift    = value;
+    emulation->usart0.tx_shifting = true;
+    sl_avr_emu_event_schedule(emulation, emulation->tick_count + sl_avr_emu_usart_frame_ticks(emulation), sl_avr_emu_usart_tx_event, usart);
+  }
+  else if(!emulation->usart0.tx_buffered)
+  {
+    emulation->usart0.tx_buffer   = value;
+    emulation->usart0.tx_buffered = true;
+    SL_AVR_EMU_CLEAR_BIT(emulation->memory.data[SL_AVR_EMU_USART_0_UCSR0A], SL_AVR_EMU_USART_0_UDRE0);
+  }
+}
+
+/**
+ * @brief UCSR0A write hook.  Status flags are read only, except TXC0 which is cleared by writing one.
+ * 
+ * @param emulation
+ * @param address
+ * @param value
+ * @param context   - USART state
+ */
+static void sl_avr_emu_usart_ucsra_write(sl_avr_emu_emulation_s *emulation, sl_avr_emu_address_t address, sl_avr_emu_byte_t value, void *context)
+{
+  const sl_avr_emu_byte_t writable = (1 << SL_AVR_EMU_USART_0_U2X0) | (1 << SL_AVR_EMU_USART_0_MPCM0);
+
+  if(SL_AVR_EMU_CHECK_BIT(value, SL_AVR_EMU_USART_0_TXC0))
+  {
+    SL_AVR_EMU_CLEAR_BIT(emulation->memory.data[address], SL_AVR_EMU_USART_0_TXC0);
+  }
+  emulation->memory.data[address] = (emulation->memory.data[address] & ~writable) | (value & writable);
+}
+
+/**
+ * @brief UCSR0B write hook, starts receive frames when the receiver is enabled
+ * 
+ * @param emulation
+ * @param address
+ * @param value
+ * @param context   - USART state
+ */
+static void sl_avr_emu_usart_ucsrb_write(sl_avr_emu_emulation_s *emulation, sl_avr_emu_address_t address, sl_avr_emu_byte_t value, void *context)
+{
+  bool receiving = SL_AVR_EMU_CHECK_BIT(emulation->memory.data[address], SL_AVR_EMU_USART_0_RXEN0);
+
+  emulation->memory.data[address] = value;
+  if(!receiving && SL_AVR_EMU_CHECK_BIT(value, SL_AVR_EMU_USART_0_RXEN0))
+  {
+    sl_avr_emu_event_cancel(emulation, sl_avr_emu_usart_rx_event, context);
+    sl_avr_emu_event_schedule(emulation, emulation->tick_count + sl_avr_emu_usart_frame_ticks(emulation), sl_avr_emu_usart_rx_event, context);
+  }
+}
+
+/**
+ * @brief Moves bytes from the input descriptor into the receive ring
+ * 
+ * @param usart
+ */
+static void sl_avr_emu_usart_host_read(sl_avr_emu_usart_s *usart)
+{
+  uint_fast32_t head = atomic_load_explicit(&usart->rx.head, memory_order_relaxed);
+  uint_fast32_t free_size;
+  uint_fast32_t offset;
+  ssize_t       size;
+
+  free_size = SL_AVR_EMU_USART_RING_SIZE - (head - atomic_load_explicit(&usart->rx.tail, memory_order_acquire));
+  if(0 == free_size)
+  {
+    if(usart->input_pollable && !usart->input_paused)
+    {
+      /* Level triggered input would wake the thread until the ring drains */
+      epoll_ctl(usart->epoll_fd, EPOLL_CTL_MOD, usart->input_fd, &(struct epoll_event){.events = 0});
+    }
+    usart->input_paused = true;
+    return;
+  }
+  if(usart->input_paused)
+  {
+    if(usart->input_pollable)
+    {
+      epoll_ctl(usart->epoll_fd, EPOLL_CTL_MOD, usart->input_fd, &(struct epoll_event){.events = EPOLLIN});
+    }
+    usart->input_paused = false;
+  }
+
+  offset = head & SL_AVR_EMU_USART_RING_MASK;
+  size   = read(usart->input_fd, &usart->rx.buffer[offset],
+                (free_size < (SL_AVR_EMU_USART_RING_SIZE - offset))?free_size:(SL_AVR_EMU_USART_RING_SIZE - offset));
+  if(size > 0)
+  {
+    atomic_store_explicit(&usart->rx.head, head + size, memory_order_release);
+  }
+  else if(0 == size || (EAGAIN != errno && EINTR != errno))
+  {
+    usart->input_eof = true;
+    if(usart->input_pollable)
+    {
+      epoll_ctl(usart->epoll_fd, EPOLL_CTL_DEL, usart->input_fd, NULL);
+    }
+  }
+}
+
+/**
+ * @brief Moves bytes from the transmit ring to the output descriptor
+ * 
+ * @param usart
+ */
+static void sl_avr_emu_usart_host_write(sl_avr_emu_usart_s *usart)
+{
+  uint_fast32_t tail = atomic_load_explicit(&usart->tx.tail, memory_order_relaxed);
+  uint_fast32_t used;
+  uint_fast32_t offset;
+  ssize_t       size;
+
+  while(0 != (used = atomic_load_explicit(&usart->tx.head, memory_order_acquire) - tail))
+  {
+    offset = tail & SL_AVR_EMU_USART_RING_MASK;
+    size   = write(usart->output_fd, &usart->tx.buffer[offset],
+                   (used < (SL_AVR_EMU_USART_RING_SIZE - offset))?used:(SL_AVR_EMU_USART_RING_SIZE - offset));
+    if(size <= 0)
+    {
+      break;
+    }
+    tail += size;
+    atomic_store_explicit(&usart->tx.tail, tail, memory_order_release);
+  }
+}
+
+/**
+ * @brief Host thread, waits for input and flushes output until stopped
+ * 
+ * @param context - USART state
+ * @return void*
+ */
+static void *sl_avr_emu_usart_thread(void *context)
+{
+  sl_avr_emu_usart_s *usart = context;
+  struct epoll_event  event;
+
+  while(atomic_load(&usart->running))
+  {
+    epoll_wait(usart->epoll_fd, &event, 1, SL_AVR_EMU_USART_FLUSH_MS);
+
+    if(usart->input_fd >= 0 && !usart->input_eof)
+    {
+      sl_avr_emu_usart_host_read(usart);
+    }
+    if(usart->output_fd >= 0)
+    {
+      sl_avr_emu_usart_host_write(usart);
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * @brief Attaches USART0 to emulation, bridging it to host file descriptors through a host thread.
+ *        Firmware never waits on the host, bytes the host is too slow to take are dropped.
+ *        Without descriptors no thread is started, bytes only move through the serial handlers.
+ * 
+ * @param emulation
+ * @param input_fd  - Descriptor received bytes are read from, -1 for none
+ * @param output_fd - Descriptor transmitted bytes are written to, -1 for none
+ * @return sl_avr_emu_result_e
+ */
+sl_avr_emu_result_e sl_avr_emu_usart_start(sl_avr_emu_emulation_s *emulation, int input_fd, int output_fd)
+{
+  sl_avr_emu_result_e result = SL_AVR_EMU_RESULT_SUCCESS;
+  sl_avr_emu_usart_s *usart;
+
+  if(NULL != emulation->hooks.usart0)
+  {
+    return SL_AVR_EMU_RESULT_FAILURE;
+  }
+
+  usart = calloc(1, sizeof(sl_avr_emu_usart_s));
+  if(NULL == usart)
+  {
+    return SL_AVR_EMU_RESULT_FAILURE;
+  }
+  usart->input_fd     = input_fd;
+  usart->output_fd    = output_fd;
+  usart->owned_fds[0] = usart->owned_fds[1] = -1;
+  usart->epoll_fd     = epoll_create1(EPOLL_CLOEXEC);
+  if(usart->epoll_fd < 0)
+  {
+    free(usart);
+    return SL_AVR_EMU_RESULT_FAILURE;
+  }
+  usart->input_pollable = (input_fd >= 0 && 0 == epoll_ctl(usart->epoll_fd, EPOLL_CTL_ADD, input_fd, &(struct epoll_event){.events = EPOLLIN}));
+  emulation->hooks.usart0 = usart;
+  memset(&emulation->usart0, 0, sizeof(emulation->usart0));
+
+  /* Reset values, transmit buffer empty and 8-bit frames */
+  emulation->memory.data[SL_AVR_EMU_USART_0_UCSR0A] = (1 << SL_AVR_EMU_USART_0_UDRE0);
+  emulation->memory.data[SL_AVR_EMU_USART_0_UCSR0C] = (1 << SL_AVR_EMU_USART_0_UCSZ01) | (1 << SL_AVR_EMU_USART_0_UCSZ00);
+
+  result = sl_avr_emu_io_attach(emulation, SL_AVR_EMU_USART_0_UDR0, sl_avr_emu_usart_udr_read, sl_avr_emu_usart_udr_write, usart);
+  if(SL_AVR_EMU_RESULT_SUCCESS == result)
+  {
+    result = sl_avr_emu_io_attach(emulation, SL_AVR_EMU_USART_0_UCSR0A, NULL, sl_avr_emu_usart_ucsra_write, usart);
+  }
+  if(SL_AVR_EMU_RESULT_SUCCESS == result)
+  {
+    result = sl_avr_emu_io_attach(emulation, SL_AVR_EMU_USART_0_UCSR0B, NULL, sl_avr_emu_usart_ucsrb_write, usart);
+  }
+  if(SL_AVR_EMU_RESULT_SUCCESS == result)
+  {
+    emulation->hooks.serial_rx_handler = sl_avr_emu_usart_receive;
+    emulation->hooks.serial_rx_context = usart;
+  }
+  if(SL_AVR_EMU_RESULT_SUCCESS == result && (input_fd >= 0 || output_fd >= 0))
+  {
+    atomic_store(&usart->running, true);
+    if(0 != pthread_create(&usart->thread, NULL, sl_avr_emu_usart_thread, usart))
+    {
+      atomic_store(&usart->running, false);
+      result = SL_AVR_EMU_RESULT_FAILURE;
+    }
+  }
+
+  if(SL_AVR_EMU_RESULT_SUCCESS != result)
+  {
+    sl_avr_emu_usart_stop(emulation);
+  }
+
+  return result;
+}
+
+/**
+ * @brief Attaches USART0 to emulation, bridging it to a host endpoint
+ * 
+ * @param emulation
+ * @param endpoint  - "-" for stdin and stdout, "pty" for a new pseudo-terminal, else a path to a FIFO, tty or file
+ * @return sl_avr_emu_result_e - SL_AVR_EMU_RESULT_INVALID_FILE_PATH if endpoint could not be opened
+ */
+sl_avr_emu_result_e sl_avr_emu_usart_open(sl_avr_emu_emulation_s *emulation, const char *endpoint)
+{
+  sl_avr_emu_result_e result;
+  int                 fd;
+  int                 peer_fd = -1;
+  struct termios      attributes;
+
+  if(0 == strcmp(endpoint, "-"))
+  {
+    return sl_avr_emu_usart_start(emulation, STDIN_FILENO, STDOUT_FILENO);
+  }
+
+  if(0 == strcmp(endpoint, "pty"))
+  {
+    fd = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if(fd < 0 || 0 != grantpt(fd) || 0 != unlockpt(fd) ||
+       (peer_fd = open(ptsname(fd), O_RDWR | O_NOCTTY | O_CLOEXEC)) < 0)
+    {
+      if(fd >= 0)
+      {
+        close(fd);
+      }
+      return SL_AVR_EMU_RESULT_INVALID_FILE_PATH;
+    }
+    /* Raw bytes both ways.  The emulator keeps the terminal side open, so terminals may come and go without a hangup. */
+    if(0 == tcgetattr(peer_fd, &attributes))
+    {
+      cfmakeraw(&attributes);
+      tcsetattr(peer_fd, TCSANOW, &attributes);
+    }
+    printf("USART0 on %s\n", ptsname(fd));
+    fflush(stdout);
+  }
+  else
+  {
+    /* Read-write so opening a FIFO does not wait for its other end, non-blocking so a stalled reader cannot stall the host thread */
+    fd = open(endpoint, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if(fd < 0)
+    {
+      return SL_AVR_EMU_RESULT_INVALID_FILE_PATH;
+    }
+    if(isatty(fd) && 0 == tcgetattr(fd, &attributes))
+    {
+      cfmakeraw(&attributes);
+      tcsetattr(fd, TCSANOW, &attributes);
+    }
+  }
+
+  result = sl_avr_emu_usart_start(emulation, fd, fd);
+  if(SL_AVR_EMU_RESULT_SUCCESS == result)
+  {
+    emulation->hooks.usart0->owned_fds[0] = fd;
+    emulation->hooks.usart0->owned_fds[1] = peer_fd;
+  }
+  else
+  {
+    close(fd);
+    if(peer_fd >= 0)
+    {
+      close(peer_fd);
+    }
+  }
+
+  return result;
+}
+
+/**
+ * @brief Receives a byte on USART0, as if its frame just completed.
+ *        Serial receive stimuli for SL_AVR_EMU_USART_0_PORT arrive here.
+ * 
+ * @param emulation
+ * @param port      - Serial port number, bytes for other ports are ignored
+ * @param byte
+ * @param context   - USART state
+ * @return sl_avr_emu_result_e
+ */
+sl_avr_emu_result_e sl_avr_emu_usart_receive(sl_avr_emu_emulation_s *emulation, sl_avr_emu_address_t port, sl_avr_emu_byte_t byte, void *context)
+{
+  sl_avr_emu_usart_s *usart = context;
+
+  if(SL_AVR_EMU_USART_0_PORT != port ||
+     !SL_AVR_EMU_CHECK_BIT(emulation->memory.data[SL_AVR_EMU_USART_0_UCSR0B], SL_AVR_EMU_USART_0_RXEN0))
+  {
+    return SL_AVR_EMU_RESULT_SUCCESS;
+  }
+
+  if(SL_AVR_EMU_CHECK_BIT(emulation->memory.data[SL_AVR_EMU_USART_0_UCSR0A], SL_AVR_EMU_USART_0_RXC0))
+  {
+    SL_AVR_EMU_SET_BIT(emulation->memory.data[SL_AVR_EMU_USART_0_UCSR0A], SL_AVR_EMU_USART_0_DOR0);
+    usart->rx_overruns++;
+  }
+  else
+  {
+    emulation->usart0.rx_data = byte;
+    SL_AVR_EMU_SET_BIT(emulation->memory.data[SL_AVR_EMU_USART_0_UCSR0A], SL_AVR_EMU_USART_0_RXC0);
+    usart->rx_bytes++;
+  }
+
+  return SL_AVR_EMU_RESULT_SUCCESS;
+}
+
+/**
+ * @brief Prints USART0 byte counts
+ * 
+ * @param output
+ * @param emulation
+ */
+void sl_avr_emu_usart_report(FILE *output, const sl_avr_emu_emulation_s *emulation)
+{
+  const sl_avr_emu_usart_s *usart = emulation->hooks.usart0;
+
+  fprintf(output, "USART0: %lu bytes received, %lu overruns, %lu bytes transmitted, %lu dropped\n",
+          usart->rx_bytes, usart->rx_overruns, usart->tx_bytes, usart->tx_dropped);
+}
+
+/**
+ * @brief Flushes transmitted bytes to the host, stops the host thread and detaches USART0
+ * 
+ * @param emulation
+ */
+void sl_avr_emu_usart_stop(sl_avr_emu_emulation_s *emulation)
+{
+  sl_avr_emu_usart_s *usart = emulation->hooks.usart0;
+  uint32_t            i;
+
+  if(NULL == usart)
+  {
+    return;
+  }
+
+  if(atomic_load(&usart->running))
+  {
+    atomic_store(&usart->running, false);
+    pthread_join(usart->thread, NULL);
+  }
+  if(usart->output_fd >= 0)
+  {
+    sl_avr_emu_usart_host_write(usart);
+  }
+
+  sl_avr_emu_event_cancel(emulation, sl_avr_emu_usart_rx_event, usart);
+  sl_avr_emu_event_cancel(emulation, sl_avr_emu_usart_tx_event, usart);
+  sl_avr_emu_io_detach(emulation, SL_AVR_EMU_USART_0_UDR0);
+  sl_avr_emu_io_detach(emulation, SL_AVR_EMU_USART_0_UCSR0A);
+  sl_avr_emu_io_detach(emulation, SL_AVR_EMU_USART_0_UCSR0B);
+  if(usart == emulation->hooks.serial_rx_context)
+  {
+    emulation->hooks.serial_rx_handler = NULL;
+    emulation->hooks.serial_rx_context = NULL;
+  }
+
+  close(usart->epoll_fd);
+  for(i = 0; i < sizeof(usart->owned_fds)/sizeof(usart->owned_fds[0]); i++)
+  {
+    if(usart->owned_fds[i] >= 0)
+    {
+      close(usart->owned_fds[i]);
+    }
+  }
+  free(usart);
+  emulation->hooks.usart0 = NULL;
+}
@@ -0,0 +1,438 @@
+/**
+ * @file sl_avr_emu_watch.c
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator Data Access Heatmap and Watch Logic
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ * Counters are kept per data address and only grouped into regions for reporting.  A watch hit
+ * is latched by the access and acted on once its instruction completes, so the instruction
+ * is never left half executed.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sl_avr_emu_bitops.h"
+#include "sl_avr_emu_breakpoint.h"
+#include "sl_avr_emu_elf.h"
+#include "sl_avr_emu_opcode.h"
+#include "sl_avr_emu_watch.h"
+
+/**
+ * @brief Report entry, a data symbol or a fixed size region
+ * 
+ */
+typedef struct
+{
+  sl_avr_emu_extended_address_t start;
+  sl_avr_emu_extended_address_t end;
+  /* NULL for regions without a data symbol */
+  const sl_avr_emu_symbol_s    *symbol;
+  uint64_t                      reads;
+  uint64_t                      writes;
+
+} sl_avr_emu_watch_entry_s;
+
+/**
+ * @brief Orders entries by accesses, descending
+ * 
+ * @param a
+ * @param b
+ * @return int
+ */
+static int sl_avr_emu_watch_compare(const void *a, const void *b)
+{
+  const sl_avr_emu_watch_entry_s *entry_a = a;
+  const sl_avr_emu_watch_entry_s *entry_b = b;
+
+  return ((entry_a->reads + entry_a->writes) < (entry_b->reads + entry_b->writes))?1:
+         ((entry_a->reads + entry_a->writes) > (entry_b->reads + entry_b->writes))?-1:
+         (entry_a->start > entry_b->start);
+}
+
+/**
+ * @brief Attaches new access counters, without watch ranges, to emulation
+ * 
+ * @param emulation
+ * @return sl_avr_emu_result_e
+ */
+sl_avr_emu_result_e sl_avr_emu_watch_start(sl_avr_emu_emulation_s *emulation)
+{
+  sl_avr_emu_result_e result = SL_AVR_EMU_RESULT_SUCCESS;
+  sl_avr_emu_watch_s *watch;
+
+  watch = calloc(1, sizeof(sl_avr_emu_watch_s));
+  if(watch != NULL)
+  {
+    emulation->hooks.watch = watch;
+  }
+  else
+  {
+    result = SL_AVR_EMU_RESULT_FAILURE;
+  }
+
+  return result;
+}
+
+/**
+ * @brief Adds a watch range.  Attaches access counters first if needed.
+ * 
+ * @param emulation
+ * @param start     - First data address watched
+ * @param size      - Bytes watched
+ * @param access    - Access kinds to trigger on
+ * @param callback  - NULL to stop emulation on a hit
+ * @param context   - Passed to callback
+ * @return sl_avr_emu_result_e - SL_AVR_EMU_RESULT_FAILURE if SL_AVR_EMU_WATCH_MAX ranges are already watched
+ */
+sl_avr_emu_result_e sl_avr_emu_watch_add(sl_avr_emu_emulation_s *emulation, sl_avr_emu_extended_address_t start, uint32_t size,
+                                         sl_avr_emu_watch_access_e access, sl_avr_emu_watch_callback_f callback, void *context)
+{
+  sl_avr_emu_result_e       result = SL_AVR_EMU_RESULT_SUCCESS;
+  sl_avr_emu_watch_s       *watch;
+  sl_avr_emu_watch_range_s *range;
+
+  if(0 == size || !SL_AVR_EMU_DATA_ADDRESS_VALID(start))
+  {
+    return SL_AVR_EMU_RESULT_INVALID_DATA_ADDRESS;
+  }
+  if(NULL == emulation->hooks.watch)
+  {
+    result = sl_avr_emu_watch_start(emulation);
+  }
+  watch = emulation->hooks.watch;
+
+  if(SL_AVR_EMU_RESULT_SUCCESS == result && watch->range_count < SL_AVR_EMU_WATCH_MAX)
+  {
+    range           = &watch->ranges[watch->range_count];
+    range->start    = start;
+    range->end      = (size < (SL_AVR_EMU_DATA_SIZE - start))?(start + size):SL_AVR_EMU_DATA_SIZE;
+    range->access   = access;
+    range->callback = callback;
+    range->context  = context;
+
+    if(0 == watch->range_count || range->start < watch->range_start)
+    {
+      watch->range_start = range->start;
+    }
+    if(0 == watch->range_count || range->end > watch->range_end)
+    {
+      watch->range_end = range->end;
+    }
+    watch->range_count++;
+  }
+  else
+  {
+    result = SL_AVR_EMU_RESULT_FAILURE;
+  }
+
+  return result;
+}
+
+/**
+ * @brief Removes the watch range added with the same start, size and access
+ * 
+ * @param emulation
+ * @param start
+ * @param size
+ * @param access
+ * @return sl_avr_emu_result_e - SL_AVR_EMU_RESULT_FAILURE if no such range is watched
+ */
+sl_avr_emu_result_e sl_avr_emu_watch_remove(sl_avr_emu_emulation_s *emulation, sl_avr_emu_extended_address_t start, uint32_t size,
+                                            sl_avr_emu_watch_access_e access)
+{
+  sl_avr_emu_result_e           result = SL_AVR_EMU_RESULT_FAILURE;
+  sl_avr_emu_watch_s           *watch  = emulation->hooks.watch;
+  sl_avr_emu_extended_address_t end;
+  uint32_t                      i;
+
+  if(NULL == watch || 0 == size || !SL_AVR_EMU_DATA_ADDRESS_VALID(start))
+  {
+    return result;
+  }
+  end = (size < (SL_AVR_EMU_DATA_SIZE - start))?(start + size):SL_AVR_EMU_DATA_SIZE;
+
+  for(i = 0; i < watch->range_count; i++)
+  {
+    if(start == watch->ranges[i].start && end == watch->ranges[i].end && access == watch->ranges[i].access)
+    {
+      watch->ranges[i] = watch->ranges[--watch->range_count];
+      result = SL_AVR_EMU_RESULT_SUCCESS;
+      break;
+    }
+  }
+
+  /* Rebuild the union of the remaining ranges */
+  for(i = 0; i < watch->range_count; i++)
+  {
+    if(0 == i || watch->ranges[i].start < watch->range_start)
+    {
+      watch->range_start = watch->ranges[i].start;
+    }
+    if(0 == i || watch->ranges[i].end > watch->range_end)
+    {
+      watch->range_end = watch->ranges[i].end;
+    }
+  }
+  if(0 == watch->range_count)
+  {
+    watch->range_start = 0;
+    watch->range_end   = 0;
+  }
+  watch->triggered = false;
+
+  return result;
+}
+
+/**
+ * @brief Removes all watch ranges, leaving the access counters attached
+ * 
+ * @param emulation
+ */
+void sl_avr_emu_watch_clear(sl_avr_emu_emulation_s *emulation)
+{
+  sl_avr_emu_watch_s *watch = emulation->hooks.watch;
+
+  if(watch != NULL)
+  {
+    watch->range_count = 0;
+    watch->range_start = 0;
+    watch->range_end   = 0;
+    watch->triggered   = false;
+  }
+}
+
+/**
+ * @brief Accounts the stack accesses of pushing or popping bytes at the current stack pointer
+ * 
+ * @param emulation
+ * @param bytes     - Bytes pushed or popped
+ * @param push      - True for pushes, which write, else pops, which read
+ */
+void sl_avr_emu_watch_stack(sl_avr_emu_emulation_s *emulation, uint32_t bytes, bool push)
+{
+  sl_avr_emu_extended_address_t sp = SL_AVR_EMU_GET_SP(emulation);
+  uint32_t                      i;
+
+  /* Walks the stack pointer as the pushes and pops will, stopping where they overflow or underflow */
+  for(i = 0; i < bytes && SL_AVR_EMU_DATA_ADDRESS_VALID(sp); i++)
+  {
+    if(push)
+    {
+      sl_avr_emu_watch_access(emulation, sp, true);
+      if(0 == sp)
+      {
+        break;
+      }
+      sp--;
+    }
+    else
+    {
+      if(sp >= SL_AVR_EMU_DATA_SIZE-1)
+      {
+        break;
+      }
+      sp++;
+      sl_avr_emu_watch_access(emulation, sp, false);
+    }
+  }
+}
+
+/**
+ * @brief Accounts the data accesses the instruction at PC is about to make.  Called before each instruction when
+ *        access counters are attached, so the instruction handlers themselves never test for counters.
+ * 
+ * @param emulation
+ */
+void sl_avr_emu_watch_instruction(sl_avr_emu_emulation_s *emulation)
+{
+  /* Decoded from the instruction a breakpoint replaced, which is what runs when resuming from it */
+  sl_avr_emu_word_t             opcode   = sl_avr_emu_breakpoint_word(emulation, emulation->memory.pc);
+  uint32_t                      pc_bytes = SL_AVR_EMU_EXTENDED_PC_ADDRESS?3:2;
+  sl_avr_emu_extended_address_t address;
+
+  if(SL_AVR_EMU_IS_IN_OUT(opcode))
+  {
+    address = SL_AVR_EMU_IO_TO_DATA_ADDRESS((opcode & 0xF) | ((opcode >> 5) & 0x30));
+    sl_avr_emu_watch_access(emulation, address, SL_AVR_EMU_CHECK_BIT(opcode, 11));
+  }
+  else if(SL_AVR_EMU_IS_SBIC_SBIS(opcode))
+  {
+    sl_avr_emu_watch_access(emulation, SL_AVR_EMU_IO_TO_DATA_ADDRESS((opcode >> 3) & 0x1F), false);
+  }
+  else if(SL_AVR_EMU_IS_PUSH_POP(opcode))
+  {
+    sl_avr_emu_watch_stack(emulation, 1, SL_AVR_EMU_CHECK_BIT(opcode, 9));
+  }
+  else if(SL_AVR_EMU_IS_LD_ST(opcode))
+  {
+    if(!(SL_AVR_EMU_CHECK_BIT(opcode, 0) && SL_AVR_EMU_CHECK_BIT(opcode, 1)))
+    {
+      address = emulation->memory.data[SL_AVR_EMU_XL_ADDRESS] | (emulation->memory.data[SL_AVR_EMU_XH_ADDRESS] << 8);
+      if(SL_AVR_EMU_EXTENDED_DATA_ADDRESS)
+      {
+        address |= emulation->memory.data[SL_AVR_EMU_RAMPX_ADDRESS] << 16;
+      }
+      /* Pre-decrement accesses the decremented address */
+      if(SL_AVR_EMU_CHECK_BIT(opcode, 1))
+      {
+        address--;
+      }
+      sl_avr_emu_watch_access(emulation, address, SL_AVR_EMU_CHECK_BIT(opcode, 9));
+    }
+  }
+  else if(SL_AVR_EMU_IS_LDS_STS(opcode))
+  {
+    if(SL_AVR_EMU_VERSION_AVRRC != emulation->version && SL_AVR_EMU_PC_ADDRESS_VALID(emulation->memory.pc + 1))
+    {
+      address = emulation->memory.flash[emulation->memory.pc + 1];
+      if(SL_AVR_EMU_EXTENDED_DATA_ADDRESS)
+      {
+        address |= (emulation->memory.data[SL_AVR_EMU_RAMPD_ADDRESS] << 16);
+      }
+      sl_avr_emu_watch_access(emulation, address, SL_AVR_EMU_CHECK_BIT(opcode, 9));
+    }
+  }
+  else if(SL_AVR_EMU_IS_JMP_CALL(opcode))
+  {
+    if(SL_AVR_EMU_CHECK_BIT(opcode, 1) && SL_AVR_EMU_VERSION_AVRRC != emulation->version &&
+       SL_AVR_EMU_PC_ADDRESS_VALID(emulation->memory.pc + 1))
+    {
+      sl_avr_emu_watch_stack(emulation, pc_bytes, true);
+    }
+  }
+  else if(SL_AVR_EMU_IS_RJMP_RCALL(opcode))
+  {
+    if(SL_AVR_EMU_CHECK_BIT(opcode, 12))
+    {
+      sl_avr_emu_watch_stack(emulation, pc_bytes, true);
+    }
+  }
+  else if(SL_AVR_EMU_IS_RET(opcode) || SL_AVR_EMU_IS_RETI(opcode))
+  {
+    sl_avr_emu_watch_stack(emulation, pc_bytes, false);
+  }
+}
+
+/**
+ * @brief Runs the callback of a watch hit made by the instruction that just completed.
+ *        Called after each instruction when access counters are attached.
+ * 
+ * @param emulation
+ * @param pc        - Instruction that just completed
+ * @return sl_avr_emu_result_e - SL_AVR_EMU_RESULT_WATCHPOINT for hits on ranges without a callback
+ */
+sl_avr_emu_result_e sl_avr_emu_watch_check(sl_avr_emu_emulation_s *emulation, sl_avr_emu_extended_address_t pc)
+{
+  sl_avr_emu_result_e             result = SL_AVR_EMU_RESULT_SUCCESS;
+  sl_avr_emu_watch_s             *watch  = emulation->hooks.watch;
+  const sl_avr_emu_watch_range_s *range;
+
+  if(watch->triggered)
+  {
+    watch->triggered  = false;
+    watch->trigger_pc = pc;
+    range = &watch->ranges[watch->trigger_range];
+    if(range->callback != NULL)
+    {
+      result = range->callback(emulation, watch->trigger_address, watch->trigger_write, range->context);
+    }
+    else
+    {
+      result = SL_AVR_EMU_RESULT_WATCHPOINT;
+    }
+  }
+
+  return result;
+}
+
+/**
+ * @brief Prints reads and writes of the top_n most accessed data symbols, or fixed size regions without symbols
+ * 
+ * @param output
+ * @param emulation
+ * @param top_n
+ */
+void sl_avr_emu_watch_report(FILE *output, const sl_avr_emu_emulation_s *emulation, uint32_t top_n)
+{
+  const sl_avr_emu_watch_s  *watch = emulation->hooks.watch;
+  sl_avr_emu_watch_entry_s  *entries;
+  sl_avr_emu_watch_entry_s  *entry = NULL;
+  const sl_avr_emu_symbol_s *symbol;
+  uint32_t                   entry_count = 0;
+  uint64_t                   total_reads = 0, total_writes = 0;
+  uint32_t                   address;
+  uint32_t                   i;
+  char                       name[64];
+
+  if(NULL == watch)
+  {
+    return;
+  }
+
+  entries = malloc(SL_AVR_EMU_DATA_SIZE * sizeof(sl_avr_emu_watch_entry_s));
+  if(NULL == entries)
+  {
+    return;
+  }
+
+  /* Addresses are visited in order, so an address joins the previous entry if it shares its symbol or region */
+  for(address = 0; address < SL_AVR_EMU_DATA_SIZE; address++)
+  {
+    if(0 == watch->reads[address] && 0 == watch->writes[address])
+    {
+      continue;
+    }
+    symbol = sl_avr_emu_symbol_lookup(emulation->hooks.symbols, SL_AVR_EMU_ELF_DATA_OFFSET + address, NULL);
+    if(symbol != NULL && 0 == symbol->size)
+    {
+      symbol = NULL;
+    }
+    if(NULL == entry || entry->symbol != symbol ||
+       (NULL == symbol && entry->start != (address & ~(SL_AVR_EMU_WATCH_REGION_SIZE - 1))))
+    {
+      entry         = &entries[entry_count++];
+      entry->symbol = symbol;
+      entry->start  = (symbol != NULL)?(symbol->address - SL_AVR_EMU_ELF_DATA_OFFSET):(address & ~(SL_AVR_EMU_WATCH_REGION_SIZE - 1));
+      entry->end    = (symbol != NULL)?(entry->start + symbol->size):(entry->start + SL_AVR_EMU_WATCH_REGION_SIZE);
+      entry->reads  = 0;
+      entry->writes = 0;
+    }
+    entry->reads  += watch->reads[address];
+    entry->writes += watch->writes[address];
+    total_reads   += watch->reads[address];
+    total_writes  += watch->writes[address];
+  }
+  qsort(entries, entry_count, sizeof(sl_avr_emu_watch_entry_s), sl_avr_emu_watch_compare);
+
+  fprintf(output, "\nData accesses: %lu reads, %lu writes\n", total_reads, total_writes);
+  fprintf(output, "  %-32s %-15s %12s %12s\n", "region", "addresses", "reads", "writes");
+  for(i = 0; i < top_n && i < entry_count; i++)
+  {
+    if(entries[i].symbol != NULL)
+    {
+      snprintf(name, sizeof(name), "%s", entries[i].symbol->name);
+    }
+    else
+    {
+      snprintf(name, sizeof(name), "%s", (entries[i].start < SL_AVR_EMU_IO_ADDRESS_SPACE_OFFSET)?"registers":"-");
+    }
+    fprintf(output, "  %-32s 0x%04x-0x%04x %12lu %12lu\n", name, entries[i].start, entries[i].end - 1, entries[i].reads, entries[i].writes);
+  }
+
+  free(entries);
+}
+
+/**
+ * @brief Detaches and frees emulation's access counters and watch ranges
+ * 
+ * @param emulation
+ */
+void sl_avr_emu_watch_stop(sl_avr_emu_emulation_s *emulation)
+{
+  free(emulation->hooks.watch);
+  emulation->hooks.watch = NULL;
+}
@@ -0,0 +1,289 @@
+/**
+ * @file sl_avr_emu_waveform.c
+ * @author Ed Sandor (ed@ewsandor.com)
+ * @brief Sandor Labs AVR Emulator Compare Output Waveform Logic
+ * @version 0.1
+ * @date 2020-09-20
+ * 
+ * @copyright Copyright (c) 2020
+ * 
+ * The timers report compare output changes as they step through compare matches, TOP and BOTTOM,
+ * so waveforms are recorded without sampling pins.  Outputs are the compare output units' OCnx
+ * signals, whether or not the port drives them onto the pin.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sl_avr_emu_waveform.h"
+
+/* Initial edge buffer, doubled as needed */
+#define SL_AVR_EMU_WAVEFORM_EDGES_INITIAL 4096
+
+const char *const sl_avr_emu_waveform_pin_names[SL_AVR_EMU_WAVEFORM_PIN_COUNT] =
+{
+  "OC0A", "OC0B", "OC1A", "OC1B", "OC2A", "OC2B",
+};
+
+/* Port pins of the compare outputs on the ATmega328P */
+static const char *const sl_avr_emu_waveform_port_pins[SL_AVR_EMU_WAVEFORM_PIN_COUNT] =
+{
+  "PD6", "PD5", "PB1", "PB2", "PB3", "PD3",
+};
+
+/**
+ * @brief Attaches a new waveform recorder to emulation, starting from the current compare output levels
+ * 
+ * @param emulation
+ * @return sl_avr_emu_result_e
+ */
+sl_avr_emu_result_e sl_avr_emu_waveform_start(sl_avr_emu_emulation_s *emulation)
+{
+  const sl_avr_emu_timer_s *timers[] = {&emulation->timer0, &emulation->timer1, &emulation->timer2};
+  sl_avr_emu_waveform_s    *waveform;
+  uint32_t                  i;
+
+  waveform = calloc(1, sizeof(sl_avr_emu_waveform_s));
+  if(waveform != NULL)
+  {
+    waveform->edge_capacity = SL_AVR_EMU_WAVEFORM_EDGES_INITIAL;
+    waveform->edges         = malloc(waveform->edge_capacity * sizeof(sl_avr_emu_waveform_edge_s));
+  }
+  if(NULL == waveform || NULL == waveform->edges)
+  {
+    free(waveform);
+    return SL_AVR_EMU_RESULT_FAILURE;
+  }
+
+  waveform->start_tick = emulation->tick_count;
+  for(i = 0; i < SL_AVR_EMU_WAVEFORM_PIN_COUNT; i++)
+  {
+    waveform->initial[i] = (timers[i/2]->oc >> (i%2)) & 0x1;
+  }
+  emulation->hooks.waveform = waveform;
+
+  return SL_AVR_EMU_RESULT_SUCCESS;
+}
+
+/**
+ * @brief Records a compare output level change.  Called by the timers.
+ * 
+ * @param emulation
+ * @param tick      - Tick of the timer clock edge that changed the output
+ * @param pin
+ * @param level
+ */
+void sl_avr_emu_waveform_edge(sl_avr_emu_emulation_s *emulation, sl_avr_emu_tick_count_t tick, uint8_t pin, bool level)
+{
+  sl_avr_emu_waveform_s      *waveform = emulation->hooks.waveform;
+  sl_avr_emu_waveform_edge_s *edges;
+
+  if(waveform->edge_count == waveform->edge_capacity)
+  {
+    edges = realloc(waveform->edges, 2 * waveform->edge_capacity * sizeof(sl_avr_emu_waveform_edge_s));
+    if(NULL == edges)
+    {
+      waveform->dropped++;
+      return;
+    }
+    waveform->edges          = edges;
+    waveform->edge_capacity *= 2;
+  }
+
+  waveform->edges[waveform->edge_count].tick  = tick;
+  waveform->edges[waveform->edge_count].pin   = pin;
+  waveform->edges[waveform->edge_count].level = level;
+  waveform->edge_count++;
+}
+
+/**
+ * @brief Computes period, duty cycle and jitter of a compare output from its recorded edges
+ * 
+ * @param emulation
+ * @param pin
+ * @param analysis
+ */
+void sl_avr_emu_waveform_analyze(const sl_avr_emu_emulation_s *emulation, uint8_t pin, sl_avr_emu_waveform_analysis_s *analysis)
+{
+  const sl_avr_emu_waveform_s      *waveform    = emulation->hooks.waveform;
+  const sl_avr_emu_waveform_edge_s *edge;
+  bool                              rose        = false;
+  bool                              fell        = false;
+  sl_avr_emu_tick_count_t           rise_tick   = 0;
+  sl_avr_emu_tick_count_t           fall_tick   = 0;
+  uint64_t                          period;
+  double                            duty;
+  double                            sum         = 0;
+  double                            sum_squares = 0;
+  double                            duty_sum    = 0;
+  uint64_t                          i;
+
+  memset(analysis, 0, sizeof(sl_avr_emu_waveform_analysis_s));
+  analysis->period_min = UINT64_MAX;
+  analysis->duty_min   = 1.0;
+
+  if(NULL == waveform)
+  {
+    return;
+  }
+
+  for(i = 0; i < waveform->edge_count; i++)
+  {
+    edge = &waveform->edges[i];
+    if(edge->pin != pin)
+    {
+      continue;
+    }
+    analysis->edges++;
+
+    if(!edge->level)
+    {
+      fall_tick = edge->tick;
+      fell      = rose;
+      continue;
+    }
+
+    if(rose)
+    {
+      period = edge->tick - rise_tick;
+      /* Only dropped edges leave a period without a falling edge */
+      duty   = (fell && period > 0)?((double)(fall_tick - rise_tick) / period):1.0;
+
+      analysis->periods++;
+      sum         += period;
+      sum_squares += (double)period * period;
+      duty_sum    += duty;
+      analysis->period_min = (period < analysis->period_min)?period:analysis->period_min;
+      analysis->period_max = (period > analysis->period_max)?period:analysis->period_max;
+      analysis->duty_min   = (duty < analysis->duty_min)?duty:analysis->duty_min;
+      analysis->duty_max   = (duty > analysis->duty_max)?duty:analysis->duty_max;
+    }
+    rose      = true;
+    fell      = false;
+    rise_tick = edge->tick;
+  }
+
+  if(analysis->periods > 0)
+  {
+    analysis->period_mean   = sum / analysis->periods;
+    analysis->period_stddev = sqrt(fmax(0, sum_squares / analysis->periods - analysis->period_mean * analysis->period_mean));
+    analysis->frequency_hz  = (analysis->period_mean > 0)?(emulation->clock_hz / analysis->period_mean):0;
+    analysis->duty_mean     = duty_sum / analysis->periods;
+  }
+  else
+  {
+    analysis->period_min = 0;
+    analysis->duty_min   = 0;
+  }
+}
+
+/**
+ * @brief Prints the analysis of each compare output that changed
+ * 
+ * @param output
+ * @param emulation
+ */
+void sl_avr_emu_waveform_report(FILE *output, const sl_avr_emu_emulation_s *emulation)
+{
+  const sl_avr_emu_waveform_s    *waveform = emulation->hooks.waveform;
+  sl_avr_emu_waveform_analysis_s  analysis;
+  uint8_t                         pin;
+
+  if(NULL == waveform)
+  {
+    return;
+  }
+
+  fprintf(output, "\nCompare output waveforms (%lu edges", waveform->edge_count);
+  if(waveform->dropped > 0)
+  {
+    fprintf(output, ", %lu dropped", waveform->dropped);
+  }
+  fprintf(output, "):\n");
+  for(pin = 0; pin < SL_AVR_EMU_WAVEFORM_PIN_COUNT; pin++)
+  {
+    sl_avr_emu_waveform_analyze(emulation, pin, &analysis);
+    if(0 == analysis.edges)
+    {
+      continue;
+    }
+    fprintf(output, "  %s (%s): %lu edges, %lu periods\n", sl_avr_emu_waveform_pin_names[pin], sl_avr_emu_waveform_port_pins[pin],
+            analysis.edges, analysis.periods);
+    if(analysis.periods > 0)
+    {
+      fprintf(output, "    frequency %.3f Hz, period %.1f ticks (min %lu, max %lu, jitter %lu p-p, %.2f rms)\n",
+              analysis.frequency_hz, analysis.period_mean, analysis.period_min, analysis.period_max,
+              analysis.period_max - analysis.period_min, analysis.period_stddev);
+      fprintf(output, "    duty %.3f%% (min %.3f%%, max %.3f%%)\n",
+              100 * analysis.duty_mean, 100 * analysis.duty_min, 100 * analysis.duty_max);
+    }
+  }
+}
+
+/**
+ * @brief Writes the recorded edges as a Value Change Dump, in picoseconds at the emulation clock
+ * 
+ * @param output
+ * @param emulation
+ * @return sl_avr_emu_result_e
+ */
+sl_avr_emu_result_e sl_avr_emu_waveform_write_vcd(FILE *output, const sl_avr_emu_emulation_s *emulation)
+{
+  const sl_avr_emu_waveform_s *waveform = emulation->hooks.waveform;
+  /* Rounded for clocks that are not a whole number of picoseconds */
+  uint64_t                     tick_ps;
+  sl_avr_emu_tick_count_t      last_tick;
+  uint64_t                     i;
+  uint8_t                      pin;
+
+  if(NULL == waveform || 0 == emulation->clock_hz)
+  {
+    return SL_AVR_EMU_RESULT_FAILURE;
+  }
+  tick_ps = (1000000000000ULL + emulation->clock_hz/2) / emulation->clock_hz;
+
+  fprintf(output, "$comment sl_avr_emu compare outputs, %u Hz clock $end\n", emulation->clock_hz);
+  fprintf(output, "$timescale 1 ps $end\n");
+  fprintf(output, "$scope module avr $end\n");
+  for(pin = 0; pin < SL_AVR_EMU_WAVEFORM_PIN_COUNT; pin++)
+  {
+    fprintf(output, "$var wire 1 %c %s $end\n", '!' + pin, sl_avr_emu_waveform_pin_names[pin]);
+  }
+  fprintf(output, "$upscope $end\n$enddefinitions $end\n");
+
+  fprintf(output, "#%lu\n$dumpvars\n", waveform->start_tick * tick_ps);
+  for(pin = 0; pin < SL_AVR_EMU_WAVEFORM_PIN_COUNT; pin++)
+  {
+    fprintf(output, "%u%c\n", waveform->initial[pin], '!' + pin);
+  }
+  fprintf(output, "$end\n");
+
+  last_tick = waveform->start_tick;
+  for(i = 0; i < waveform->edge_count; i++)
+  {
+    if(waveform->edges[i].tick != last_tick)
+    {
+      last_tick = waveform->edges[i].tick;
+      fprintf(output, "#%lu\n", last_tick * tick_ps);
+    }
+    fprintf(output, "%u%c\n", waveform->edges[i].level, '!' + waveform->edges[i].pin);
+  }
+
+  return ferror(output)?SL_AVR_EMU_RESULT_FAILURE:SL_AVR_EMU_RESULT_SUCCESS;
+}
+
+/**
+ * @brief Detaches and frees emulation's waveform recorder
+ * 
+ * @param emulation
+ */
+void sl_avr_emu_waveform_stop(sl_avr_emu_emulation_s *emulation)
+{
+  if(emulation->hooks.waveform != NULL)
+  {
+    free(emulation->hooks.waveform->edges);
+    free(emulation->hooks.waveform);
+    emulation->hooks.waveform = NULL;
+  }
+}